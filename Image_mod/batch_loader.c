@@ -0,0 +1,483 @@
+// batch_loader.c
+#include "batch_loader.h"
+#include "utils.h"
+#include "instrument.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef IMAGE_MOD_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+
+#define BATCH_HEADER_SIZE 54
+#define BATCH_COLOR_TABLE_SIZE 1024
+
+// Stdio fallback: the regular loaders, one file after the other.
+static int bmp8_loadBatchStdio(const char **filenames, int count, t_bmp8 **images) {
+    int loaded = 0;
+    for (int i = 0; i < count; ++i) {
+        images[i] = bmp8_loadImage(filenames[i]);
+        if (images[i]) loaded++;
+    }
+    return loaded;
+}
+
+static int bmp24_loadBatchStdio(const char **filenames, int count, t_bmp24 **images) {
+    int loaded = 0;
+    for (int i = 0; i < count; ++i) {
+        images[i] = bmp24_loadImage(filenames[i]);
+        if (images[i]) loaded++;
+    }
+    return loaded;
+}
+
+
+#ifdef IMAGE_MOD_HAVE_IO_URING
+
+#define URING_ENTRIES 256
+#define URING_FILES_PER_GROUP 64
+#define URING_MAX_READ (1u << 30)
+
+// Minimal io_uring wrapper on top of the raw syscalls (no liburing dependency).
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned toSubmit;
+    int broken;                // submitted reads could not be waited for: their buffers must never be freed
+} t_uring;
+
+// One outstanding read: where it goes, how much is left and from which offset.
+typedef struct {
+    int file;
+    unsigned char *buffer;
+    size_t remaining;
+    off_t offset;
+} t_uring_read;
+
+enum { FILE_PENDING = 0, FILE_FAILED, FILE_READ_ERROR, FILE_FALLBACK };
+
+typedef struct {
+    int fd;
+    int state;
+    unsigned char header[BATCH_HEADER_SIZE + BATCH_COLOR_TABLE_SIZE];
+} t_uring_file;
+
+
+// io_uring is used unless IMAGE_MOD_IO_URING=0, which forces stdio (to compare the two backends).
+static int uring_allowed(void) {
+    const char *env = getenv("IMAGE_MOD_IO_URING");
+    return !env || strcmp(env, "0") != 0;
+}
+
+static int uring_init(t_uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -1;
+    ring->entries = params.sq_entries;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            munmap(ring->sqRing, ring->sqRingSize);
+            close(ring->fd);
+            return -1;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+        munmap(ring->sqRing, ring->sqRingSize);
+        close(ring->fd);
+        return -1;
+    }
+
+    unsigned char *sq = (unsigned char *)ring->sqRing;
+    unsigned char *cq = (unsigned char *)ring->cqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void uring_destroy(t_uring *ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+}
+
+// Queues one IORING_OP_READ; the caller never queues more than ring->entries reads at a time.
+static void uring_queueRead(t_uring *ring, int fd, void *buffer, unsigned len, off_t offset, unsigned long long userData) {
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)buffer;
+    sqe->len = len;
+    sqe->off = (unsigned long long)offset;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->toSubmit++;
+}
+
+// Submits the queued reads and waits for at least one completion.
+static int uring_submitAndWait(t_uring *ring) {
+    int ret;
+    trace_beginIndexed("io", "io_uring_enter", ring->toSubmit);
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    trace_end("io", "io_uring_enter");
+    if (ret < 0) return -1;
+    ring->toSubmit -= (unsigned)ret;
+    return 0;
+}
+
+// Waits for the completions of the reads already submitted after io_uring_enter failed, so that their buffers can
+// be freed; the reads queued but never submitted die with the ring. If the ring cannot be waited on either, it is
+// marked broken.
+static void uring_drain(t_uring *ring, unsigned inFlight) {
+    unsigned submitted = inFlight - ring->toSubmit;
+    while (submitted > 0) {
+        int ret;
+        do {
+            ret = (int)syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            ring->broken = 1;
+            return;
+        }
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        submitted -= tail - head < submitted ? tail - head : submitted;
+        __atomic_store_n(ring->cqHead, tail, __ATOMIC_RELEASE);
+    }
+}
+
+// Runs a list of reads to completion, resubmitting short reads. A file whose read fails is flagged;
+// -EINVAL/-EOPNOTSUPP means the kernel lacks IORING_OP_READ, so that file falls back to stdio.
+// Errors already reported while opening/validating use FILE_FAILED; read errors use FILE_READ_ERROR.
+// Returns -1 if the ring fails: no read is in flight then, unless the ring is marked broken.
+static int uring_runReads(t_uring *ring, t_uring_read *reads, int readCount, t_uring_file *files) {
+    int *retry = (int *)malloc((readCount > 0 ? readCount : 1) * sizeof(int));
+    if (!retry) return -1;
+    int retryCount = 0;
+    int next = 0;
+    unsigned inFlight = 0;
+
+    while (next < readCount || retryCount > 0 || inFlight > 0) {
+        while (inFlight < ring->entries && (retryCount > 0 || next < readCount)) {
+            int r = retryCount > 0 ? retry[--retryCount] : next++;
+            t_uring_read *rd = &reads[r];
+            if (files[rd->file].state != FILE_PENDING) continue;
+            unsigned len = rd->remaining > URING_MAX_READ ? URING_MAX_READ : (unsigned)rd->remaining;
+            uring_queueRead(ring, files[rd->file].fd, rd->buffer, len, rd->offset, (unsigned long long)r);
+            inFlight++;
+        }
+        if (inFlight == 0) break;
+        if (uring_submitAndWait(ring) != 0) {
+            uring_drain(ring, inFlight);
+            free(retry);
+            return -1;
+        }
+
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+            t_uring_read *rd = &reads[cqe->user_data];
+            t_uring_file *file = &files[rd->file];
+            if (cqe->res < 0) {
+                if (file->state == FILE_PENDING) {
+                    file->state = (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) ? FILE_FALLBACK : FILE_READ_ERROR;
+                }
+            } else if (cqe->res == 0 && rd->remaining > 0) {
+                file->state = FILE_READ_ERROR; // unexpected EOF
+            } else {
+                rd->buffer += cqe->res;
+                rd->remaining -= (size_t)cqe->res;
+                rd->offset += cqe->res;
+                if (rd->remaining > 0) retry[retryCount++] = (int)cqe->user_data;
+            }
+            head++;
+            inFlight--;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    free(retry);
+    return 0;
+}
+
+// Opens a group of files and reads all their headers in one submission burst. Every files[i].fd is valid or -1 on
+// return, so the caller can always close them.
+static int uring_readHeaders(t_uring *ring, const char **filenames, int count, t_uring_file *files, size_t headerBytes) {
+    for (int i = 0; i < count; ++i) {
+        files[i].state = FILE_PENDING;
+        files[i].fd = -1;
+    }
+    t_uring_read *reads = (t_uring_read *)malloc(count * sizeof(t_uring_read));
+    if (!reads) return -1;
+    int readCount = 0;
+    for (int i = 0; i < count; ++i) {
+        files[i].fd = open(filenames[i], O_RDONLY);
+        if (files[i].fd < 0) {
+            instr_error("Error: Cannot open file %s\n", filenames[i]);
+            files[i].state = FILE_FAILED;
+            continue;
+        }
+        reads[readCount].file = i;
+        reads[readCount].buffer = files[i].header;
+        reads[readCount].remaining = headerBytes;
+        reads[readCount].offset = 0;
+        readCount++;
+    }
+    int ret = uring_runReads(ring, reads, readCount, files);
+    free(reads);
+    return ret;
+}
+
+static void uring_closeFiles(t_uring_file *files, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (files[i].fd >= 0) close(files[i].fd);
+        files[i].fd = -1;
+    }
+}
+
+static int bmp8_loadGroupUring(t_uring *ring, const char **filenames, int count, t_bmp8 **images, t_uring_file *files) {
+    for (int i = 0; i < count; ++i) images[i] = NULL;
+    if (uring_readHeaders(ring, filenames, count, files, BATCH_HEADER_SIZE + BATCH_COLOR_TABLE_SIZE) != 0) return -1;
+
+    t_uring_read *reads = (t_uring_read *)malloc(count * sizeof(t_uring_read));
+    if (!reads) return -1;
+    int readCount = 0;
+    for (int i = 0; i < count; ++i) {
+        if (files[i].state != FILE_PENDING) continue;
+        t_bmp8 *img = (t_bmp8 *)malloc(sizeof(t_bmp8));
+        if (!img) {
+            instr_error("Error: Cannot allocate memory for image structure.\n");
+            files[i].state = FILE_FAILED;
+            continue;
+        }
+        img->data = NULL;
+        memcpy(img->header, files[i].header, BATCH_HEADER_SIZE);
+        memcpy(img->colorTable, files[i].header + BATCH_HEADER_SIZE, BATCH_COLOR_TABLE_SIZE);
+        unsigned int dataOffset = 0;
+        if (bmp8_parseHeader(img, filenames[i], &dataOffset) != 0) {
+            bmp8_free(img);
+            files[i].state = FILE_FAILED;
+            continue;
+        }
+        img->data = (unsigned char *)malloc(img->dataSize);
+        if (!img->data) {
+            instr_error("Error: Cannot allocate memory for pixel data (%zu bytes).\n", img->dataSize);
+            bmp8_free(img);
+            files[i].state = FILE_FAILED;
+            continue;
+        }
+        images[i] = img;
+        reads[readCount].file = i;
+        reads[readCount].buffer = img->data;
+        reads[readCount].remaining = img->dataSize;
+        reads[readCount].offset = dataOffset;
+        readCount++;
+    }
+    int ret = uring_runReads(ring, reads, readCount, files);
+    free(reads);
+    return ret;
+}
+
+static int bmp24_loadGroupUring(t_uring *ring, const char **filenames, int count, t_bmp24 **images, t_uring_file *files) {
+    for (int i = 0; i < count; ++i) images[i] = NULL;
+    if (uring_readHeaders(ring, filenames, count, files, BATCH_HEADER_SIZE) != 0) return -1;
+
+    // One read per row: rows land directly in img->data, the file padding is never read.
+    int capacity = 0;
+    for (int i = 0; i < count; ++i) {
+        if (files[i].state != FILE_PENDING) continue;
+        t_bmp_header header;
+        t_bmp_info info;
+        memcpy(&header, files[i].header, sizeof(t_bmp_header));
+        memcpy(&info, files[i].header + sizeof(t_bmp_header), sizeof(t_bmp_info));
+        if (bmp24_checkHeader(&header, &info, filenames[i]) != 0) {
+            files[i].state = FILE_FAILED;
+            continue;
+        }
+        t_bmp24 *img = bmp24_allocate(info.width, info.height, info.bits);
+        if (!img) {
+            files[i].state = FILE_FAILED;
+            continue;
+        }
+        img->header = header;
+        img->header_info = info;
+        img->width = info.width;
+        img->height = info.height;
+        img->colorDepth = info.bits;
+        images[i] = img;
+        capacity += img->height;
+    }
+
+    t_uring_read *reads = (t_uring_read *)malloc((capacity > 0 ? capacity : 1) * sizeof(t_uring_read));
+    if (!reads) return -1;
+    int readCount = 0;
+    for (int i = 0; i < count; ++i) {
+        t_bmp24 *img = images[i];
+        if (!img) continue;
+        size_t row_stride = calculate_row_stride(img->width);
+        for (int y = 0; y < img->height; ++y) {
+            reads[readCount].file = i;
+            reads[readCount].buffer = (unsigned char *)img->data[y];
+            reads[readCount].remaining = (size_t)img->width * 3;
+            reads[readCount].offset = (off_t)img->header.offset + (off_t)(img->height - 1 - y) * row_stride;
+            readCount++;
+        }
+    }
+    int ret = uring_runReads(ring, reads, readCount, files);
+    free(reads);
+    return ret;
+}
+
+#endif // IMAGE_MOD_HAVE_IO_URING
+
+
+int bmp8_loadBatch(const char **filenames, int count, t_bmp8 **images) {
+    if (!filenames || !images || count <= 0) return 0;
+#ifdef IMAGE_MOD_HAVE_IO_URING
+    t_uring ring;
+    t_uring_file *files = NULL;
+    if (uring_allowed()) files = (t_uring_file *)malloc(URING_FILES_PER_GROUP * sizeof(t_uring_file));
+    if (files && uring_init(&ring, URING_ENTRIES) == 0) {
+        int loaded = 0, start = 0;
+        for (; start < count; start += URING_FILES_PER_GROUP) {
+            int n = count - start < URING_FILES_PER_GROUP ? count - start : URING_FILES_PER_GROUP;
+            int ret = bmp8_loadGroupUring(&ring, filenames + start, n, images + start, files);
+            uring_closeFiles(files, n);
+            if (ret != 0) {
+                // The ring failed: this group and the next ones go through stdio. A broken ring may still write
+                // into the group's images, which are then abandoned rather than freed.
+                for (int i = 0; i < n; ++i) {
+                    if (!ring.broken) bmp8_free(images[start + i]);
+                    images[start + i] = NULL;
+                }
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                int state = files[i].state;
+                if (state != FILE_PENDING) {
+                    bmp8_free(images[start + i]);
+                    images[start + i] = state == FILE_FALLBACK ? bmp8_loadImage(filenames[start + i]) : NULL;
+                    if (state == FILE_READ_ERROR) instr_error("Error: Failed to read %s.\n", filenames[start + i]);
+                } else {
+                    instr_info("Image '%s' loaded successfully (%ux%u, %u-bit).\n", filenames[start + i],
+                           images[start + i]->width, images[start + i]->height, images[start + i]->colorDepth);
+                }
+                if (images[start + i]) loaded++;
+            }
+        }
+        uring_destroy(&ring);
+        free(files);
+        if (start < count) loaded += bmp8_loadBatchStdio(filenames + start, count - start, images + start);
+        return loaded;
+    }
+    free(files);
+#endif
+    return bmp8_loadBatchStdio(filenames, count, images);
+}
+
+int bmp24_loadBatch(const char **filenames, int count, t_bmp24 **images) {
+    if (!filenames || !images || count <= 0) return 0;
+#ifdef IMAGE_MOD_HAVE_IO_URING
+    t_uring ring;
+    t_uring_file *files = NULL;
+    if (uring_allowed()) files = (t_uring_file *)malloc(URING_FILES_PER_GROUP * sizeof(t_uring_file));
+    if (files && uring_init(&ring, URING_ENTRIES) == 0) {
+        int loaded = 0, start = 0;
+        for (; start < count; start += URING_FILES_PER_GROUP) {
+            int n = count - start < URING_FILES_PER_GROUP ? count - start : URING_FILES_PER_GROUP;
+            int ret = bmp24_loadGroupUring(&ring, filenames + start, n, images + start, files);
+            uring_closeFiles(files, n);
+            if (ret != 0) {
+                // The ring failed: this group and the next ones go through stdio. A broken ring may still write
+                // into the group's images, which are then abandoned rather than freed.
+                for (int i = 0; i < n; ++i) {
+                    if (!ring.broken) bmp24_free(images[start + i]);
+                    images[start + i] = NULL;
+                }
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                int state = files[i].state;
+                if (state != FILE_PENDING) {
+                    bmp24_free(images[start + i]);
+                    images[start + i] = state == FILE_FALLBACK ? bmp24_loadImage(filenames[start + i]) : NULL;
+                    if (state == FILE_READ_ERROR) instr_error("Error: Failed to read %s.\n", filenames[start + i]);
+                } else {
+                    instr_info("Image '%s' loaded successfully (%dx%d, %d-bit).\n", filenames[start + i],
+                           images[start + i]->width, images[start + i]->height, images[start + i]->colorDepth);
+                }
+                if (images[start + i]) loaded++;
+            }
+        }
+        uring_destroy(&ring);
+        free(files);
+        if (start < count) loaded += bmp24_loadBatchStdio(filenames + start, count - start, images + start);
+        return loaded;
+    }
+    free(files);
+#endif
+    return bmp24_loadBatchStdio(filenames, count, images);
+}
+
+const char *batch_loader_backend(void) {
+#ifdef IMAGE_MOD_HAVE_IO_URING
+    t_uring ring;
+    if (uring_allowed() && uring_init(&ring, 1) == 0) {
+        uring_destroy(&ring);
+        return "io_uring";
+    }
+#endif
+    return "stdio";
+}
@@ -0,0 +1,18 @@
+#ifndef BATCH_LOADER_H
+#define BATCH_LOADER_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Function bmp8_loadBatch is needed to load many 8-bit BMP files at once.
+// images[i] receives the image for filenames[i], or NULL if it could not be loaded. Returns how many were loaded.
+int bmp8_loadBatch(const char **filenames, int count, t_bmp8 **images);
+
+// Function bmp24_loadBatch is needed to load many 24-bit BMP files at once (same contract as bmp8_loadBatch).
+int bmp24_loadBatch(const char **filenames, int count, t_bmp24 **images);
+
+// Function batch_loader_backend names the backend the batch loaders will use on this machine ("io_uring" or "stdio").
+// IMAGE_MOD_IO_URING=0 in the environment forces stdio.
+const char *batch_loader_backend(void);
+
+#endif // BATCH_LOADER_H
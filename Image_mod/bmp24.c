@@ -2,6 +2,14 @@
 #include "bmp24.h"
 #include "bmp8.h"
 #include "utils.h"
+#include "instrument.h"
+#include "trace.h"
+#include "cpu_dispatch.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,31 +35,47 @@
 t_pixel **bmp24_allocateDataPixels(int width, int height) {
     if (width <= 0 || height <= 0) return NULL;
 
-    t_pixel **pixels = (t_pixel **)malloc(height * sizeof(t_pixel *));
+    size_t numPixels;
+    if (checked_mul_size((size_t)width, (size_t)height, &numPixels) != 0 || numPixels > SIZE_MAX / sizeof(t_pixel)) {
+        instr_error("Error: Image dimensions %dx%d are too large.\n", width, height);
+        return NULL;
+    }
+
+    t_pixel **pixels = (t_pixel **)malloc((size_t)height * sizeof(t_pixel *));
     if (!pixels) {
-        printf("Error: Failed to allocate memory for pixel rows.\n");
+        instr_error("Error: Failed to allocate memory for pixel rows.\n");
         return NULL;
     }
-    pixels[0] = (t_pixel *)calloc(height * width, sizeof(t_pixel));
+    pixels[0] = (t_pixel *)calloc(numPixels, sizeof(t_pixel));
     if (!pixels[0]) {
-        printf("Error: Failed to allocate memory for pixel data block.\n");
+        instr_error("Error: Failed to allocate memory for pixel data block.\n");
         free(pixels);
         return NULL;
     }
     for (int i = 1; i < height; ++i) {
-        pixels[i] = pixels[0] + i * width;
+        pixels[i] = pixels[0] + (size_t)i * width;
     }
     return pixels;
 }
 
 // [Part 2.3 Implementation] Free 2D pixel array (allocated contiguously)
+// The block starts at the lowest row pointer, which is not pixels[0] once the rows are reordered (bmp24_flipVertical).
 void bmp24_freeDataPixels(t_pixel **pixels, int height) {
     if (!pixels) return;
-    if (pixels[0]) {
-        free(pixels[0]);
+    t_pixel *block = pixels[0];
+    for (int i = 1; i < height; ++i) {
+        if (pixels[i] < block) block = pixels[i];
     }
+    free(block);
     free(pixels);
-    (void)height;
+}
+
+// Fills the 32-bit image/file size fields. Images whose data does not fit in 4 GB store 0, which BMP allows for uncompressed data.
+static void bmp24_setSizeFields(t_bmp24 *img) {
+    uint64_t imageSize = (uint64_t)calculate_row_stride(img->width) * (uint64_t)img->height;
+    uint64_t fileSize = (uint64_t)img->header.offset + imageSize;
+    img->header_info.imagesize = imageSize <= UINT32_MAX ? (uint32_t)imageSize : 0;
+    img->header.size = fileSize <= UINT32_MAX ? (uint32_t)fileSize : 0;
 }
 
 // [Part 2.3 Implementation] Allocate t_bmp24 structure and its data
@@ -60,7 +84,7 @@ t_bmp24 *bmp24_allocate(int width, int height, int colorDepth) {
 
     t_bmp24 *img = (t_bmp24 *)malloc(sizeof(t_bmp24));
     if (!img) {
-        printf("Error: Failed to allocate memory for t_bmp24 structure.\n");
+        instr_error("Error: Failed to allocate memory for t_bmp24 structure.\n");
         return NULL;
     }
 
@@ -84,9 +108,7 @@ t_bmp24 *bmp24_allocate(int width, int height, int colorDepth) {
     img->header_info.planes = 1;
     img->header_info.bits = colorDepth; // Usually 24
     img->header_info.compression = NO_COMPRESSION;
-    int row_stride = calculate_row_stride(width);
-    img->header_info.imagesize = row_stride * height;
-    img->header.size = img->header.offset + img->header_info.imagesize;
+    bmp24_setSizeFields(img);
 
     return img;
 }
@@ -100,11 +122,35 @@ void bmp24_free(t_bmp24 *img) {
     }
 }
 
-// [Part 2.4.3 Implementation] Load 24-bit BMP
-t_bmp24 *bmp24_loadImage(const char *filename) {
+// Validates the file and info headers of a 24-bit BMP; a top-down height is turned positive. Returns 0 if usable.
+int bmp24_checkHeader(t_bmp_header *header, t_bmp_info *info, const char *filename) {
+    if (!header || !info) return -1;
+    if (header->type != BITMAP_MAGIC) {
+        instr_error("Error: File %s is not a BMP file (Magic number 0x%X).\n", filename, header->type);
+        return -1;
+    }
+    if (info->size != BMP_INFOHEADER_SIZE) {
+         instr_warning("Warning: BMP info header size is %u, expected %d. May be an unsupported BMP variant.\n", info->size, BMP_INFOHEADER_SIZE);
+    }
+    if (info->bits != 24) {
+        instr_error("Error: File %s is not a 24-bit BMP (Bits=%u).\n", filename, info->bits);
+        return -1;
+    }
+     if (info->compression != NO_COMPRESSION) {
+        instr_error("Error: Compression is not supported (Compression=%u).\n", info->compression);
+        return -1;
+    }
+    if (info->height < 0) {
+         instr_warning("Warning: Image height is negative (top-down BMP). Handling as positive.\n");
+         info->height = -info->height;
+    }
+    return 0;
+}
+
+static t_bmp24 *bmp24_loadImageFile(const char *filename) {
     FILE *file = fopen(filename, "rb");
     if (!file) {
-        printf("Error: Cannot open file %s\n", filename);
+        instr_error("Error: Cannot open file %s\n", filename);
         return NULL;
     }
 
@@ -112,38 +158,19 @@ t_bmp24 *bmp24_loadImage(const char *filename) {
     t_bmp_info info;
 
     if (fread(&header, sizeof(t_bmp_header), 1, file) != 1) {
-         printf("Error: Failed to read BMP header from %s.\n", filename);
+         instr_error("Error: Failed to read BMP header from %s.\n", filename);
          fclose(file); return NULL;
     }
     if (fread(&info, sizeof(t_bmp_info), 1, file) != 1) {
-        printf("Error: Failed to read BMP info header from %s.\n", filename);
+        instr_error("Error: Failed to read BMP info header from %s.\n", filename);
          fclose(file); return NULL;
     }
 
 
-    if (header.type != BITMAP_MAGIC) {
-        printf("Error: File %s is not a BMP file (Magic number 0x%X).\n", filename, header.type);
+    if (bmp24_checkHeader(&header, &info, filename) != 0) {
         fclose(file);
         return NULL;
     }
-    if (info.size != BMP_INFOHEADER_SIZE) {
-         printf("Warning: BMP info header size is %u, expected %d. May be an unsupported BMP variant.\n", info.size, BMP_INFOHEADER_SIZE);
-    }
-    if (info.bits != 24) {
-        printf("Error: File %s is not a 24-bit BMP (Bits=%u).\n", filename, info.bits);
-        fclose(file);
-        return NULL;
-    }
-     if (info.compression != NO_COMPRESSION) {
-        printf("Error: Compression is not supported (Compression=%u).\n", info.compression);
-        fclose(file);
-        return NULL;
-    }
-    if (info.height < 0) {
-         printf("Warning: Image height is negative (top-down BMP). Handling as positive.\n");
-         info.height = -info.height;
-    }
-
 
     t_bmp24 *img = bmp24_allocate(info.width, info.height, info.bits);
     if (!img) {
@@ -159,14 +186,24 @@ t_bmp24 *bmp24_loadImage(const char *filename) {
 
 
     if (bmp24_readPixelData(img, file) != 0) {
-        printf("Error: Failed to read pixel data from %s.\n", filename);
+        instr_error("Error: Failed to read pixel data from %s.\n", filename);
         fclose(file);
         bmp24_free(img);
         return NULL;
     }
 
     fclose(file);
-    printf("Image '%s' loaded successfully (%dx%d, %d-bit).\n", filename, img->width, img->height, img->colorDepth);
+    instr_info("Image '%s' loaded successfully (%dx%d, %d-bit).\n", filename, img->width, img->height, img->colorDepth);
+    return img;
+}
+
+// [Part 2.4.3 Implementation] Load 24-bit BMP
+t_bmp24 *bmp24_loadImage(const char *filename) {
+    t_instr_span span;
+    instr_begin(&span, "bmp24_loadImage");
+    t_bmp24 *img = bmp24_loadImageFile(filename);
+    uint64_t pixels = img ? (uint64_t)img->width * (uint64_t)img->height : 0;
+    instr_end(&span, pixels, img ? (uint64_t)img->header.offset + (uint64_t)calculate_row_stride(img->width) * img->height : 0);
     return img;
 }
 
@@ -174,15 +211,17 @@ t_bmp24 *bmp24_loadImage(const char *filename) {
 // [Part 2.4.4 Implementation] Save 24-bit BMP
 void bmp24_saveImage(const char *filename, t_bmp24 *img) {
     if (!img || !img->data) {
-        printf("Error: Cannot save NULL or invalid image data.\n");
+        instr_error("Error: Cannot save NULL or invalid image data.\n");
         return;
     }
 
     FILE *file = fopen(filename, "wb");
     if (!file) {
-        printf("Error: Cannot open file %s for writing.\n", filename);
+        instr_error("Error: Cannot open file %s for writing.\n", filename);
         return;
     }
+    t_instr_span span;
+    instr_begin(&span, "bmp24_saveImage");
 
     img->header.type = BITMAP_MAGIC;
     img->header.offset = DEFAULT_OFFSET;
@@ -192,9 +231,7 @@ void bmp24_saveImage(const char *filename, t_bmp24 *img) {
     img->header_info.planes = 1;
     img->header_info.bits = 24;
     img->header_info.compression = NO_COMPRESSION;
-    int row_stride = calculate_row_stride(img->width);
-    img->header_info.imagesize = row_stride * img->height;
-    img->header.size = img->header.offset + img->header_info.imagesize;
+    bmp24_setSizeFields(img);
 
     img->header.reserved1 = 0;
     img->header.reserved2 = 0;
@@ -205,22 +242,23 @@ void bmp24_saveImage(const char *filename, t_bmp24 *img) {
 
 
     if (fwrite(&img->header, sizeof(t_bmp_header), 1, file) != 1) {
-        printf("Error: Failed to write BMP header to %s.\n", filename);
-        fclose(file); return;
+        instr_error("Error: Failed to write BMP header to %s.\n", filename);
+        fclose(file); instr_end(&span, 0, 0); return;
     }
      if (fwrite(&img->header_info, sizeof(t_bmp_info), 1, file) != 1) {
-        printf("Error: Failed to write BMP info header to %s.\n", filename);
-        fclose(file); return;
+        instr_error("Error: Failed to write BMP info header to %s.\n", filename);
+        fclose(file); instr_end(&span, 0, 0); return;
     }
 
 
-    if (bmp24_writePixelData(img, file) != 0) {
-        printf("Error: Failed to write pixel data to %s.\n", filename);
+    int ok = bmp24_writePixelData(img, file) == 0;
+    fclose(file);
+    instr_end(&span, ok ? (uint64_t)img->width * (uint64_t)img->height : 0, ok ? (uint64_t)img->header.offset + (uint64_t)calculate_row_stride(img->width) * img->height : 0);
+    if (!ok) {
+        instr_error("Error: Failed to write pixel data to %s.\n", filename);
     } else {
-         printf("Image saved successfully as %s.\n", filename);
+         instr_info("Image saved successfully as %s.\n", filename);
     }
-
-    fclose(file);
 }
 
 void bmp24_printInfo(t_bmp24 *img) {
@@ -249,38 +287,40 @@ int bmp24_readPixelData(t_bmp24 *img, FILE *file) {
 
     int width = img->width;
     int height = img->height;
-    int row_stride = calculate_row_stride(width);
-    uint32_t data_offset = img->header.offset;
+    size_t row_stride = calculate_row_stride(width);
+    uint64_t data_offset = img->header.offset;
 
     unsigned char *row_buffer = (unsigned char *)malloc(row_stride);
     if (!row_buffer) {
-        printf("Error: Failed to allocate buffer for reading rows.\n");
+        instr_error("Error: Failed to allocate buffer for reading rows.\n");
         return -1;
     }
+    instr_scratchAlloc(row_stride);
 
     for (int y = 0; y < height; ++y) {
-        uint32_t row_file_offset = data_offset + (height - 1 - y) * row_stride;
+        uint64_t row_file_offset = data_offset + (uint64_t)(height - 1 - y) * row_stride;
 
-        if (fseek(file, row_file_offset, SEEK_SET) != 0) {
-             printf("Error: fseek failed for row %d (file row %d) offset %u\n", y, height - 1- y, row_file_offset);
-             free(row_buffer); return -1;
+        if (file_seek64(file, row_file_offset) != 0) {
+             instr_error("Error: fseek failed for row %d (file row %d) offset %" PRIu64 "\n", y, height - 1- y, row_file_offset);
+             free(row_buffer); instr_scratchFree(row_stride); return -1;
         }
-        if (fread(row_buffer, 1, row_stride, file) != row_stride) {
-            printf("Error: Failed to read data for row %d (file row %d).\n", y, height - 1- y);
-             if(ferror(file)) perror("fread error"); else if (feof(file)) printf("fread error: unexpected EOF\n");
+        trace_beginIndexed("io", "fread row", y);
+        size_t got = fread(row_buffer, 1, row_stride, file);
+        trace_end("io", "fread row");
+        if (got != row_stride) {
+            instr_error("Error: Failed to read data for row %d (file row %d).\n", y, height - 1- y);
+             if(ferror(file)) instr_error("fread error: %s\n", strerror(errno)); else if (feof(file)) instr_error("fread error: unexpected EOF\n");
             free(row_buffer);
+            instr_scratchFree(row_stride);
             return -1;
         }
 
-        t_pixel* dest_row = img->data[y];
-        for (int x = 0; x < width; ++x) {
-            dest_row[x].blue  = row_buffer[x * 3 + 0];
-            dest_row[x].green = row_buffer[x * 3 + 1];
-            dest_row[x].red   = row_buffer[x * 3 + 2];
-        }
+        // t_pixel is laid out blue, green, red like the file, so a row unpacks with one copy.
+        memcpy(img->data[y], row_buffer, (size_t)width * sizeof(t_pixel));
     }
 
     free(row_buffer);
+    instr_scratchFree(row_stride);
     return 0;
 }
 
@@ -290,90 +330,102 @@ int bmp24_writePixelData(t_bmp24 *img, FILE *file) {
 
     int width = img->width;
     int height = img->height;
-    int row_stride = calculate_row_stride(width);
-    uint32_t data_offset = img->header.offset;
+    size_t row_stride = calculate_row_stride(width);
+    uint64_t data_offset = img->header.offset;
 
     unsigned char *row_buffer = (unsigned char *)malloc(row_stride);
      if (!row_buffer) {
-        printf("Error: Failed to allocate buffer for writing rows.\n");
+        instr_error("Error: Failed to allocate buffer for writing rows.\n");
         return -1;
     }
+    instr_scratchAlloc(row_stride);
 
 
     for (int y = 0; y < height; ++y) {
-         t_pixel* src_row = img->data[y];
+        memcpy(row_buffer, img->data[y], (size_t)width * sizeof(t_pixel));
+        memset(row_buffer + (size_t)width * sizeof(t_pixel), 0, row_stride - (size_t)width * sizeof(t_pixel));
 
-        for (int x = 0; x < width; ++x) {
-            row_buffer[x * 3 + 0] = src_row[x].blue;
-            row_buffer[x * 3 + 1] = src_row[x].green;
-            row_buffer[x * 3 + 2] = src_row[x].red;
-        }
-        for (int p = width * 3; p < row_stride; ++p) {
-            row_buffer[p] = 0;
-        }
+        uint64_t row_file_offset = data_offset + (uint64_t)(height - 1 - y) * row_stride;
 
-        uint32_t row_file_offset = data_offset + (height - 1 - y) * row_stride;
-
-        if (fseek(file, row_file_offset, SEEK_SET) != 0) {
-             printf("Error: fseek failed for writing row %d (file row %d) offset %u\n", y, height - 1 - y, row_file_offset);
-             free(row_buffer); return -1;
+        if (file_seek64(file, row_file_offset) != 0) {
+             instr_error("Error: fseek failed for writing row %d (file row %d) offset %" PRIu64 "\n", y, height - 1 - y, row_file_offset);
+             free(row_buffer); instr_scratchFree(row_stride); return -1;
         }
-        if (fwrite(row_buffer, 1, row_stride, file) != row_stride) {
-            printf("Error: Failed to write data for row %d (file row %d).\n", y, height - 1 - y);
-            if(ferror(file)) perror("fwrite error");
+        trace_beginIndexed("io", "fwrite row", y);
+        size_t put = fwrite(row_buffer, 1, row_stride, file);
+        trace_end("io", "fwrite row");
+        if (put != row_stride) {
+            instr_error("Error: Failed to write data for row %d (file row %d).\n", y, height - 1 - y);
+            if(ferror(file)) instr_error("fwrite error: %s\n", strerror(errno));
             free(row_buffer);
+            instr_scratchFree(row_stride);
             return -1;
         }
     }
 
     free(row_buffer);
+    instr_scratchFree(row_stride);
     return 0;
 }
 
 
+// Point operations run on the shared pool in bands of rows of about tune_params()->chunkBytes.
+typedef enum { BMP24_POINT_NEGATE, BMP24_POINT_ADD, BMP24_POINT_GRAYSCALE } t_bmp24_point;
+
+typedef struct {
+    t_pixel **data;
+    int width;
+    t_bmp24_point op;
+    int value;
+} t_bmp24_pointJob;
+
+static void bmp24_pointRows(size_t begin, size_t end, void *userData) {
+    const t_bmp24_pointJob *job = (const t_bmp24_pointJob *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t rowBytes = (size_t)job->width * sizeof(t_pixel);
+    for (size_t y = begin; y < end; ++y) {
+        switch (job->op) {
+            case BMP24_POINT_NEGATE: kernels->negate((unsigned char *)job->data[y], rowBytes); break;
+            case BMP24_POINT_ADD: kernels->addSaturate((unsigned char *)job->data[y], rowBytes, job->value); break;
+            case BMP24_POINT_GRAYSCALE: kernels->grayscale24(job->data[y], (size_t)job->width); break;
+        }
+    }
+}
+
+static void bmp24_pointOp(t_bmp24 *img, t_bmp24_point op, int value) {
+    t_bmp24_pointJob job = { img->data, img->width, op, value };
+    size_t grain = pool_grain((size_t)img->width * sizeof(t_pixel), tune_params()->chunkBytes);
+    pool_parallelFor((size_t)img->height, grain, bmp24_pointRows, &job);
+}
+
 // [Part 2.5 Implementation] Negative
 void bmp24_negative(t_bmp24 *img) {
      if (!img || !img->data) return;
-     for (int y = 0; y < img->height; ++y) {
-         for (int x = 0; x < img->width; ++x) {
-             img->data[y][x].red = 255 - img->data[y][x].red;
-             img->data[y][x].green = 255 - img->data[y][x].green;
-             img->data[y][x].blue = 255 - img->data[y][x].blue;
-         }
-     }
-     printf("Negative filter applied (24-bit).\n");
+    t_instr_span span;
+    instr_begin(&span, "bmp24_negative");
+    bmp24_pointOp(img, BMP24_POINT_NEGATE, 0);
+    instr_end(&span, (uint64_t)img->width * img->height, 6 * (uint64_t)img->width * img->height);
+     instr_info("Negative filter applied (24-bit).\n");
 }
 
 // [Part 2.5 Implementation] Grayscale (simple average)
 void bmp24_grayscale(t_bmp24 *img) {
      if (!img || !img->data) return;
-     for (int y = 0; y < img->height; ++y) {
-         for (int x = 0; x < img->width; ++x) {
-             uint16_t sum = img->data[y][x].red + img->data[y][x].green + img->data[y][x].blue;
-             uint8_t avg = (uint8_t)(sum / 3);
-             img->data[y][x].red = avg;
-             img->data[y][x].green = avg;
-             img->data[y][x].blue = avg;
-         }
-     }
-      printf("Grayscale conversion applied (24-bit).\n");
+    t_instr_span span;
+    instr_begin(&span, "bmp24_grayscale");
+    bmp24_pointOp(img, BMP24_POINT_GRAYSCALE, 0);
+    instr_end(&span, (uint64_t)img->width * img->height, 6 * (uint64_t)img->width * img->height);
+      instr_info("Grayscale conversion applied (24-bit).\n");
 }
 
 // [Part 2.5 Implementation] Brightness
 void bmp24_brightness(t_bmp24 *img, int value) {
      if (!img || !img->data) return;
-      for (int y = 0; y < img->height; ++y) {
-         for (int x = 0; x < img->width; ++x) {
-             int r = img->data[y][x].red + value;
-             int g = img->data[y][x].green + value;
-             int b = img->data[y][x].blue + value;
-             // Use clamp_u8 helper
-             img->data[y][x].red   = clamp_u8((double)r);
-             img->data[y][x].green = clamp_u8((double)g);
-             img->data[y][x].blue  = clamp_u8((double)b);
-         }
-     }
-      printf("Brightness adjusted by %d (24-bit).\n", value);
+    t_instr_span span;
+    instr_begin(&span, "bmp24_brightness");
+    bmp24_pointOp(img, BMP24_POINT_ADD, value);
+    instr_end(&span, (uint64_t)img->width * img->height, 6 * (uint64_t)img->width * img->height);
+      instr_info("Brightness adjusted by %d (24-bit).\n", value);
 }
 
 // [Part 2.6 Implementation] Convolution Helper: Applies kernel to one pixel
@@ -405,88 +457,197 @@ t_pixel bmp24_convolution_helper(t_pixel **original_data, int x, int y, int widt
      return result;
 }
 
+// Convolves row y of src into dstRow; border rows and the kernelSize/2 pixels at each end of a row are copied unchanged.
+void bmp24_convolveRow(t_pixel **src, int width, int height, int y, float **kernel, int kernelSize, t_pixel *dstRow) {
+    int n = kernelSize / 2;
+    if (y < n || y >= height - n || width < kernelSize) {
+        memcpy(dstRow, src[y], (size_t)width * sizeof(t_pixel));
+        return;
+    }
+    memcpy(dstRow, src[y], (size_t)n * sizeof(t_pixel));
+    memcpy(dstRow + width - n, src[y] + width - n, (size_t)n * sizeof(t_pixel));
+
+    // The dispatched kernel works on the interleaved bytes, with the same arithmetic as bmp24_convolution_helper.
+    t_conv_rows conv;
+    if (cpu_convBegin(&conv, kernel, kernelSize) != 0) {
+        memcpy(dstRow + n, src[y] + n, (size_t)(width - 2 * n) * sizeof(t_pixel));
+        return;
+    }
+    for (int k = 0; k < kernelSize; ++k) {
+        conv.rows[k] = (const unsigned char *)src[y - n + k];
+    }
+    cpu_kernels()->convolve24(conv.rows, conv.weights, kernelSize, (size_t)n * sizeof(t_pixel),
+                              (size_t)(width - n) * sizeof(t_pixel), (unsigned char *)dstRow);
+    cpu_convEnd(&conv);
+}
+
+// Defines one filter pass; each pool task convolves a band of rows starting at row first + begin.
+typedef struct {
+    t_pixel **src;
+    t_pixel **dst;
+    int width;
+    int height;
+    float **kernel;
+    int kernelSize;
+    int first;
+} t_bmp24_filterJob;
+
+static void bmp24_filterBand(size_t begin, size_t end, void *userData) {
+    const t_bmp24_filterJob *job = (const t_bmp24_filterJob *)userData;
+    for (size_t i = begin; i < end; ++i) {
+        int y = job->first + (int)i;
+        bmp24_convolveRow(job->src, job->width, job->height, y, job->kernel, job->kernelSize, job->dst[y]);
+    }
+}
+
 // [Part 2.6 Implementation] Apply Filter Wrapper: Applies kernel to whole image
 void bmp24_applyFilter(t_bmp24 *img, float **kernel, int kernelSize) {
      if (!img || !img->data || !kernel || kernelSize <= 0 || kernelSize % 2 == 0) {
-        printf("Error: Invalid arguments for applyFilter (24-bit).\n");
+        instr_error("Error: Invalid arguments for applyFilter (24-bit).\n");
         return;
     }
     int width = img->width;
     int height = img->height;
     int n = kernelSize / 2;
 
+    uint64_t numPixels = (uint64_t)width * (uint64_t)height;
+    t_instr_span span;
+    instr_begin(&span, "bmp24_applyFilter");
     t_pixel **tempData = bmp24_allocateDataPixels(width, height);
     if (!tempData) {
-        printf("Error: Failed to allocate temp data for filter (24-bit).\n");
+        instr_error("Error: Failed to allocate temp data for filter (24-bit).\n");
+        instr_end(&span, 0, 0);
         return;
     }
+    instr_scratchAlloc(numPixels * sizeof(t_pixel));
      for (int y = 0; y < height; ++y) {
-         memcpy(tempData[y], img->data[y], width * sizeof(t_pixel));
+         memcpy(tempData[y], img->data[y], (size_t)width * sizeof(t_pixel));
      }
 
-    for (int y = n; y < height - n; ++y) {
-        for (int x = n; x < width - n; ++x) {
-            img->data[y][x] = bmp24_convolution_helper(tempData, x, y, width, height, kernel, kernelSize);
-        }
+    if (height > 2 * n) {
+        t_bmp24_filterJob job = { tempData, img->data, width, height, kernel, kernelSize, n };
+        pool_parallelFor((size_t)(height - 2 * n), (size_t)tune_params()->bandRows, bmp24_filterBand, &job);
     }
 
     bmp24_freeDataPixels(tempData, height);
-    printf("Applied %dx%d filter (24-bit).\n", kernelSize, kernelSize);
+    instr_scratchFree(numPixels * sizeof(t_pixel));
+    instr_end(&span, numPixels, 9 * numPixels);
+    instr_info("Applied %dx%d filter (24-bit).\n", kernelSize, kernelSize);
 }
 
 
 void bmp24_boxBlur(t_bmp24 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp24_boxBlur");
     int size = 3;
     float **kernel = allocate_kernel(size);
-    if (!kernel) { printf("Kernel alloc failed for box blur (24-bit)\n"); return; }
+    if (!kernel) { instr_error("Kernel alloc failed for box blur (24-bit)\n"); instr_end(&span, 0, 0); return; }
     float val = 1.0f / 9.0f;
     for(int i=0; i<size; ++i) for(int j=0; j<size; ++j) kernel[i][j] = val;
     bmp24_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? (uint64_t)img->width * img->height : 0, img ? 6 * (uint64_t)img->width * img->height : 0);
 }
 
 void bmp24_gaussianBlur(t_bmp24 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp24_gaussianBlur");
     int size = 3;
     float **kernel = allocate_kernel(size);
-    if (!kernel) { printf("Kernel alloc failed for gaussian blur (24-bit)\n"); return; }
+    if (!kernel) { instr_error("Kernel alloc failed for gaussian blur (24-bit)\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] = 1.0f/16.0f; kernel[0][1] = 2.0f/16.0f; kernel[0][2] = 1.0f/16.0f;
     kernel[1][0] = 2.0f/16.0f; kernel[1][1] = 4.0f/16.0f; kernel[1][2] = 2.0f/16.0f;
     kernel[2][0] = 1.0f/16.0f; kernel[2][1] = 2.0f/16.0f; kernel[2][2] = 1.0f/16.0f;
     bmp24_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? (uint64_t)img->width * img->height : 0, img ? 6 * (uint64_t)img->width * img->height : 0);
 }
 
 void bmp24_outline(t_bmp24 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp24_outline");
     int size = 3;
     float **kernel = allocate_kernel(size);
-     if (!kernel) { printf("Kernel alloc failed for outline (24-bit)\n"); return; }
+     if (!kernel) { instr_error("Kernel alloc failed for outline (24-bit)\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] = -1.0f; kernel[0][1] = -1.0f; kernel[0][2] = -1.0f;
     kernel[1][0] = -1.0f; kernel[1][1] =  8.0f; kernel[1][2] = -1.0f;
     kernel[2][0] = -1.0f; kernel[2][1] = -1.0f; kernel[2][2] = -1.0f;
     bmp24_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? (uint64_t)img->width * img->height : 0, img ? 6 * (uint64_t)img->width * img->height : 0);
 }
 
 void bmp24_emboss(t_bmp24 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp24_emboss");
     int size = 3;
     float **kernel = allocate_kernel(size);
-     if (!kernel) { printf("Kernel alloc failed for emboss (24-bit)\n"); return; }
+     if (!kernel) { instr_error("Kernel alloc failed for emboss (24-bit)\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] = -2.0f; kernel[0][1] = -1.0f; kernel[0][2] =  0.0f;
     kernel[1][0] = -1.0f; kernel[1][1] =  1.0f; kernel[1][2] =  1.0f;
     kernel[2][0] =  0.0f; kernel[2][1] =  1.0f; kernel[2][2] =  2.0f;
     bmp24_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? (uint64_t)img->width * img->height : 0, img ? 6 * (uint64_t)img->width * img->height : 0);
 }
 
 void bmp24_sharpen(t_bmp24 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp24_sharpen");
      int size = 3;
     float **kernel = allocate_kernel(size);
-     if (!kernel) { printf("Kernel alloc failed for sharpen (24-bit)\n"); return; }
+     if (!kernel) { instr_error("Kernel alloc failed for sharpen (24-bit)\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] =  0.0f; kernel[0][1] = -1.0f; kernel[0][2] =  0.0f;
     kernel[1][0] = -1.0f; kernel[1][1] =  5.0f; kernel[1][2] = -1.0f;
     kernel[2][0] =  0.0f; kernel[2][1] = -1.0f; kernel[2][2] =  0.0f;
     bmp24_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? (uint64_t)img->width * img->height : 0, img ? 6 * (uint64_t)img->width * img->height : 0);
+}
+
+// Defines the two row passes of bmp24_equalize: to YUV with a histogram of Y, then back to RGB through lut.
+typedef struct {
+    t_pixel **data;
+    int width;
+    uint8_t *y;
+    double *u;
+    double *v;
+    uint64_t *hist;
+    const unsigned int *lut;
+    pthread_mutex_t lock;
+} t_bmp24_yuvJob;
+
+static void bmp24_toYuvRows(size_t begin, size_t end, void *userData) {
+    t_bmp24_yuvJob *job = (t_bmp24_yuvJob *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    // The kernel counts in 32 bits: local is moved into total before it could wrap (a single-threaded run gets
+    // every row here).
+    unsigned int local[256] = { 0 };
+    uint64_t total[256] = { 0 };
+    size_t counted = 0;
+    for (size_t y = begin; y < end; ++y) {
+        size_t index = y * (size_t)job->width;
+        if (counted > UINT32_MAX - (size_t)job->width) {
+            for (int i = 0; i < 256; ++i) total[i] += local[i];
+            memset(local, 0, sizeof(local));
+            counted = 0;
+        }
+        kernels->rgbToYuv(job->data[y], (size_t)job->width, job->y + index, job->u + index, job->v + index);
+        kernels->histogram(job->y + index, (size_t)job->width, local);
+        counted += (size_t)job->width;
+    }
+    pthread_mutex_lock(&job->lock);
+    for (int i = 0; i < 256; ++i) job->hist[i] += total[i] + local[i];
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void bmp24_fromYuvRows(size_t begin, size_t end, void *userData) {
+    const t_bmp24_yuvJob *job = (const t_bmp24_yuvJob *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    for (size_t y = begin; y < end; ++y) {
+        size_t index = y * (size_t)job->width;
+        kernels->yuvToRgb(job->y + index, job->lut, job->u + index, job->v + index, (size_t)job->width, job->data[y]);
+    }
 }
 
 // [Part 3.4.3 Implementation] Equalize color image using YUV space
@@ -495,62 +656,54 @@ void bmp24_equalize(t_bmp24 *img) {
 
     int width = img->width;
     int height = img->height;
-    int numPixels = width * height;
+    size_t numPixels = (size_t)width * (size_t)height; // bmp24_allocate guarantees this does not overflow
     if(numPixels == 0) return;
 
+    t_instr_span span;
+    instr_begin(&span, "bmp24_equalize");
     uint8_t *y_channel = (uint8_t *)malloc(numPixels * sizeof(uint8_t));
     double *u_channel = (double *)malloc(numPixels * sizeof(double));
     double *v_channel = (double *)malloc(numPixels * sizeof(double));
-    unsigned int *y_hist = (unsigned int *)calloc(256, sizeof(unsigned int));
+    uint64_t *y_hist = (uint64_t *)calloc(256, sizeof(uint64_t));
     unsigned int *y_hist_eq = NULL;
 
     if (!y_channel || !u_channel || !v_channel || !y_hist) {
-        printf("Error: Failed to allocate memory for YUV equalization.\n");
+        instr_error("Error: Failed to allocate memory for YUV equalization.\n");
         free(y_channel); free(u_channel); free(v_channel); free(y_hist);
+        instr_end(&span, 0, 0);
         return;
     }
+    size_t scratchBytes = numPixels * (sizeof(uint8_t) + 2 * sizeof(double)) + 256 * sizeof(uint64_t);
+    instr_scratchAlloc(scratchBytes);
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int index = y * width + x;
-            t_yuv current_yuv = rgb_to_yuv(img->data[y][x]);
-
-
-            y_channel[index] = clamp_u8(current_yuv.y);
-            u_channel[index] = current_yuv.u;
-            v_channel[index] = current_yuv.v;
-
-            y_hist[y_channel[index]]++;
-        }
-    }
+    t_bmp24_yuvJob job = { img->data, width, y_channel, u_channel, v_channel, y_hist, NULL, PTHREAD_MUTEX_INITIALIZER };
+    size_t grain = pool_grain((size_t)width * sizeof(t_pixel), tune_params()->chunkBytes);
+    pool_parallelFor((size_t)height, grain, bmp24_toYuvRows, &job);
 
     // Step 2 & 3: Compute normalized CDF for Y channel
     y_hist_eq = bmp8_computeCDF(y_hist, numPixels);
     if (!y_hist_eq) {
-        printf("Error: Failed compute Y channel CDF.\n");
+        instr_error("Error: Failed compute Y channel CDF.\n");
         free(y_channel); free(u_channel); free(v_channel); free(y_hist);
+        pthread_mutex_destroy(&job.lock);
+        instr_scratchFree(scratchBytes);
+        instr_end(&span, 0, 0);
         return;
     }
 
 
     // Step 4 & 5: Apply equalization to Y and convert back to RGB
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-             int index = y * width + x;
-             double original_u = u_channel[index];
-             double original_v = v_channel[index];
-             uint8_t original_y_val = y_channel[index];
-             double new_y = (double)y_hist_eq[original_y_val];
-             t_yuv equalized_yuv = { new_y, original_u, original_v };
-             img->data[y][x] = yuv_to_rgb(equalized_yuv);
-        }
-    }
+    job.lut = y_hist_eq;
+    pool_parallelFor((size_t)height, grain, bmp24_fromYuvRows, &job);
 
-    printf("Color histogram equalization applied (Y channel).\n");
+    instr_info("Color histogram equalization applied (Y channel).\n");
 
     free(y_channel);
     free(u_channel);
     free(v_channel);
     free(y_hist);
     free(y_hist_eq);
+    pthread_mutex_destroy(&job.lock);
+    instr_scratchFree(scratchBytes);
+    instr_end(&span, numPixels, 6 * (uint64_t)numPixels);
 }
\ No newline at end of file
@@ -13,6 +13,8 @@ typedef struct {
     uint8_t green;
     uint8_t red;
 } t_pixel;
+// Rows of t_pixel are read from and written to files as raw bytes, so a pixel must be exactly the 3 BGR bytes.
+_Static_assert(sizeof(t_pixel) == 3, "t_pixel must match the packed BGR layout of the file");
 
 // [Part 2.2.1] Defines the BMP file header structure (14 bytes).
 #pragma pack(push, 1)
@@ -67,6 +69,7 @@ void bmp24_freeDataPixels(t_pixel **pixels, int height);
 t_bmp24 *bmp24_allocate(int width, int height, int colorDepth);
 void bmp24_free(t_bmp24 *img);
 
+int bmp24_checkHeader(t_bmp_header *header, t_bmp_info *info, const char *filename);
 t_bmp24 *bmp24_loadImage(const char *filename);
 void bmp24_saveImage(const char *filename, t_bmp24 *img);
 void bmp24_printInfo(t_bmp24 *img);
@@ -79,6 +82,7 @@ void bmp24_grayscale(t_bmp24 *img);
 void bmp24_brightness(t_bmp24 *img, int value);
 
 t_pixel bmp24_convolution_helper(t_pixel **original_data, int x, int y, int width, int height, float **kernel, int kernelSize);
+void bmp24_convolveRow(t_pixel **src, int width, int height, int y, float **kernel, int kernelSize, t_pixel *dstRow);
 void bmp24_applyFilter(t_bmp24 *img, float **kernel, int kernelSize);
 
 void bmp24_boxBlur(t_bmp24 *img);
@@ -1,6 +1,14 @@
 // bmp8.c
 #include "bmp8.h"
 #include "utils.h"
+#include "instrument.h"
+#include "trace.h"
+#include "cpu_dispatch.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <math.h>
 #include <string.h> // For memcpy
 #include <stdio.h> // For printf, FILE, fopen, etc.
@@ -15,54 +23,109 @@
 #define HEADER_SIZE 54
 #define COLOR_TABLE_SIZE 1024
 
-// [Part 1.2.1 Implementation] Reads BMP file, allocates memory, populates t_bmp8 struct.
-t_bmp8 *bmp8_loadImage(const char *filename) {
+// Fills width/height/colorDepth/dataSize from the raw header bytes and validates them. Returns 0 if the image is a usable 8-bit BMP.
+int bmp8_parseHeader(t_bmp8 *img, const char *filename, unsigned int *dataOffset) {
+    if (!img) return -1;
+    img->width = *(unsigned int *)&img->header[WIDTH_OFFSET];
+    img->height = *(unsigned int *)&img->header[HEIGHT_OFFSET];
+    img->colorDepth = *(unsigned short *)&img->header[DEPTH_OFFSET];
+    *dataOffset = *(unsigned int*)&img->header[DATA_OFFSET_HDR];
+
+    unsigned int headerDataSize = *(unsigned int *)&img->header[DATA_SIZE_OFFSET];
+    if (checked_mul_size(img->width, img->height, &img->dataSize) != 0) { // For 8-bit uncompressed
+        instr_error("Error: Image %s is too large (%ux%u).\n", filename, img->width, img->height);
+        return -1;
+    }
+    if (headerDataSize != 0 && headerDataSize != img->dataSize) {
+         instr_warning("Warning: Header data size (%u) differs from calculated (%zu)\n", headerDataSize, img->dataSize);
+    }
+
+    if (img->header[0] != 'B' || img->header[1] != 'M') {
+        instr_error("Error: File %s is not a valid BMP file (Invalid signature).\n", filename);
+        return -1;
+    }
+    if (img->colorDepth != 8) {
+        instr_error("Error: Image %s is not an 8-bit grayscale image (colorDepth=%u).\n", filename, img->colorDepth);
+        return -1;
+    }
+    return 0;
+}
+
+t_bmp8 *bmp8_allocate(unsigned int width, unsigned int height) {
+    if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX) {
+        instr_error("Error: Invalid 8-bit image size %ux%u.\n", width, height);
+        return NULL;
+    }
+    size_t dataSize;
+    if (checked_mul_size(width, height, &dataSize) != 0) {
+        instr_error("Error: Image dimensions %ux%u are too large.\n", width, height);
+        return NULL;
+    }
+    t_bmp8 *img = (t_bmp8 *)calloc(1, sizeof(t_bmp8));
+    if (!img) {
+        instr_error("Error: Cannot allocate memory for image structure.\n");
+        return NULL;
+    }
+    img->data = (unsigned char *)calloc(dataSize, 1);
+    if (!img->data) {
+        instr_error("Error: Cannot allocate memory for pixel data (%zu bytes).\n", dataSize);
+        free(img);
+        return NULL;
+    }
+    img->width = width;
+    img->height = height;
+    img->colorDepth = 8;
+    img->dataSize = dataSize;
+
+    // Rows of an 8-bit image are written without padding (see bmp8_saveImage), so the data size is width * height.
+    uint64_t fileSize = (uint64_t)HEADER_SIZE + COLOR_TABLE_SIZE + dataSize;
+    img->header[0] = 'B';
+    img->header[1] = 'M';
+    *(unsigned int*)&img->header[2] = fileSize <= UINT32_MAX ? (unsigned int)fileSize : 0;
+    *(unsigned int*)&img->header[DATA_OFFSET_HDR] = HEADER_SIZE + COLOR_TABLE_SIZE;
+    *(unsigned int*)&img->header[14] = 40;
+    *(unsigned int*)&img->header[WIDTH_OFFSET] = width;
+    *(unsigned int*)&img->header[HEIGHT_OFFSET] = height;
+    img->header[26] = 1;
+    img->header[DEPTH_OFFSET] = 8;
+    *(unsigned int*)&img->header[DATA_SIZE_OFFSET] = dataSize <= UINT32_MAX ? (unsigned int)dataSize : 0;
+    *(unsigned int*)&img->header[46] = 256;
+    for (int i = 0; i < 256; ++i) {
+        img->colorTable[i * 4 + 0] = img->colorTable[i * 4 + 1] = img->colorTable[i * 4 + 2] = (unsigned char)i;
+    }
+    return img;
+}
+
+static t_bmp8 *bmp8_loadImageFile(const char *filename) {
     FILE *file = fopen(filename, "rb");
     if (!file) {
-        printf("Error: Cannot open file %s\n", filename);
+        instr_error("Error: Cannot open file %s\n", filename);
         return NULL;
     }
 
     t_bmp8 *img = (t_bmp8 *)malloc(sizeof(t_bmp8));
     if (!img) {
-        printf("Error: Cannot allocate memory for image structure.\n");
+        instr_error("Error: Cannot allocate memory for image structure.\n");
         fclose(file);
         return NULL;
     }
     img->data = NULL;
 
     if (fread(img->header, 1, HEADER_SIZE, file) != HEADER_SIZE) {
-        printf("Error: Failed to read BMP header from %s.\n", filename);
+        instr_error("Error: Failed to read BMP header from %s.\n", filename);
         fclose(file);
         bmp8_free(img);
         return NULL;
     }
 
-    img->width = *(unsigned int *)&img->header[WIDTH_OFFSET];
-    img->height = *(unsigned int *)&img->header[HEIGHT_OFFSET];
-    img->colorDepth = *(unsigned short *)&img->header[DEPTH_OFFSET];
-    unsigned int dataOffset = *(unsigned int*)&img->header[DATA_OFFSET_HDR];
-
-    unsigned int headerDataSize = *(unsigned int *)&img->header[DATA_SIZE_OFFSET];
-    img->dataSize = img->width * img->height; // For 8-bit uncompressed
-    if (headerDataSize != 0 && headerDataSize != img->dataSize) {
-         printf("Warning: Header data size (%u) differs from calculated (%u)\n", headerDataSize, img->dataSize);
-    }
-
-    if (img->header[0] != 'B' || img->header[1] != 'M') {
-        printf("Error: File %s is not a valid BMP file (Invalid signature).\n", filename);
-        fclose(file);
-        bmp8_free(img);
-        return NULL;
-    }
-    if (img->colorDepth != 8) {
-        printf("Error: Image %s is not an 8-bit grayscale image (colorDepth=%u).\n", filename, img->colorDepth);
+    unsigned int dataOffset = 0;
+    if (bmp8_parseHeader(img, filename, &dataOffset) != 0) {
         fclose(file);
         bmp8_free(img);
         return NULL;
     }
     if (fread(img->colorTable, 1, COLOR_TABLE_SIZE, file) != COLOR_TABLE_SIZE) {
-        printf("Error: Failed to read color table from %s.\n", filename);
+        instr_error("Error: Failed to read color table from %s.\n", filename);
         fclose(file);
         bmp8_free(img);
         return NULL;
@@ -70,69 +133,94 @@ t_bmp8 *bmp8_loadImage(const char *filename) {
 
     img->data = (unsigned char *)malloc(img->dataSize);
     if (!img->data) {
-        printf("Error: Cannot allocate memory for pixel data (%u bytes).\n", img->dataSize);
+        instr_error("Error: Cannot allocate memory for pixel data (%zu bytes).\n", img->dataSize);
         fclose(file);
         bmp8_free(img);
         return NULL;
     }
 
-    if (fseek(file, dataOffset, SEEK_SET) != 0) {
-         printf("Error: Failed to seek to pixel data offset (%u) in %s.\n", dataOffset, filename);
+    if (file_seek64(file, dataOffset) != 0) {
+         instr_error("Error: Failed to seek to pixel data offset (%u) in %s.\n", dataOffset, filename);
         fclose(file);
         bmp8_free(img);
         return NULL;
     }
-    if (fread(img->data, 1, img->dataSize, file) != img->dataSize) {
-        printf("Error: Failed to read pixel data from %s.\n", filename);
-         if(ferror(file)) perror("fread error"); else if(feof(file)) printf("fread error: unexpected EOF\n");
+    trace_begin("io", "fread pixels");
+    size_t got = fread(img->data, 1, img->dataSize, file);
+    trace_end("io", "fread pixels");
+    if (got != img->dataSize) {
+        instr_error("Error: Failed to read pixel data from %s.\n", filename);
+         if(ferror(file)) instr_error("fread error: %s\n", strerror(errno)); else if(feof(file)) instr_error("fread error: unexpected EOF\n");
         fclose(file);
         bmp8_free(img);
         return NULL;
     }
 
     fclose(file);
-    printf("Image '%s' loaded successfully (%ux%u, %u-bit).\n", filename, img->width, img->height, img->colorDepth);
+    instr_info("Image '%s' loaded successfully (%ux%u, %u-bit).\n", filename, img->width, img->height, img->colorDepth);
     return img;
 }
 
-// [Part 1.2.2 Implementation] Writes the t_bmp8 struct data back to a BMP file.
-void bmp8_saveImage(const char *filename, t_bmp8 *img) {
-    if (!img || !img->data) {
-        printf("Error: Cannot save NULL or invalid image.\n");
-        return;
-    }
+// [Part 1.2.1 Implementation] Reads BMP file, allocates memory, populates t_bmp8 struct.
+t_bmp8 *bmp8_loadImage(const char *filename) {
+    t_instr_span span;
+    instr_begin(&span, "bmp8_loadImage");
+    t_bmp8 *img = bmp8_loadImageFile(filename);
+    instr_end(&span, img ? img->dataSize : 0, img ? (uint64_t)HEADER_SIZE + COLOR_TABLE_SIZE + img->dataSize : 0);
+    return img;
+}
+
+static int bmp8_saveImageFile(const char *filename, t_bmp8 *img) {
 
     FILE *file = fopen(filename, "wb");
     if (!file) {
-        printf("Error: Cannot open file %s for writing.\n", filename);
-        return;
+        instr_error("Error: Cannot open file %s for writing.\n", filename);
+        return -1;
     }
 
+    // The 32-bit size fields cannot describe data beyond 4 GB; 0 ("unknown") is valid for uncompressed BMPs.
+    uint64_t fileSize = (uint64_t)HEADER_SIZE + COLOR_TABLE_SIZE + img->dataSize;
     *(unsigned int*)&img->header[DATA_OFFSET_HDR] = HEADER_SIZE + COLOR_TABLE_SIZE;
-    *(unsigned int*)&img->header[DATA_SIZE_OFFSET] = img->dataSize;
-    *(unsigned int*)&img->header[2] = HEADER_SIZE + COLOR_TABLE_SIZE + img->dataSize;
+    *(unsigned int*)&img->header[DATA_SIZE_OFFSET] = img->dataSize <= UINT32_MAX ? (unsigned int)img->dataSize : 0;
+    *(unsigned int*)&img->header[2] = fileSize <= UINT32_MAX ? (unsigned int)fileSize : 0;
 
 
     if (fwrite(img->header, 1, HEADER_SIZE, file) != HEADER_SIZE) {
-        printf("Error: Failed to write BMP header to %s.\n", filename);
+        instr_error("Error: Failed to write BMP header to %s.\n", filename);
         fclose(file);
-        return;
+        return -1;
     }
 
     if (fwrite(img->colorTable, 1, COLOR_TABLE_SIZE, file) != COLOR_TABLE_SIZE) {
-        printf("Error: Failed to write color table to %s.\n", filename);
+        instr_error("Error: Failed to write color table to %s.\n", filename);
         fclose(file);
-        return;
+        return -1;
     }
 
-    if (fwrite(img->data, 1, img->dataSize, file) != img->dataSize) {
-        printf("Error: Failed to write pixel data to %s.\n", filename);
+    trace_begin("io", "fwrite pixels");
+    size_t put = fwrite(img->data, 1, img->dataSize, file);
+    trace_end("io", "fwrite pixels");
+    if (put != img->dataSize) {
+        instr_error("Error: Failed to write pixel data to %s.\n", filename);
         fclose(file);
-        return;
+        return -1;
     }
 
     fclose(file);
-    printf("Image saved successfully as %s.\n", filename);
+    instr_info("Image saved successfully as %s.\n", filename);
+    return 0;
+}
+
+// [Part 1.2.2 Implementation] Writes the t_bmp8 struct data back to a BMP file.
+void bmp8_saveImage(const char *filename, t_bmp8 *img) {
+    if (!img || !img->data) {
+        instr_error("Error: Cannot save NULL or invalid image.\n");
+        return;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_saveImage");
+    int ok = bmp8_saveImageFile(filename, img) == 0;
+    instr_end(&span, ok ? img->dataSize : 0, ok ? (uint64_t)HEADER_SIZE + COLOR_TABLE_SIZE + img->dataSize : 0);
 }
 
 // [Part 1.2.3 Implementation] Frees allocated memory.
@@ -156,31 +244,59 @@ void bmp8_printInfo(t_bmp8 *img) {
     printf("  Width:       %u\n", img->width);
     printf("  Height:      %u\n", img->height);
     printf("  Color Depth: %u\n", img->colorDepth);
-    printf("  Data Size:   %u bytes\n", img->dataSize);
+    printf("  Data Size:   %zu bytes\n", img->dataSize);
     printf("  File Size (Header): %u bytes\n", *(unsigned int*)&img->header[2]);
     printf("  Data Offset (Header): %u \n", *(unsigned int*)&img->header[10]);
 }
 
 
+// Point operations run on the shared pool in chunks of tune_params()->chunkBytes.
+typedef enum { BMP8_POINT_NEGATE, BMP8_POINT_ADD, BMP8_POINT_THRESHOLD, BMP8_POINT_LUT } t_bmp8_point;
+
+typedef struct {
+    unsigned char *data;
+    t_bmp8_point op;
+    int value;
+    const unsigned int *lut;
+} t_bmp8_pointJob;
+
+static void bmp8_pointChunk(size_t begin, size_t end, void *userData) {
+    const t_bmp8_pointJob *job = (const t_bmp8_pointJob *)userData;
+    unsigned char *data = job->data + begin;
+    size_t length = end - begin;
+    switch (job->op) {
+        case BMP8_POINT_NEGATE: cpu_kernels()->negate(data, length); break;
+        case BMP8_POINT_ADD: cpu_kernels()->addSaturate(data, length, job->value); break;
+        case BMP8_POINT_THRESHOLD: cpu_kernels()->threshold(data, length, job->value); break;
+        case BMP8_POINT_LUT:
+            for (size_t i = 0; i < length; ++i) data[i] = (unsigned char)job->lut[data[i]];
+            break;
+    }
+}
+
+static void bmp8_pointOp(t_bmp8 *img, t_bmp8_point op, int value, const unsigned int *lut) {
+    t_bmp8_pointJob job = { img->data, op, value, lut };
+    pool_parallelFor(img->dataSize, pool_grain(1, tune_params()->chunkBytes), bmp8_pointChunk, &job);
+}
+
 // [Part 1.3.1 Implementation] Inverts pixel values.
 void bmp8_negative(t_bmp8 *img) {
     if (!img || !img->data) return;
-    for (unsigned int i = 0; i < img->dataSize; ++i) {
-        img->data[i] = 255 - img->data[i];
-    }
-     printf("Negative filter applied (8-bit).\n");
+    t_instr_span span;
+    instr_begin(&span, "bmp8_negative");
+    bmp8_pointOp(img, BMP8_POINT_NEGATE, 0, NULL);
+    instr_end(&span, img->dataSize, 2 * (uint64_t)img->dataSize);
+     instr_info("Negative filter applied (8-bit).\n");
 }
 
 // [Part 1.3.2 Implementation] Adjusts brightness, clamping values.
 void bmp8_brightness(t_bmp8 *img, int value) {
      if (!img || !img->data) return;
-    for (unsigned int i = 0; i < img->dataSize; ++i) {
-        int newValue = (int)img->data[i] + value;
-        if (newValue < 0) newValue = 0;
-        if (newValue > 255) newValue = 255;
-        img->data[i] = (unsigned char)newValue;
-    }
-    printf("Brightness adjusted by %d (8-bit).\n", value);
+    t_instr_span span;
+    instr_begin(&span, "bmp8_brightness");
+    bmp8_pointOp(img, BMP8_POINT_ADD, value, NULL);
+    instr_end(&span, img->dataSize, 2 * (uint64_t)img->dataSize);
+    instr_info("Brightness adjusted by %d (8-bit).\n", value);
 }
 
 // [Part 1.3.3 Implementation] Applies thresholding.
@@ -189,144 +305,235 @@ void bmp8_threshold(t_bmp8 *img, int threshold) {
     if (threshold < 0) threshold = 0;
     if (threshold > 255) threshold = 255;
 
-    for (unsigned int i = 0; i < img->dataSize; ++i) {
-        img->data[i] = (img->data[i] >= threshold) ? 255 : 0;
+    t_instr_span span;
+    instr_begin(&span, "bmp8_threshold");
+    bmp8_pointOp(img, BMP8_POINT_THRESHOLD, threshold, NULL);
+    instr_end(&span, img->dataSize, 2 * (uint64_t)img->dataSize);
+     instr_info("Threshold filter applied at %d (8-bit).\n", threshold);
+}
+
+// Convolves row y of src into dstRow. Rows within kernelSize/2 of the top/bottom edge and the kernelSize/2
+// pixels at each end of a row are border pixels and are copied unchanged.
+void bmp8_convolveRow(const unsigned char *src, unsigned int width, unsigned int height, unsigned int y,
+                      float **kernel, int kernelSize, unsigned char *dstRow) {
+    unsigned int n = (unsigned int)(kernelSize / 2);
+    const unsigned char *srcRow = src + (size_t)y * width;
+    if (y < n || y + n >= height || width < (unsigned int)kernelSize) {
+        memcpy(dstRow, srcRow, width);
+        return;
+    }
+    memcpy(dstRow, srcRow, n);
+    memcpy(dstRow + width - n, srcRow + width - n, n);
+
+    t_conv_rows conv;
+    if (cpu_convBegin(&conv, kernel, kernelSize) != 0) {
+        memcpy(dstRow, srcRow, width);
+        return;
+    }
+    for (int k = 0; k < kernelSize; ++k) {
+        conv.rows[k] = src + (size_t)(y - n + k) * width;
+    }
+    cpu_kernels()->convolve8(conv.rows, conv.weights, kernelSize, n, width - n, dstRow);
+    cpu_convEnd(&conv);
+}
+
+// Defines one filter pass; each pool task convolves a band of rows starting at row first + begin.
+typedef struct {
+    const unsigned char *src;
+    unsigned char *dst;
+    unsigned int width;
+    unsigned int height;
+    float **kernel;
+    int kernelSize;
+    unsigned int first;
+} t_bmp8_filterJob;
+
+static void bmp8_filterBand(size_t begin, size_t end, void *userData) {
+    const t_bmp8_filterJob *job = (const t_bmp8_filterJob *)userData;
+    for (size_t i = begin; i < end; ++i) {
+        unsigned int y = job->first + (unsigned int)i;
+        bmp8_convolveRow(job->src, job->width, job->height, y, job->kernel, job->kernelSize,
+                         job->dst + (size_t)y * job->width);
     }
-     printf("Threshold filter applied at %d (8-bit).\n", threshold);
 }
 
 // [Part 1.4.1 Implementation] Applies convolution filter.
 void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize) {
     if (!img || !img->data || !kernel || kernelSize <= 0 || kernelSize % 2 == 0) {
-        printf("Error: Invalid arguments for applyFilter (8-bit).\n");
+        instr_error("Error: Invalid arguments for applyFilter (8-bit).\n");
         return;
     }
 
     unsigned int width = img->width;
     unsigned int height = img->height;
-    unsigned int dataSize = img->dataSize;
+    size_t dataSize = img->dataSize;
     int n = kernelSize / 2;
 
+    t_instr_span span;
+    instr_begin(&span, "bmp8_applyFilter");
     unsigned char *tempData = (unsigned char *)malloc(dataSize);
     if (!tempData) {
-        printf("Error: Failed to allocate memory for temp data in filter (8-bit).\n");
+        instr_error("Error: Failed to allocate memory for temp data in filter (8-bit).\n");
+        instr_end(&span, 0, 0);
         return;
     }
+    instr_scratchAlloc(dataSize);
     memcpy(tempData, img->data, dataSize);
 
-    for (unsigned int y = n; y < height - n; ++y) {
-        for (unsigned int x = n; x < width - n; ++x) {
-            float sum = 0.0f;
-
-            for (int ky = -n; ky <= n; ++ky) { // Loop from -n to n for kernel indices
-                for (int kx = -n; kx <= n; ++kx) {
-                    unsigned int pixelY = y + ky;
-                    unsigned int pixelX = x + kx;
-                    unsigned int pixelIndex = pixelY * width + pixelX;
-                    sum += tempData[pixelIndex] * kernel[ky + n][kx + n];
-                }
-            }
-
-            if (sum < 0.0f) sum = 0.0f;
-            if (sum > 255.0f) sum = 255.0f;
-
-            img->data[y * width + x] = (unsigned char)round(sum);
-        }
+    // Images smaller than the kernel have no interior pixel; the check also guards the unsigned subtraction.
+    if ((unsigned int)n < height && (unsigned int)(2 * n) < height) {
+        t_bmp8_filterJob job = { tempData, img->data, width, height, kernel, kernelSize, (unsigned int)n };
+        pool_parallelFor(height - 2 * (unsigned int)n, (size_t)tune_params()->bandRows, bmp8_filterBand, &job);
     }
 
     free(tempData);
-    printf("Applied %dx%d filter (8-bit).\n", kernelSize, kernelSize);
+    instr_scratchFree(dataSize);
+    instr_end(&span, dataSize, 3 * (uint64_t)dataSize);
+    instr_info("Applied %dx%d filter (8-bit).\n", kernelSize, kernelSize);
 }
 
 void bmp8_boxBlur(t_bmp8 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp8_boxBlur");
     int size = 3;
     float **kernel = allocate_kernel(size);
-    if (!kernel) { printf("Kernel alloc failed for box blur\n"); return; }
+    if (!kernel) { instr_error("Kernel alloc failed for box blur\n"); instr_end(&span, 0, 0); return; }
     float val = 1.0f / 9.0f;
     for(int i=0; i<size; ++i) for(int j=0; j<size; ++j) kernel[i][j] = val;
     bmp8_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? img->dataSize : 0, img ? 2 * (uint64_t)img->dataSize : 0);
 }
 
 void bmp8_gaussianBlur(t_bmp8 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp8_gaussianBlur");
     int size = 3;
     float **kernel = allocate_kernel(size);
-    if (!kernel) { printf("Kernel alloc failed for gaussian blur\n"); return; }
+    if (!kernel) { instr_error("Kernel alloc failed for gaussian blur\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] = 1.0f/16.0f; kernel[0][1] = 2.0f/16.0f; kernel[0][2] = 1.0f/16.0f;
     kernel[1][0] = 2.0f/16.0f; kernel[1][1] = 4.0f/16.0f; kernel[1][2] = 2.0f/16.0f;
     kernel[2][0] = 1.0f/16.0f; kernel[2][1] = 2.0f/16.0f; kernel[2][2] = 1.0f/16.0f;
     bmp8_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? img->dataSize : 0, img ? 2 * (uint64_t)img->dataSize : 0);
 }
 void bmp8_outline(t_bmp8 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp8_outline");
     int size = 3;
     float **kernel = allocate_kernel(size);
-     if (!kernel) { printf("Kernel alloc failed for outline\n"); return; }
+     if (!kernel) { instr_error("Kernel alloc failed for outline\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] = -1.0f; kernel[0][1] = -1.0f; kernel[0][2] = -1.0f;
     kernel[1][0] = -1.0f; kernel[1][1] =  8.0f; kernel[1][2] = -1.0f;
     kernel[2][0] = -1.0f; kernel[2][1] = -1.0f; kernel[2][2] = -1.0f;
     bmp8_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? img->dataSize : 0, img ? 2 * (uint64_t)img->dataSize : 0);
 }
 
 void bmp8_emboss(t_bmp8 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp8_emboss");
     int size = 3;
     float **kernel = allocate_kernel(size);
-     if (!kernel) { printf("Kernel alloc failed for emboss\n"); return; }
+     if (!kernel) { instr_error("Kernel alloc failed for emboss\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] = -2.0f; kernel[0][1] = -1.0f; kernel[0][2] =  0.0f;
     kernel[1][0] = -1.0f; kernel[1][1] =  1.0f; kernel[1][2] =  1.0f;
     kernel[2][0] =  0.0f; kernel[2][1] =  1.0f; kernel[2][2] =  2.0f;
     bmp8_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? img->dataSize : 0, img ? 2 * (uint64_t)img->dataSize : 0);
 }
 
 void bmp8_sharpen(t_bmp8 *img) {
+    t_instr_span span;
+    instr_begin(&span, "bmp8_sharpen");
      int size = 3;
     float **kernel = allocate_kernel(size);
-     if (!kernel) { printf("Kernel alloc failed for sharpen\n"); return; }
+     if (!kernel) { instr_error("Kernel alloc failed for sharpen\n"); instr_end(&span, 0, 0); return; }
     kernel[0][0] =  0.0f; kernel[0][1] = -1.0f; kernel[0][2] =  0.0f;
     kernel[1][0] = -1.0f; kernel[1][1] =  5.0f; kernel[1][2] = -1.0f;
     kernel[2][0] =  0.0f; kernel[2][1] = -1.0f; kernel[2][2] =  0.0f;
     bmp8_applyFilter(img, kernel, size);
     free_kernel(kernel, size);
+    instr_end(&span, img ? img->dataSize : 0, img ? 2 * (uint64_t)img->dataSize : 0);
+}
+
+// Bytes the 32-bit histogram kernels count at once; a single-threaded run gets the whole image as one chunk.
+#define BMP8_HISTOGRAM_BLOCK ((size_t)1 << 30)
+
+// Each pool task counts its chunk into a local histogram and adds it to the shared one.
+typedef struct {
+    const unsigned char *data;
+    uint64_t *hist;
+    pthread_mutex_t lock;
+} t_bmp8_histogramJob;
+
+void bmp8_histogramAdd(const unsigned char *data, size_t length, uint64_t hist[256]) {
+    for (size_t block = 0; block < length; block += BMP8_HISTOGRAM_BLOCK) {
+        unsigned int local[256] = { 0 };
+        size_t n = length - block < BMP8_HISTOGRAM_BLOCK ? length - block : BMP8_HISTOGRAM_BLOCK;
+        cpu_kernels()->histogram(data + block, n, local);
+        for (int i = 0; i < 256; ++i) hist[i] += local[i];
+    }
+}
+
+static void bmp8_histogramChunk(size_t begin, size_t end, void *userData) {
+    t_bmp8_histogramJob *job = (t_bmp8_histogramJob *)userData;
+    uint64_t total[256] = { 0 };
+    bmp8_histogramAdd(job->data + begin, end - begin, total);
+    pthread_mutex_lock(&job->lock);
+    for (int i = 0; i < 256; ++i) job->hist[i] += total[i];
+    pthread_mutex_unlock(&job->lock);
+}
+
+void bmp8_histogramBytes(const unsigned char *data, size_t length, uint64_t hist[256]) {
+    t_bmp8_histogramJob job = { data, hist, PTHREAD_MUTEX_INITIALIZER };
+    pool_parallelFor(length, pool_grain(1, tune_params()->chunkBytes), bmp8_histogramChunk, &job);
+    pthread_mutex_destroy(&job.lock);
 }
 
 // [Part 3.3.1 Implementation] Computes histogram.
-unsigned int *bmp8_computeHistogram(t_bmp8 *img) {
+uint64_t *bmp8_computeHistogram(t_bmp8 *img) {
     if (!img || !img->data) return NULL;
 
-    unsigned int *hist = (unsigned int *)calloc(256, sizeof(unsigned int));
+    uint64_t *hist = (uint64_t *)calloc(256, sizeof(uint64_t));
     if (!hist) {
-        printf("Error: Failed to allocate memory for histogram (8-bit).\n");
+        instr_error("Error: Failed to allocate memory for histogram (8-bit).\n");
         return NULL;
     }
 
-    for (unsigned int i = 0; i < img->dataSize; ++i) {
-        hist[img->data[i]]++;
-    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_computeHistogram");
+    bmp8_histogramBytes(img->data, img->dataSize, hist);
+    instr_end(&span, img->dataSize, img->dataSize);
     return hist;
 }
 
 
 // [Part 3.3.2 Implementation] Computes normalized CDF (mapping table).
-unsigned int *bmp8_computeCDF(unsigned int *hist, int numPixels) {
-     if (!hist || numPixels <= 0) return NULL;
+unsigned int *bmp8_computeCDF(const uint64_t *hist, size_t numPixels) {
+     if (!hist || numPixels == 0) return NULL;
 
-    unsigned int *cdf = (unsigned int *)calloc(256, sizeof(unsigned int));
+    uint64_t *cdf = (uint64_t *)calloc(256, sizeof(uint64_t));
     unsigned int *hist_eq = (unsigned int *)calloc(256, sizeof(unsigned int)); // mapping table
     if (!cdf || !hist_eq) {
-        printf("Error: Failed to allocate memory for CDF/HistEq (8-bit).\n");
+        instr_error("Error: Failed to allocate memory for CDF/HistEq (8-bit).\n");
         free(cdf);
         free(hist_eq);
         return NULL;
     }
 
+    t_instr_span span;
+    instr_begin(&span, "bmp8_computeCDF");
+    instr_scratchAlloc(256 * sizeof(uint64_t));
     cdf[0] = hist[0];
     for (int i = 1; i < 256; ++i) {
         cdf[i] = cdf[i - 1] + hist[i];
     }
 
-    unsigned int cdf_min = 0;
+    uint64_t cdf_min = 0;
     int min_gray_level = -1;
     for(int i=0; i<256; ++i) {
         if(hist[i] > 0) {
@@ -338,20 +545,21 @@ unsigned int *bmp8_computeCDF(unsigned int *hist, int numPixels) {
         cdf_min = cdf[min_gray_level];
     } else {
         cdf_min = 0;
-         printf("Warning: Could not find minimum non-zero CDF value. Equalization might be incorrect.\n");
+         instr_warning("Warning: Could not find minimum non-zero CDF value. Equalization might be incorrect.\n");
     }
 
 
-    double denominator = (double)numPixels - cdf_min;
+    double denominator = (double)numPixels - (double)cdf_min;
     if (denominator <= 0) {
-        printf("Warning: Cannot normalize histogram (numPixels=%d, cdf_min=%u). Mapping gray levels linearly.\n", numPixels, cdf_min);
+        instr_warning("Warning: Cannot normalize histogram (numPixels=%zu, cdf_min=%llu). Mapping gray levels linearly.\n",
+                      numPixels, (unsigned long long)cdf_min);
         for(int i=0; i<256; ++i) hist_eq[i] = i;
     } else {
         for (int i = 0; i < 256; ++i) {
             if (cdf[i] < cdf_min) {
                  hist_eq[i] = 0;
             } else {
-                 double numerator = (double)cdf[i] - cdf_min;
+                 double numerator = (double)cdf[i] - (double)cdf_min;
                  double mapped_value = round((numerator / denominator) * 255.0);
 
 
@@ -363,6 +571,8 @@ unsigned int *bmp8_computeCDF(unsigned int *hist, int numPixels) {
     }
 
     free(cdf);
+    instr_scratchFree(256 * sizeof(uint64_t));
+    instr_end(&span, 0, 0);
     return hist_eq;
 }
 
@@ -371,23 +581,28 @@ unsigned int *bmp8_computeCDF(unsigned int *hist, int numPixels) {
 void bmp8_equalize(t_bmp8 *img) {
     if (!img || !img->data || img->dataSize == 0) return;
 
-    unsigned int *hist = bmp8_computeHistogram(img);
-    if (!hist) return;
+    t_instr_span span;
+    instr_begin(&span, "bmp8_equalize");
+    uint64_t *hist = bmp8_computeHistogram(img);
+    if (!hist) {
+        instr_end(&span, 0, 0);
+        return;
+    }
 
     unsigned int *hist_eq = bmp8_computeCDF(hist, img->dataSize);
     if (!hist_eq) {
         free(hist);
+        instr_end(&span, 0, 0);
         return;
     }
 
 
-    for (unsigned int i = 0; i < img->dataSize; ++i) {
-        img->data[i] = hist_eq[img->data[i]];
-    }
+    bmp8_pointOp(img, BMP8_POINT_LUT, 0, hist_eq);
 
-    printf("Histogram equalization applied (8-bit).\n");
+    instr_info("Histogram equalization applied (8-bit).\n");
 
 
     free(hist);
     free(hist_eq);
+    instr_end(&span, img->dataSize, 3 * (uint64_t)img->dataSize);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 // [Part 1.1] Defines the structure for an 8-bit BMP image.
 typedef struct {
@@ -14,15 +15,21 @@ typedef struct {
     unsigned int width;
     unsigned int height;
     unsigned int colorDepth;
-    unsigned int dataSize;
+    size_t dataSize;
 } t_bmp8;
 
 // [Part 1.2.1] Function bmp8_loadImage is needed to read an 8-bit BMP file into memory.
 t_bmp8 *bmp8_loadImage(const char *filename);
 
+// Function bmp8_parseHeader is needed to decode and validate the 54 header bytes already stored in img->header.
+int bmp8_parseHeader(t_bmp8 *img, const char *filename, unsigned int *dataOffset);
+
 // [Part 1.2.2] Function bmp8_saveImage is needed to write an 8-bit BMP image from memory to a file.
 void bmp8_saveImage(const char *filename, t_bmp8 *img);
 
+// Function bmp8_allocate is needed to create a blank 8-bit image (grayscale color table, headers filled in).
+t_bmp8 *bmp8_allocate(unsigned int width, unsigned int height);
+
 // [Part 1.2.3] Function bmp8_free is needed to release memory allocated for an 8-bit BMP image.
 void bmp8_free(t_bmp8 *img);
 
@@ -40,6 +47,9 @@ void bmp8_threshold(t_bmp8 *img, int threshold);
 
 // [Part 1.4.1 step 1] Function bmp8_applyFilter is needed to apply a generic convolution filter (kernel) to an 8-bit image.
 void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize);
+// Function bmp8_convolveRow is needed to compute one filtered row of src into a separate destination row.
+void bmp8_convolveRow(const unsigned char *src, unsigned int width, unsigned int height, unsigned int y,
+                      float **kernel, int kernelSize, unsigned char *dstRow);
 
 void bmp8_boxBlur(t_bmp8 *img);
 void bmp8_gaussianBlur(t_bmp8 *img);
@@ -49,11 +59,16 @@ void bmp8_sharpen(t_bmp8 *img);
 
 
 // [Part 3.3.1 step 1] Function bmp8_computeHistogram is needed to calculate the frequency of each gray level in an 8-bit image.
-unsigned int *bmp8_computeHistogram(t_bmp8 *img);
+// The counters are 64-bit so that images of more than 4G pixels do not wrap them.
+uint64_t *bmp8_computeHistogram(t_bmp8 *img);
+// Function bmp8_histogramBytes is needed to add the gray levels of length bytes to hist, in parallel on the shared pool.
+void bmp8_histogramBytes(const unsigned char *data, size_t length, uint64_t hist[256]);
+// Function bmp8_histogramAdd is needed to do the same on the calling thread (for code that is already a pool task).
+void bmp8_histogramAdd(const unsigned char *data, size_t length, uint64_t hist[256]);
 
 // [Part 3.3.2 step 1] Function bmp8_computeCDF is needed to calculate the normalized cumulative distribution function from a histogram.
 
-unsigned int *bmp8_computeCDF(unsigned int *hist, int numPixels);
+unsigned int *bmp8_computeCDF(const uint64_t *hist, size_t numPixels);
 
 // [Part 3.3.3 step 1] Function bmp8_equalize is needed to apply histogram equalization to enhance the contrast of an 8-bit image.
 void bmp8_equalize(t_bmp8 *img);
@@ -0,0 +1,204 @@
+// bmp_index.c
+#include "bmp_index.h"
+#include "bmp24.h"
+#include "utils.h"
+#include "instrument.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+
+#define INDEX_SIGNATURE "# imagemod-index v"
+#define INDEX_VERSION 2
+#define INDEX_LINE_MAX 4096
+
+// Since version 2 a backslash, tab, newline or carriage return in a path is written as \\, \t, \n or \r, so that
+// every file stays on one line with the path in the first column.
+static void index_writePath(FILE *out, const char *path) {
+    for (const char *c = path; *c; ++c) {
+        switch (*c) {
+            case '\\': fputs("\\\\", out); break;
+            case '\t': fputs("\\t", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            default: fputc(*c, out);
+        }
+    }
+}
+
+// Decodes an escaped path in place. Returns -1 on an unknown or unfinished escape.
+static int index_unescapePath(char *path) {
+    char *out = path;
+    for (const char *c = path; *c; ++c) {
+        if (*c != '\\') {
+            *out++ = *c;
+            continue;
+        }
+        switch (*++c) {
+            case '\\': *out++ = '\\'; break;
+            case 't': *out++ = '\t'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            default: return -1;
+        }
+    }
+    *out = '\0';
+    return 0;
+}
+
+int bmp_probe(const char *filename, t_bmp_probe *info) {
+    if (!filename || !info) return -1;
+
+    struct stat st;
+    if (stat(filename, &st) != 0) return -1;
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) return -1;
+
+    t_bmp_header header;
+    t_bmp_info header_info;
+    int ok = fread(&header, sizeof(t_bmp_header), 1, file) == 1 &&
+             fread(&header_info, sizeof(t_bmp_info), 1, file) == 1;
+    fclose(file);
+    if (!ok) return -1;
+
+    if (header.type != BITMAP_MAGIC) return -1;
+    if (header_info.bits != 8 && header_info.bits != 24) return -1;
+    if (header_info.compression != NO_COMPRESSION) return -1;
+    if (header_info.width <= 0 || header_info.height == 0) return -1;
+
+    int height = header_info.height < 0 ? -header_info.height : header_info.height;
+    // 24-bit rows are padded to 4 bytes; 8-bit data is stored as width * height, as bmp8_saveImage writes it.
+    uint64_t rowBytes = header_info.bits == 24 ? (uint64_t)calculate_row_stride(header_info.width) : (uint64_t)header_info.width;
+    if ((uint64_t)header.offset + rowBytes * (uint64_t)height > (uint64_t)st.st_size) return -1;
+
+    info->width = header_info.width;
+    info->height = height;
+    info->colorDepth = header_info.bits;
+    info->dataOffset = header.offset;
+    info->fileSize = (uint64_t)st.st_size;
+    info->mtime = (int64_t)st.st_mtime;
+    return 0;
+}
+
+int bmp_buildIndex(const char *directory, const char *indexPath) {
+    if (!directory || !indexPath) return -1;
+
+    int count = 0;
+    char **files = list_bmp_files(directory, &count);
+    if (!files) return -1;
+
+    FILE *out = fopen(indexPath, "w");
+    if (!out) {
+        instr_error("Error: Cannot open file %s for writing.\n", indexPath);
+        free_file_list(files, count);
+        return -1;
+    }
+    fprintf(out, "%s%d\n# path\tsize\twidth\theight\tdepth\tmtime\n", INDEX_SIGNATURE, INDEX_VERSION);
+
+    int indexed = 0;
+    for (int i = 0; i < count; ++i) {
+        t_bmp_probe info;
+        if (bmp_probe(files[i], &info) != 0) {
+            instr_warning("Warning: Skipping %s (not a supported BMP).\n", files[i]);
+            continue;
+        }
+        index_writePath(out, files[i]);
+        fprintf(out, "\t%" PRIu64 "\t%d\t%d\t%d\t%" PRId64 "\n",
+                info.fileSize, info.width, info.height, info.colorDepth, info.mtime);
+        indexed++;
+    }
+
+    int failed = ferror(out);
+    fclose(out);
+    free_file_list(files, count);
+    if (failed) {
+        instr_error("Error: Failed to write index %s.\n", indexPath);
+        return -1;
+    }
+    instr_info("Indexed %d of %d files into %s.\n", indexed, count, indexPath);
+    return indexed;
+}
+
+t_bmp_indexEntry *bmp_readIndex(const char *indexPath, int *count) {
+    if (!indexPath || !count) return NULL;
+    *count = 0;
+
+    FILE *in = fopen(indexPath, "r");
+    if (!in) {
+        instr_error("Error: Cannot open file %s\n", indexPath);
+        return NULL;
+    }
+
+    char line[INDEX_LINE_MAX];
+    int version = 0;
+    if (!fgets(line, sizeof(line), in) || strncmp(line, INDEX_SIGNATURE, strlen(INDEX_SIGNATURE)) != 0 ||
+        sscanf(line + strlen(INDEX_SIGNATURE), "%d", &version) != 1 || version < 1 || version > INDEX_VERSION) {
+        instr_error("Error: %s is not an image index.\n", indexPath);
+        fclose(in);
+        return NULL;
+    }
+
+    int capacity = 64;
+    t_bmp_indexEntry *entries = (t_bmp_indexEntry *)malloc(capacity * sizeof(t_bmp_indexEntry));
+    if (!entries) {
+        instr_error("Error: Failed to allocate memory for index entries.\n");
+        fclose(in);
+        return NULL;
+    }
+
+    int outOfMemory = 0;
+    while (fgets(line, sizeof(line), in)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char *tab = strchr(line, '\t');
+        if (!tab) continue;
+        *tab = '\0';
+        if (version >= 2 && index_unescapePath(line) != 0) {
+            instr_warning("Warning: Ignoring index line with a malformed path %s.\n", line);
+            continue;
+        }
+
+        t_bmp_probe info;
+        memset(&info, 0, sizeof(info));
+        if (sscanf(tab + 1, "%" SCNu64 "\t%d\t%d\t%d\t%" SCNd64, &info.fileSize, &info.width, &info.height,
+                   &info.colorDepth, &info.mtime) != 5) {
+            instr_warning("Warning: Ignoring malformed index line for %s.\n", line);
+            continue;
+        }
+        if (*count == capacity) {
+            t_bmp_indexEntry *grown = (t_bmp_indexEntry *)realloc(entries, 2 * capacity * sizeof(t_bmp_indexEntry));
+            if (!grown) {
+                outOfMemory = 1;
+                break;
+            }
+            entries = grown;
+            capacity *= 2;
+        }
+        entries[*count].path = (char *)malloc(strlen(line) + 1);
+        if (!entries[*count].path) {
+            outOfMemory = 1;
+            break;
+        }
+        strcpy(entries[*count].path, line);
+        entries[*count].info = info;
+        (*count)++;
+    }
+
+    fclose(in);
+    // A truncated index would silently drop files, so running out of memory fails the whole read.
+    if (outOfMemory) {
+        instr_error("Error: Failed to allocate memory for index entries of %s.\n", indexPath);
+        bmp_freeIndex(entries, *count);
+        *count = 0;
+        return NULL;
+    }
+    return entries;
+}
+
+void bmp_freeIndex(t_bmp_indexEntry *entries, int count) {
+    if (!entries) return;
+    for (int i = 0; i < count; ++i) free(entries[i].path);
+    free(entries);
+}
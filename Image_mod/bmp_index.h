@@ -0,0 +1,36 @@
+#ifndef BMP_INDEX_H
+#define BMP_INDEX_H
+
+#include <stdint.h>
+
+// Defines what a header-only probe learns about a BMP file without touching its pixel data.
+typedef struct {
+    int width;
+    int height;
+    int colorDepth;
+    uint32_t dataOffset;
+    uint64_t fileSize;
+    int64_t mtime;
+} t_bmp_probe;
+
+// Defines one line of a collection index.
+typedef struct {
+    char *path;
+    t_bmp_probe info;
+} t_bmp_indexEntry;
+
+// Function bmp_probe is needed to read and validate only the 54-byte header of an 8-bit or 24-bit BMP.
+// Returns 0 on success, -1 if the file cannot be read or is not a supported uncompressed BMP.
+int bmp_probe(const char *filename, t_bmp_probe *info);
+
+// Function bmp_buildIndex is needed to probe every .bmp of a directory and write a compact tab-separated index
+// (path, size, width, height, depth, mtime). Backslash, tab, newline and carriage return in a path are escaped as
+// \\, \t, \n and \r. Returns the number of indexed files or -1 on error.
+int bmp_buildIndex(const char *directory, const char *indexPath);
+
+// Function bmp_readIndex is needed to load an index written by bmp_buildIndex (count receives the number of entries).
+// Returns NULL if the file cannot be read, is not an index, or does not fit in memory.
+t_bmp_indexEntry *bmp_readIndex(const char *indexPath, int *count);
+void bmp_freeIndex(t_bmp_indexEntry *entries, int count);
+
+#endif // BMP_INDEX_H
@@ -0,0 +1,325 @@
+// bmp_mapped.c
+#include "bmp_mapped.h"
+#include "utils.h"
+#include "instrument.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BMP_MAPPED_SUPPORTED 1
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+#define MAPPED_HEADER_SIZE 54
+#define MAPPED_COLOR_TABLE_SIZE 1024
+
+#ifdef BMP_MAPPED_SUPPORTED
+
+// Closes and deletes a file mapped_create could not finish, so no empty or preallocated file is left behind.
+static void mapped_abandon(t_bmp_mappedWriter *writer, const char *filename) {
+    close(writer->fd);
+    unlink(filename);
+    free(writer);
+}
+
+// Creates the file at its final size, reserves its blocks and maps it. Running out of disk space is reported
+// here by posix_fallocate rather than as a SIGBUS in the middle of a filter.
+static t_bmp_mappedWriter *mapped_create(const char *filename, int colorDepth, int width, int height,
+                                         size_t rowStride, uint64_t dataOffset) {
+    if (width <= 0 || height <= 0) {
+        instr_error("Error: Invalid dimensions %dx%d for mapped output.\n", width, height);
+        return NULL;
+    }
+    size_t dataSize;
+    if (checked_mul_size(rowStride, (size_t)height, &dataSize) != 0 || dataSize > SIZE_MAX - dataOffset) {
+        instr_error("Error: Image dimensions %dx%d are too large.\n", width, height);
+        return NULL;
+    }
+
+    t_bmp_mappedWriter *writer = (t_bmp_mappedWriter *)malloc(sizeof(t_bmp_mappedWriter));
+    if (!writer) {
+        instr_error("Error: Cannot allocate memory for mapped writer.\n");
+        return NULL;
+    }
+    writer->colorDepth = colorDepth;
+    writer->width = width;
+    writer->height = height;
+    writer->rowStride = rowStride;
+    writer->dataOffset = dataOffset;
+    writer->fileSize = dataOffset + dataSize;
+
+    writer->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        instr_error("Error: Cannot open file %s for writing.\n", filename);
+        free(writer);
+        return NULL;
+    }
+    if (ftruncate(writer->fd, (off_t)writer->fileSize) != 0) {
+        instr_error("Error: Cannot resize %s to %llu bytes.\n", filename, (unsigned long long)writer->fileSize);
+        mapped_abandon(writer, filename);
+        return NULL;
+    }
+#ifdef __linux__
+    int ret = posix_fallocate(writer->fd, 0, (off_t)writer->fileSize);
+    if (ret != 0 && ret != EOPNOTSUPP && ret != EINVAL) { // Some file systems cannot preallocate; ftruncate is enough there.
+        instr_error("Error: Cannot reserve %llu bytes for %s.\n", (unsigned long long)writer->fileSize, filename);
+        mapped_abandon(writer, filename);
+        return NULL;
+    }
+#endif
+    writer->map = (unsigned char *)mmap(NULL, (size_t)writer->fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+    if (writer->map == MAP_FAILED) {
+        instr_error("Error: Cannot map %s.\n", filename);
+        mapped_abandon(writer, filename);
+        return NULL;
+    }
+    return writer;
+}
+
+#endif // BMP_MAPPED_SUPPORTED
+
+
+t_bmp_mappedWriter *bmp_mappedWriter_open24(const char *filename, int width, int height) {
+#ifdef BMP_MAPPED_SUPPORTED
+    t_bmp_mappedWriter *writer = mapped_create(filename, 24, width, height, calculate_row_stride(width), DEFAULT_OFFSET);
+    if (!writer) return NULL;
+
+    t_bmp_header header;
+    t_bmp_info info;
+    memset(&header, 0, sizeof(header));
+    memset(&info, 0, sizeof(info));
+    uint64_t imageSize = writer->fileSize - writer->dataOffset;
+    header.type = BITMAP_MAGIC;
+    header.size = writer->fileSize <= UINT32_MAX ? (uint32_t)writer->fileSize : 0;
+    header.offset = DEFAULT_OFFSET;
+    info.size = BMP_INFOHEADER_SIZE;
+    info.width = width;
+    info.height = height;
+    info.planes = 1;
+    info.bits = 24;
+    info.compression = NO_COMPRESSION;
+    info.imagesize = imageSize <= UINT32_MAX ? (uint32_t)imageSize : 0;
+    memcpy(writer->map, &header, sizeof(header));
+    memcpy(writer->map + sizeof(header), &info, sizeof(info));
+    return writer;
+#else
+    (void)width; (void)height;
+    instr_error("Error: Mapped output is not supported on this platform (%s).\n", filename);
+    return NULL;
+#endif
+}
+
+t_bmp_mappedWriter *bmp_mappedWriter_open8(const char *filename, int width, int height,
+                                           const unsigned char *header, const unsigned char *colorTable) {
+#ifdef BMP_MAPPED_SUPPORTED
+    // 8-bit data is stored unpadded (width * height), the layout bmp8_loadImage/bmp8_saveImage use.
+    t_bmp_mappedWriter *writer = mapped_create(filename, 8, width, height, (size_t)width,
+                                               MAPPED_HEADER_SIZE + MAPPED_COLOR_TABLE_SIZE);
+    if (!writer) return NULL;
+
+    uint64_t imageSize = writer->fileSize - writer->dataOffset;
+    t_bmp_header fileHeader;
+    t_bmp_info info;
+    if (header) {
+        memcpy(&fileHeader, header, sizeof(fileHeader));
+        memcpy(&info, header + sizeof(fileHeader), sizeof(info));
+    } else {
+        memset(&fileHeader, 0, sizeof(fileHeader));
+        memset(&info, 0, sizeof(info));
+        fileHeader.type = BITMAP_MAGIC;
+        info.size = BMP_INFOHEADER_SIZE;
+        info.width = width;
+        info.height = height;
+        info.planes = 1;
+        info.bits = 8;
+        info.compression = NO_COMPRESSION;
+        info.ncolors = 256;
+    }
+    fileHeader.size = writer->fileSize <= UINT32_MAX ? (uint32_t)writer->fileSize : 0;
+    fileHeader.offset = (uint32_t)writer->dataOffset;
+    info.imagesize = imageSize <= UINT32_MAX ? (uint32_t)imageSize : 0;
+    memcpy(writer->map, &fileHeader, sizeof(fileHeader));
+    memcpy(writer->map + sizeof(fileHeader), &info, sizeof(info));
+
+    unsigned char *table = writer->map + MAPPED_HEADER_SIZE;
+    if (colorTable) {
+        memcpy(table, colorTable, MAPPED_COLOR_TABLE_SIZE);
+    } else {
+        for (int i = 0; i < 256; ++i) {
+            table[i * 4 + 0] = (unsigned char)i;
+            table[i * 4 + 1] = (unsigned char)i;
+            table[i * 4 + 2] = (unsigned char)i;
+            table[i * 4 + 3] = 0;
+        }
+    }
+    return writer;
+#else
+    (void)width; (void)height; (void)header; (void)colorTable;
+    instr_error("Error: Mapped output is not supported on this platform (%s).\n", filename);
+    return NULL;
+#endif
+}
+
+// 24-bit files store rows bottom-up; the 8-bit layout keeps t_bmp8 data order.
+static uint64_t mapped_fileRow(const t_bmp_mappedWriter *writer, int y) {
+    return writer->colorDepth == 24 ? (uint64_t)(writer->height - 1 - y) : (uint64_t)y;
+}
+
+unsigned char *bmp_mappedWriter_row(t_bmp_mappedWriter *writer, int y) {
+    if (!writer || y < 0 || y >= writer->height) return NULL;
+    return writer->map + writer->dataOffset + mapped_fileRow(writer, y) * writer->rowStride;
+}
+
+int bmp_mappedWriter_flushRows(t_bmp_mappedWriter *writer, int y0, int y1) {
+#ifdef BMP_MAPPED_SUPPORTED
+    if (!writer) return -1;
+    if (y0 < 0) y0 = 0;
+    if (y1 > writer->height) y1 = writer->height;
+    if (y0 >= y1) return 0;
+
+    uint64_t firstRow = mapped_fileRow(writer, y0);
+    uint64_t lastRow = mapped_fileRow(writer, y1 - 1);
+    if (firstRow > lastRow) {
+        uint64_t tmp = firstRow; firstRow = lastRow; lastRow = tmp;
+    }
+    uint64_t start = writer->dataOffset + firstRow * writer->rowStride;
+    uint64_t end = writer->dataOffset + (lastRow + 1) * writer->rowStride;
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    start -= start % page; // msync needs a page-aligned address
+    trace_beginIndexed("io", "msync", y0);
+    int ret = msync(writer->map + start, (size_t)(end - start), MS_ASYNC);
+    trace_end("io", "msync");
+    return ret;
+#else
+    (void)y0; (void)y1;
+    return writer ? 0 : -1;
+#endif
+}
+
+int bmp_mappedWriter_close(t_bmp_mappedWriter *writer) {
+    if (!writer) return -1;
+    int ret = 0;
+#ifdef BMP_MAPPED_SUPPORTED
+    trace_begin("io", "msync");
+    if (msync(writer->map, (size_t)writer->fileSize, MS_SYNC) != 0) ret = -1;
+    trace_end("io", "msync");
+    if (munmap(writer->map, (size_t)writer->fileSize) != 0) ret = -1;
+    if (close(writer->fd) != 0) ret = -1;
+#endif
+    free(writer);
+    return ret;
+}
+
+
+int bmp8_saveImageMapped(const char *filename, t_bmp8 *img) {
+    if (!img || !img->data) {
+        instr_error("Error: Cannot save NULL or invalid image.\n");
+        return -1;
+    }
+#ifndef BMP_MAPPED_SUPPORTED
+    // bmp8_saveImage reports failures through instr_error only.
+    unsigned long errorsBefore = instr_errorCount();
+    bmp8_saveImage(filename, img);
+    return instr_errorCount() == errorsBefore ? 0 : -1;
+#else
+    t_bmp_mappedWriter *writer = bmp_mappedWriter_open8(filename, (int)img->width, (int)img->height, img->header, img->colorTable);
+    if (!writer) return -1;
+    memcpy(bmp_mappedWriter_row(writer, 0), img->data, img->dataSize);
+    if (bmp_mappedWriter_close(writer) != 0) {
+        instr_error("Error: Failed to write pixel data to %s.\n", filename);
+        remove(filename); // the file has its full size but not all of its pixels
+        return -1;
+    }
+    instr_info("Image saved successfully as %s.\n", filename);
+    return 0;
+#endif
+}
+
+int bmp24_saveImageMapped(const char *filename, t_bmp24 *img) {
+    if (!img || !img->data) {
+        instr_error("Error: Cannot save NULL or invalid image data.\n");
+        return -1;
+    }
+#ifndef BMP_MAPPED_SUPPORTED
+    unsigned long errorsBefore = instr_errorCount();
+    bmp24_saveImage(filename, img);
+    return instr_errorCount() == errorsBefore ? 0 : -1;
+#else
+    t_bmp_mappedWriter *writer = bmp_mappedWriter_open24(filename, img->width, img->height);
+    if (!writer) return -1;
+    // A t_pixel row is already in file byte order (BGR); padding bytes stay zero from ftruncate.
+    for (int y = 0; y < img->height; ++y) {
+        memcpy(bmp_mappedWriter_row(writer, y), img->data[y], (size_t)img->width * sizeof(t_pixel));
+    }
+    if (bmp_mappedWriter_close(writer) != 0) {
+        instr_error("Error: Failed to write pixel data to %s.\n", filename);
+        remove(filename); // the file has its full size but not all of its pixels
+        return -1;
+    }
+    instr_info("Image saved successfully as %s.\n", filename);
+    return 0;
+#endif
+}
+
+
+int bmp8_applyFilterToFile(t_bmp8 *img, float **kernel, int kernelSize, const char *filename) {
+    if (!img || !img->data || !kernel || kernelSize <= 0 || kernelSize % 2 == 0) {
+        instr_error("Error: Invalid arguments for applyFilterToFile (8-bit).\n");
+        return -1;
+    }
+    t_bmp_mappedWriter *writer = bmp_mappedWriter_open8(filename, (int)img->width, (int)img->height, img->header, img->colorTable);
+    if (!writer) return -1;
+
+    for (int y0 = 0; y0 < writer->height; y0 += MAPPED_FLUSH_ROWS) {
+        int y1 = y0 + MAPPED_FLUSH_ROWS < writer->height ? y0 + MAPPED_FLUSH_ROWS : writer->height;
+        trace_beginIndexed("band", "filter band", y0);
+        for (int y = y0; y < y1; ++y) {
+            bmp8_convolveRow(img->data, img->width, img->height, (unsigned int)y, kernel, kernelSize,
+                             bmp_mappedWriter_row(writer, y));
+        }
+        trace_end("band", "filter band");
+        bmp_mappedWriter_flushRows(writer, y0, y1);
+    }
+
+    if (bmp_mappedWriter_close(writer) != 0) {
+        instr_error("Error: Failed to write pixel data to %s.\n", filename);
+        remove(filename); // the file has its full size but not all of its pixels
+        return -1;
+    }
+    instr_info("Applied %dx%d filter (8-bit) into %s.\n", kernelSize, kernelSize, filename);
+    return 0;
+}
+
+int bmp24_applyFilterToFile(t_bmp24 *img, float **kernel, int kernelSize, const char *filename) {
+    if (!img || !img->data || !kernel || kernelSize <= 0 || kernelSize % 2 == 0) {
+        instr_error("Error: Invalid arguments for applyFilterToFile (24-bit).\n");
+        return -1;
+    }
+    t_bmp_mappedWriter *writer = bmp_mappedWriter_open24(filename, img->width, img->height);
+    if (!writer) return -1;
+
+    for (int y0 = 0; y0 < writer->height; y0 += MAPPED_FLUSH_ROWS) {
+        int y1 = y0 + MAPPED_FLUSH_ROWS < writer->height ? y0 + MAPPED_FLUSH_ROWS : writer->height;
+        trace_beginIndexed("band", "filter band", y0);
+        for (int y = y0; y < y1; ++y) {
+            bmp24_convolveRow(img->data, img->width, img->height, y, kernel, kernelSize,
+                              (t_pixel *)bmp_mappedWriter_row(writer, y));
+        }
+        trace_end("band", "filter band");
+        bmp_mappedWriter_flushRows(writer, y0, y1);
+    }
+
+    if (bmp_mappedWriter_close(writer) != 0) {
+        instr_error("Error: Failed to write pixel data to %s.\n", filename);
+        remove(filename); // the file has its full size but not all of its pixels
+        return -1;
+    }
+    instr_info("Applied %dx%d filter (24-bit) into %s.\n", kernelSize, kernelSize, filename);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef BMP_MAPPED_H
+#define BMP_MAPPED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Rows written through a mapped writer are flushed to disk in bands of this many rows.
+#define MAPPED_FLUSH_ROWS 64
+
+// Defines a BMP file that is preallocated and memory-mapped so pixel rows can be written in place.
+typedef struct {
+    int colorDepth;
+    int width;
+    int height;
+    size_t rowStride;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+    unsigned char *map;
+    int fd;
+} t_bmp_mappedWriter;
+
+// Function bmp_mappedWriter_open24 is needed to create, preallocate and map a 24-bit BMP; the headers are written immediately.
+t_bmp_mappedWriter *bmp_mappedWriter_open24(const char *filename, int width, int height);
+
+// Function bmp_mappedWriter_open8 is needed to do the same for an 8-bit BMP. header (54 bytes) and colorTable (1024 bytes)
+// are copied from an existing image when given; otherwise a fresh header and a grayscale palette are written.
+t_bmp_mappedWriter *bmp_mappedWriter_open8(const char *filename, int width, int height,
+                                           const unsigned char *header, const unsigned char *colorTable);
+
+// Function bmp_mappedWriter_row returns where row y of the image lives in the file, in the same row order as the
+// image's data (top-down t_pixel rows for 24-bit, t_bmp8 data order for 8-bit).
+unsigned char *bmp_mappedWriter_row(t_bmp_mappedWriter *writer, int y);
+
+// Function bmp_mappedWriter_flushRows starts writing back rows [y0, y1) with an msync of just their byte range.
+int bmp_mappedWriter_flushRows(t_bmp_mappedWriter *writer, int y0, int y1);
+
+// Function bmp_mappedWriter_close syncs whatever is left, unmaps and closes the file. Returns 0 on success.
+int bmp_mappedWriter_close(t_bmp_mappedWriter *writer);
+
+// Save helpers: write an image through a mapped file instead of stdio. Return 0 on success; on failure the output
+// file is removed.
+int bmp8_saveImageMapped(const char *filename, t_bmp8 *img);
+int bmp24_saveImageMapped(const char *filename, t_bmp24 *img);
+
+// Filter helpers: convolve img and write the result straight into the mapped output file, band by band.
+// img itself is left untouched, so no intermediate copy of the image is made. Return 0 on success; on failure the
+// output file is removed.
+int bmp8_applyFilterToFile(t_bmp8 *img, float **kernel, int kernelSize, const char *filename);
+int bmp24_applyFilterToFile(t_bmp24 *img, float **kernel, int kernelSize, const char *filename);
+
+#endif // BMP_MAPPED_H
@@ -0,0 +1,473 @@
+// cpu_dispatch.c
+#include "cpu_dispatch.h"
+#include "simd_kernels.h"
+#include "instrument.h"
+#include "utils.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(IMAGE_MOD_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#elif defined(IMAGE_MOD_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static const char *g_levelNames[CPU_LEVEL_COUNT] = { "scalar", "sse2", "ssse3", "avx2", "avx512" };
+
+static pthread_once_t g_dispatchOnce = PTHREAD_ONCE_INIT;
+static t_cpu_kernels g_tables[CPU_LEVEL_COUNT];
+static t_cpu_level g_detected = CPU_SCALAR;
+static const t_cpu_kernels *volatile g_active = &g_tables[CPU_SCALAR];
+static volatile t_cpu_level g_activeLevel = CPU_SCALAR;
+
+
+// ---- Scalar reference kernels: the loops the ops had before dispatch, unchanged. ----
+
+void scalar_negate(unsigned char *data, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        data[i] = 255 - data[i];
+    }
+}
+
+void scalar_addSaturate(unsigned char *data, size_t n, int value) {
+    for (size_t i = 0; i < n; ++i) {
+        int newValue = (int)data[i] + value;
+        if (newValue < 0) newValue = 0;
+        if (newValue > 255) newValue = 255;
+        data[i] = (unsigned char)newValue;
+    }
+}
+
+void scalar_threshold(unsigned char *data, size_t n, int threshold) {
+    for (size_t i = 0; i < n; ++i) {
+        data[i] = (data[i] >= threshold) ? 255 : 0;
+    }
+}
+
+void scalar_lut(unsigned char *data, size_t n, const unsigned char *table) {
+    for (size_t i = 0; i < n; ++i) {
+        data[i] = table[data[i]];
+    }
+}
+
+void scalar_histogram(const unsigned char *data, size_t n, unsigned int *hist) {
+    for (size_t i = 0; i < n; ++i) {
+        hist[data[i]]++;
+    }
+}
+
+void scalar_convolve8(const unsigned char *const *rows, const float *weights, int kernelSize,
+                      size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    for (size_t x = x0; x < x1; ++x) {
+        float sum = 0.0f;
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                sum += rows[ky][x + kx - n] * weights[ky * kernelSize + kx];
+            }
+        }
+        if (sum < 0.0f) sum = 0.0f;
+        if (sum > 255.0f) sum = 255.0f;
+        dst[x] = (unsigned char)round(sum);
+    }
+}
+
+void scalar_convolve24(const unsigned char *const *rows, const float *weights, int kernelSize,
+                       size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    for (size_t x = x0; x < x1; ++x) {
+        double sum = 0.0;
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                sum += rows[ky][x + (size_t)kx * 3 - (size_t)n * 3] * weights[ky * kernelSize + kx];
+            }
+        }
+        dst[x] = clamp_u8(sum);
+    }
+}
+
+void scalar_grayscale24(t_pixel *row, size_t n) {
+    for (size_t x = 0; x < n; ++x) {
+        uint16_t sum = row[x].red + row[x].green + row[x].blue;
+        uint8_t avg = (uint8_t)(sum / 3);
+        row[x].red = avg;
+        row[x].green = avg;
+        row[x].blue = avg;
+    }
+}
+
+void scalar_rgbToYuv(const t_pixel *src, size_t n, uint8_t *y, double *u, double *v) {
+    for (size_t x = 0; x < n; ++x) {
+        t_yuv yuv = rgb_to_yuv(src[x]);
+        y[x] = clamp_u8(yuv.y);
+        u[x] = yuv.u;
+        v[x] = yuv.v;
+    }
+}
+
+void scalar_yuvToRgb(const uint8_t *y, const unsigned int *yMap, const double *u, const double *v,
+                     size_t n, t_pixel *dst) {
+    for (size_t x = 0; x < n; ++x) {
+        t_yuv yuv = { (double)yMap[y[x]], u[x], v[x] };
+        dst[x] = yuv_to_rgb(yuv);
+    }
+}
+
+void scalar_resizeH(const unsigned char *src, size_t srcWidth, int channels, const int32_t *start,
+                    const int16_t *weights, int taps, size_t n, unsigned char *dst) {
+    (void)srcWidth;
+    for (size_t i = 0; i < n; ++i) {
+        const int16_t *w = weights + i * (size_t)taps;
+        const unsigned char *p = src + (size_t)start[i] * channels;
+        for (int c = 0; c < channels; ++c) {
+            int32_t sum = 0;
+            for (int k = 0; k < taps; ++k) sum += (int32_t)p[k * channels + c] * w[k];
+            dst[i * channels + c] = resize_round(sum);
+        }
+    }
+}
+
+void scalar_resizeV(const unsigned char *const *rows, const int16_t *weights, int taps, size_t n, unsigned char *dst) {
+    for (size_t x = 0; x < n; ++x) {
+        int32_t sum = 0;
+        for (int k = 0; k < taps; ++k) sum += (int32_t)rows[k][x] * weights[k];
+        dst[x] = resize_round(sum);
+    }
+}
+
+void scalar_pyramidV(const unsigned char *const *rows, int binomial, size_t n, uint16_t *dst) {
+    for (size_t x = 0; x < n; ++x) {
+        if (binomial) dst[x] = (uint16_t)(rows[0][x] + 4 * rows[1][x] + 6 * rows[2][x] + 4 * rows[3][x] + rows[4][x]);
+        else dst[x] = (uint16_t)(rows[0][x] + rows[1][x]);
+    }
+}
+
+void scalar_pyramidH8(const uint16_t *src, size_t width, int binomial, unsigned char *dst) {
+    pyramid_reduceH(src, width, 1, binomial, 0, (width + 1) / 2, dst);
+}
+
+void scalar_pyramidH24(const uint16_t *src, size_t width, int binomial, unsigned char *dst) {
+    pyramid_reduceH(src, width, 3, binomial, 0, (width + 1) / 2, dst);
+}
+
+void scalar_transposeTile8(const unsigned char *const *src, size_t srcX, unsigned char *const *dst, size_t dstX) {
+    for (int i = 0; i < CPU_TILE8; ++i) {
+        for (int j = 0; j < CPU_TILE8; ++j) dst[i][dstX + j] = src[j][srcX + i];
+    }
+}
+
+void scalar_transposeTile24(const unsigned char *const *src, size_t srcX, unsigned char *const *dst, size_t dstX) {
+    for (int i = 0; i < CPU_TILE24; ++i) {
+        for (int j = 0; j < CPU_TILE24; ++j) memcpy(dst[i] + (dstX + j) * 3, src[j] + (srcX + i) * 3, 3);
+    }
+}
+
+void scalar_reverse8(unsigned char *row, size_t n) {
+    for (size_t i = 0, j = n; i + 1 < j; ++i) {
+        --j;
+        unsigned char t = row[i];
+        row[i] = row[j];
+        row[j] = t;
+    }
+}
+
+void scalar_reverse24(unsigned char *row, size_t n) {
+    for (size_t i = 0, j = n; i + 1 < j; ++i) {
+        --j;
+        unsigned char t[3];
+        memcpy(t, row + i * 3, 3);
+        memcpy(row + i * 3, row + j * 3, 3);
+        memcpy(row + j * 3, t, 3);
+    }
+}
+
+void scalar_localThreshold(const unsigned char *src, size_t n, const uint32_t *sums, const uint64_t *squares,
+                           size_t window, const t_cpu_threshold *params, unsigned char *dst) {
+    for (size_t i = 0; i < n; ++i) {
+        double sum = (double)(uint32_t)(sums[i + window] - sums[i]);
+        double squareSum = (double)(int64_t)(squares[i + window] - squares[i]);
+        double spread = params->count * squareSum - sum * sum;
+        double a = params->scale * ((double)src[i] * params->count - sum * params->meanWeight);
+        double b = params->offset + params->slope * sum, bound = b * b * spread;
+        int white = params->positive ? a >= 0.0 && a * a >= bound : a >= 0.0 || a * a <= bound;
+        dst[i] = white ? 255 : 0;
+    }
+}
+
+static unsigned char scalar_min(unsigned char a, unsigned char b) { return a < b ? a : b; }
+static unsigned char scalar_max(unsigned char a, unsigned char b) { return a > b ? a : b; }
+
+// Sorts each column of three, then takes the median of the largest low, the median middle and the smallest high.
+void scalar_median3(const unsigned char *const *rows, size_t step, size_t n, unsigned char *dst) {
+    const unsigned char *left[3] = { rows[0] - step, rows[1] - step, rows[2] - step };
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char low[3], mid[3], high[3];
+        for (int d = 0; d < 3; ++d) {
+            size_t at = i + (size_t)d * step;
+            unsigned char a = left[0][at], b = left[1][at], c = left[2][at];
+            unsigned char t = scalar_min(a, b), u = scalar_max(a, b);
+            low[d] = scalar_min(t, c);
+            t = scalar_max(t, c);
+            mid[d] = scalar_min(u, t);
+            high[d] = scalar_max(u, t);
+        }
+        unsigned char lo = scalar_max(scalar_max(low[0], low[1]), low[2]);
+        unsigned char hi = scalar_min(scalar_min(high[0], high[1]), high[2]);
+        unsigned char me = scalar_max(scalar_min(mid[0], mid[1]), scalar_min(scalar_max(mid[0], mid[1]), mid[2]));
+        dst[i] = scalar_max(scalar_min(lo, me), scalar_min(scalar_max(lo, me), hi));
+    }
+}
+
+void scalar_rowExtremum(const unsigned char *a, const unsigned char *b, size_t n, int maximum, unsigned char *dst) {
+    if (maximum) {
+        for (size_t i = 0; i < n; ++i) dst[i] = scalar_max(a[i], b[i]);
+    } else {
+        for (size_t i = 0; i < n; ++i) dst[i] = scalar_min(a[i], b[i]);
+    }
+}
+
+void scalar_sobel(const unsigned char *const *rows, size_t n, int16_t *gx, int16_t *gy, int16_t *magnitude) {
+    const unsigned char *left[3] = { rows[0] - 1, rows[1] - 1, rows[2] - 1 };
+    const unsigned char *right[3] = { rows[0] + 1, rows[1] + 1, rows[2] + 1 };
+    for (size_t i = 0; i < n; ++i) {
+        int dx = (right[0][i] - left[0][i]) + 2 * (right[1][i] - left[1][i]) + (right[2][i] - left[2][i]);
+        int dy = (left[2][i] + 2 * rows[2][i] + right[2][i]) - (left[0][i] + 2 * rows[0][i] + right[0][i]);
+        gx[i] = (int16_t)dx;
+        gy[i] = (int16_t)dy;
+        magnitude[i] = (int16_t)((dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy));
+    }
+}
+
+void cpu_fillScalar(t_cpu_kernels *k) {
+    k->negate = scalar_negate;
+    k->addSaturate = scalar_addSaturate;
+    k->threshold = scalar_threshold;
+    k->lut = scalar_lut;
+    k->histogram = scalar_histogram;
+    k->convolve8 = scalar_convolve8;
+    k->convolve24 = scalar_convolve24;
+    k->grayscale24 = scalar_grayscale24;
+    k->rgbToYuv = scalar_rgbToYuv;
+    k->yuvToRgb = scalar_yuvToRgb;
+    k->resizeH = scalar_resizeH;
+    k->resizeV = scalar_resizeV;
+    k->pyramidV = scalar_pyramidV;
+    k->pyramidH8 = scalar_pyramidH8;
+    k->pyramidH24 = scalar_pyramidH24;
+    k->transposeTile8 = scalar_transposeTile8;
+    k->transposeTile24 = scalar_transposeTile24;
+    k->reverse8 = scalar_reverse8;
+    k->reverse24 = scalar_reverse24;
+    k->localThreshold = scalar_localThreshold;
+    k->median3 = scalar_median3;
+    k->rowExtremum = scalar_rowExtremum;
+    k->sobel = scalar_sobel;
+}
+
+
+int cpu_convBegin(t_conv_rows *conv, float **kernel, int kernelSize) {
+    conv->rows = conv->rowsStack;
+    conv->weights = conv->weightsStack;
+    if (kernelSize > CONV_STACK_KERNEL) {
+        conv->rows = (const unsigned char **)malloc((size_t)kernelSize * sizeof(*conv->rows));
+        conv->weights = (float *)malloc((size_t)kernelSize * kernelSize * sizeof(float));
+        if (!conv->rows || !conv->weights) {
+            instr_error("Error: Failed to allocate memory for a %dx%d kernel.\n", kernelSize, kernelSize);
+            cpu_convEnd(conv);
+            return -1;
+        }
+    }
+    for (int k = 0; k < kernelSize; ++k) {
+        memcpy(conv->weights + (size_t)k * kernelSize, kernel[k], (size_t)kernelSize * sizeof(float));
+    }
+    return 0;
+}
+
+void cpu_convEnd(t_conv_rows *conv) {
+    if (conv->rows != conv->rowsStack) free((void *)conv->rows);
+    if (conv->weights != conv->weightsStack) free(conv->weights);
+    conv->rows = conv->rowsStack;
+    conv->weights = conv->weightsStack;
+}
+
+
+// ---- Detection ----
+
+#ifdef IMAGE_MOD_SIMD_X86
+static void cpu_cpuid(unsigned int leaf, unsigned int sub, unsigned int regs[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)sub);
+    for (int i = 0; i < 4; ++i) regs[i] = (unsigned int)r[i];
+#else
+    __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// XCR0 tells which register states the OS saves on context switch (AVX needs YMM, AVX-512 also opmask/ZMM).
+static unsigned long long cpu_xgetbv(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+t_cpu_level cpu_detectLevel(void) {
+#ifdef IMAGE_MOD_SIMD_X86
+    unsigned int regs[4];
+    cpu_cpuid(0, 0, regs);
+    unsigned int maxLeaf = regs[0];
+    cpu_cpuid(1, 0, regs);
+    unsigned int ecx1 = regs[2], edx1 = regs[3];
+
+    t_cpu_level level = CPU_SCALAR;
+    if (!(edx1 & (1u << 26))) return level;            // SSE2
+    level = CPU_SSE2;
+    if (!(ecx1 & (1u << 9))) return level;             // SSSE3
+    level = CPU_SSSE3;
+
+    if (!(ecx1 & (1u << 27)) || maxLeaf < 7) return level;   // OSXSAVE
+    unsigned long long xcr0 = cpu_xgetbv();
+    if ((xcr0 & 0x6) != 0x6) return level;             // XMM and YMM state
+    cpu_cpuid(7, 0, regs);
+    unsigned int ebx7 = regs[1];
+    if (!(ecx1 & (1u << 28)) || !(ebx7 & (1u << 5))) return level;   // AVX, AVX2
+    level = CPU_AVX2;
+    if ((xcr0 & 0xE0) != 0xE0) return level;           // opmask and ZMM state
+    if ((ebx7 & (1u << 16)) && (ebx7 & (1u << 30))) level = CPU_AVX512;   // AVX512F, AVX512BW
+    return level;
+#else
+    return CPU_SCALAR;
+#endif
+}
+
+void cpu_modelName(char *name, size_t size) {
+    if (!name || size == 0) return;
+    name[0] = '\0';
+#ifdef IMAGE_MOD_SIMD_X86
+    unsigned int regs[4];
+    cpu_cpuid(0x80000000u, 0, regs);
+    if (regs[0] >= 0x80000004u) {
+        char brand[49];
+        for (unsigned int i = 0; i < 3; ++i) {
+            cpu_cpuid(0x80000002u + i, 0, regs);
+            memcpy(brand + 16 * i, regs, 16);
+        }
+        brand[48] = '\0';
+        const char *start = brand;
+        while (*start == ' ') ++start;
+        snprintf(name, size, "%s", start);
+    }
+#endif
+    // Other architectures (and hypervisors that hide the brand string) name the CPU in /proc/cpuinfo.
+    FILE *f = name[0] == '\0' ? fopen("/proc/cpuinfo", "r") : NULL;
+    if (f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            const char *colon = strchr(line, ':');
+            if (colon && (strncmp(line, "model name", 10) == 0 || strncmp(line, "Hardware", 8) == 0 ||
+                          strncmp(line, "cpu model", 9) == 0)) {
+                ++colon;
+                while (*colon == ' ') ++colon;
+                snprintf(name, size, "%s", colon);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    if (name[0] == '\0') snprintf(name, size, "unknown");
+    // Trailing blanks, and the tabs and newlines that would break a line-based file, are removed.
+    size_t length = strlen(name);
+    for (size_t i = 0; i < length; ++i) {
+        if (name[i] == '\t' || name[i] == '\n' || name[i] == '\r') name[i] = ' ';
+    }
+    while (length > 0 && name[length - 1] == ' ') name[--length] = '\0';
+}
+
+#ifdef IMAGE_MOD_SIMD_X86
+// AVX512-VBMI is not a level of its own: it only upgrades the lut kernel of the AVX-512 table.
+static int cpu_hasVbmi(void) {
+    if (cpu_detectLevel() < CPU_AVX512) return 0;
+    unsigned int regs[4];
+    cpu_cpuid(7, 0, regs);
+    return (regs[2] & (1u << 1)) != 0;
+}
+#endif
+
+static void cpu_buildTables(void) {
+#ifdef IMAGE_MOD_SIMD_X86
+    int vbmi = cpu_hasVbmi();
+#endif
+    for (int level = 0; level < CPU_LEVEL_COUNT; ++level) {
+        t_cpu_kernels *k = &g_tables[level];
+        cpu_fillScalar(k);
+#ifdef IMAGE_MOD_SIMD_X86
+        if (level >= CPU_SSE2) cpu_fillSse2(k);
+        if (level >= CPU_SSSE3) cpu_fillSsse3(k);
+        if (level >= CPU_AVX2) cpu_fillAvx2(k);
+        if (level >= CPU_AVX512) cpu_fillAvx512(k);
+        if (level >= CPU_AVX512 && vbmi) cpu_fillAvx512Vbmi(k);
+#endif
+    }
+}
+
+static void cpu_init(void) {
+    cpu_buildTables();
+    g_detected = cpu_detectLevel();
+    t_cpu_level level = g_detected;
+
+    const char *env = getenv("IMAGE_MOD_SIMD");
+    t_cpu_level requested;
+    if (env != NULL && env[0] != '\0') {
+        if (cpu_parseLevel(env, &requested) != 0) {
+            instr_warning("Warning: Unknown IMAGE_MOD_SIMD value '%s', using %s.\n", env, g_levelNames[level]);
+        } else if (requested > g_detected) {
+            instr_warning("Warning: IMAGE_MOD_SIMD=%s is not supported by this CPU, using %s.\n", env, g_levelNames[level]);
+        } else {
+            level = requested;
+        }
+    }
+    g_activeLevel = level;
+    g_active = &g_tables[level];
+}
+
+const t_cpu_kernels *cpu_kernels(void) {
+    pthread_once(&g_dispatchOnce, cpu_init);
+    return g_active;
+}
+
+t_cpu_level cpu_getLevel(void) {
+    pthread_once(&g_dispatchOnce, cpu_init);
+    return g_activeLevel;
+}
+
+int cpu_setLevel(t_cpu_level level) {
+    pthread_once(&g_dispatchOnce, cpu_init);
+    if (level < CPU_SCALAR || level >= CPU_LEVEL_COUNT || level > g_detected) return -1;
+    g_activeLevel = level;
+    g_active = &g_tables[level];
+    return 0;
+}
+
+const char *cpu_levelName(t_cpu_level level) {
+    if (level < CPU_SCALAR || level >= CPU_LEVEL_COUNT) return "unknown";
+    return g_levelNames[level];
+}
+
+int cpu_parseLevel(const char *name, t_cpu_level *level) {
+    if (!name || !level) return -1;
+    for (int i = 0; i < CPU_LEVEL_COUNT; ++i) {
+        if (strcmp(name, g_levelNames[i]) == 0) {
+            *level = (t_cpu_level)i;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,143 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp24.h"
+
+// Instruction-set levels of the hot kernels, lowest first. Each level includes the ones below it.
+typedef enum {
+    CPU_SCALAR = 0,
+    CPU_SSE2,
+    CPU_SSSE3,
+    CPU_AVX2,
+    CPU_AVX512,
+    CPU_LEVEL_COUNT
+} t_cpu_level;
+
+// Defines the per-span constants of the localThreshold kernel.
+typedef struct {
+    double count;                  // pixels of each window
+    double scale;
+    double meanWeight;
+    double offset;
+    double slope;
+    int positive;                  // b >= 0 for every pixel
+} t_cpu_threshold;
+
+// Defines the kernels selected at startup. Every entry is set at every level; a level that has no
+// specialised version of a kernel keeps the one of the level below. All levels give bit-identical results.
+typedef struct {
+    // Point ops on a run of bytes (8-bit data, or the BGR bytes of a 24-bit row).
+    void (*negate)(unsigned char *data, size_t n);
+    void (*addSaturate)(unsigned char *data, size_t n, int value);
+    void (*threshold)(unsigned char *data, size_t n, int threshold);
+
+    // Maps every byte through a 256-entry table (fused point ops, see graph.c).
+    void (*lut)(unsigned char *data, size_t n, const unsigned char *table);
+
+    // Adds the value counts of data to hist (256 counters).
+    void (*histogram)(const unsigned char *data, size_t n, unsigned int *hist);
+
+    // Convolution of output positions [x0, x1) of one row. rows[k] is the source row k - kernelSize/2 lines
+    // away from the output row, weights is the kernel in row-major order. convolve8 works on 8-bit pixels with a
+    // float sum (as bmp8_applyFilter); convolve24 works on interleaved BGR bytes (positions are byte offsets)
+    // with float products summed in double (as bmp24_convolution_helper).
+    void (*convolve8)(const unsigned char *const *rows, const float *weights, int kernelSize,
+                      size_t x0, size_t x1, unsigned char *dst);
+    void (*convolve24)(const unsigned char *const *rows, const float *weights, int kernelSize,
+                       size_t x0, size_t x1, unsigned char *dst);
+
+    // Color conversion of n pixels: average grayscale in place, and RGB <-> YUV as used by bmp24_equalize
+    // (Y is stored rounded; on the way back Y goes through yMap).
+    void (*grayscale24)(t_pixel *row, size_t n);
+    void (*rgbToYuv)(const t_pixel *src, size_t n, uint8_t *y, double *u, double *v);
+    void (*yuvToRgb)(const uint8_t *y, const unsigned int *yMap, const double *u, const double *v,
+                     size_t n, t_pixel *dst);
+
+    // Resampling with fixed-point weights (CPU_RESIZE_BITS fraction bits, see resize.c). resizeH computes n output
+    // pixels of one row of srcWidth pixels: pixel i is the sum of taps source pixels from start[i], weighted by
+    // weights[i * taps ...]; channels is 1 or 3 and start[i] + taps <= srcWidth. resizeV computes n bytes of one
+    // output row as the sum of rows[k][x] * weights[k] over the taps rows.
+    void (*resizeH)(const unsigned char *src, size_t srcWidth, int channels, const int32_t *start,
+                    const int16_t *weights, int taps, size_t n, unsigned char *dst);
+    void (*resizeV)(const unsigned char *const *rows, const int16_t *weights, int taps, size_t n, unsigned char *dst);
+
+    // 2x reduction of an image pyramid (pyramid.c). pyramidV sums the bytes of 2 rows (box) or 5 rows with weights
+    // 1 4 6 4 1 (binomial) into dst. pyramidH8/24 reduce such a row of width pixels to (width + 1) / 2 pixels with
+    // the same weights (edge pixels repeated) and divide by the total weight, rounding.
+    void (*pyramidV)(const unsigned char *const *rows, int binomial, size_t n, uint16_t *dst);
+    void (*pyramidH8)(const uint16_t *src, size_t width, int binomial, unsigned char *dst);
+    void (*pyramidH24)(const uint16_t *src, size_t width, int binomial, unsigned char *dst);
+
+    // Rotation and flips (geometry.c). transposeTile8 copies a CPU_TILE8 x CPU_TILE8 block of bytes with
+    // dst[i][dstX + j] = src[j][srcX + i] (src and dst point at the first row of the block); transposeTile24 does the
+    // same for CPU_TILE24 x CPU_TILE24 BGR pixels, with x in pixels. reverse8/24 reverse the n pixels of a row in place.
+    void (*transposeTile8)(const unsigned char *const *src, size_t srcX, unsigned char *const *dst, size_t dstX);
+    void (*transposeTile24)(const unsigned char *const *src, size_t srcX, unsigned char *const *dst, size_t dstX);
+    void (*reverse8)(unsigned char *row, size_t n);
+    void (*reverse24)(unsigned char *row, size_t n);
+
+    // Local threshold of n pixels (threshold.c). The window of pixel i has the sum S = sums[i + window] - sums[i]
+    // (modulo 2^32) and the sum of squares Q = squares[i + window] - squares[i] (below 2^52), both converted to
+    // double exactly; with D = count Q - S^2, a = scale (p count - S meanWeight) and b = offset + slope S, dst[i] is
+    // 255 when a >= b sqrt(D) (tested on squares, b has the sign of positive) and 0 otherwise.
+    void (*localThreshold)(const unsigned char *src, size_t n, const uint32_t *sums, const uint64_t *squares,
+                           size_t window, const t_cpu_threshold *params, unsigned char *dst);
+
+    // 3x3 median of n bytes (median.c): dst[i] is the median of rows[k][i + d * step] for k = 0..2 and d = -1..1
+    // (step 1 for 8-bit rows, 3 for BGR ones), computed with min/max only.
+    void (*median3)(const unsigned char *const *rows, size_t step, size_t n, unsigned char *dst);
+
+    // Elementwise extremum of two rows (morph.c): dst[i] = max(a[i], b[i]) if maximum, else min. dst may be a or b.
+    void (*rowExtremum)(const unsigned char *a, const unsigned char *b, size_t n, int maximum, unsigned char *dst);
+
+    // Sobel gradients of n pixels (edges.c): rows[0..2] are the rows below, at and above (in memory), read at i - 1,
+    // i and i + 1. gx[i] is the right column minus the left one and gy[i] rows[2] minus rows[0], each weighted 1 2 1
+    // across; magnitude[i] = |gx[i]| + |gy[i]| (at most 2040).
+    void (*sobel)(const unsigned char *const *rows, size_t n, int16_t *gx, int16_t *gy, int16_t *magnitude);
+} t_cpu_kernels;
+
+// Block sizes of transposeTile8/24.
+#define CPU_TILE8 16
+#define CPU_TILE24 8
+
+// Fraction bits of the resampling weights: a weight of 1.0 is 1 << CPU_RESIZE_BITS and still fits an int16.
+#define CPU_RESIZE_BITS 14
+
+// Kernels up to this size are passed to the convolution kernels without a heap allocation.
+#define CONV_STACK_KERNEL 15
+
+// Defines the arguments of one convolve8/convolve24 call: the caller points rows[k] at its source rows.
+typedef struct {
+    const unsigned char **rows;
+    float *weights;
+    const unsigned char *rowsStack[CONV_STACK_KERNEL];
+    float weightsStack[CONV_STACK_KERNEL * CONV_STACK_KERNEL];
+} t_conv_rows;
+
+// Function cpu_convBegin is needed to flatten kernel into conv->weights. Returns -1 if a large kernel cannot be allocated.
+int cpu_convBegin(t_conv_rows *conv, float **kernel, int kernelSize);
+void cpu_convEnd(t_conv_rows *conv);
+
+// Function cpu_kernels returns the kernel table of the active level. The first call detects the CPU with cpuid;
+// IMAGE_MOD_SIMD=scalar|sse2|ssse3|avx2|avx512 caps the level (for benchmarking and testing each variant).
+const t_cpu_kernels *cpu_kernels(void);
+
+// Function cpu_detectLevel returns the highest level supported by this CPU and OS (and this build).
+t_cpu_level cpu_detectLevel(void);
+
+// Function cpu_modelName is needed to identify the machine (cpuid brand string, else /proc/cpuinfo, else "unknown").
+void cpu_modelName(char *name, size_t size);
+
+t_cpu_level cpu_getLevel(void);
+
+// Function cpu_setLevel switches the active level. Returns -1 if the CPU does not support it.
+int cpu_setLevel(t_cpu_level level);
+
+const char *cpu_levelName(t_cpu_level level);
+
+// Function cpu_parseLevel is needed to read a level name ("scalar", "sse2", ...). Returns 0 on success.
+int cpu_parseLevel(const char *name, t_cpu_level *level);
+
+#endif // CPU_DISPATCH_H
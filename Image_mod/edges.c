@@ -0,0 +1,247 @@
+// edges.c
+// Sobel gradients and the Canny edge detector. The sobel dispatch kernel computes gx, gy and |gx| + |gy| of a row in
+// one pass over its three source rows with 16-bit accumulators (|gx| and |gy| are at most 1020); the first and last
+// pixels, whose windows repeat the edge columns, are done here.
+// Each Canny pool task takes a band of rows and keeps the gradients of three rows, so the gradients, the non-maximum
+// suppression and the weak/strong classification run in one pass. The magnitude rows have a zero at both ends and
+// rows past the image are all zero, so the suppression needs no bounds test; the candidate map has a border of zeros
+// for the same reason. The hysteresis then grows the edges from every strong pixel with an explicit stack instead of
+// recursion, marking pixels as they are pushed, so no pixel is pushed twice.
+#include "edges.h"
+#include "cpu_dispatch.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EDGES_TAN22 13573          // tan(22.5 degrees) in Q15
+#define EDGES_MIN_BAND 16          // bands recompute the gradients of one row on each side
+#define EDGES_WEAK 1
+#define EDGES_STRONG 2
+#define EDGES_EDGE 255
+#define EDGES_STACK 4096
+
+// Defines one Sobel or Canny run on the rows of src (memory order).
+typedef struct {
+    const unsigned char *src;
+    unsigned char *dst;            // magnitudes (bmp8_sobel)
+    unsigned char *direction;      // sectors (bmp8_sobel), may be NULL
+    unsigned char *map;            // candidates with a border of zeros, (width + 2) x (height + 2) (bmp8_canny)
+    size_t width;
+    size_t height;
+    int low;
+    int high;
+    atomic_int failed;
+} t_edges_job;
+
+// Gradient of pixel x of rows (below, at, above), repeating the first and last columns.
+static void edges_gradientAt(const unsigned char *const *rows, size_t width, size_t x, int16_t *gx, int16_t *gy,
+                             int16_t *magnitude) {
+    size_t l = x > 0 ? x - 1 : 0, r = x + 1 < width ? x + 1 : width - 1;
+    int dx = (rows[0][r] - rows[0][l]) + 2 * (rows[1][r] - rows[1][l]) + (rows[2][r] - rows[2][l]);
+    int dy = (rows[2][l] + 2 * rows[2][x] + rows[2][r]) - (rows[0][l] + 2 * rows[0][x] + rows[0][r]);
+    gx[x] = (int16_t)dx;
+    gy[x] = (int16_t)dy;
+    magnitude[x] = (int16_t)((dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy));
+}
+
+// Gradients of row y, repeating the first and last rows.
+static void edges_gradientRow(const t_edges_job *job, const t_cpu_kernels *kernels, size_t y, int16_t *gx, int16_t *gy,
+                              int16_t *magnitude) {
+    size_t width = job->width;
+    const unsigned char *rows[3] = { job->src + (y > 0 ? y - 1 : 0) * width, job->src + y * width,
+                                     job->src + (y + 1 < job->height ? y + 1 : y) * width };
+    if (width > 2) {
+        const unsigned char *inner[3] = { rows[0] + 1, rows[1] + 1, rows[2] + 1 };
+        kernels->sobel(inner, width - 2, gx + 1, gy + 1, magnitude + 1);
+    }
+    edges_gradientAt(rows, width, 0, gx, gy, magnitude);
+    if (width > 1) edges_gradientAt(rows, width, width - 1, gx, gy, magnitude);
+}
+
+// Sector of a gradient (gy > 0 points up on display), without division: |gy| is compared with |gx| tan(22.5) and
+// |gx| tan(67.5) = |gx| (tan(22.5) + 2) in Q15. A zero gradient is horizontal.
+static unsigned char edges_sector(int gx, int gy) {
+    int ax = gx < 0 ? -gx : gx, ay = (gy < 0 ? -gy : gy) << 15, tan22 = ax * EDGES_TAN22;
+    if (ay <= tan22) return EDGES_HORIZONTAL;
+    if (ay > tan22 + (ax << 16)) return EDGES_VERTICAL;
+    return (gx < 0) == (gy < 0) ? EDGES_RISING : EDGES_FALLING;
+}
+
+static void edges_sobelRows(size_t begin, size_t end, void *userData) {
+    t_edges_job *job = (t_edges_job *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t width = job->width;
+    int16_t *gx = (int16_t *)malloc(3 * width * sizeof(int16_t));
+    if (!gx) {
+        atomic_store(&job->failed, 1);
+        return;
+    }
+    int16_t *gy = gx + width, *magnitude = gy + width;
+    for (size_t y = begin; y < end; ++y) {
+        edges_gradientRow(job, kernels, y, gx, gy, magnitude);
+        unsigned char *out = job->dst + y * width;
+        for (size_t x = 0; x < width; ++x) out[x] = magnitude[x] > 255 ? 255 : (unsigned char)magnitude[x];
+        if (job->direction) {
+            unsigned char *sector = job->direction + y * width;
+            for (size_t x = 0; x < width; ++x) sector[x] = edges_sector(gx[x], gy[x]);
+        }
+    }
+    free(gx);
+}
+
+// Classifies the rows [begin, end) into the map: local maxima across the edge above high are strong, those above low
+// weak. Row y keeps its gradients in slot (y + 1) % 3. Of two equal maxima along the gradient, the left (or lower)
+// one is kept.
+static void edges_cannyRows(size_t begin, size_t end, void *userData) {
+    t_edges_job *job = (t_edges_job *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t width = job->width, stride = width + 2, slot = 2 * width + stride;
+    int16_t *buffer = (int16_t *)calloc(3 * slot, sizeof(int16_t));
+    if (!buffer) {
+        atomic_store(&job->failed, 1);
+        return;
+    }
+    int16_t *gx[3], *gy[3], *magnitude[3];
+    for (int s = 0; s < 3; ++s) {
+        gx[s] = buffer + s * slot;
+        gy[s] = gx[s] + width;
+        magnitude[s] = gy[s] + width;
+    }
+    // The slot of row -1 stays zero.
+    if (begin > 0) edges_gradientRow(job, kernels, begin - 1, gx[begin % 3], gy[begin % 3], magnitude[begin % 3] + 1);
+    size_t first = (begin + 1) % 3;
+    edges_gradientRow(job, kernels, begin, gx[first], gy[first], magnitude[first] + 1);
+    for (size_t y = begin; y < end; ++y) {
+        size_t next = (y + 2) % 3, at = (y + 1) % 3;
+        const int16_t *below = magnitude[y % 3], *row = magnitude[at];
+        int16_t *above = magnitude[next];
+        if (y + 1 < job->height) edges_gradientRow(job, kernels, y + 1, gx[next], gy[next], above + 1);
+        else memset(above, 0, stride * sizeof(int16_t));
+        const int16_t *dx = gx[at], *dy = gy[at];
+        unsigned char *map = job->map + (y + 1) * stride + 1;
+        for (size_t x = 0; x < width; ++x) {
+            int m = row[x + 1], a, b;
+            if (m <= job->low) {
+                map[x] = 0;
+                continue;
+            }
+            switch (edges_sector(dx[x], dy[x])) {
+                case EDGES_HORIZONTAL: a = row[x]; b = row[x + 2]; break;
+                case EDGES_VERTICAL: a = below[x + 1]; b = above[x + 1]; break;
+                case EDGES_RISING: a = below[x]; b = above[x + 2]; break;
+                default: a = above[x]; b = below[x + 2]; break;
+            }
+            map[x] = m > a && m >= b ? (m > job->high ? EDGES_STRONG : EDGES_WEAK) : 0;
+        }
+    }
+    free(buffer);
+}
+
+// Marks every candidate connected to a strong pixel as an edge (8-connectivity). Returns -1 if the stack cannot grow.
+static int edges_hysteresis(unsigned char *map, size_t width, size_t height) {
+    size_t stride = width + 2, capacity = EDGES_STACK, count = 0;
+    size_t *stack = (size_t *)malloc(capacity * sizeof(size_t));
+    if (!stack) return -1;
+    const ptrdiff_t step = (ptrdiff_t)stride;
+    const ptrdiff_t offsets[8] = { -step - 1, -step, -step + 1, -1, 1, step - 1, step, step + 1 };
+    for (size_t y = 1; y <= height; ++y) {
+        for (size_t i = y * stride + 1; i <= y * stride + width; ++i) {
+            if (map[i] != EDGES_STRONG) continue;
+            map[i] = EDGES_EDGE;
+            stack[count++] = i;
+            while (count > 0) {
+                size_t p = stack[--count];
+                for (int k = 0; k < 8; ++k) {
+                    size_t q = (size_t)((ptrdiff_t)p + offsets[k]);
+                    if (map[q] != EDGES_WEAK && map[q] != EDGES_STRONG) continue;
+                    if (count == capacity) {
+                        size_t *grown = (size_t *)realloc(stack, 2 * capacity * sizeof(size_t));
+                        if (!grown) {
+                            free(stack);
+                            return -1;
+                        }
+                        stack = grown;
+                        capacity *= 2;
+                    }
+                    map[q] = EDGES_EDGE;
+                    stack[count++] = q;
+                }
+            }
+        }
+    }
+    free(stack);
+    return 0;
+}
+
+int bmp8_sobel(t_bmp8 *img, unsigned char *direction) {
+    if (!img || !img->data || img->width == 0 || img->height == 0) {
+        instr_error("Error: Invalid arguments for Sobel gradients (8-bit).\n");
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_sobel");
+    size_t dataSize = img->dataSize;
+    unsigned char *copy = (unsigned char *)malloc(dataSize);
+    if (!copy) {
+        instr_error("Error: Failed to allocate memory for Sobel gradients (8-bit).\n");
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_scratchAlloc(dataSize);
+    memcpy(copy, img->data, dataSize);
+    t_edges_job job = { copy, img->data, direction, NULL, img->width, img->height, 0, 0, 0 };
+    size_t bandRows = (size_t)tune_params()->bandRows;
+    pool_parallelFor(job.height, bandRows > EDGES_MIN_BAND ? bandRows : EDGES_MIN_BAND, edges_sobelRows, &job);
+    int status = atomic_load(&job.failed) ? -1 : 0;
+    if (status != 0) {
+        memcpy(img->data, copy, dataSize);
+        instr_error("Error: Failed to allocate Sobel rows (8-bit).\n");
+    }
+    free(copy);
+    instr_scratchFree(dataSize);
+    uint64_t bytes = (direction ? 3 : 2) * (uint64_t)dataSize;
+    instr_end(&span, status == 0 ? dataSize : 0, status == 0 ? bytes : 0);
+    if (status == 0) instr_info("Sobel gradient magnitude computed (8-bit).\n");
+    return status;
+}
+
+int bmp8_canny(t_bmp8 *img, int low, int high) {
+    if (!img || !img->data || img->width == 0 || img->height == 0 || low < 0 || high < low ||
+        high > EDGES_MAX_MAGNITUDE) {
+        instr_error("Error: Invalid arguments for Canny edges (thresholds %d and %d).\n", low, high);
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_canny");
+    size_t width = img->width, height = img->height, mapSize = (width + 2) * (height + 2);
+    unsigned char *map = (unsigned char *)calloc(mapSize, 1);
+    if (!map) {
+        instr_error("Error: Failed to allocate memory for Canny edges (8-bit).\n");
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_scratchAlloc(mapSize);
+    t_edges_job job = { img->data, NULL, NULL, map, width, height, low, high, 0 };
+    size_t bandRows = (size_t)tune_params()->bandRows;
+    pool_parallelFor(height, bandRows > EDGES_MIN_BAND ? bandRows : EDGES_MIN_BAND, edges_cannyRows, &job);
+    int status = atomic_load(&job.failed) || edges_hysteresis(map, width, height) != 0 ? -1 : 0;
+    if (status == 0) {
+        for (size_t y = 0; y < height; ++y) {
+            const unsigned char *src = map + (y + 1) * (width + 2) + 1;
+            unsigned char *dst = img->data + y * width;
+            for (size_t x = 0; x < width; ++x) dst[x] = src[x] == EDGES_EDGE ? 255 : 0;
+        }
+    } else {
+        instr_error("Error: Failed to allocate Canny rows or stack (8-bit).\n");
+    }
+    free(map);
+    instr_scratchFree(mapSize);
+    instr_end(&span, status == 0 ? img->dataSize : 0, status == 0 ? 2 * (uint64_t)img->dataSize + 2 * mapSize : 0);
+    if (status == 0) instr_info("Canny edges extracted with thresholds %d and %d (8-bit).\n", low, high);
+    return status;
+}
@@ -0,0 +1,29 @@
+#ifndef EDGES_H
+#define EDGES_H
+
+#include "bmp8.h"
+
+// Largest Sobel magnitude |gx| + |gy| (4 x 255 on each axis), the upper bound of the Canny thresholds.
+#define EDGES_MAX_MAGNITUDE 2040
+
+// Defines the direction sectors of the gradient (as displayed), for the direction output of bmp8_sobel.
+typedef enum {
+    EDGES_HORIZONTAL = 0,          // within 22.5 degrees of left-right (a vertical edge)
+    EDGES_RISING,                  // towards up-right or down-left
+    EDGES_VERTICAL,                // within 22.5 degrees of up-down (a horizontal edge)
+    EDGES_FALLING                  // towards up-left or down-right
+} t_edges_sector;
+
+// Function bmp8_sobel is needed to replace an 8-bit image with its Sobel gradient magnitude |gx| + |gy|, saturated
+// to 255, repeating the edge pixels past the borders. direction (may be NULL) receives the t_edges_sector of every
+// pixel, laid out as img->data.
+// Returns 0, or -1 on invalid arguments or when memory runs out (the image is then unchanged).
+int bmp8_sobel(t_bmp8 *img, unsigned char *direction);
+
+// Function bmp8_canny is needed to extract thin edges: pixels whose Sobel magnitude is a local maximum across the
+// edge and above high become 255, as do those above low connected to them through such pixels; the others become 0.
+// 0 <= low <= high <= EDGES_MAX_MAGNITUDE.
+// Returns 0, or -1 on invalid arguments or when memory runs out (the image is then unchanged).
+int bmp8_canny(t_bmp8 *img, int low, int high);
+
+#endif // EDGES_H
@@ -0,0 +1,295 @@
+// geometry.c
+// Rotation, transpose and flips. Every transform works on arrays of row pointers in display order, so 8-bit data
+// (stored bottom-up) and 24-bit data share the code, and a rotation is a transpose with the source rows (90) or the
+// destination rows (270) taken in reverse order. The transpose walks GEOMETRY_BLOCK x GEOMETRY_BLOCK blocks, small
+// enough for the rows they read and the rows they write to stay in cache, and moves each block as
+// CPU_TILE8/CPU_TILE24 tiles transposed in registers. Tasks of the shared pool take strips of destination rows.
+#include "geometry.h"
+#include "instrument.h"
+#include "cpu_dispatch.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEOMETRY_BLOCK 64          // pixels per side of a cache block of the transpose
+#define GEOMETRY_SWAP_BYTES 4096   // bytes swapped at a time by the 8-bit vertical flip
+
+// Defines one transform; src has srcHeight rows of srcWidth pixels.
+typedef struct {
+    unsigned char *const *src;
+    unsigned char *const *dst;
+    size_t srcWidth;
+    size_t srcHeight;
+    int pixelBytes;
+} t_geometry_job;
+
+static void geometry_copyPixel(const t_geometry_job *job, size_t x, size_t y) {
+    if (job->pixelBytes == 1) job->dst[x][y] = job->src[y][x];
+    else memcpy(job->dst[x] + y * 3, job->src[y] + x * 3, 3);
+}
+
+// Transposes the source columns of blocks [begin, end), which are the destination rows of the same blocks.
+static void geometry_transposeBlocks(size_t begin, size_t end, void *userData) {
+    const t_geometry_job *job = (const t_geometry_job *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t tile = job->pixelBytes == 1 ? CPU_TILE8 : CPU_TILE24;
+    void (*transposeTile)(const unsigned char *const *, size_t, unsigned char *const *, size_t) =
+        job->pixelBytes == 1 ? kernels->transposeTile8 : kernels->transposeTile24;
+    for (size_t block = begin; block < end; ++block) {
+        size_t x0 = block * GEOMETRY_BLOCK;
+        size_t x1 = x0 + GEOMETRY_BLOCK < job->srcWidth ? x0 + GEOMETRY_BLOCK : job->srcWidth;
+        for (size_t y0 = 0; y0 < job->srcHeight; y0 += GEOMETRY_BLOCK) {
+            size_t y1 = y0 + GEOMETRY_BLOCK < job->srcHeight ? y0 + GEOMETRY_BLOCK : job->srcHeight;
+            size_t x = x0;
+            for (; x + tile <= x1; x += tile) {
+                size_t y = y0;
+                for (; y + tile <= y1; y += tile) {
+                    transposeTile((const unsigned char *const *)job->src + y, x, job->dst + x, y);
+                }
+                for (; y < y1; ++y) {
+                    for (size_t i = x; i < x + tile; ++i) geometry_copyPixel(job, i, y);
+                }
+            }
+            for (; x < x1; ++x) {
+                for (size_t y = y0; y < y1; ++y) geometry_copyPixel(job, x, y);
+            }
+        }
+    }
+}
+
+// Rotates rows [begin, end) of the destination by 180 degrees: each is the mirrored row from the other end.
+static void geometry_rotate180Rows(size_t begin, size_t end, void *userData) {
+    const t_geometry_job *job = (const t_geometry_job *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    for (size_t y = begin; y < end; ++y) {
+        memcpy(job->dst[y], job->src[job->srcHeight - 1 - y], job->srcWidth * job->pixelBytes);
+        if (job->pixelBytes == 1) kernels->reverse8(job->dst[y], job->srcWidth);
+        else kernels->reverse24(job->dst[y], job->srcWidth);
+    }
+}
+
+static void geometry_reverseRows(size_t begin, size_t end, void *userData) {
+    const t_geometry_job *job = (const t_geometry_job *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    for (size_t y = begin; y < end; ++y) {
+        if (job->pixelBytes == 1) kernels->reverse8(job->src[y], job->srcWidth);
+        else kernels->reverse24(job->src[y], job->srcWidth);
+    }
+}
+
+// Swaps rows y and srcHeight - 1 - y for y in [begin, end).
+static void geometry_swapRows(size_t begin, size_t end, void *userData) {
+    const t_geometry_job *job = (const t_geometry_job *)userData;
+    unsigned char buffer[GEOMETRY_SWAP_BYTES];
+    size_t rowBytes = job->srcWidth * job->pixelBytes;
+    for (size_t y = begin; y < end; ++y) {
+        unsigned char *a = job->src[y], *b = job->src[job->srcHeight - 1 - y];
+        for (size_t x = 0; x < rowBytes; x += GEOMETRY_SWAP_BYTES) {
+            size_t n = rowBytes - x < GEOMETRY_SWAP_BYTES ? rowBytes - x : GEOMETRY_SWAP_BYTES;
+            memcpy(buffer, a + x, n);
+            memcpy(a + x, b + x, n);
+            memcpy(b + x, buffer, n);
+        }
+    }
+}
+
+static void geometry_reverseArray(unsigned char **rows, size_t count) {
+    for (size_t i = 0, j = count; i + 1 < j; ++i) {
+        --j;
+        unsigned char *t = rows[i];
+        rows[i] = rows[j];
+        rows[j] = t;
+    }
+}
+
+// Applies turns quarter turns clockwise (0-3), or a transpose if turns is -1, from src (srcHeight rows of srcWidth
+// pixels) to dst. Both arrays are in display order and may be reordered.
+static void geometry_run(unsigned char **src, size_t srcWidth, size_t srcHeight, unsigned char **dst, int pixelBytes,
+                         int turns) {
+    t_geometry_job job = { src, dst, srcWidth, srcHeight, pixelBytes };
+    size_t chunkBytes = tune_params()->chunkBytes;
+    if (turns == 0) {
+        for (size_t y = 0; y < srcHeight; ++y) memcpy(dst[y], src[y], srcWidth * pixelBytes);
+        return;
+    }
+    if (turns == 2) {
+        pool_parallelFor(srcHeight, pool_grain(srcWidth * pixelBytes, chunkBytes), geometry_rotate180Rows, &job);
+        return;
+    }
+    if (turns == 1) geometry_reverseArray(src, srcHeight);
+    if (turns == 3) geometry_reverseArray(dst, srcWidth);
+    size_t blocks = (srcWidth + GEOMETRY_BLOCK - 1) / GEOMETRY_BLOCK;
+    pool_parallelFor(blocks, pool_grain((size_t)GEOMETRY_BLOCK * srcHeight * pixelBytes, chunkBytes),
+                     geometry_transposeBlocks, &job);
+}
+
+// Returns the rows of an 8-bit image in display order (the data is stored bottom-up).
+static unsigned char **geometry_rows8(const t_bmp8 *img) {
+    unsigned char **rows = (unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    if (!rows) return NULL;
+    for (unsigned int y = 0; y < img->height; ++y) rows[y] = img->data + (size_t)(img->height - 1 - y) * img->width;
+    return rows;
+}
+
+static unsigned char **geometry_rows24(const t_bmp24 *img) {
+    unsigned char **rows = (unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    if (!rows) return NULL;
+    for (int y = 0; y < img->height; ++y) rows[y] = (unsigned char *)img->data[y];
+    return rows;
+}
+
+// Converts degrees to clockwise quarter turns (0-3); -1 if degrees is not a multiple of 90.
+static int geometry_turns(int degrees) {
+    if (degrees % 90 != 0) return -1;
+    return ((degrees / 90) % 4 + 4) % 4;
+}
+
+void bmp8_flipHorizontal(t_bmp8 *img) {
+    if (!img || !img->data) return;
+    t_instr_span span;
+    instr_begin(&span, "bmp8_flipHorizontal");
+    unsigned char **rows = geometry_rows8(img);
+    if (!rows) {
+        instr_error("Error: Failed to allocate flip rows (8-bit).\n");
+        instr_end(&span, 0, 0);
+        return;
+    }
+    t_geometry_job job = { rows, rows, img->width, img->height, 1 };
+    pool_parallelFor(img->height, pool_grain(img->width, tune_params()->chunkBytes), geometry_reverseRows, &job);
+    free(rows);
+    instr_end(&span, img->dataSize, 2 * (uint64_t)img->dataSize);
+    instr_info("Image flipped horizontally (8-bit).\n");
+}
+
+void bmp8_flipVertical(t_bmp8 *img) {
+    if (!img || !img->data) return;
+    t_instr_span span;
+    instr_begin(&span, "bmp8_flipVertical");
+    unsigned char **rows = geometry_rows8(img);
+    if (!rows) {
+        instr_error("Error: Failed to allocate flip rows (8-bit).\n");
+        instr_end(&span, 0, 0);
+        return;
+    }
+    t_geometry_job job = { rows, rows, img->width, img->height, 1 };
+    pool_parallelFor(img->height / 2, pool_grain(2 * (size_t)img->width, tune_params()->chunkBytes),
+                     geometry_swapRows, &job);
+    free(rows);
+    instr_end(&span, img->dataSize, 2 * (uint64_t)img->dataSize);
+    instr_info("Image flipped vertically (8-bit).\n");
+}
+
+void bmp24_flipHorizontal(t_bmp24 *img) {
+    if (!img || !img->data) return;
+    t_instr_span span;
+    instr_begin(&span, "bmp24_flipHorizontal");
+    unsigned char **rows = geometry_rows24(img);
+    if (!rows) {
+        instr_error("Error: Failed to allocate flip rows (24-bit).\n");
+        instr_end(&span, 0, 0);
+        return;
+    }
+    t_geometry_job job = { rows, rows, (size_t)img->width, (size_t)img->height, (int)sizeof(t_pixel) };
+    pool_parallelFor((size_t)img->height, pool_grain((size_t)img->width * sizeof(t_pixel), tune_params()->chunkBytes),
+                     geometry_reverseRows, &job);
+    free(rows);
+    instr_end(&span, (uint64_t)img->width * img->height, 6 * (uint64_t)img->width * img->height);
+    instr_info("Image flipped horizontally (24-bit).\n");
+}
+
+void bmp24_flipVertical(t_bmp24 *img) {
+    if (!img || !img->data) return;
+    t_instr_span span;
+    instr_begin(&span, "bmp24_flipVertical");
+    geometry_reverseArray((unsigned char **)img->data, (size_t)img->height);
+    instr_end(&span, (uint64_t)img->width * img->height, (uint64_t)img->height * sizeof(t_pixel *) * 2);
+    instr_info("Image flipped vertically (24-bit).\n");
+}
+
+// Makes the 8-bit result of turns quarter turns (or a transpose, turns = -1).
+static t_bmp8 *geometry_transform8(const t_bmp8 *img, int turns, const char *name) {
+    int swap = turns != 0 && turns != 2;
+    t_instr_span span;
+    instr_begin(&span, name);
+    t_bmp8 *out = swap ? bmp8_allocate(img->height, img->width) : bmp8_allocate(img->width, img->height);
+    unsigned char **src = out ? geometry_rows8(img) : NULL;
+    unsigned char **dst = src ? geometry_rows8(out) : NULL;
+    if (!dst) {
+        if (out) instr_error("Error: Failed to allocate rotation rows (8-bit).\n");
+        free(src);
+        bmp8_free(out);
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    memcpy(out->colorTable, img->colorTable, sizeof(out->colorTable));
+    geometry_run(src, img->width, img->height, dst, 1, turns);
+    free(src);
+    free(dst);
+    instr_end(&span, img->dataSize, 2 * (uint64_t)img->dataSize);
+    return out;
+}
+
+static t_bmp24 *geometry_transform24(const t_bmp24 *img, int turns, const char *name) {
+    int swap = turns != 0 && turns != 2;
+    t_instr_span span;
+    instr_begin(&span, name);
+    t_bmp24 *out = swap ? bmp24_allocate(img->height, img->width, 24) : bmp24_allocate(img->width, img->height, 24);
+    unsigned char **src = out ? geometry_rows24(img) : NULL;
+    unsigned char **dst = src ? geometry_rows24(out) : NULL;
+    if (!dst) {
+        if (out) instr_error("Error: Failed to allocate rotation rows (24-bit).\n");
+        free(src);
+        bmp24_free(out);
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    geometry_run(src, (size_t)img->width, (size_t)img->height, dst, (int)sizeof(t_pixel), turns);
+    free(src);
+    free(dst);
+    instr_end(&span, (uint64_t)img->width * img->height, 6 * (uint64_t)img->width * img->height);
+    return out;
+}
+
+t_bmp8 *bmp8_transpose(const t_bmp8 *img) {
+    if (!img || !img->data) {
+        instr_error("Error: Invalid image for transpose (8-bit).\n");
+        return NULL;
+    }
+    t_bmp8 *out = geometry_transform8(img, -1, "bmp8_transpose");
+    if (out) instr_info("Image transposed (8-bit).\n");
+    return out;
+}
+
+t_bmp8 *bmp8_rotate(const t_bmp8 *img, int degrees) {
+    int turns = geometry_turns(degrees);
+    if (!img || !img->data || turns < 0) {
+        instr_error("Error: Invalid arguments for rotation by %d degrees (8-bit).\n", degrees);
+        return NULL;
+    }
+    t_bmp8 *out = geometry_transform8(img, turns, "bmp8_rotate");
+    if (out) instr_info("Image rotated by %d degrees (8-bit).\n", degrees);
+    return out;
+}
+
+t_bmp24 *bmp24_transpose(const t_bmp24 *img) {
+    if (!img || !img->data) {
+        instr_error("Error: Invalid image for transpose (24-bit).\n");
+        return NULL;
+    }
+    t_bmp24 *out = geometry_transform24(img, -1, "bmp24_transpose");
+    if (out) instr_info("Image transposed (24-bit).\n");
+    return out;
+}
+
+t_bmp24 *bmp24_rotate(const t_bmp24 *img, int degrees) {
+    int turns = geometry_turns(degrees);
+    if (!img || !img->data || turns < 0) {
+        instr_error("Error: Invalid arguments for rotation by %d degrees (24-bit).\n", degrees);
+        return NULL;
+    }
+    t_bmp24 *out = geometry_transform24(img, turns, "bmp24_rotate");
+    if (out) instr_info("Image rotated by %d degrees (24-bit).\n", degrees);
+    return out;
+}
@@ -0,0 +1,27 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Orientation changes. Directions are as the image is displayed (top row first), whatever the row order of the data.
+
+// Function bmp8_flipHorizontal is needed to mirror an 8-bit image left to right, in place.
+void bmp8_flipHorizontal(t_bmp8 *img);
+// Function bmp8_flipVertical is needed to mirror an 8-bit image top to bottom, in place.
+void bmp8_flipVertical(t_bmp8 *img);
+void bmp24_flipHorizontal(t_bmp24 *img);
+// Function bmp24_flipVertical only reverses the row pointers of img->data; no pixel moves.
+void bmp24_flipVertical(t_bmp24 *img);
+
+// Function bmp8_transpose is needed to mirror an 8-bit image along its main diagonal (width and height swap).
+// Returns a new image (free with bmp8_free), or NULL when memory runs out.
+t_bmp8 *bmp8_transpose(const t_bmp8 *img);
+// Function bmp8_rotate is needed to rotate an 8-bit image clockwise by degrees, a multiple of 90 (negative values
+// turn counter-clockwise). Returns a new image (free with bmp8_free), or NULL for other angles or when memory runs out.
+t_bmp8 *bmp8_rotate(const t_bmp8 *img, int degrees);
+
+t_bmp24 *bmp24_transpose(const t_bmp24 *img);
+t_bmp24 *bmp24_rotate(const t_bmp24 *img, int degrees);
+
+#endif // GEOMETRY_H
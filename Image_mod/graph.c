@@ -0,0 +1,660 @@
+// graph.c
+// Deferred mode: recording, planning (passes of fused stages) and band-by-band execution on the shared pool.
+#include "graph.h"
+#include "utils.h"
+#include "instrument.h"
+#include "cpu_dispatch.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRAPH_INITIAL_NODES 8
+#define GRAPH_MAX_CONVS 8                  // convolutions fused into one pass; a longer run starts a new pass
+#define GRAPH_TILE_BYTES (512 * 1024)      // intermediate rows of one band, sized to stay in L2
+
+typedef enum {
+    GRAPH_NEGATIVE,
+    GRAPH_BRIGHTNESS,
+    GRAPH_THRESHOLD,
+    GRAPH_GRAYSCALE,
+    GRAPH_CONVOLVE,
+    GRAPH_EQUALIZE
+} t_graph_op;
+
+typedef struct {
+    t_graph_op op;
+    int value;
+    float **kernel;
+    int kernelSize;
+} t_graph_node;
+
+struct t_graph {
+    t_graph_node *nodes;
+    int count;
+    int capacity;
+};
+
+// Byte map applied to every channel: the composition of the point ops folded into it. A map of a single op is run
+// with that op's kernel (the kernels are faster than a table lookup); longer maps run as one lut pass.
+typedef struct {
+    int ops;                      // 0: identity
+    t_graph_op single;            // the op when ops == 1
+    int singleValue;
+    unsigned char table[256];
+} t_graph_map;
+
+// Per-pixel stage: map, then grayscale (24-bit), then a second map.
+typedef struct {
+    t_graph_map before;
+    int grayscale;
+    t_graph_map after;
+} t_graph_pixels;
+
+typedef struct {
+    float **kernel;
+    int kernelSize;
+    t_graph_pixels store;         // applied to the convolved rows as they are stored
+} t_graph_conv;
+
+// One pass over the image: load (with its pixel stage), up to GRAPH_MAX_CONVS convolutions, store.
+typedef struct {
+    t_graph_pixels load;
+    t_graph_conv convs[GRAPH_MAX_CONVS];
+    int convCount;
+    int equalize;                 // an equalize follows the pass
+} t_graph_pass;
+
+typedef struct {
+    t_graph_pass *passes;
+    int count;
+    int opCount;
+} t_graph_plan;
+
+// 3x3 kernels of the named filters, as in bmp8.c/bmp24.c.
+static const float g_namedKernels[5][9] = {
+    { 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f },
+    { 1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f, 2.0f / 16.0f, 4.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f },
+    { -1.0f, -1.0f, -1.0f, -1.0f, 8.0f, -1.0f, -1.0f, -1.0f, -1.0f },
+    { -2.0f, -1.0f, 0.0f, -1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 2.0f },
+    { 0.0f, -1.0f, 0.0f, -1.0f, 5.0f, -1.0f, 0.0f, -1.0f, 0.0f }
+};
+
+
+// ---- Recording ----
+
+t_graph *graph_create(void) {
+    t_graph *graph = (t_graph *)calloc(1, sizeof(t_graph));
+    if (!graph) instr_error("Error: Failed to allocate graph.\n");
+    return graph;
+}
+
+void graph_clear(t_graph *graph) {
+    if (!graph) return;
+    for (int i = 0; i < graph->count; ++i) {
+        if (graph->nodes[i].kernel) free_kernel(graph->nodes[i].kernel, graph->nodes[i].kernelSize);
+    }
+    graph->count = 0;
+}
+
+void graph_free(t_graph *graph) {
+    if (!graph) return;
+    graph_clear(graph);
+    free(graph->nodes);
+    free(graph);
+}
+
+int graph_size(const t_graph *graph) {
+    return graph ? graph->count : 0;
+}
+
+static int graph_add(t_graph *graph, t_graph_op op, int value, float **kernel, int kernelSize) {
+    if (!graph) {
+        instr_error("Error: NULL graph.\n");
+        return -1;
+    }
+    if (graph->count == graph->capacity) {
+        int capacity = graph->capacity ? graph->capacity * 2 : GRAPH_INITIAL_NODES;
+        t_graph_node *nodes = (t_graph_node *)realloc(graph->nodes, (size_t)capacity * sizeof(t_graph_node));
+        if (!nodes) {
+            instr_error("Error: Failed to grow graph.\n");
+            return -1;
+        }
+        graph->nodes = nodes;
+        graph->capacity = capacity;
+    }
+    t_graph_node node = { op, value, kernel, kernelSize };
+    graph->nodes[graph->count++] = node;
+    return 0;
+}
+
+int graph_negative(t_graph *graph) {
+    return graph_add(graph, GRAPH_NEGATIVE, 0, NULL, 0);
+}
+
+int graph_brightness(t_graph *graph, int value) {
+    return graph_add(graph, GRAPH_BRIGHTNESS, value, NULL, 0);
+}
+
+int graph_threshold(t_graph *graph, int threshold) {
+    if (threshold < 0) threshold = 0;
+    if (threshold > 255) threshold = 255;
+    return graph_add(graph, GRAPH_THRESHOLD, threshold, NULL, 0);
+}
+
+int graph_grayscale(t_graph *graph) {
+    return graph_add(graph, GRAPH_GRAYSCALE, 0, NULL, 0);
+}
+
+int graph_equalize(t_graph *graph) {
+    return graph_add(graph, GRAPH_EQUALIZE, 0, NULL, 0);
+}
+
+int graph_convolve(t_graph *graph, float **kernel, int kernelSize) {
+    if (!kernel || kernelSize <= 0 || kernelSize % 2 == 0) {
+        instr_error("Error: Invalid kernel for graph_convolve.\n");
+        return -1;
+    }
+    float **copy = allocate_kernel(kernelSize);
+    if (!copy) {
+        instr_error("Error: Failed to allocate graph kernel.\n");
+        return -1;
+    }
+    for (int i = 0; i < kernelSize; ++i) memcpy(copy[i], kernel[i], (size_t)kernelSize * sizeof(float));
+    if (graph_add(graph, GRAPH_CONVOLVE, 0, copy, kernelSize) != 0) {
+        free_kernel(copy, kernelSize);
+        return -1;
+    }
+    return 0;
+}
+
+static int graph_named(t_graph *graph, int index) {
+    float row0[3], row1[3], row2[3];
+    float *kernel[3] = { row0, row1, row2 };
+    for (int i = 0; i < 9; ++i) kernel[i / 3][i % 3] = g_namedKernels[index][i];
+    return graph_convolve(graph, kernel, 3);
+}
+
+int graph_boxBlur(t_graph *graph) { return graph_named(graph, 0); }
+int graph_gaussianBlur(t_graph *graph) { return graph_named(graph, 1); }
+int graph_outline(t_graph *graph) { return graph_named(graph, 2); }
+int graph_emboss(t_graph *graph) { return graph_named(graph, 3); }
+int graph_sharpen(t_graph *graph) { return graph_named(graph, 4); }
+
+
+// ---- Maps ----
+
+static void graph_mapInit(t_graph_map *map) {
+    map->ops = 0;
+    for (int i = 0; i < 256; ++i) map->table[i] = (unsigned char)i;
+}
+
+static void graph_mapCheckIdentity(t_graph_map *map) {
+    for (int i = 0; i < 256; ++i) {
+        if (map->table[i] != i) return;
+    }
+    map->ops = 0;
+}
+
+// The op is applied to the table with the same kernel the immediate call uses, so the table is exact.
+static void graph_mapAdd(t_graph_map *map, t_graph_op op, int value) {
+    const t_cpu_kernels *kernels = cpu_kernels();
+    if (op == GRAPH_NEGATIVE) kernels->negate(map->table, 256);
+    else if (op == GRAPH_BRIGHTNESS) kernels->addSaturate(map->table, 256, value);
+    else kernels->threshold(map->table, 256, value);
+    if (map->ops == 0) {
+        map->single = op;
+        map->singleValue = value;
+    }
+    map->ops++;
+    graph_mapCheckIdentity(map);
+}
+
+// Puts the equalize table first: the map then applies to the equalized values.
+static void graph_mapPrepend(t_graph_map *map, const unsigned int *equalize) {
+    unsigned char table[256];
+    for (int i = 0; i < 256; ++i) table[i] = map->table[equalize[i]];
+    memcpy(map->table, table, sizeof(table));
+    map->ops = 2;
+    graph_mapCheckIdentity(map);
+}
+
+static void graph_mapApply(const t_graph_map *map, unsigned char *data, size_t n) {
+    if (map->ops == 0) return;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    if (map->ops > 1) kernels->lut(data, n, map->table);
+    else if (map->single == GRAPH_NEGATIVE) kernels->negate(data, n);
+    else if (map->single == GRAPH_BRIGHTNESS) kernels->addSaturate(data, n, map->singleValue);
+    else kernels->threshold(data, n, map->singleValue);
+}
+
+static void graph_pixelsInit(t_graph_pixels *pixels) {
+    graph_mapInit(&pixels->before);
+    pixels->grayscale = 0;
+    graph_mapInit(&pixels->after);
+}
+
+static int graph_pixelsIdentity(const t_graph_pixels *pixels) {
+    return pixels->before.ops == 0 && !pixels->grayscale && pixels->after.ops == 0;
+}
+
+// Applies a pixel stage to rowBytes bytes: whole 8-bit rows or chunks, or whole 24-bit rows.
+static void graph_pixelsApply(const t_graph_pixels *pixels, unsigned char *data, size_t n, int bpp) {
+    graph_mapApply(&pixels->before, data, n);
+    if (pixels->grayscale && bpp == 3) cpu_kernels()->grayscale24((t_pixel *)data, n / 3);
+    graph_mapApply(&pixels->after, data, n);
+}
+
+
+// ---- Planning ----
+
+static t_graph_pass *graph_newPass(t_graph_plan *plan) {
+    t_graph_pass *passes = (t_graph_pass *)realloc(plan->passes, (size_t)(plan->count + 1) * sizeof(t_graph_pass));
+    if (!passes) return NULL;
+    plan->passes = passes;
+    t_graph_pass *pass = &plan->passes[plan->count++];
+    graph_pixelsInit(&pass->load);
+    pass->convCount = 0;
+    pass->equalize = 0;
+    return pass;
+}
+
+// Splits the recorded chain into passes for an image of depth bits. Returns -1 if an op does not apply to it.
+static int graph_plan(const t_graph *graph, int depth, t_graph_plan *plan) {
+    plan->passes = NULL;
+    plan->count = 0;
+    plan->opCount = graph->count;
+    t_graph_pass *pass = graph_newPass(plan);
+    if (!pass) {
+        instr_error("Error: Failed to allocate graph plan.\n");
+        return -1;
+    }
+    int gray = 0;                 // every pixel already has equal channels
+    for (int i = 0; i < graph->count; ++i) {
+        const t_graph_node *node = &graph->nodes[i];
+        t_graph_pixels *stage = pass->convCount ? &pass->convs[pass->convCount - 1].store : &pass->load;
+        switch (node->op) {
+            case GRAPH_THRESHOLD:
+                if (depth != 8) {
+                    instr_error("Error: Threshold is only defined for 8-bit images.\n");
+                    return -1;
+                }
+                // fall through
+            case GRAPH_NEGATIVE:
+            case GRAPH_BRIGHTNESS:
+                graph_mapAdd(stage->grayscale ? &stage->after : &stage->before, node->op, node->value);
+                break;
+            case GRAPH_GRAYSCALE:
+                // A byte map or a convolution treats the three channels alike, so gray pixels stay gray.
+                if (depth == 24 && !gray) {
+                    stage->grayscale = 1;
+                    gray = 1;
+                }
+                break;
+            case GRAPH_CONVOLVE:
+                if (pass->convCount == GRAPH_MAX_CONVS) {
+                    pass = graph_newPass(plan);
+                    if (!pass) {
+                        instr_error("Error: Failed to allocate graph plan.\n");
+                        return -1;
+                    }
+                }
+                pass->convs[pass->convCount].kernel = node->kernel;
+                pass->convs[pass->convCount].kernelSize = node->kernelSize;
+                graph_pixelsInit(&pass->convs[pass->convCount].store);
+                pass->convCount++;
+                break;
+            case GRAPH_EQUALIZE:
+                pass->equalize = 1;
+                pass = graph_newPass(plan);
+                if (!pass) {
+                    instr_error("Error: Failed to allocate graph plan.\n");
+                    return -1;
+                }
+                gray = 0;
+                break;
+        }
+    }
+    return 0;
+}
+
+
+// ---- Execution ----
+
+// Defines one pass over the image. Rows are addressed through row-pointer arrays so the 8-bit and 24-bit layouts
+// share the code; bpp is 1 or 3 bytes per pixel.
+typedef struct {
+    const t_graph_pass *pass;
+    int bpp;
+    unsigned int width;
+    unsigned int height;
+    size_t rowBytes;
+    unsigned char **src;
+    unsigned char **dst;
+    unsigned int bandRows;
+    uint64_t *hist;               // histogram of the output, for a following 8-bit equalize (else NULL)
+    pthread_mutex_t lock;
+    atomic_int failed;
+} t_graph_job;
+
+static void graph_mergeHistogram(t_graph_job *job, const uint64_t *local) {
+    pthread_mutex_lock(&job->lock);
+    for (int i = 0; i < 256; ++i) job->hist[i] += local[i];
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Pass without convolutions, in place: chunks of bytes (8-bit) or bands of rows (24-bit).
+static void graph_pixelChunk(size_t begin, size_t end, void *userData) {
+    t_graph_job *job = (t_graph_job *)userData;
+    uint64_t local[256] = { 0 };
+    if (job->bpp == 1) {
+        // 8-bit data is one contiguous block, so chunks need not follow rows.
+        unsigned char *data = job->src[0] + begin;
+        graph_pixelsApply(&job->pass->load, data, end - begin, 1);
+        if (job->hist) bmp8_histogramAdd(data, end - begin, local);
+    } else {
+        for (size_t y = begin; y < end; ++y) graph_pixelsApply(&job->pass->load, job->src[y], job->rowBytes, 3);
+    }
+    if (job->hist) graph_mergeHistogram(job, local);
+}
+
+// Convolves row y of the level whose rows [inLo, ...) are in. Border rows and the kernelSize/2 pixels at each end of
+// a row are copied, as in bmp8_convolveRow/bmp24_convolveRow.
+static void graph_convolveRow(const t_graph_job *job, unsigned char *const *in, unsigned int inLo, unsigned int y,
+                              t_conv_rows *conv, int kernelSize, unsigned char *dstRow) {
+    unsigned int n = (unsigned int)(kernelSize / 2);
+    const unsigned char *srcRow = in[y - inLo];
+    if (y < n || y + n >= job->height || job->width < (unsigned int)kernelSize) {
+        memcpy(dstRow, srcRow, job->rowBytes);
+        return;
+    }
+    size_t edge = (size_t)n * job->bpp;
+    memcpy(dstRow, srcRow, edge);
+    memcpy(dstRow + job->rowBytes - edge, srcRow + job->rowBytes - edge, edge);
+    for (int k = 0; k < kernelSize; ++k) conv->rows[k] = in[y - n + (unsigned int)k - inLo];
+    if (job->bpp == 1) {
+        cpu_kernels()->convolve8(conv->rows, conv->weights, kernelSize, n, job->width - n, dstRow);
+    } else {
+        cpu_kernels()->convolve24(conv->rows, conv->weights, kernelSize, edge, job->rowBytes - edge, dstRow);
+    }
+}
+
+// One band of output rows through the whole pass. Level 0 is the loaded input, level i the output of convolution i;
+// each level covers the rows the next one reads. Level 0 reads the image directly when the load stage is empty, and
+// the last level is written straight to the output buffer.
+static void graph_band(size_t begin, size_t end, void *userData) {
+    t_graph_job *job = (t_graph_job *)userData;
+    const t_graph_pass *pass = job->pass;
+    int levels = pass->convCount;
+    int loadInPlace = graph_pixelsIdentity(&pass->load);
+
+    for (size_t band = begin; band < end; ++band) {
+        if (atomic_load(&job->failed)) return;
+        unsigned int lo[GRAPH_MAX_CONVS + 1], hi[GRAPH_MAX_CONVS + 1];
+        lo[levels] = (unsigned int)band * job->bandRows;
+        hi[levels] = lo[levels] + job->bandRows < job->height ? lo[levels] + job->bandRows : job->height;
+        for (int i = levels; i > 0; --i) {
+            unsigned int n = (unsigned int)(pass->convs[i - 1].kernelSize / 2);
+            lo[i - 1] = lo[i] > n ? lo[i] - n : 0;
+            hi[i - 1] = hi[i] + n < job->height ? hi[i] + n : job->height;
+        }
+
+        // Scratch rows of the buffered levels, and their row pointers.
+        size_t rows = 0;
+        for (int i = loadInPlace ? 1 : 0; i < levels; ++i) rows += hi[i] - lo[i];
+        unsigned char *scratch = NULL;
+        unsigned char **pointers = NULL;
+        if (rows > 0) {
+            scratch = (unsigned char *)malloc(rows * job->rowBytes);
+            pointers = (unsigned char **)malloc(rows * sizeof(unsigned char *));
+            if (!scratch || !pointers) {
+                free(scratch);
+                free(pointers);
+                atomic_store(&job->failed, 1);
+                return;
+            }
+        }
+        unsigned char **level[GRAPH_MAX_CONVS + 1];
+        size_t used = 0;
+        for (int i = 0; i <= levels; ++i) {
+            if (i == 0 && loadInPlace) {
+                level[i] = job->src + lo[0];
+            } else if (i == levels) {
+                level[i] = job->dst + lo[levels];
+            } else {
+                level[i] = pointers + used;
+                used += hi[i] - lo[i];
+            }
+        }
+        for (size_t r = 0; r < rows; ++r) pointers[r] = scratch + r * job->rowBytes;
+
+        if (!loadInPlace) {
+            for (unsigned int y = lo[0]; y < hi[0]; ++y) {
+                memcpy(level[0][y - lo[0]], job->src[y], job->rowBytes);
+                graph_pixelsApply(&pass->load, level[0][y - lo[0]], job->rowBytes, job->bpp);
+            }
+        }
+        for (int i = 1; i <= levels; ++i) {
+            const t_graph_conv *step = &pass->convs[i - 1];
+            t_conv_rows conv;
+            if (cpu_convBegin(&conv, step->kernel, step->kernelSize) != 0) {
+                atomic_store(&job->failed, 1);
+                break;
+            }
+            for (unsigned int y = lo[i]; y < hi[i]; ++y) {
+                unsigned char *out = level[i][y - lo[i]];
+                graph_convolveRow(job, level[i - 1], lo[i - 1], y, &conv, step->kernelSize, out);
+                graph_pixelsApply(&step->store, out, job->rowBytes, job->bpp);
+            }
+            cpu_convEnd(&conv);
+        }
+        if (job->hist) {
+            // Rows are counted by the 32-bit kernel and moved into total before the counters could wrap.
+            unsigned int rowCounts[256] = { 0 };
+            uint64_t total[256] = { 0 };
+            size_t counted = 0;
+            for (unsigned int y = lo[levels]; y < hi[levels]; ++y) {
+                if (counted > UINT32_MAX - job->rowBytes) {
+                    for (int i = 0; i < 256; ++i) total[i] += rowCounts[i];
+                    memset(rowCounts, 0, sizeof(rowCounts));
+                    counted = 0;
+                }
+                cpu_kernels()->histogram(job->dst[y], job->rowBytes, rowCounts);
+                counted += job->rowBytes;
+            }
+            for (int i = 0; i < 256; ++i) total[i] += rowCounts[i];
+            graph_mergeHistogram(job, total);
+        }
+        free(scratch);
+        free(pointers);
+    }
+}
+
+// Rows per band: as many as fit GRAPH_TILE_BYTES of intermediate rows, and enough that the rows recomputed around
+// each band (the halo of the fused convolutions) stay a small share.
+static unsigned int graph_bandRows(const t_graph_pass *pass, size_t rowBytes, unsigned int height) {
+    unsigned int halo = 0;
+    for (int i = 0; i < pass->convCount; ++i) halo += (unsigned int)(pass->convs[i].kernelSize / 2);
+    int buffered = pass->convCount - 1 + (graph_pixelsIdentity(&pass->load) ? 0 : 1);
+    size_t rows = (size_t)tune_params()->bandRows;
+    if (buffered > 0) {
+        size_t fit = GRAPH_TILE_BYTES / ((size_t)buffered * rowBytes);
+        fit = fit > 2 * (size_t)halo ? fit - 2 * (size_t)halo : 1;
+        if (fit > rows) rows = fit;
+        if (rows < 8 * (size_t)halo) rows = 8 * (size_t)halo;
+    }
+    return rows < height ? (unsigned int)rows : height;
+}
+
+// Runs one pass. src are the image rows; with convolutions the result goes to dst (rows of a new buffer).
+static int graph_runPass(const t_graph_pass *pass, int bpp, unsigned int width, unsigned int height,
+                         unsigned char **src, unsigned char **dst, size_t dataSize, uint64_t *hist) {
+    if (width == 0 || height == 0) return 0;
+    t_graph_job job;
+    job.pass = pass;
+    job.bpp = bpp;
+    job.width = width;
+    job.height = height;
+    job.rowBytes = (size_t)width * bpp;
+    job.src = src;
+    job.dst = dst;
+    job.hist = hist;
+    pthread_mutex_init(&job.lock, NULL);
+    atomic_init(&job.failed, 0);
+
+    if (pass->convCount == 0) {
+        if (graph_pixelsIdentity(&pass->load) && !hist) {
+            pthread_mutex_destroy(&job.lock);
+            return 0;
+        }
+        if (bpp == 1) {
+            pool_parallelFor(dataSize, pool_grain(1, tune_params()->chunkBytes), graph_pixelChunk, &job);
+        } else {
+            pool_parallelFor(height, pool_grain(job.rowBytes, tune_params()->chunkBytes), graph_pixelChunk, &job);
+        }
+    } else {
+        job.bandRows = graph_bandRows(pass, job.rowBytes, height);
+        size_t bands = (height + job.bandRows - 1) / job.bandRows;
+        pool_parallelFor(bands, 1, graph_band, &job);
+    }
+    pthread_mutex_destroy(&job.lock);
+    return atomic_load(&job.failed) ? -1 : 0;
+}
+
+static void graph_freePlan(t_graph_plan *plan) {
+    free(plan->passes);
+    plan->passes = NULL;
+    plan->count = 0;
+}
+
+int graph_execute8(const t_graph *graph, t_bmp8 *img) {
+    if (!graph || !img || !img->data) {
+        instr_error("Error: Invalid arguments for graph_execute8.\n");
+        return -1;
+    }
+    t_graph_plan plan;
+    if (graph_plan(graph, 8, &plan) != 0) {
+        graph_freePlan(&plan);
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, "graph_execute8");
+    unsigned int width = img->width, height = img->height;
+    unsigned char **src = (unsigned char **)malloc((size_t)height * sizeof(unsigned char *));
+    unsigned char **dst = (unsigned char **)malloc((size_t)height * sizeof(unsigned char *));
+    unsigned int *equalize = NULL;
+    int result = src && dst ? 0 : -1;
+    if (result != 0) instr_error("Error: Failed to allocate graph rows (8-bit).\n");
+    uint64_t bytes = 0;
+
+    for (int p = 0; p < plan.count && result == 0; ++p) {
+        t_graph_pass *pass = &plan.passes[p];
+        if (equalize) {
+            graph_mapPrepend(&pass->load.before, equalize);
+            free(equalize);
+            equalize = NULL;
+        }
+        for (unsigned int y = 0; y < height; ++y) src[y] = img->data + (size_t)y * width;
+        uint64_t hist[256] = { 0 };
+        unsigned char *out = NULL;
+        if (pass->convCount > 0) {
+            out = (unsigned char *)malloc(img->dataSize);
+            if (!out) {
+                instr_error("Error: Failed to allocate graph output (8-bit).\n");
+                result = -1;
+                break;
+            }
+            instr_scratchAlloc(img->dataSize);
+            for (unsigned int y = 0; y < height; ++y) dst[y] = out + (size_t)y * width;
+        }
+        result = graph_runPass(pass, 1, width, height, src, dst, img->dataSize, pass->equalize ? hist : NULL);
+        if (out) {
+            // The new buffer replaces the image data instead of being copied back.
+            if (result == 0) {
+                free(img->data);
+                img->data = out;
+            } else {
+                free(out);
+                instr_error("Error: Failed to allocate graph band (8-bit).\n");
+            }
+            instr_scratchFree(img->dataSize);
+        }
+        bytes += 2 * (uint64_t)img->dataSize;
+        if (result == 0 && pass->equalize) {
+            equalize = bmp8_computeCDF(hist, img->dataSize);
+            if (!equalize) result = -1;
+        }
+    }
+    free(equalize);
+    free(src);
+    free(dst);
+    graph_freePlan(&plan);
+    instr_end(&span, result == 0 ? img->dataSize : 0, bytes);
+    if (result == 0) instr_info("Graph of %d operations executed in %d passes (8-bit).\n", graph->count, plan.count);
+    return result;
+}
+
+int graph_execute24(const t_graph *graph, t_bmp24 *img) {
+    if (!graph || !img || !img->data) {
+        instr_error("Error: Invalid arguments for graph_execute24.\n");
+        return -1;
+    }
+    t_graph_plan plan;
+    if (graph_plan(graph, 24, &plan) != 0) {
+        graph_freePlan(&plan);
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, "graph_execute24");
+    int width = img->width, height = img->height;
+    size_t dataSize = (size_t)width * height * sizeof(t_pixel);
+    unsigned char **src = (unsigned char **)malloc((size_t)height * sizeof(unsigned char *));
+    unsigned char **dst = (unsigned char **)malloc((size_t)height * sizeof(unsigned char *));
+    int result = src && dst ? 0 : -1;
+    if (result != 0) instr_error("Error: Failed to allocate graph rows (24-bit).\n");
+    uint64_t bytes = 0;
+    int passes = plan.count;
+
+    for (int p = 0; p < plan.count && result == 0; ++p) {
+        const t_graph_pass *pass = &plan.passes[p];
+        for (int y = 0; y < height; ++y) src[y] = (unsigned char *)img->data[y];
+        t_pixel **out = NULL;
+        if (pass->convCount > 0) {
+            out = bmp24_allocateDataPixels(width, height);
+            if (!out) {
+                result = -1;
+                break;
+            }
+            instr_scratchAlloc(dataSize);
+            for (int y = 0; y < height; ++y) dst[y] = (unsigned char *)out[y];
+        }
+        result = graph_runPass(pass, 3, (unsigned int)width, (unsigned int)height, src, dst, dataSize, NULL);
+        if (out) {
+            if (result == 0) {
+                bmp24_freeDataPixels(img->data, height);
+                img->data = out;
+            } else {
+                bmp24_freeDataPixels(out, height);
+                instr_error("Error: Failed to allocate graph band (24-bit).\n");
+            }
+            instr_scratchFree(dataSize);
+        }
+        bytes += 2 * (uint64_t)dataSize;
+        // The YUV equalize needs the whole image converted first, so it stays a step of its own.
+        if (result == 0 && pass->equalize) {
+            unsigned long errors = instr_errorCount();
+            bmp24_equalize(img);
+            if (instr_errorCount() != errors) result = -1;
+            passes++;
+        }
+    }
+    free(src);
+    free(dst);
+    graph_freePlan(&plan);
+    instr_end(&span, result == 0 ? (uint64_t)width * height : 0, bytes);
+    if (result == 0) instr_info("Graph of %d operations executed in %d passes (24-bit).\n", graph->count, passes);
+    return result;
+}
@@ -0,0 +1,47 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Defines a recorded chain of operations (deferred mode). Recording does no pixel work; graph_execute8/24 plan the
+// chain for the depth of the image and run it with fewer passes over memory than the same calls made one by one:
+//  - adjacent point ops (negative, brightness, threshold, the map of an 8-bit equalize) become one 256-entry table,
+//    and chains that cancel out (two negatives) disappear;
+//  - point ops run while a convolution loads its input or stores its output, not as passes of their own;
+//  - consecutive convolutions run band by band, each band through all of them while the intermediate rows are in
+//    cache, and write to a new buffer instead of copying the image first;
+//  - a grayscale of pixels that are already gray is dropped.
+// The results are bit-identical to calling the bmp8/bmp24 functions in the recorded order.
+typedef struct t_graph t_graph;
+
+// Function graph_create is needed to start an empty graph; NULL if it cannot be allocated.
+t_graph *graph_create(void);
+void graph_free(t_graph *graph);
+// Function graph_clear is needed to reuse a graph for a new chain.
+void graph_clear(t_graph *graph);
+// Function graph_size returns the number of recorded operations.
+int graph_size(const t_graph *graph);
+
+// Recording. Each returns 0, or -1 (reported through instr_error) for invalid arguments or allocation failures.
+int graph_negative(t_graph *graph);
+int graph_brightness(t_graph *graph, int value);
+// Function graph_threshold is only valid on 8-bit images; graph_execute24 rejects a graph that contains it.
+int graph_threshold(t_graph *graph, int threshold);
+// Function graph_grayscale is a no-op on 8-bit images, as in the interactive tool.
+int graph_grayscale(t_graph *graph);
+// Function graph_convolve is needed to record an odd-sized kernel; the kernel is copied.
+int graph_convolve(t_graph *graph, float **kernel, int kernelSize);
+int graph_boxBlur(t_graph *graph);
+int graph_gaussianBlur(t_graph *graph);
+int graph_outline(t_graph *graph);
+int graph_emboss(t_graph *graph);
+int graph_sharpen(t_graph *graph);
+int graph_equalize(t_graph *graph);
+
+// Function graph_execute8 is needed to run the recorded chain on an 8-bit image. The graph is not changed and can
+// be executed on other images. Returns 0, or -1 on failure (the image may then hold the result of part of the chain).
+int graph_execute8(const t_graph *graph, t_bmp8 *img);
+int graph_execute24(const t_graph *graph, t_bmp24 *img);
+
+#endif // GRAPH_H
@@ -0,0 +1,418 @@
+// image_bench.c
+// Micro-benchmarks for every public operation of bmp8.h/bmp24.h on synthetic images.
+// Usage: image_bench [--sizes 1,4,16,100] [--reps N] [--warmup N] [--format csv|json] [--out FILE] [--tmpdir DIR]
+//                    [--instr FILE] [--perf-counters] [--trace FILE] [--simd scalar|sse2|ssse3|avx2|avx512]
+//                    [--threads N] [--tune]
+// --simd benchmarks the kernels of one dispatch level (default: the best the CPU supports).
+// --threads sizes the shared thread pool (default: IMAGE_MOD_THREADS, the tuning cache or the CPU count).
+// --tune only runs the auto-tuner and stores its choice in the tuning cache (tune.h) for later runs.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "utils.h"
+#include "instrument.h"
+#include "trace.h"
+#include "cpu_dispatch.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include "resize.h"
+#include "pyramid.h"
+#include "geometry.h"
+#include "warp.h"
+#include "integral.h"
+#include "threshold.h"
+#include "median.h"
+#include "morph.h"
+#include "edges.h"
+
+#define BENCH_MAX_SIZES 16
+#define BENCH_MAX_REPS 1000
+
+typedef struct {
+    double megapixels[BENCH_MAX_SIZES];
+    int sizeCount;
+    int reps;
+    int warmup;
+    int json;
+    const char *outPath;
+    const char *tmpDir;
+    const char *instrPath;
+    const char *tracePath;
+    int perfCounters;
+    int simdSet;
+    t_cpu_level simdLevel;
+    int threads;
+    int tune;
+} t_bench_options;
+
+// One benchmarked operation. bytesFactor is how many times the op streams the image (read + write = 2).
+typedef struct {
+    const char *name;
+    void (*run8)(t_bmp8 *img);
+    void (*run24)(t_bmp24 *img);
+    double bytesFactor;
+} t_bench_op;
+
+static char g_tmpPath[512];
+
+
+static double now_seconds(void) {
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Deterministic xorshift noise on top of a gradient, so histograms and filters see realistic data.
+static unsigned int bench_random(unsigned int *state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static t_bmp8 *make_bmp8(int width, int height) {
+    t_bmp8 *img = bmp8_allocate((unsigned int)width, (unsigned int)height);
+    if (!img) return NULL;
+
+    unsigned int state = 2463534242u;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int value = (x * 255 / width + y * 255 / height) / 2 + (int)(bench_random(&state) % 64) - 32;
+            img->data[(size_t)y * width + x] = (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value);
+        }
+    }
+    return img;
+}
+
+static t_bmp24 *make_bmp24(int width, int height) {
+    t_bmp24 *img = bmp24_allocate(width, height, 24);
+    if (!img) return NULL;
+    unsigned int state = 88172645u;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned int noise = bench_random(&state);
+            img->data[y][x].red = (uint8_t)(x * 255 / width ^ (noise & 31));
+            img->data[y][x].green = (uint8_t)(y * 255 / height ^ ((noise >> 8) & 31));
+            img->data[y][x].blue = (uint8_t)((x + y) * 127 / (width + height) + ((noise >> 16) & 63));
+        }
+    }
+    return img;
+}
+
+static void copy_bmp8(t_bmp8 *dst, const t_bmp8 *src) {
+    memcpy(dst->data, src->data, src->dataSize);
+}
+
+static void copy_bmp24(t_bmp24 *dst, const t_bmp24 *src) {
+    for (int y = 0; y < src->height; ++y) {
+        memcpy(dst->data[y], src->data[y], (size_t)src->width * sizeof(t_pixel));
+    }
+}
+
+
+// Adapters giving every op the same signature.
+static void op8_load(t_bmp8 *img) { (void)img; bmp8_free(bmp8_loadImage(g_tmpPath)); }
+static void op8_save(t_bmp8 *img) { bmp8_saveImage(g_tmpPath, img); }
+static void op8_brightness(t_bmp8 *img) { bmp8_brightness(img, 40); }
+static void op8_threshold(t_bmp8 *img) { bmp8_threshold(img, 128); }
+static void op8_histogram(t_bmp8 *img) { free(bmp8_computeHistogram(img)); }
+static void op24_load(t_bmp24 *img) { (void)img; bmp24_free(bmp24_loadImage(g_tmpPath)); }
+static void op24_save(t_bmp24 *img) { bmp24_saveImage(g_tmpPath, img); }
+static void op24_brightness(t_bmp24 *img) { bmp24_brightness(img, 40); }
+// Thumbnail: Lanczos to 256 pixels on the long side.
+static void op8_thumbnail(t_bmp8 *img) {
+    unsigned int side = img->width > img->height ? img->width : img->height;
+    unsigned int width = img->width * 256 / side, height = img->height * 256 / side;
+    bmp8_free(bmp8_resize(img, width ? width : 1, height ? height : 1, RESIZE_LANCZOS));
+}
+static void op24_thumbnail(t_bmp24 *img) {
+    int side = img->width > img->height ? img->width : img->height;
+    int width = img->width * 256 / side, height = img->height * 256 / side;
+    bmp24_free(bmp24_resize(img, width ? width : 1, height ? height : 1, RESIZE_LANCZOS));
+}
+// Pyramid: all levels down to 1x1 with the binomial reduction.
+static void op8_pyramid(t_bmp8 *img) {
+    t_bmp8 *levels[PYRAMID_MAX_LEVELS];
+    int count = bmp8_pyramid(img, PYRAMID_MAX_LEVELS, PYRAMID_BINOMIAL, levels);
+    for (int i = 0; i < count; ++i) bmp8_free(levels[i]);
+}
+static void op24_pyramid(t_bmp24 *img) {
+    t_bmp24 *levels[PYRAMID_MAX_LEVELS];
+    int count = bmp24_pyramid(img, PYRAMID_MAX_LEVELS, PYRAMID_BINOMIAL, levels);
+    for (int i = 0; i < count; ++i) bmp24_free(levels[i]);
+}
+static void op8_rotate90(t_bmp8 *img) { bmp8_free(bmp8_rotate(img, 90)); }
+static void op24_rotate90(t_bmp24 *img) { bmp24_free(bmp24_rotate(img, 90)); }
+// Deskew: a 3 degree affine rotation about the centre.
+static void op8_deskew(t_bmp8 *img) {
+    double matrix[6];
+    warp_rotationMatrix(3.0, img->width / 2.0, img->height / 2.0, matrix);
+    bmp8_free(bmp8_warpAffine(img, matrix, img->width, img->height, 255));
+}
+static void op24_deskew(t_bmp24 *img) {
+    double matrix[6];
+    t_pixel white = { 255, 255, 255 };
+    warp_rotationMatrix(3.0, img->width / 2.0, img->height / 2.0, matrix);
+    bmp24_free(bmp24_warpAffine(img, matrix, img->width, img->height, white));
+}
+// Summed-area tables with squares (the tables are 4 + 8 bytes per channel byte read).
+static void op8_integral(t_bmp8 *img) { integral_free(bmp8_integral(img, 1)); }
+static void op24_integral(t_bmp24 *img) { integral_free(bmp24_integral(img, 1)); }
+// Document binarization with a 31x31 window.
+static void op8_sauvola(t_bmp8 *img) { bmp8_adaptiveThreshold(img, THRESHOLD_SAUVOLA, 31, 0.34); }
+static void op8_otsu(t_bmp8 *img) { bmp8_autoThreshold(img, THRESHOLD_OTSU, NULL); }
+static void op8_median3(t_bmp8 *img) { bmp8_median(img, 1); }
+static void op8_median7(t_bmp8 *img) { bmp8_median(img, 3); }
+static void op24_median3(t_bmp24 *img) { bmp24_median(img, 1); }
+static void op24_median7(t_bmp24 *img) { bmp24_median(img, 3); }
+// Erosion with a small and a large element (the cost should not change).
+static void op8_erode3(t_bmp8 *img) { bmp8_morphology(img, MORPH_ERODE, 3, 3); }
+static void op8_erode31(t_bmp8 *img) { bmp8_morphology(img, MORPH_ERODE, 31, 31); }
+static void op8_sobel(t_bmp8 *img) { bmp8_sobel(img, NULL); }
+static void op8_canny(t_bmp8 *img) { bmp8_canny(img, 100, 300); }
+
+static const t_bench_op g_ops[] = {
+    { "load",        op8_load,           op24_load,           1.0 },
+    { "save",        op8_save,           op24_save,           1.0 },
+    { "negative",    bmp8_negative,      bmp24_negative,      2.0 },
+    { "brightness",  op8_brightness,     op24_brightness,     2.0 },
+    { "threshold",   op8_threshold,      NULL,                2.0 },
+    { "grayscale",   NULL,               bmp24_grayscale,     2.0 },
+    { "boxBlur",     bmp8_boxBlur,       bmp24_boxBlur,       2.0 },
+    { "gaussianBlur", bmp8_gaussianBlur, bmp24_gaussianBlur,  2.0 },
+    { "outline",     bmp8_outline,       bmp24_outline,       2.0 },
+    { "emboss",      bmp8_emboss,        bmp24_emboss,        2.0 },
+    { "sharpen",     bmp8_sharpen,       bmp24_sharpen,       2.0 },
+    { "histogram",   op8_histogram,      NULL,                1.0 },
+    { "equalize",    bmp8_equalize,      bmp24_equalize,      3.0 },
+    { "thumbnail",   op8_thumbnail,      op24_thumbnail,      1.0 },
+    { "pyramid",     op8_pyramid,        op24_pyramid,        1.33 },
+    { "rotate90",    op8_rotate90,       op24_rotate90,       2.0 },
+    { "flipH",       bmp8_flipHorizontal, bmp24_flipHorizontal, 2.0 },
+    { "deskew",      op8_deskew,         op24_deskew,         2.0 },
+    { "integral",    op8_integral,       op24_integral,       13.0 },
+    { "sauvola",     op8_sauvola,        NULL,                3.0 },
+    { "otsu",        op8_otsu,           NULL,                3.0 },
+    { "median3",     op8_median3,        op24_median3,        3.0 },
+    { "median7",     op8_median7,        op24_median7,        3.0 },
+    { "erode3",      op8_erode3,         NULL,                5.0 },
+    { "erode31",     op8_erode31,        NULL,                5.0 },
+    { "sobel",       op8_sobel,          NULL,                3.0 },
+    { "canny",       op8_canny,          NULL,                4.0 },
+};
+
+
+static int compare_doubles(const void *a, const void *b) {
+    double da = *(const double *)a, db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static void report(FILE *out, const t_bench_options *opt, int *first, const char *op, int depth,
+                   int width, int height, double *samples, int count, double bytes) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+    double median = count % 2 ? samples[count / 2] : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+    int p95Index = (int)ceil(0.95 * count) - 1;
+    double p95 = samples[p95Index < 0 ? 0 : p95Index];
+    double mpix = (double)width * height / 1e6;
+    double mpixPerSec = median > 0 ? mpix / median : 0.0;
+    double gbPerSec = median > 0 ? bytes / median / 1e9 : 0.0;
+
+    if (opt->json) {
+        fprintf(out, "%s\n    {\"op\": \"%s\", \"depth\": %d, \"width\": %d, \"height\": %d, \"megapixels\": %.3f, "
+                     "\"reps\": %d, \"median_ms\": %.4f, \"p95_ms\": %.4f, \"mpix_per_s\": %.2f, \"gb_per_s\": %.3f}",
+                *first ? "" : ",", op, depth, width, height, mpix, count, median * 1e3, p95 * 1e3, mpixPerSec, gbPerSec);
+    } else {
+        fprintf(out, "%s,%d,%d,%d,%.3f,%d,%.4f,%.4f,%.2f,%.3f\n",
+                op, depth, width, height, mpix, count, median * 1e3, p95 * 1e3, mpixPerSec, gbPerSec);
+    }
+    fflush(out);
+    *first = 0;
+}
+
+static void bench_size(FILE *out, const t_bench_options *opt, int *first, int side) {
+    double samples[BENCH_MAX_REPS];
+    int opCount = (int)(sizeof(g_ops) / sizeof(g_ops[0]));
+
+    for (int depth = 8; depth <= 24; depth += 16) {
+        t_bmp8 *src8 = NULL, *work8 = NULL;
+        t_bmp24 *src24 = NULL, *work24 = NULL;
+        if (depth == 8) {
+            src8 = make_bmp8(side, side);
+            work8 = make_bmp8(side, side);
+            if (!src8 || !work8) { printf("Error: Cannot allocate %dx%d 8-bit benchmark image.\n", side, side); bmp8_free(src8); bmp8_free(work8); continue; }
+            bmp8_saveImage(g_tmpPath, src8); // input for the load benchmark
+        } else {
+            src24 = make_bmp24(side, side);
+            work24 = bmp24_allocate(side, side, 24);
+            if (!src24 || !work24) { printf("Error: Cannot allocate %dx%d 24-bit benchmark image.\n", side, side); bmp24_free(src24); bmp24_free(work24); continue; }
+            bmp24_saveImage(g_tmpPath, src24);
+        }
+        double imageBytes = (double)side * side * (depth / 8);
+
+        for (int o = 0; o < opCount; ++o) {
+            const t_bench_op *op = &g_ops[o];
+            if ((depth == 8 && !op->run8) || (depth == 24 && !op->run24)) continue;
+
+            for (int r = -opt->warmup; r < opt->reps; ++r) {
+                if (depth == 8) copy_bmp8(work8, src8); else copy_bmp24(work24, src24);
+                double start = now_seconds();
+                if (depth == 8) op->run8(work8); else op->run24(work24);
+                double elapsed = now_seconds() - start;
+                if (r >= 0) samples[r] = elapsed;
+            }
+            report(out, opt, first, op->name, depth, side, side, samples, opt->reps, imageBytes * op->bytesFactor);
+        }
+
+        bmp8_free(src8); bmp8_free(work8);
+        bmp24_free(src24); bmp24_free(work24);
+    }
+}
+
+
+static int parse_options(int argc, char **argv, t_bench_options *opt) {
+    static const double defaultSizes[] = { 1, 4, 16, 100 };
+    opt->sizeCount = 4;
+    memcpy(opt->megapixels, defaultSizes, sizeof(defaultSizes));
+    opt->reps = 5;
+    opt->warmup = 1;
+    opt->json = 0;
+    opt->outPath = NULL;
+    opt->tmpDir = ".";
+    opt->instrPath = NULL;
+    opt->tracePath = NULL;
+    opt->perfCounters = 0;
+    opt->simdSet = 0;
+    opt->simdLevel = CPU_SCALAR;
+    opt->threads = 0;
+    opt->tune = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--sizes") == 0 && value) {
+            opt->sizeCount = 0;
+            char buffer[256];
+            snprintf(buffer, sizeof(buffer), "%s", value);
+            for (char *tok = strtok(buffer, ","); tok && opt->sizeCount < BENCH_MAX_SIZES; tok = strtok(NULL, ",")) {
+                double mp = atof(tok);
+                if (mp > 0) opt->megapixels[opt->sizeCount++] = mp;
+            }
+            ++i;
+        } else if (strcmp(arg, "--reps") == 0 && value) {
+            opt->reps = atoi(value);
+            ++i;
+        } else if (strcmp(arg, "--warmup") == 0 && value) {
+            opt->warmup = atoi(value);
+            ++i;
+        } else if (strcmp(arg, "--format") == 0 && value) {
+            opt->json = strcmp(value, "json") == 0;
+            ++i;
+        } else if (strcmp(arg, "--out") == 0 && value) {
+            opt->outPath = value;
+            ++i;
+        } else if (strcmp(arg, "--tmpdir") == 0 && value) {
+            opt->tmpDir = value;
+            ++i;
+        } else if (strcmp(arg, "--instr") == 0 && value) {
+            opt->instrPath = value;
+            ++i;
+        } else if (strcmp(arg, "--trace") == 0 && value) {
+            opt->tracePath = value;
+            ++i;
+        } else if (strcmp(arg, "--simd") == 0 && value && cpu_parseLevel(value, &opt->simdLevel) == 0) {
+            opt->simdSet = 1;
+            ++i;
+        } else if (strcmp(arg, "--threads") == 0 && value && atoi(value) > 0) {
+            opt->threads = atoi(value);
+            ++i;
+        } else if (strcmp(arg, "--tune") == 0) {
+            opt->tune = 1;
+        } else if (strcmp(arg, "--perf-counters") == 0) {
+            opt->perfCounters = 1;
+        } else {
+            printf("Usage: %s [--sizes 1,4,16,100] [--reps N] [--warmup N] [--format csv|json] [--out FILE] [--tmpdir DIR] "
+                   "[--instr FILE] [--perf-counters] [--trace FILE] [--simd LEVEL] [--threads N] [--tune]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (opt->reps < 1 || opt->reps > BENCH_MAX_REPS || opt->warmup < 0 || opt->sizeCount == 0) {
+        printf("Error: Invalid --sizes/--reps/--warmup values.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Runs the auto-tuner with its progress on stdout and saves the result for later runs on this CPU model.
+static int run_tuner(void) {
+    char model[128];
+    cpu_modelName(model, sizeof(model));
+    printf("Tuning for %s (%s kernels)...\n", model, cpu_levelName(cpu_getLevel()));
+    instr_setConsole(INSTR_CONSOLE_ALL);
+    t_tune_params params;
+    if (tune_run(&params) != 0) return 1;
+    const char *path = tune_cachePath();
+    if (!path || tune_save(path, &params) != 0) {
+        printf("Error: Could not save the tuning cache%s%s.\n", path ? " " : "", path ? path : "");
+        return 1;
+    }
+    printf("Saved to %s\n", path);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    t_bench_options opt;
+    if (parse_options(argc, argv, &opt) != 0) return 1;
+
+    // Progress messages of the operations would be timed too and mix with the results on stdout.
+    instr_setConsole(INSTR_CONSOLE_ERRORS);
+    if (opt.simdSet && cpu_setLevel(opt.simdLevel) != 0) {
+        printf("Error: This CPU does not support the %s kernels.\n", cpu_levelName(opt.simdLevel));
+        return 1;
+    }
+    if (opt.tune) return run_tuner();
+    if (opt.threads > 0 && pool_setThreadCount(opt.threads) != 0) {
+        printf("Warning: Could not start %d pool threads; using %d.\n", opt.threads, pool_threadCount());
+    }
+    if (opt.instrPath && instr_openJsonSink(opt.instrPath) != 0) return 1;
+    if (opt.tracePath && trace_start(opt.tracePath) != 0) return 1;
+    if (opt.perfCounters && instr_enableHardwareCounters(1) != 0) {
+        printf("Warning: Hardware counters are not available; --instr records will not include them.\n");
+    }
+
+    FILE *out = opt.outPath ? fopen(opt.outPath, "w") : stdout;
+    if (!out) {
+        printf("Error: Cannot open file %s for writing.\n", opt.outPath);
+        return 1;
+    }
+    snprintf(g_tmpPath, sizeof(g_tmpPath), "%s/image_bench_tmp.bmp", opt.tmpDir);
+
+    int first = 1;
+    if (opt.json) {
+        fprintf(out, "{\n  \"simd\": \"%s\",\n  \"threads\": %d,\n  \"results\": [",
+                cpu_levelName(cpu_getLevel()), pool_threadCount());
+    }
+    else fprintf(out, "op,depth,width,height,megapixels,reps,median_ms,p95_ms,mpix_per_s,gb_per_s\n");
+
+    for (int s = 0; s < opt.sizeCount; ++s) {
+        // Square images, side rounded to a multiple of 4 so 24-bit rows need no padding.
+        int side = ((int)sqrt(opt.megapixels[s] * 1e6) + 3) & ~3;
+        bench_size(out, &opt, &first, side);
+    }
+
+    if (opt.json) fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+    remove(g_tmpPath);
+    instr_closeJsonSink();
+    trace_stop();
+    return 0;
+}
@@ -0,0 +1,664 @@
+// image_check.c
+// Golden-image correctness and performance-regression gate. Runs every operation on the bundled sample images and
+//  - compares an FNV-1a hash of each output with golden/reference.txt (exact match), or, with --refdir, the PSNR of
+//    each output against reference images saved earlier by --update (for kernels allowed to differ in rounding);
+//  - with --timings, compares the best time over --reps runs of each operation with a stored baseline
+//    (--tolerance, default 0.25). The minimum is used because it is the most stable statistic on a loaded machine.
+// Usage: image_check [--images DIR] [--reference FILE] [--refdir DIR] [--min-psnr DB]
+//                    [--timings FILE] [--tolerance FRACTION] [--reps N] [--update] [--update-timings]
+//                    [--simd scalar|sse2|ssse3|avx2|avx512]
+// --simd runs the check with the kernels of one dispatch level; it exits with 77 (skipped) if the CPU lacks it.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "utils.h"
+#include "instrument.h"
+#include "cpu_dispatch.h"
+#include "resize.h"
+#include "pyramid.h"
+#include "geometry.h"
+#include "warp.h"
+#include "integral.h"
+#include "threshold.h"
+#include "median.h"
+#include "morph.h"
+#include "edges.h"
+
+#define CHECK_RESULT_BYTES 160
+#define CHECK_PATH_MAX 512
+#define CHECK_SKIPPED 77
+
+typedef struct {
+    const char *imagesDir;
+    const char *referencePath;
+    const char *refDir;
+    const char *timingsPath;
+    double minPsnr;
+    double tolerance;
+    int reps;
+    int simdSet;
+    t_cpu_level simdLevel;
+    int update;
+    int updateTimings;
+} t_check_options;
+
+// One checked operation. Exactly one of run8/run24 is set; the op is run on every image of that depth.
+typedef struct {
+    const char *name;
+    void (*run8)(t_bmp8 *img);
+    void (*run24)(t_bmp24 *img);
+} t_check_op;
+
+// A line of the reference or timing file: image name, op name and a value (hash or best time in milliseconds).
+typedef struct {
+    char image[64];
+    char op[64];
+    unsigned long long hash;
+    double value;
+} t_check_entry;
+
+static const char *g_images8[] = { "lena_gray.bmp", "barbara_gray.bmp" };
+static const char *g_images24[] = { "lena_color.bmp", "flowers_color.bmp" };
+static char g_tmpPath[CHECK_PATH_MAX];
+
+
+static double now_seconds(void) {
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long fnv1a(unsigned long long hash, const unsigned char *bytes, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static unsigned long long hash_bmp8(const t_bmp8 *img) {
+    unsigned int dims[2] = { img->width, img->height };
+    unsigned long long hash = fnv1a(1469598103934665603ULL, (const unsigned char *)dims, sizeof(dims));
+    return fnv1a(hash, img->data, img->dataSize);
+}
+
+static unsigned long long hash_bmp24(const t_bmp24 *img) {
+    int dims[2] = { img->width, img->height };
+    unsigned long long hash = fnv1a(1469598103934665603ULL, (const unsigned char *)dims, sizeof(dims));
+    for (int y = 0; y < img->height; ++y) {
+        hash = fnv1a(hash, (const unsigned char *)img->data[y], (size_t)img->width * sizeof(t_pixel));
+    }
+    return hash;
+}
+
+static double sum_squared_error(const unsigned char *a, const unsigned char *b, size_t n) {
+    double sse = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = (double)a[i] - (double)b[i];
+        sse += d * d;
+    }
+    return sse;
+}
+
+// Returns the PSNR in dB for a total squared error over n samples (INFINITY when identical).
+static double psnr(double sse, size_t n) {
+    if (sse == 0.0) return INFINITY;
+    return 10.0 * log10(255.0 * 255.0 / (sse / (double)n));
+}
+
+
+// Ops whose result is not an image leave it in the image itself so it can be hashed the same way:
+// the histogram op stores the 256 counters in the first pixels, save/load round-trip through a temp file.
+static void op8_save_load(t_bmp8 *img) {
+    bmp8_saveImage(g_tmpPath, img);
+    t_bmp8 *loaded = bmp8_loadImage(g_tmpPath);
+    if (loaded && loaded->dataSize == img->dataSize) memcpy(img->data, loaded->data, img->dataSize);
+    else memset(img->data, 0, img->dataSize);
+    bmp8_free(loaded);
+}
+static void op24_save_load(t_bmp24 *img) {
+    bmp24_saveImage(g_tmpPath, img);
+    t_bmp24 *loaded = bmp24_loadImage(g_tmpPath);
+    for (int y = 0; y < img->height; ++y) {
+        if (loaded && loaded->width == img->width && loaded->height == img->height)
+            memcpy(img->data[y], loaded->data[y], (size_t)img->width * sizeof(t_pixel));
+        else memset(img->data[y], 0, (size_t)img->width * sizeof(t_pixel));
+    }
+    bmp24_free(loaded);
+}
+static void op8_histogram(t_bmp8 *img) {
+    uint64_t *hist = bmp8_computeHistogram(img);
+    unsigned int counts[256];   // stored as 32-bit counters, the layout of the golden hashes
+    for (int i = 0; hist && i < 256; ++i) counts[i] = (unsigned int)hist[i];
+    memset(img->data, 0, img->dataSize);
+    if (hist && img->dataSize >= sizeof(counts)) memcpy(img->data, counts, sizeof(counts));
+    free(hist);
+}
+static void op8_brightness_up(t_bmp8 *img) { bmp8_brightness(img, 40); }
+static void op8_brightness_down(t_bmp8 *img) { bmp8_brightness(img, -60); }
+static void op8_threshold(t_bmp8 *img) { bmp8_threshold(img, 128); }
+static void op8_niblack(t_bmp8 *img) { bmp8_adaptiveThreshold(img, THRESHOLD_NIBLACK, 25, -0.2); }
+static void op8_sauvola(t_bmp8 *img) { bmp8_adaptiveThreshold(img, THRESHOLD_SAUVOLA, 31, 0.34); }
+static void op8_otsu(t_bmp8 *img) { bmp8_autoThreshold(img, THRESHOLD_OTSU, NULL); }
+static void op8_triangle(t_bmp8 *img) { bmp8_autoThreshold(img, THRESHOLD_TRIANGLE, NULL); }
+static void op8_median3(t_bmp8 *img) { bmp8_median(img, 1); }
+static void op8_median7(t_bmp8 *img) { bmp8_median(img, 3); }
+static void op8_erode(t_bmp8 *img) { bmp8_morphology(img, MORPH_ERODE, 5, 3); }
+static void op8_dilate(t_bmp8 *img) { bmp8_morphology(img, MORPH_DILATE, 3, 7); }
+static void op8_open(t_bmp8 *img) { bmp8_morphology(img, MORPH_OPEN, 9, 9); }
+static void op8_close(t_bmp8 *img) { bmp8_morphology(img, MORPH_CLOSE, 4, 6); }
+static void op8_tophat(t_bmp8 *img) { bmp8_morphology(img, MORPH_TOPHAT, 15, 15); }
+static void op8_sobel(t_bmp8 *img) { bmp8_sobel(img, NULL); }
+static void op8_canny(t_bmp8 *img) { bmp8_canny(img, 100, 300); }
+static void op24_median3(t_bmp24 *img) { bmp24_median(img, 1); }
+static void op24_median7(t_bmp24 *img) { bmp24_median(img, 3); }
+static void op24_brightness_up(t_bmp24 *img) { bmp24_brightness(img, 40); }
+static void op24_brightness_down(t_bmp24 *img) { bmp24_brightness(img, -60); }
+
+// Resize ops replace the image with the resized one (the hash covers the new size).
+static void resize8(t_bmp8 *img, unsigned int width, unsigned int height, t_resize_filter filter) {
+    t_bmp8 *resized = bmp8_resize(img, width, height, filter);
+    if (!resized) return;
+    t_bmp8 swap = *img;
+    *img = *resized;
+    *resized = swap;
+    bmp8_free(resized);
+}
+static void resize24(t_bmp24 *img, int width, int height, t_resize_filter filter) {
+    t_bmp24 *resized = bmp24_resize(img, width, height, filter);
+    if (!resized) return;
+    t_bmp24 swap = *img;
+    *img = *resized;
+    *resized = swap;
+    bmp24_free(resized);
+}
+static void op8_resize_bilinear(t_bmp8 *img) { resize8(img, img->width * 3 / 5, img->height * 3 / 5, RESIZE_BILINEAR); }
+static void op8_resize_bicubic(t_bmp8 *img) { resize8(img, img->width * 7 / 4, img->height * 5 / 4, RESIZE_BICUBIC); }
+static void op8_resize_lanczos(t_bmp8 *img) { resize8(img, 150, 97, RESIZE_LANCZOS); }
+static void op24_resize_bilinear(t_bmp24 *img) { resize24(img, img->width * 3 / 5, img->height * 3 / 5, RESIZE_BILINEAR); }
+static void op24_resize_bicubic(t_bmp24 *img) { resize24(img, img->width * 7 / 4, img->height * 5 / 4, RESIZE_BICUBIC); }
+static void op24_resize_lanczos(t_bmp24 *img) { resize24(img, 150, 97, RESIZE_LANCZOS); }
+
+// Pyramid ops replace the image with the third level; every level feeds the next, so the hash covers all three.
+static void pyramid8(t_bmp8 *img, t_pyramid_filter filter) {
+    t_bmp8 *levels[3];
+    int count = bmp8_pyramid(img, 3, filter, levels);
+    if (count <= 0) return;
+    t_bmp8 swap = *img;
+    *img = *levels[count - 1];
+    *levels[count - 1] = swap;
+    for (int i = 0; i < count; ++i) bmp8_free(levels[i]);
+}
+static void pyramid24(t_bmp24 *img, t_pyramid_filter filter) {
+    t_bmp24 *levels[3];
+    int count = bmp24_pyramid(img, 3, filter, levels);
+    if (count <= 0) return;
+    t_bmp24 swap = *img;
+    *img = *levels[count - 1];
+    *levels[count - 1] = swap;
+    for (int i = 0; i < count; ++i) bmp24_free(levels[i]);
+}
+static void op8_pyramid_box(t_bmp8 *img) { pyramid8(img, PYRAMID_BOX); }
+static void op8_pyramid_binomial(t_bmp8 *img) { pyramid8(img, PYRAMID_BINOMIAL); }
+static void op24_pyramid_box(t_bmp24 *img) { pyramid24(img, PYRAMID_BOX); }
+static void op24_pyramid_binomial(t_bmp24 *img) { pyramid24(img, PYRAMID_BINOMIAL); }
+
+// Rotations and transposes replace the image with the result, like the resize ops.
+static void rotate8(t_bmp8 *img, int degrees) {
+    t_bmp8 *turned = degrees ? bmp8_rotate(img, degrees) : bmp8_transpose(img);
+    if (!turned) return;
+    t_bmp8 swap = *img;
+    *img = *turned;
+    *turned = swap;
+    bmp8_free(turned);
+}
+static void rotate24(t_bmp24 *img, int degrees) {
+    t_bmp24 *turned = degrees ? bmp24_rotate(img, degrees) : bmp24_transpose(img);
+    if (!turned) return;
+    t_bmp24 swap = *img;
+    *img = *turned;
+    *turned = swap;
+    bmp24_free(turned);
+}
+static void op8_rotate90(t_bmp8 *img) { rotate8(img, 90); }
+static void op8_rotate180(t_bmp8 *img) { rotate8(img, 180); }
+static void op8_rotate270(t_bmp8 *img) { rotate8(img, 270); }
+static void op8_transpose(t_bmp8 *img) { rotate8(img, 0); }
+static void op24_rotate90(t_bmp24 *img) { rotate24(img, 90); }
+static void op24_rotate180(t_bmp24 *img) { rotate24(img, 180); }
+static void op24_rotate270(t_bmp24 *img) { rotate24(img, 270); }
+static void op24_transpose(t_bmp24 *img) { rotate24(img, 0); }
+
+// Warps replace the image with the result: a 7 degree deskew on white, and a mild keystone correction.
+static const double g_keystone[9] = { 1.0, 0.05, -5.0, 0.02, 1.0, 0.0, 0.0003, 0.0002, 1.0 };
+static void op8_warp_affine(t_bmp8 *img) {
+    double matrix[6];
+    warp_rotationMatrix(7.0, (img->width - 1) / 2.0, (img->height - 1) / 2.0, matrix);
+    t_bmp8 *warped = bmp8_warpAffine(img, matrix, img->width, img->height, 255);
+    if (!warped) return;
+    t_bmp8 swap = *img;
+    *img = *warped;
+    *warped = swap;
+    bmp8_free(warped);
+}
+static void op8_warp_perspective(t_bmp8 *img) {
+    t_bmp8 *warped = bmp8_warpPerspective(img, g_keystone, img->width, img->height, 0);
+    if (!warped) return;
+    t_bmp8 swap = *img;
+    *img = *warped;
+    *warped = swap;
+    bmp8_free(warped);
+}
+static void op24_warp_affine(t_bmp24 *img) {
+    double matrix[6];
+    t_pixel white = { 255, 255, 255 };
+    warp_rotationMatrix(7.0, (img->width - 1) / 2.0, (img->height - 1) / 2.0, matrix);
+    t_bmp24 *warped = bmp24_warpAffine(img, matrix, img->width, img->height, white);
+    if (!warped) return;
+    t_bmp24 swap = *img;
+    *img = *warped;
+    *warped = swap;
+    bmp24_free(warped);
+}
+static void op24_warp_perspective(t_bmp24 *img) {
+    t_pixel black = { 0, 0, 0 };
+    t_bmp24 *warped = bmp24_warpPerspective(img, g_keystone, img->width, img->height, black);
+    if (!warped) return;
+    t_bmp24 swap = *img;
+    *img = *warped;
+    *warped = swap;
+    bmp24_free(warped);
+}
+
+// Region ops read the summed-area tables of every 15x15 window (clipped at the borders): the local variance / 16 of
+// an 8-bit image, the local mean of each channel of a 24-bit one. Integer arithmetic only.
+#define CHECK_REGION_RADIUS 7
+static void region_window(unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int *x0,
+                          unsigned int *y0, unsigned int *x1, unsigned int *y1) {
+    *x0 = x > CHECK_REGION_RADIUS ? x - CHECK_REGION_RADIUS : 0;
+    *y0 = y > CHECK_REGION_RADIUS ? y - CHECK_REGION_RADIUS : 0;
+    *x1 = x + CHECK_REGION_RADIUS + 1 < width ? x + CHECK_REGION_RADIUS + 1 : width;
+    *y1 = y + CHECK_REGION_RADIUS + 1 < height ? y + CHECK_REGION_RADIUS + 1 : height;
+}
+static void op8_region_stats(t_bmp8 *img) {
+    t_integral *table = bmp8_integral(img, 1);
+    if (!table) return;
+    for (unsigned int y = 0; y < img->height; ++y) {
+        unsigned char *row = img->data + (size_t)(img->height - 1 - y) * img->width;
+        for (unsigned int x = 0; x < img->width; ++x) {
+            unsigned int x0, y0, x1, y1;
+            region_window(x, y, img->width, img->height, &x0, &y0, &x1, &y1);
+            uint64_t count = (uint64_t)(x1 - x0) * (y1 - y0);
+            uint64_t sum = integral_sum(table, x0, y0, x1, y1, 0);
+            uint64_t spread = count * integral_sumSquares(table, x0, y0, x1, y1, 0) - sum * sum;
+            uint64_t value = spread / (count * count) / 16;
+            row[x] = (unsigned char)(value > 255 ? 255 : value);
+        }
+    }
+    integral_free(table);
+}
+static void op24_region_stats(t_bmp24 *img) {
+    t_integral *table = bmp24_integral(img, 0);
+    if (!table) return;
+    for (int y = 0; y < img->height; ++y) {
+        unsigned char *row = (unsigned char *)img->data[y];
+        for (int x = 0; x < img->width; ++x) {
+            unsigned int x0, y0, x1, y1;
+            region_window((unsigned int)x, (unsigned int)y, (unsigned int)img->width, (unsigned int)img->height, &x0,
+                          &y0, &x1, &y1);
+            uint64_t count = (uint64_t)(x1 - x0) * (y1 - y0);
+            for (int c = 0; c < 3; ++c) {
+                row[3 * x + c] = (unsigned char)((integral_sum(table, x0, y0, x1, y1, c) + count / 2) / count);
+            }
+        }
+    }
+    integral_free(table);
+}
+
+static const t_check_op g_ops[] = {
+    { "saveLoad",       op8_save_load,        NULL },
+    { "negative",       bmp8_negative,        NULL },
+    { "brightnessUp",   op8_brightness_up,    NULL },
+    { "brightnessDown", op8_brightness_down,  NULL },
+    { "threshold",      op8_threshold,        NULL },
+    { "boxBlur",        bmp8_boxBlur,         NULL },
+    { "gaussianBlur",   bmp8_gaussianBlur,    NULL },
+    { "outline",        bmp8_outline,         NULL },
+    { "emboss",         bmp8_emboss,          NULL },
+    { "sharpen",        bmp8_sharpen,         NULL },
+    { "histogram",      op8_histogram,        NULL },
+    { "equalize",       bmp8_equalize,        NULL },
+    { "resizeBilinear", op8_resize_bilinear,  NULL },
+    { "resizeBicubic",  op8_resize_bicubic,   NULL },
+    { "resizeLanczos",  op8_resize_lanczos,   NULL },
+    { "pyramidBox",     op8_pyramid_box,      NULL },
+    { "pyramidBinomial", op8_pyramid_binomial, NULL },
+    { "rotate90",       op8_rotate90,         NULL },
+    { "rotate180",      op8_rotate180,        NULL },
+    { "rotate270",      op8_rotate270,        NULL },
+    { "transpose",      op8_transpose,        NULL },
+    { "flipHorizontal", bmp8_flipHorizontal,  NULL },
+    { "flipVertical",   bmp8_flipVertical,    NULL },
+    { "warpAffine",     op8_warp_affine,      NULL },
+    { "warpPerspective", op8_warp_perspective, NULL },
+    { "regionStats",    op8_region_stats,     NULL },
+    { "niblack",        op8_niblack,          NULL },
+    { "sauvola",        op8_sauvola,          NULL },
+    { "otsu",           op8_otsu,             NULL },
+    { "triangle",       op8_triangle,         NULL },
+    { "median3",        op8_median3,          NULL },
+    { "median7",        op8_median7,          NULL },
+    { "erode",          op8_erode,            NULL },
+    { "dilate",         op8_dilate,           NULL },
+    { "open",           op8_open,             NULL },
+    { "close",          op8_close,            NULL },
+    { "tophat",         op8_tophat,           NULL },
+    { "sobel",          op8_sobel,            NULL },
+    { "canny",          op8_canny,            NULL },
+    { "saveLoad",       NULL,                 op24_save_load },
+    { "negative",       NULL,                 bmp24_negative },
+    { "brightnessUp",   NULL,                 op24_brightness_up },
+    { "brightnessDown", NULL,                 op24_brightness_down },
+    { "grayscale",      NULL,                 bmp24_grayscale },
+    { "boxBlur",        NULL,                 bmp24_boxBlur },
+    { "gaussianBlur",   NULL,                 bmp24_gaussianBlur },
+    { "outline",        NULL,                 bmp24_outline },
+    { "emboss",         NULL,                 bmp24_emboss },
+    { "sharpen",        NULL,                 bmp24_sharpen },
+    { "equalize",       NULL,                 bmp24_equalize },
+    { "resizeBilinear", NULL,                 op24_resize_bilinear },
+    { "resizeBicubic",  NULL,                 op24_resize_bicubic },
+    { "resizeLanczos",  NULL,                 op24_resize_lanczos },
+    { "pyramidBox",     NULL,                 op24_pyramid_box },
+    { "pyramidBinomial", NULL,                op24_pyramid_binomial },
+    { "rotate90",       NULL,                 op24_rotate90 },
+    { "rotate180",      NULL,                 op24_rotate180 },
+    { "rotate270",      NULL,                 op24_rotate270 },
+    { "transpose",      NULL,                 op24_transpose },
+    { "flipHorizontal", NULL,                 bmp24_flipHorizontal },
+    { "flipVertical",   NULL,                 bmp24_flipVertical },
+    { "warpAffine",     NULL,                 op24_warp_affine },
+    { "warpPerspective", NULL,                op24_warp_perspective },
+    { "regionStats",    NULL,                 op24_region_stats },
+    { "median3",        NULL,                 op24_median3 },
+    { "median7",        NULL,                 op24_median7 },
+};
+
+
+// Reads every entry of a reference or timing file into *entries (grown as needed, free with free()).
+// Returns the number of entries, or -1 if the file cannot be read or memory runs out.
+static int read_entries(const char *path, t_check_entry **entries, int hexValues) {
+    *entries = NULL;
+    FILE *in = fopen(path, "r");
+    if (!in) return -1;
+    int count = 0, capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), in)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (count == capacity) {
+            int grown = capacity ? 2 * capacity : 64;
+            t_check_entry *resized = (t_check_entry *)realloc(*entries, (size_t)grown * sizeof(t_check_entry));
+            if (!resized) {
+                free(*entries);
+                *entries = NULL;
+                fclose(in);
+                return -1;
+            }
+            *entries = resized;
+            capacity = grown;
+        }
+        t_check_entry *e = &(*entries)[count];
+        int ok = hexValues ? sscanf(line, "%63s %63s %llx", e->image, e->op, &e->hash) == 3
+                           : sscanf(line, "%63s %63s %lf", e->image, e->op, &e->value) == 3;
+        if (ok) count++;
+    }
+    fclose(in);
+    return count;
+}
+
+static const t_check_entry *find_entry(const t_check_entry *entries, int count, const char *image, const char *op) {
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(entries[i].image, image) == 0 && strcmp(entries[i].op, op) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+// Loads the reference output of one op saved by --update --refdir, compares it by PSNR. Returns 1 if acceptable.
+static int check_psnr(const t_check_options *opt, const char *image, const char *op, t_bmp8 *img8, t_bmp24 *img24, double *value) {
+    char path[CHECK_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s.%s", opt->refDir, op, image);
+    *value = -1.0;
+    if (img8) {
+        t_bmp8 *ref = bmp8_loadImage(path);
+        if (ref && ref->dataSize == img8->dataSize) *value = psnr(sum_squared_error(ref->data, img8->data, img8->dataSize), img8->dataSize);
+        bmp8_free(ref);
+    } else {
+        t_bmp24 *ref = bmp24_loadImage(path);
+        if (ref && ref->width == img24->width && ref->height == img24->height) {
+            size_t rowBytes = (size_t)img24->width * sizeof(t_pixel);
+            double sse = 0.0;
+            for (int y = 0; y < img24->height; ++y) {
+                sse += sum_squared_error((unsigned char *)ref->data[y], (unsigned char *)img24->data[y], rowBytes);
+            }
+            *value = psnr(sse, rowBytes * img24->height);
+        }
+        bmp24_free(ref);
+    }
+    return *value >= opt->minPsnr;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double da = *(const double *)a, db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+
+static int parse_options(int argc, char **argv, t_check_options *opt) {
+    opt->imagesDir = ".";
+    opt->referencePath = NULL;
+    opt->refDir = NULL;
+    opt->timingsPath = NULL;
+    opt->minPsnr = 50.0;
+    opt->tolerance = 0.25;
+    opt->reps = 5;
+    opt->simdSet = 0;
+    opt->simdLevel = CPU_SCALAR;
+    opt->update = 0;
+    opt->updateTimings = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--images") == 0 && value) { opt->imagesDir = value; ++i; }
+        else if (strcmp(arg, "--reference") == 0 && value) { opt->referencePath = value; ++i; }
+        else if (strcmp(arg, "--refdir") == 0 && value) { opt->refDir = value; ++i; }
+        else if (strcmp(arg, "--min-psnr") == 0 && value) { opt->minPsnr = atof(value); ++i; }
+        else if (strcmp(arg, "--timings") == 0 && value) { opt->timingsPath = value; ++i; }
+        else if (strcmp(arg, "--tolerance") == 0 && value) { opt->tolerance = atof(value); ++i; }
+        else if (strcmp(arg, "--reps") == 0 && value) { opt->reps = atoi(value); ++i; }
+        else if (strcmp(arg, "--simd") == 0 && value && cpu_parseLevel(value, &opt->simdLevel) == 0) {
+            opt->simdSet = 1; ++i;
+        }
+        else if (strcmp(arg, "--update") == 0) opt->update = 1;
+        else if (strcmp(arg, "--update-timings") == 0) opt->updateTimings = 1;
+        else {
+            printf("Usage: %s [--images DIR] [--reference FILE] [--refdir DIR] [--min-psnr DB] [--timings FILE] "
+                   "[--tolerance FRACTION] [--reps N] [--update] [--update-timings] [--simd LEVEL]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (opt->reps < 1 || opt->reps > 100 || opt->tolerance < 0.0) {
+        printf("Error: Invalid --reps/--tolerance values.\n");
+        return -1;
+    }
+    if (opt->updateTimings && !opt->timingsPath) {
+        printf("Error: --update-timings needs --timings FILE.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    t_check_options opt;
+    if (parse_options(argc, argv, &opt) != 0) return 2;
+    instr_setConsole(INSTR_CONSOLE_ERRORS);
+    if (opt.simdSet && cpu_setLevel(opt.simdLevel) != 0) {
+        printf("Skipped: this CPU does not support the %s kernels.\n", cpu_levelName(opt.simdLevel));
+        return CHECK_SKIPPED;
+    }
+
+    char defaultReference[CHECK_PATH_MAX];
+    if (!opt.referencePath) {
+        snprintf(defaultReference, sizeof(defaultReference), "%s/golden/reference.txt", opt.imagesDir);
+        opt.referencePath = defaultReference;
+    }
+    // One temporary file per level, so the per-level tests can run in parallel.
+    snprintf(g_tmpPath, sizeof(g_tmpPath), "image_check_tmp_%s.bmp", cpu_levelName(cpu_getLevel()));
+
+    t_check_entry *references = NULL, *timings = NULL;
+    int referenceCount = 0, timingCount = 0;
+    if (!opt.update) {
+        referenceCount = read_entries(opt.referencePath, &references, 1);
+        if (referenceCount < 0 && !opt.refDir) {
+            printf("Error: Cannot read reference file %s (run with --update to create it).\n", opt.referencePath);
+            return 2;
+        }
+    }
+    if (opt.timingsPath && !opt.updateTimings) {
+        timingCount = read_entries(opt.timingsPath, &timings, 0);
+        if (timingCount < 0) {
+            printf("Error: Cannot read timing baseline %s (run with --update-timings to create it).\n", opt.timingsPath);
+            free(references);
+            return 2;
+        }
+    }
+
+    FILE *referenceOut = opt.update ? fopen(opt.referencePath, "w") : NULL;
+    FILE *timingsOut = opt.updateTimings ? fopen(opt.timingsPath, "w") : NULL;
+    if ((opt.update && !referenceOut) || (opt.updateTimings && !timingsOut)) {
+        printf("Error: Cannot open output file for --update/--update-timings.\n");
+        if (referenceOut) fclose(referenceOut);
+        if (timingsOut) fclose(timingsOut);
+        free(references);
+        free(timings);
+        return 2;
+    }
+    if (referenceOut) fprintf(referenceOut, "# image op fnv1a64 (generated by image_check --update)\n");
+    if (timingsOut) fprintf(timingsOut, "# image op best_ms (generated by image_check --update-timings)\n");
+
+    int failures = 0, checks = 0;
+    int opCount = (int)(sizeof(g_ops) / sizeof(g_ops[0]));
+    // Every op runs on two images, each giving a hash (or PSNR) row and, with --timings, a time row.
+    size_t maxResults = (size_t)opCount * 2 * (opt.timingsPath ? 2 : 1);
+    char (*results)[CHECK_RESULT_BYTES] = (char (*)[CHECK_RESULT_BYTES])malloc(maxResults * CHECK_RESULT_BYTES);
+    int resultCount = 0;
+    if (!results) {
+        printf("Error: Cannot allocate the results of %zu checks.\n", maxResults);
+        if (referenceOut) fclose(referenceOut);
+        if (timingsOut) fclose(timingsOut);
+        free(references);
+        free(timings);
+        return 2;
+    }
+
+    for (int o = 0; o < opCount; ++o) {
+        const t_check_op *op = &g_ops[o];
+        const char **images = op->run8 ? g_images8 : g_images24;
+        for (int f = 0; f < 2; ++f) {
+            char path[CHECK_PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", opt.imagesDir, images[f]);
+
+            double samples[100];
+            unsigned long long hash = 0;
+            t_bmp8 *out8 = NULL;
+            t_bmp24 *out24 = NULL;
+            int reps = opt.timingsPath ? opt.reps : 1;
+            for (int r = 0; r < reps; ++r) {
+                t_bmp8 *img8 = op->run8 ? bmp8_loadImage(path) : NULL;
+                t_bmp24 *img24 = op->run24 ? bmp24_loadImage(path) : NULL;
+                if (!img8 && !img24) {
+                    printf("Error: Cannot load sample image %s.\n", path);
+                    bmp8_free(out8);
+                    bmp24_free(out24);
+                    if (referenceOut) fclose(referenceOut);
+                    if (timingsOut) fclose(timingsOut);
+                    free(references);
+                    free(timings);
+                    free(results);
+                    return 2;
+                }
+                double start = now_seconds();
+                if (img8) op->run8(img8); else op->run24(img24);
+                samples[r] = now_seconds() - start;
+                hash = img8 ? hash_bmp8(img8) : hash_bmp24(img24);
+                bmp8_free(out8); bmp24_free(out24);
+                out8 = img8; out24 = img24;
+            }
+
+            if (referenceOut) {
+                fprintf(referenceOut, "%s %s %016llx\n", images[f], op->name, hash);
+                if (opt.refDir) {
+                    char refPath[CHECK_PATH_MAX];
+                    snprintf(refPath, sizeof(refPath), "%s/%s.%s", opt.refDir, op->name, images[f]);
+                    if (out8) bmp8_saveImage(refPath, out8); else bmp24_saveImage(refPath, out24);
+                }
+            } else {
+                const t_check_entry *ref = find_entry(references, referenceCount > 0 ? referenceCount : 0, images[f], op->name);
+                int ok;
+                if (opt.refDir) {
+                    double value;
+                    ok = check_psnr(&opt, images[f], op->name, out8, out24, &value);
+                    snprintf(results[resultCount++], CHECK_RESULT_BYTES, "%s %-14s %-18s psnr %.2f dB (min %.2f)",
+                             ok ? "PASS" : "FAIL", op->name, images[f], value, opt.minPsnr);
+                } else {
+                    ok = ref && ref->hash == hash;
+                    snprintf(results[resultCount++], CHECK_RESULT_BYTES, "%s %-14s %-18s hash %016llx%s",
+                             ok ? "PASS" : "FAIL", op->name, images[f], hash, ref ? "" : " (no reference)");
+                }
+                checks++;
+                if (!ok) failures++;
+            }
+
+            if (opt.timingsPath) {
+                qsort(samples, reps, sizeof(double), compare_doubles);
+                double best = samples[0] * 1e3;
+                if (timingsOut) {
+                    fprintf(timingsOut, "%s %s %.4f\n", images[f], op->name, best);
+                } else {
+                    const t_check_entry *base = find_entry(timings, timingCount, images[f], op->name);
+                    int ok = !base || best <= base->value * (1.0 + opt.tolerance);
+                    snprintf(results[resultCount++], CHECK_RESULT_BYTES, "%s %-14s %-18s time %.3f ms (baseline %.3f ms, +%.0f%% allowed)",
+                             ok ? "PASS" : "FAIL", op->name, images[f], best, base ? base->value : 0.0, opt.tolerance * 100.0);
+                    checks++;
+                    if (!ok) failures++;
+                }
+            }
+            bmp8_free(out8);
+            bmp24_free(out24);
+        }
+    }
+    remove(g_tmpPath);
+
+    if (referenceOut) fclose(referenceOut);
+    if (timingsOut) fclose(timingsOut);
+    free(references);
+    free(timings);
+    if (opt.update || opt.updateTimings) {
+        printf("Reference data written.\n");
+        free(results);
+        return 0;
+    }
+
+    printf("\n--- image_check results ---\n");
+    for (int i = 0; i < resultCount; ++i) printf("%s\n", results[i]);
+    free(results);
+    printf("%d of %d checks passed.\n", checks - failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,829 @@
+// imagemod.c
+// Public status-code interface over the bmp8/bmp24 functions. Failures of the underlying functions are detected
+// through the per-thread error count of instrument.c, which also keeps their message for im_lastError.
+#include "imagemod.h"
+#include "bmp8.h"
+#include "bmp24.h"
+#include "utils.h"
+#include "pipeline.h"
+#include "bmp_index.h"
+#include "bmp_mapped.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include "graph.h"
+#include "resize.h"
+#include "pyramid.h"
+#include "geometry.h"
+#include "warp.h"
+#include "integral.h"
+#include "threshold.h"
+#include "median.h"
+#include "morph.h"
+#include "edges.h"
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IM_STRINGIFY2(x) #x
+#define IM_STRINGIFY(x) IM_STRINGIFY2(x)
+#define IM_MESSAGE_MAX 512
+
+struct t_im_image {
+    int depth;
+    t_bmp8 *img8;
+    t_bmp24 *img24;
+};
+
+struct t_im_integral {
+    t_integral *table;
+};
+
+struct t_im_graph {
+    t_graph *graph;
+    int thresholds;               // recorded thresholds: the graph cannot run on 24-bit images
+};
+
+// Records message as the last error of the thread (printed according to the log level) and returns status.
+static t_im_status im_fail(t_im_status status, const char *format, ...) {
+    char message[IM_MESSAGE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    instr_error("%s", message);
+    return status;
+}
+
+// Status of a call into bmp8/bmp24 that started when the thread's error count was errorsBefore.
+static t_im_status im_result(unsigned long errorsBefore, t_im_status onError) {
+    return instr_errorCount() != errorsBefore ? onError : IM_OK;
+}
+
+// Status of a failed load/save: the underlying functions only report allocation failures through errno.
+static t_im_status im_ioFailure(void) {
+    return errno == ENOMEM ? IM_ERR_NO_MEMORY : IM_ERR_IO;
+}
+
+static int im_valid(const t_im_image *image) {
+    return image && ((image->depth == 8 && image->img8 && image->img8->data) ||
+                     (image->depth == 24 && image->img24 && image->img24->data));
+}
+
+const char *im_version(void) {
+    return IM_STRINGIFY(IMAGEMOD_VERSION_MAJOR) "." IM_STRINGIFY(IMAGEMOD_VERSION_MINOR) "."
+           IM_STRINGIFY(IMAGEMOD_VERSION_PATCH);
+}
+
+const char *im_statusString(t_im_status status) {
+    switch (status) {
+        case IM_OK: return "ok";
+        case IM_ERR_INVALID_ARGUMENT: return "invalid argument";
+        case IM_ERR_IO: return "input/output error";
+        case IM_ERR_FORMAT: return "unsupported file format";
+        case IM_ERR_NO_MEMORY: return "out of memory";
+        case IM_ERR_UNSUPPORTED: return "operation not supported for this image";
+    }
+    return "unknown status";
+}
+
+const char *im_lastError(void) {
+    return instr_lastError();
+}
+
+void im_setLogLevel(t_im_log level) {
+    if (level == IM_LOG_ALL) instr_setConsole(INSTR_CONSOLE_ALL);
+    else if (level == IM_LOG_ERRORS) instr_setConsole(INSTR_CONSOLE_ERRORS);
+    else instr_setConsole(INSTR_CONSOLE_SILENT);
+}
+
+
+// ---- Images ----
+
+t_im_status im_load(const char *path, int depth, t_im_image **image) {
+    if (!image) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: im_load needs an output image pointer.\n");
+    *image = NULL;
+    if (!path || (depth != 0 && depth != 8 && depth != 24)) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_load (depth must be 0, 8 or 24).\n");
+    }
+
+    // The header probe tells a missing file from a file in another format before any pixel is read.
+    t_bmp_probe probe;
+    if (bmp_probe(path, &probe) != 0) {
+        FILE *file = fopen(path, "rb");
+        if (!file) return im_fail(IM_ERR_IO, "Error: Cannot open file %s: %s\n", path, strerror(errno));
+        fclose(file);
+        return im_fail(IM_ERR_FORMAT, "Error: %s is not an uncompressed 8-bit or 24-bit BMP file.\n", path);
+    }
+    if (depth != 0 && probe.colorDepth != depth) {
+        return im_fail(IM_ERR_FORMAT, "Error: %s is not a %d-bit image (it is %d-bit).\n", path, depth, probe.colorDepth);
+    }
+
+    t_im_image *result = (t_im_image *)calloc(1, sizeof(t_im_image));
+    if (!result) return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for image structure.\n");
+    result->depth = probe.colorDepth;
+    errno = 0;
+    if (result->depth == 8) result->img8 = bmp8_loadImage(path);
+    else result->img24 = bmp24_loadImage(path);
+    if (!result->img8 && !result->img24) {
+        free(result);
+        return im_ioFailure();
+    }
+    *image = result;
+    return IM_OK;
+}
+
+t_im_status im_save(const t_im_image *image, const char *path) {
+    if (!im_valid(image) || !path) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_save.\n");
+    unsigned long errorsBefore = instr_errorCount();
+    errno = 0;
+    if (image->depth == 8) bmp8_saveImage(path, image->img8);
+    else bmp24_saveImage(path, image->img24);
+    return instr_errorCount() != errorsBefore ? im_ioFailure() : IM_OK;
+}
+
+t_im_status im_create(int width, int height, int depth, t_im_image **image) {
+    if (!image) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: im_create needs an output image pointer.\n");
+    *image = NULL;
+    if (width <= 0 || height <= 0 || (depth != 8 && depth != 24)) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid image size %dx%d or depth %d.\n", width, height, depth);
+    }
+    t_im_image *result = (t_im_image *)calloc(1, sizeof(t_im_image));
+    if (!result) return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for image structure.\n");
+    result->depth = depth;
+    unsigned long errorsBefore = instr_errorCount();
+    if (depth == 8) result->img8 = bmp8_allocate((unsigned int)width, (unsigned int)height);
+    else result->img24 = bmp24_allocate(width, height, 24);
+    if (!result->img8 && !result->img24) {
+        free(result);
+        // bmp24_allocate reports only allocation failures; sizes it rejects silently are too large to address.
+        if (instr_errorCount() == errorsBefore) instr_error("Error: Cannot allocate a %dx%d image.\n", width, height);
+        return IM_ERR_NO_MEMORY;
+    }
+    *image = result;
+    return IM_OK;
+}
+
+void im_free(t_im_image *image) {
+    if (!image) return;
+    bmp8_free(image->img8);
+    bmp24_free(image->img24);
+    free(image);
+}
+
+t_im_status im_getInfo(const t_im_image *image, t_im_info *info) {
+    if (!im_valid(image) || !info) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_getInfo.\n");
+    info->depth = image->depth;
+    if (image->depth == 8) {
+        const t_bmp8 *img = image->img8;
+        info->width = (int)img->width;
+        info->height = (int)img->height;
+        info->dataSize = img->dataSize;
+        memcpy(&info->fileSize, img->header + 2, sizeof(info->fileSize));
+        memcpy(&info->dataOffset, img->header + 10, sizeof(info->dataOffset));
+    } else {
+        const t_bmp24 *img = image->img24;
+        info->width = img->width;
+        info->height = img->height;
+        info->dataSize = (size_t)img->width * img->height * sizeof(t_pixel);
+        info->fileSize = img->header.size;
+        info->dataOffset = img->header.offset;
+    }
+    return IM_OK;
+}
+
+// Row y (0 = top) of an image in memory. 8-bit data keeps the bottom-up row order of the file.
+static unsigned char *im_row(const t_im_image *image, int y, size_t *rowBytes) {
+    if (image->depth == 8) {
+        *rowBytes = image->img8->width;
+        return image->img8->data + (size_t)(image->img8->height - 1 - (unsigned int)y) * image->img8->width;
+    }
+    *rowBytes = (size_t)image->img24->width * sizeof(t_pixel);
+    return (unsigned char *)image->img24->data[y];
+}
+
+static int im_height(const t_im_image *image) {
+    return image->depth == 8 ? (int)image->img8->height : image->img24->height;
+}
+
+t_im_status im_readPixels(const t_im_image *image, void *dst, size_t stride) {
+    if (!im_valid(image) || !dst) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_readPixels.\n");
+    for (int y = 0; y < im_height(image); ++y) {
+        size_t rowBytes;
+        const unsigned char *row = im_row(image, y, &rowBytes);
+        if (stride < rowBytes) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Stride %zu is shorter than a row.\n", stride);
+        memcpy((unsigned char *)dst + (size_t)y * stride, row, rowBytes);
+    }
+    return IM_OK;
+}
+
+t_im_status im_writePixels(t_im_image *image, const void *src, size_t stride) {
+    if (!im_valid(image) || !src) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_writePixels.\n");
+    for (int y = 0; y < im_height(image); ++y) {
+        size_t rowBytes;
+        unsigned char *row = im_row(image, y, &rowBytes);
+        if (stride < rowBytes) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Stride %zu is shorter than a row.\n", stride);
+        memcpy(row, (const unsigned char *)src + (size_t)y * stride, rowBytes);
+    }
+    return IM_OK;
+}
+
+
+// ---- Operations ----
+
+static t_im_status im_applyRaw(t_bmp8 *img8, t_bmp24 *img24, t_im_operation op) {
+    unsigned long errorsBefore = instr_errorCount();
+    switch (op) {
+        case IM_OP_NEGATIVE: if (img8) bmp8_negative(img8); else bmp24_negative(img24); break;
+        case IM_OP_GRAYSCALE: if (img24) bmp24_grayscale(img24); break;
+        case IM_OP_BOX_BLUR: if (img8) bmp8_boxBlur(img8); else bmp24_boxBlur(img24); break;
+        case IM_OP_GAUSSIAN_BLUR: if (img8) bmp8_gaussianBlur(img8); else bmp24_gaussianBlur(img24); break;
+        case IM_OP_OUTLINE: if (img8) bmp8_outline(img8); else bmp24_outline(img24); break;
+        case IM_OP_EMBOSS: if (img8) bmp8_emboss(img8); else bmp24_emboss(img24); break;
+        case IM_OP_SHARPEN: if (img8) bmp8_sharpen(img8); else bmp24_sharpen(img24); break;
+        case IM_OP_EQUALIZE: if (img8) bmp8_equalize(img8); else bmp24_equalize(img24); break;
+        default: return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Unknown operation %d.\n", (int)op);
+    }
+    // With valid arguments the operations can only fail to allocate their scratch memory.
+    return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+}
+
+t_im_status im_apply(t_im_image *image, t_im_operation op) {
+    if (!im_valid(image)) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid image for im_apply.\n");
+    return im_applyRaw(image->img8, image->img24, op);
+}
+
+t_im_status im_brightness(t_im_image *image, int value) {
+    if (!im_valid(image) || value < -255 || value > 255) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_brightness (value %d).\n", value);
+    }
+    if (image->depth == 8) bmp8_brightness(image->img8, value);
+    else bmp24_brightness(image->img24, value);
+    return IM_OK;
+}
+
+t_im_status im_threshold(t_im_image *image, int threshold) {
+    if (!im_valid(image) || threshold < 0 || threshold > 255) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_threshold (threshold %d).\n", threshold);
+    }
+    if (image->depth != 8) return im_fail(IM_ERR_UNSUPPORTED, "Error: Threshold is only defined for 8-bit images.\n");
+    bmp8_threshold(image->img8, threshold);
+    return IM_OK;
+}
+
+t_im_status im_autoThreshold(t_im_image *image, t_im_auto_threshold method, const unsigned int histogram[256],
+                             int *threshold) {
+    if (threshold) *threshold = 0;
+    if (!im_valid(image) || (method != IM_AUTO_OTSU && method != IM_AUTO_TRIANGLE)) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_autoThreshold.\n");
+    }
+    if (image->depth != 8) return im_fail(IM_ERR_UNSUPPORTED, "Error: Threshold is only defined for 8-bit images.\n");
+    uint64_t counts[256];
+    if (histogram) {
+        unsigned long long total = 0;
+        for (int i = 0; i < 256; ++i) {
+            counts[i] = histogram[i];
+            total += histogram[i];
+        }
+        if (total != (unsigned long long)image->img8->width * image->img8->height) {
+            return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Histogram does not match the image for im_autoThreshold.\n");
+        }
+    }
+    unsigned long errorsBefore = instr_errorCount();
+    int level = bmp8_autoThreshold(image->img8, method == IM_AUTO_OTSU ? THRESHOLD_OTSU : THRESHOLD_TRIANGLE,
+                                   histogram ? counts : NULL);
+    if (level < 0) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    if (threshold) *threshold = level;
+    return IM_OK;
+}
+
+t_im_status im_adaptiveThreshold(t_im_image *image, t_im_threshold method, int window, double k) {
+    if (!im_valid(image) || (method != IM_THRESHOLD_NIBLACK && method != IM_THRESHOLD_SAUVOLA) || window < 3 ||
+        window % 2 == 0 || window > THRESHOLD_MAX_WINDOW || !isfinite(k)) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_adaptiveThreshold (window %d).\n", window);
+    }
+    if (image->depth != 8) return im_fail(IM_ERR_UNSUPPORTED, "Error: Threshold is only defined for 8-bit images.\n");
+    unsigned long errorsBefore = instr_errorCount();
+    t_threshold_method mode = method == IM_THRESHOLD_NIBLACK ? THRESHOLD_NIBLACK : THRESHOLD_SAUVOLA;
+    if (bmp8_adaptiveThreshold(image->img8, mode, window, k) != 0) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    return IM_OK;
+}
+
+t_im_status im_median(t_im_image *image, int radius) {
+    if (!im_valid(image) || radius < 1 || radius > MEDIAN_MAX_RADIUS) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_median (radius %d).\n", radius);
+    }
+    unsigned long errorsBefore = instr_errorCount();
+    int status = image->depth == 8 ? bmp8_median(image->img8, radius) : bmp24_median(image->img24, radius);
+    if (status != 0) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    return IM_OK;
+}
+
+t_im_status im_morphology(t_im_image *image, t_im_morph op, int width, int height) {
+    if (!im_valid(image) || op < IM_MORPH_ERODE || op > IM_MORPH_TOPHAT || width < 1 || height < 1) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_morphology (%dx%d).\n", width, height);
+    }
+    if (image->depth != 8) return im_fail(IM_ERR_UNSUPPORTED, "Error: Morphology is only defined for 8-bit images.\n");
+    unsigned long errorsBefore = instr_errorCount();
+    static const t_morph_op ops[] = { MORPH_ERODE, MORPH_DILATE, MORPH_OPEN, MORPH_CLOSE, MORPH_TOPHAT };
+    if (bmp8_morphology(image->img8, ops[op], width, height) != 0) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    return IM_OK;
+}
+
+t_im_status im_sobel(t_im_image *image, unsigned char *direction, size_t stride) {
+    if (!im_valid(image)) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_sobel.\n");
+    if (image->depth != 8) return im_fail(IM_ERR_UNSUPPORTED, "Error: Sobel gradients are only defined for 8-bit images.\n");
+    size_t width = image->img8->width, height = image->img8->height;
+    if (direction && stride < width) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Stride %zu is shorter than a row.\n", stride);
+    }
+    unsigned long errorsBefore = instr_errorCount();
+    unsigned char *sectors = NULL;
+    if (direction) {
+        sectors = (unsigned char *)malloc(width * height);
+        if (!sectors) return im_fail(IM_ERR_NO_MEMORY, "Error: Failed to allocate gradient directions.\n");
+    }
+    if (bmp8_sobel(image->img8, sectors) != 0) {
+        free(sectors);
+        return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    }
+    // The directions are in memory order, bottom row first.
+    for (size_t y = 0; sectors && y < height; ++y) {
+        memcpy(direction + y * stride, sectors + (height - 1 - y) * width, width);
+    }
+    free(sectors);
+    return IM_OK;
+}
+
+t_im_status im_canny(t_im_image *image, int low, int high) {
+    if (!im_valid(image) || low < 0 || high < low || high > EDGES_MAX_MAGNITUDE) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_canny (%d, %d).\n", low, high);
+    }
+    if (image->depth != 8) return im_fail(IM_ERR_UNSUPPORTED, "Error: Canny edges are only defined for 8-bit images.\n");
+    unsigned long errorsBefore = instr_errorCount();
+    if (bmp8_canny(image->img8, low, high) != 0) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    return IM_OK;
+}
+
+t_im_status im_convolve(t_im_image *image, const float *kernel, int size) {
+    if (!im_valid(image) || !kernel || size <= 0 || size % 2 == 0) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_convolve (size %d).\n", size);
+    }
+    unsigned long errorsBefore = instr_errorCount();
+    float **rows = allocate_kernel(size);
+    if (!rows) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    for (int i = 0; i < size; ++i) {
+        memcpy(rows[i], kernel + (size_t)i * size, (size_t)size * sizeof(float));
+    }
+    if (image->depth == 8) bmp8_applyFilter(image->img8, rows, size);
+    else bmp24_applyFilter(image->img24, rows, size);
+    free_kernel(rows, size);
+    return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+}
+
+t_im_status im_convolveToFile(const t_im_image *image, const float *kernel, int size, const char *path) {
+    if (!im_valid(image) || !kernel || size <= 0 || size % 2 == 0 || !path) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_convolveToFile (size %d).\n", size);
+    }
+    unsigned long errorsBefore = instr_errorCount();
+    float **rows = allocate_kernel(size);
+    if (!rows) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    for (int i = 0; i < size; ++i) {
+        memcpy(rows[i], kernel + (size_t)i * size, (size_t)size * sizeof(float));
+    }
+    errno = 0;
+    int ret = image->depth == 8 ? bmp8_applyFilterToFile(image->img8, rows, size, path)
+                                : bmp24_applyFilterToFile(image->img24, rows, size, path);
+    free_kernel(rows, size);
+    return ret == 0 ? IM_OK : im_ioFailure();
+}
+
+t_im_status im_resize(const t_im_image *image, int width, int height, t_im_resize filter, t_im_image **result) {
+    if (result) *result = NULL;
+    if (!im_valid(image) || !result || width <= 0 || height <= 0 ||
+        (filter != IM_RESIZE_BILINEAR && filter != IM_RESIZE_BICUBIC && filter != IM_RESIZE_LANCZOS)) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_resize (%dx%d).\n", width, height);
+    }
+    t_im_image *resized = (t_im_image *)calloc(1, sizeof(t_im_image));
+    if (!resized) return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for image structure.\n");
+    resized->depth = image->depth;
+    t_resize_filter mode = filter == IM_RESIZE_BILINEAR ? RESIZE_BILINEAR : filter == IM_RESIZE_BICUBIC ? RESIZE_BICUBIC
+                                                                                                         : RESIZE_LANCZOS;
+    if (image->depth == 8) resized->img8 = bmp8_resize(image->img8, (unsigned int)width, (unsigned int)height, mode);
+    else resized->img24 = bmp24_resize(image->img24, width, height, mode);
+    if (!resized->img8 && !resized->img24) {
+        free(resized);
+        return IM_ERR_NO_MEMORY;
+    }
+    *result = resized;
+    return IM_OK;
+}
+
+t_im_status im_flip(t_im_image *image, t_im_flip axis) {
+    if (!im_valid(image) || (axis != IM_FLIP_HORIZONTAL && axis != IM_FLIP_VERTICAL)) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_flip.\n");
+    }
+    unsigned long errorsBefore = instr_errorCount();
+    if (image->depth == 8) {
+        if (axis == IM_FLIP_HORIZONTAL) bmp8_flipHorizontal(image->img8);
+        else bmp8_flipVertical(image->img8);
+    } else {
+        if (axis == IM_FLIP_HORIZONTAL) bmp24_flipHorizontal(image->img24);
+        else bmp24_flipVertical(image->img24);
+    }
+    return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+}
+
+// Wraps the result of a rotation or transpose (degrees is ignored when transpose is set).
+static t_im_status im_turn(const t_im_image *image, int degrees, int transpose, t_im_image **result) {
+    t_im_image *turned = (t_im_image *)calloc(1, sizeof(t_im_image));
+    if (!turned) return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for image structure.\n");
+    turned->depth = image->depth;
+    if (image->depth == 8) turned->img8 = transpose ? bmp8_transpose(image->img8) : bmp8_rotate(image->img8, degrees);
+    else turned->img24 = transpose ? bmp24_transpose(image->img24) : bmp24_rotate(image->img24, degrees);
+    if (!turned->img8 && !turned->img24) {
+        free(turned);
+        return IM_ERR_NO_MEMORY;
+    }
+    *result = turned;
+    return IM_OK;
+}
+
+t_im_status im_rotate(const t_im_image *image, int degrees, t_im_image **result) {
+    if (result) *result = NULL;
+    if (!im_valid(image) || !result || degrees % 90 != 0) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_rotate (%d degrees).\n", degrees);
+    }
+    return im_turn(image, degrees, 0, result);
+}
+
+t_im_status im_transpose(const t_im_image *image, t_im_image **result) {
+    if (result) *result = NULL;
+    if (!im_valid(image) || !result) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_transpose.\n");
+    return im_turn(image, 0, 1, result);
+}
+
+// Runs an affine (6 values) or perspective (9 values) warp.
+static t_im_status im_warp(const t_im_image *image, const double *matrix, int perspective, int width, int height,
+                           int fill, t_im_image **result) {
+    if (result) *result = NULL;
+    int finite = matrix != NULL;
+    for (int i = 0; finite && i < (perspective ? 9 : 6); ++i) finite = isfinite(matrix[i]);
+    if (!im_valid(image) || !finite || !result || width <= 0 || height <= 0 || fill < 0 || fill > 255) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for warp (%dx%d).\n", width, height);
+    }
+    t_im_image *warped = (t_im_image *)calloc(1, sizeof(t_im_image));
+    if (!warped) return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for image structure.\n");
+    warped->depth = image->depth;
+    if (image->depth == 8) {
+        unsigned int w = (unsigned int)width, h = (unsigned int)height;
+        warped->img8 = perspective ? bmp8_warpPerspective(image->img8, matrix, w, h, (unsigned char)fill)
+                                   : bmp8_warpAffine(image->img8, matrix, w, h, (unsigned char)fill);
+    } else {
+        t_pixel color = { (uint8_t)fill, (uint8_t)fill, (uint8_t)fill };
+        warped->img24 = perspective ? bmp24_warpPerspective(image->img24, matrix, width, height, color)
+                                    : bmp24_warpAffine(image->img24, matrix, width, height, color);
+    }
+    if (!warped->img8 && !warped->img24) {
+        free(warped);
+        return IM_ERR_NO_MEMORY;
+    }
+    *result = warped;
+    return IM_OK;
+}
+
+t_im_status im_warpAffine(const t_im_image *image, const double matrix[6], int width, int height, int fill,
+                          t_im_image **result) {
+    return im_warp(image, matrix, 0, width, height, fill, result);
+}
+
+t_im_status im_warpPerspective(const t_im_image *image, const double matrix[9], int width, int height, int fill,
+                               t_im_image **result) {
+    return im_warp(image, matrix, 1, width, height, fill, result);
+}
+
+void im_rotationMatrix(double degrees, double centerX, double centerY, double matrix[6]) {
+    if (matrix) warp_rotationMatrix(degrees, centerX, centerY, matrix);
+}
+
+t_im_status im_pyramid(const t_im_image *image, int maxLevels, t_im_pyramid filter, t_im_image **levels,
+                       int *count) {
+    if (count) *count = 0;
+    if (!im_valid(image) || !levels || !count || maxLevels < 0 ||
+        (filter != IM_PYRAMID_BOX && filter != IM_PYRAMID_BINOMIAL)) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_pyramid.\n");
+    }
+    t_pyramid_filter mode = filter == IM_PYRAMID_BOX ? PYRAMID_BOX : PYRAMID_BINOMIAL;
+    int wanted = maxLevels < PYRAMID_MAX_LEVELS ? maxLevels : PYRAMID_MAX_LEVELS;
+    t_bmp8 *levels8[PYRAMID_MAX_LEVELS];
+    t_bmp24 *levels24[PYRAMID_MAX_LEVELS];
+    int built = image->depth == 8 ? bmp8_pyramid(image->img8, wanted, mode, levels8)
+                                  : bmp24_pyramid(image->img24, wanted, mode, levels24);
+    if (built < 0) return IM_ERR_NO_MEMORY;
+    int wrapped = 0;
+    for (; wrapped < built; ++wrapped) {
+        t_im_image *level = (t_im_image *)calloc(1, sizeof(t_im_image));
+        if (!level) break;
+        level->depth = image->depth;
+        if (image->depth == 8) level->img8 = levels8[wrapped];
+        else level->img24 = levels24[wrapped];
+        levels[wrapped] = level;
+    }
+    if (wrapped < built) {
+        for (int i = 0; i < wrapped; ++i) im_free(levels[i]);
+        for (int i = wrapped; i < built; ++i) {
+            if (image->depth == 8) bmp8_free(levels8[i]);
+            else bmp24_free(levels24[i]);
+        }
+        return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for image structure.\n");
+    }
+    *count = built;
+    return IM_OK;
+}
+
+t_im_status im_savePyramid(const t_im_image *image, const char *prefix, int maxLevels, t_im_pyramid filter,
+                           int *count) {
+    if (count) *count = 0;
+    if (!prefix) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_savePyramid.\n");
+    t_im_image *levels[PYRAMID_MAX_LEVELS];
+    int built = 0;
+    t_im_status status = im_pyramid(image, maxLevels, filter, levels, &built);
+    if (status != IM_OK) return status;
+    size_t size = strlen(prefix) + 16;
+    char *path = (char *)malloc(size);
+    if (!path && built > 0) status = im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for file name.\n");
+    for (int i = 0; i < built && status == IM_OK; ++i) {
+        snprintf(path, size, "%s_%d.bmp", prefix, i + 1);
+        status = im_save(levels[i], path);
+    }
+    for (int i = 0; i < built; ++i) im_free(levels[i]);
+    free(path);
+    if (status == IM_OK && count) *count = built;
+    return status;
+}
+
+t_im_status im_integralCreate(const t_im_image *image, int squares, t_im_integral **integral) {
+    if (!integral) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: im_integralCreate needs an output pointer.\n");
+    *integral = NULL;
+    if (!im_valid(image)) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_integralCreate.\n");
+    t_im_integral *result = (t_im_integral *)calloc(1, sizeof(t_im_integral));
+    if (!result) return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for summed-area structure.\n");
+    unsigned long errorsBefore = instr_errorCount();
+    if (image->depth == 8) result->table = bmp8_integral(image->img8, squares);
+    else result->table = bmp24_integral(image->img24, squares);
+    if (!result->table) {
+        free(result);
+        return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    }
+    *integral = result;
+    return IM_OK;
+}
+
+void im_integralFree(t_im_integral *integral) {
+    if (!integral) return;
+    integral_free(integral->table);
+    free(integral);
+}
+
+t_im_status im_regionStats(const t_im_integral *integral, int x, int y, int width, int height, int channel,
+                           t_im_region *stats) {
+    if (!integral || !stats || x < 0 || y < 0 || width <= 0 || height <= 0) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_regionStats.\n");
+    }
+    t_integral_stats region;
+    if (integral_region(integral->table, (unsigned int)x, (unsigned int)y, (unsigned int)width, (unsigned int)height,
+                        channel, &region) != 0) {
+        return IM_ERR_INVALID_ARGUMENT;
+    }
+    stats->count = region.count;
+    stats->sum = region.sum;
+    stats->sumSquares = region.sumSquares;
+    stats->mean = region.mean;
+    stats->variance = region.variance;
+    return IM_OK;
+}
+
+t_im_status im_histogram(const t_im_image *image, unsigned int histogram[256]) {
+    if (!im_valid(image) || !histogram) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_histogram.\n");
+    if (image->depth != 8) return im_fail(IM_ERR_UNSUPPORTED, "Error: Histogram is only defined for 8-bit images.\n");
+    unsigned long errorsBefore = instr_errorCount();
+    uint64_t *counts = bmp8_computeHistogram(image->img8);
+    if (!counts) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    for (int i = 0; i < 256; ++i) {
+        if (counts[i] > UINT_MAX) {
+            free(counts);
+            return im_fail(IM_ERR_UNSUPPORTED, "Error: Histogram counts do not fit in 32 bits (%zu pixels).\n",
+                           image->img8->dataSize);
+        }
+        histogram[i] = (unsigned int)counts[i];
+    }
+    free(counts);
+    return IM_OK;
+}
+
+
+// ---- Deferred mode ----
+
+t_im_status im_graphCreate(t_im_graph **graph) {
+    if (!graph) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_graphCreate.\n");
+    *graph = NULL;
+    t_im_graph *result = (t_im_graph *)calloc(1, sizeof(t_im_graph));
+    if (!result) return im_fail(IM_ERR_NO_MEMORY, "Error: Cannot allocate memory for graph structure.\n");
+    result->graph = graph_create();
+    if (!result->graph) {
+        free(result);
+        return IM_ERR_NO_MEMORY;
+    }
+    *graph = result;
+    return IM_OK;
+}
+
+void im_graphFree(t_im_graph *graph) {
+    if (!graph) return;
+    graph_free(graph->graph);
+    free(graph);
+}
+
+t_im_status im_graphApply(t_im_graph *graph, t_im_operation op) {
+    if (!graph) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid graph for im_graphApply.\n");
+    int result;
+    switch (op) {
+        case IM_OP_NEGATIVE: result = graph_negative(graph->graph); break;
+        case IM_OP_GRAYSCALE: result = graph_grayscale(graph->graph); break;
+        case IM_OP_BOX_BLUR: result = graph_boxBlur(graph->graph); break;
+        case IM_OP_GAUSSIAN_BLUR: result = graph_gaussianBlur(graph->graph); break;
+        case IM_OP_OUTLINE: result = graph_outline(graph->graph); break;
+        case IM_OP_EMBOSS: result = graph_emboss(graph->graph); break;
+        case IM_OP_SHARPEN: result = graph_sharpen(graph->graph); break;
+        case IM_OP_EQUALIZE: result = graph_equalize(graph->graph); break;
+        default: return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Unknown operation %d.\n", (int)op);
+    }
+    return result == 0 ? IM_OK : IM_ERR_NO_MEMORY;
+}
+
+t_im_status im_graphBrightness(t_im_graph *graph, int value) {
+    if (!graph || value < -255 || value > 255) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_graphBrightness (value %d).\n", value);
+    }
+    return graph_brightness(graph->graph, value) == 0 ? IM_OK : IM_ERR_NO_MEMORY;
+}
+
+t_im_status im_graphThreshold(t_im_graph *graph, int threshold) {
+    if (!graph || threshold < 0 || threshold > 255) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_graphThreshold (threshold %d).\n",
+                       threshold);
+    }
+    if (graph_threshold(graph->graph, threshold) != 0) return IM_ERR_NO_MEMORY;
+    graph->thresholds++;
+    return IM_OK;
+}
+
+t_im_status im_graphConvolve(t_im_graph *graph, const float *kernel, int size) {
+    if (!graph || !kernel || size <= 0 || size % 2 == 0) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_graphConvolve (size %d).\n", size);
+    }
+    unsigned long errorsBefore = instr_errorCount();
+    float **rows = allocate_kernel(size);
+    if (!rows) return im_result(errorsBefore, IM_ERR_NO_MEMORY);
+    for (int i = 0; i < size; ++i) {
+        memcpy(rows[i], kernel + (size_t)i * size, (size_t)size * sizeof(float));
+    }
+    int result = graph_convolve(graph->graph, rows, size);
+    free_kernel(rows, size);
+    return result == 0 ? IM_OK : IM_ERR_NO_MEMORY;
+}
+
+t_im_status im_graphExecute(const t_im_graph *graph, t_im_image *image) {
+    if (!graph || !im_valid(image)) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_graphExecute.\n");
+    if (image->depth != 8 && graph->thresholds > 0) {
+        return im_fail(IM_ERR_UNSUPPORTED, "Error: Threshold is only defined for 8-bit images.\n");
+    }
+    int result = image->depth == 8 ? graph_execute8(graph->graph, image->img8) : graph_execute24(graph->graph, image->img24);
+    // With a supported chain execution can only fail to allocate its buffers.
+    return result == 0 ? IM_OK : IM_ERR_NO_MEMORY;
+}
+
+
+// ---- Directories ----
+
+static void im_batchApply(t_bmp8 *img8, t_bmp24 *img24, void *userData) {
+    im_applyRaw(img8, img24, *(const t_im_operation *)userData);
+}
+
+t_im_status im_processDirectory(const char *inputDir, const char *outputDir, int depth,
+                                t_im_operation op, int *failed) {
+    if (failed) *failed = 0;
+    if (!inputDir || !outputDir || (depth != 8 && depth != 24) || (unsigned int)op > IM_OP_EQUALIZE) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_processDirectory.\n");
+    }
+
+    int count = 0;
+    errno = 0;
+    char **files = list_bmp_files(inputDir, &count);
+    if (!files) return im_ioFailure();
+    if (count == 0) {
+        instr_info("No .bmp files found in %s.\n", inputDir);
+        free_file_list(files, count);
+        return IM_OK;
+    }
+
+    t_pipeline_job *jobs = (t_pipeline_job *)calloc(count, sizeof(t_pipeline_job));
+    char **outputs = (char **)calloc(count, sizeof(char *));
+    if (!jobs || !outputs) {
+        free(jobs); free(outputs); free_file_list(files, count);
+        return im_fail(IM_ERR_NO_MEMORY, "Error: Failed to allocate batch jobs.\n");
+    }
+    for (int i = 0; i < count; ++i) {
+        const char *base = strrchr(files[i], '/');
+        base = base ? base + 1 : files[i];
+        size_t len = strlen(outputDir) + strlen(base) + 2;
+        outputs[i] = (char *)malloc(len);
+        if (!outputs[i]) {
+            free_file_list(outputs, count); free(jobs); free_file_list(files, count);
+            return im_fail(IM_ERR_NO_MEMORY, "Error: Failed to allocate batch jobs.\n");
+        }
+        snprintf(outputs[i], len, "%s/%s", outputDir, base);
+        jobs[i].inputPath = files[i];
+        jobs[i].outputPath = outputs[i];
+    }
+
+    int failedJobs = pipeline_run(jobs, count, depth, im_batchApply, &op, 0);
+
+    free_file_list(outputs, count);
+    free(jobs);
+    free_file_list(files, count);
+    if (failedJobs < 0) return IM_ERR_NO_MEMORY;
+    if (failed) *failed = failedJobs;
+    if (failedJobs > 0) {
+        return im_fail(IM_ERR_IO, "Error: %d of %d images could not be loaded or saved.\n", failedJobs, count);
+    }
+    return IM_OK;
+}
+
+t_im_status im_buildIndex(const char *directory, const char *indexPath, int *count) {
+    if (count) *count = 0;
+    if (!directory || !indexPath) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_buildIndex.\n");
+    int indexed = bmp_buildIndex(directory, indexPath);
+    if (indexed < 0) return IM_ERR_IO;
+    if (count) *count = indexed;
+    return IM_OK;
+}
+
+t_im_status im_readIndex(const char *indexPath, t_im_indexEntry **entries, int *count) {
+    if (entries) *entries = NULL;
+    if (count) *count = 0;
+    if (!indexPath || !entries || !count) {
+        return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_readIndex.\n");
+    }
+    int n = 0;
+    errno = 0;
+    t_bmp_indexEntry *index = bmp_readIndex(indexPath, &n);
+    if (!index) return im_ioFailure();
+
+    t_im_indexEntry *result = (t_im_indexEntry *)malloc((n > 0 ? (size_t)n : 1) * sizeof(t_im_indexEntry));
+    if (!result) {
+        bmp_freeIndex(index, n);
+        return im_fail(IM_ERR_NO_MEMORY, "Error: Failed to allocate memory for index entries.\n");
+    }
+    for (int i = 0; i < n; ++i) {
+        result[i].path = index[i].path;
+        result[i].fileSize = index[i].info.fileSize;
+        result[i].width = index[i].info.width;
+        result[i].height = index[i].info.height;
+        result[i].depth = index[i].info.colorDepth;
+        result[i].mtime = index[i].info.mtime;
+    }
+    free(index);  // the paths now belong to result
+    *entries = result;
+    *count = n;
+    return IM_OK;
+}
+
+void im_freeIndex(t_im_indexEntry *entries, int count) {
+    if (!entries) return;
+    for (int i = 0; i < count; ++i) free(entries[i].path);
+    free(entries);
+}
+
+t_im_status im_autoTune(t_im_tuning *tuning) {
+    t_tune_params params;
+    if (tune_run(&params) != 0) return IM_ERR_NO_MEMORY;
+    if (tuning) im_getTuning(tuning);
+    const char *path = tune_cachePath();
+    if (!path) return im_fail(IM_ERR_IO, "Error: No location for the tuning cache (set IMAGE_MOD_TUNE_FILE or HOME).\n");
+    return tune_save(path, &params) == 0 ? IM_OK : IM_ERR_IO;
+}
+
+t_im_status im_getTuning(t_im_tuning *tuning) {
+    if (!tuning) return im_fail(IM_ERR_INVALID_ARGUMENT, "Error: Invalid arguments for im_getTuning.\n");
+    const t_tune_params *params = tune_params();
+    tuning->threads = pool_threadCount();
+    tuning->bandRows = params->bandRows;
+    tuning->chunkBytes = params->chunkBytes;
+    return IM_OK;
+}
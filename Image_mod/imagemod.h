@@ -0,0 +1,296 @@
+#ifndef IMAGEMOD_H
+#define IMAGEMOD_H
+
+// Public interface of libimagemod (static and shared). Only this header is installed; the bmp8/bmp24 structures
+// behind it may change between versions, this interface only grows.
+//
+// Every function that can fail returns a t_im_status. The library prints nothing unless asked to
+// (im_setLogLevel, or IMAGE_MOD_LOG=all|errors|silent); the message of the last failure of the calling thread
+// is available from im_lastError. Functions may be called from several threads on different images.
+
+#include <stddef.h>
+
+#define IMAGEMOD_VERSION_MAJOR 1
+#define IMAGEMOD_VERSION_MINOR 12
+#define IMAGEMOD_VERSION_PATCH 0
+
+#if defined(_WIN32) && !defined(IMAGEMOD_STATIC)
+#  ifdef IMAGEMOD_BUILDING
+#    define IMAGEMOD_API __declspec(dllexport)
+#  else
+#    define IMAGEMOD_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define IMAGEMOD_API __attribute__((visibility("default")))
+#else
+#  define IMAGEMOD_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Status codes. Values are fixed; new codes are only added at the end.
+typedef enum {
+    IM_OK = 0,
+    IM_ERR_INVALID_ARGUMENT = 1,   // NULL image, out-of-range value, even or too small kernel, ...
+    IM_ERR_IO = 2,                 // file cannot be opened, read or written
+    IM_ERR_FORMAT = 3,             // not an uncompressed 8-bit or 24-bit BMP, or not the requested depth
+    IM_ERR_NO_MEMORY = 4,
+    IM_ERR_UNSUPPORTED = 5         // operation not defined for the depth of the image
+} t_im_status;
+
+// Operations without parameters, usable on single images (im_apply) and directories (im_processDirectory).
+// Values are fixed; new operations are only added at the end.
+typedef enum {
+    IM_OP_NEGATIVE = 0,
+    IM_OP_GRAYSCALE = 1,           // no-op on 8-bit images
+    IM_OP_BOX_BLUR = 2,
+    IM_OP_GAUSSIAN_BLUR = 3,
+    IM_OP_OUTLINE = 4,
+    IM_OP_EMBOSS = 5,
+    IM_OP_SHARPEN = 6,
+    IM_OP_EQUALIZE = 7
+} t_im_operation;
+
+// Resampling filters of im_resize, from fastest to sharpest. Values are fixed.
+typedef enum {
+    IM_RESIZE_BILINEAR = 0,
+    IM_RESIZE_BICUBIC = 1,
+    IM_RESIZE_LANCZOS = 2          // Lanczos-3
+} t_im_resize;
+
+// Mirror axes of im_flip. Values are fixed.
+typedef enum {
+    IM_FLIP_HORIZONTAL = 0,        // left to right
+    IM_FLIP_VERTICAL = 1           // top to bottom
+} t_im_flip;
+
+// Reductions between the levels of im_pyramid. Values are fixed.
+typedef enum {
+    IM_PYRAMID_BOX = 0,            // mean of each 2x2 block
+    IM_PYRAMID_BINOMIAL = 1        // 5x5 binomial, smoother
+} t_im_pyramid;
+
+// Local thresholds of im_adaptiveThreshold, from the mean m and standard deviation s of the window around each pixel.
+// Values are fixed.
+typedef enum {
+    IM_THRESHOLD_NIBLACK = 0,      // m + k s (k around -0.2)
+    IM_THRESHOLD_SAUVOLA = 1       // m (1 + k (s / 128 - 1)) (k around 0.2 to 0.5)
+} t_im_threshold;
+
+// Global threshold selections of im_autoThreshold. Values are fixed.
+typedef enum {
+    IM_AUTO_OTSU = 0,              // best separation of two classes (bimodal histograms)
+    IM_AUTO_TRIANGLE = 1           // one dominant peak with a long tail (sparse text or lines)
+} t_im_auto_threshold;
+
+// Operations of im_morphology. Values are fixed.
+typedef enum {
+    IM_MORPH_ERODE = 0,            // minimum over the rectangle
+    IM_MORPH_DILATE = 1,           // maximum over the rectangle
+    IM_MORPH_OPEN = 2,             // erode then dilate: removes bright details smaller than the rectangle
+    IM_MORPH_CLOSE = 3,            // dilate then erode: fills dark details smaller than the rectangle
+    IM_MORPH_TOPHAT = 4            // image minus its opening
+} t_im_morph;
+
+// Gradient directions reported by im_sobel, as displayed. Values are fixed.
+typedef enum {
+    IM_GRADIENT_HORIZONTAL = 0,    // within 22.5 degrees of left-right (a vertical edge)
+    IM_GRADIENT_RISING = 1,        // towards up-right or down-left
+    IM_GRADIENT_VERTICAL = 2,      // within 22.5 degrees of up-down (a horizontal edge)
+    IM_GRADIENT_FALLING = 3        // towards up-left or down-right
+} t_im_gradient;
+
+typedef enum {
+    IM_LOG_ALL = 0,                // progress messages and errors on stdout (the interactive tool)
+    IM_LOG_ERRORS = 1,
+    IM_LOG_SILENT = 2
+} t_im_log;
+
+// Defines what im_getInfo reports about an image.
+typedef struct {
+    int width;
+    int height;
+    int depth;                     // 8 (grayscale) or 24 (BGR)
+    size_t dataSize;               // bytes of pixel data in memory (no row padding)
+    unsigned int fileSize;         // header fields; 0 for images too large for the 32-bit fields
+    unsigned int dataOffset;
+} t_im_info;
+
+// Defines how parallel operations split their work (im_getTuning, im_autoTune).
+typedef struct {
+    int threads;                   // threads running the operations, the calling thread included
+    int bandRows;                  // rows per task of the convolution filters
+    size_t chunkBytes;             // bytes per task of the point operations and histograms
+} t_im_tuning;
+
+// Defines the statistics of one channel over a rectangle (im_regionStats).
+typedef struct {
+    unsigned long long count;      // pixels in the rectangle
+    unsigned long long sum;
+    unsigned long long sumSquares; // 0 when the table was built without squares
+    double mean;
+    double variance;               // population variance; 0 when the table was built without squares
+} t_im_region;
+
+// Defines one file of an index written by im_buildIndex (im_readIndex).
+typedef struct {
+    char *path;
+    unsigned long long fileSize;
+    int width;
+    int height;
+    int depth;                     // 8 or 24
+    long long mtime;               // seconds since the epoch
+} t_im_indexEntry;
+
+// An image in memory, 8-bit grayscale or 24-bit color.
+typedef struct t_im_image t_im_image;
+
+// A recorded chain of operations (deferred mode), see im_graphExecute.
+typedef struct t_im_graph t_im_graph;
+
+// Summed-area tables of an image, for constant-time rectangle statistics.
+typedef struct t_im_integral t_im_integral;
+
+IMAGEMOD_API const char *im_version(void);
+IMAGEMOD_API const char *im_statusString(t_im_status status);
+// Function im_lastError returns the message of the last failure on the calling thread ("" if none).
+IMAGEMOD_API const char *im_lastError(void);
+IMAGEMOD_API void im_setLogLevel(t_im_log level);
+
+// Function im_load reads a BMP file. depth is 8 or 24 to require that depth, or 0 to accept either.
+IMAGEMOD_API t_im_status im_load(const char *path, int depth, t_im_image **image);
+IMAGEMOD_API t_im_status im_save(const t_im_image *image, const char *path);
+// Function im_create makes a black image of the given size and depth (8 or 24).
+IMAGEMOD_API t_im_status im_create(int width, int height, int depth, t_im_image **image);
+IMAGEMOD_API void im_free(t_im_image *image);
+
+IMAGEMOD_API t_im_status im_getInfo(const t_im_image *image, t_im_info *info);
+
+// Pixel access, top row first. A row is width bytes (8-bit) or 3 * width bytes in B, G, R order (24-bit);
+// stride is the distance between rows in the caller's buffer.
+IMAGEMOD_API t_im_status im_readPixels(const t_im_image *image, void *dst, size_t stride);
+IMAGEMOD_API t_im_status im_writePixels(t_im_image *image, const void *src, size_t stride);
+
+IMAGEMOD_API t_im_status im_apply(t_im_image *image, t_im_operation op);
+// Function im_brightness adds value (-255..255) to every channel, saturating.
+IMAGEMOD_API t_im_status im_brightness(t_im_image *image, int value);
+// Function im_threshold sets 8-bit pixels to 255 if >= threshold (0..255), else 0. IM_ERR_UNSUPPORTED on 24-bit.
+IMAGEMOD_API t_im_status im_threshold(t_im_image *image, int threshold);
+// Function im_autoThreshold applies im_threshold at the level picked by method from the histogram. histogram may be
+// the result of im_histogram on the unchanged image, which saves reading it again, or NULL. threshold (may be NULL)
+// receives the level used. IM_ERR_INVALID_ARGUMENT if histogram does not count the pixels of image.
+IMAGEMOD_API t_im_status im_autoThreshold(t_im_image *image, t_im_auto_threshold method,
+                                          const unsigned int histogram[256], int *threshold);
+// Function im_adaptiveThreshold sets 8-bit pixels to 255 if >= their local threshold, else 0; window (odd, 3..511)
+// is the side of the square around each pixel, clipped at the borders. The cost does not depend on window.
+// IM_ERR_UNSUPPORTED on 24-bit.
+IMAGEMOD_API t_im_status im_adaptiveThreshold(t_im_image *image, t_im_threshold method, int window, double k);
+// Function im_median replaces every pixel (every channel on 24-bit) with the median of the (2 radius + 1)^2 pixels
+// around it (radius 1..127), repeating the edge pixels past the borders; it removes salt-and-pepper noise. The cost
+// per pixel does not grow with radius.
+IMAGEMOD_API t_im_status im_median(t_im_image *image, int radius);
+// Function im_morphology applies op with a width x height rectangle (sizes from 1, even ones allowed) around each
+// pixel, ignoring the pixels past the borders. The cost per pixel does not depend on the size. IM_ERR_UNSUPPORTED on
+// 24-bit.
+IMAGEMOD_API t_im_status im_morphology(t_im_image *image, t_im_morph op, int width, int height);
+// Function im_sobel replaces an 8-bit image with its Sobel gradient magnitude |gx| + |gy|, saturated to 255.
+// direction (may be NULL) receives the t_im_gradient of every pixel, top row first, rows stride bytes apart.
+// IM_ERR_UNSUPPORTED on 24-bit.
+IMAGEMOD_API t_im_status im_sobel(t_im_image *image, unsigned char *direction, size_t stride);
+// Function im_canny replaces an 8-bit image with its Canny edges (255, else 0): thin local maxima of the Sobel
+// magnitude (0..2040) above high, extended along those above low. 0 <= low <= high <= 2040. IM_ERR_UNSUPPORTED on
+// 24-bit.
+IMAGEMOD_API t_im_status im_canny(t_im_image *image, int low, int high);
+// Function im_convolve applies a size x size kernel (odd size, row-major); border pixels are kept.
+IMAGEMOD_API t_im_status im_convolve(t_im_image *image, const float *kernel, int size);
+// Function im_convolveToFile writes the result of im_convolve straight into the BMP file at path through a memory
+// map, band by band, without copying or changing image. The file is the one im_save would write; it is removed if
+// the call fails.
+IMAGEMOD_API t_im_status im_convolveToFile(const t_im_image *image, const float *kernel, int size, const char *path);
+// Function im_resize makes a resampled copy of image in *result (free with im_free); image is not changed.
+// Shrinking filters every source pixel (no aliasing), so it also makes thumbnails.
+IMAGEMOD_API t_im_status im_resize(const t_im_image *image, int width, int height, t_im_resize filter,
+                                   t_im_image **result);
+// Function im_flip mirrors image in place.
+IMAGEMOD_API t_im_status im_flip(t_im_image *image, t_im_flip axis);
+// Function im_rotate makes a copy of image turned clockwise by degrees (a multiple of 90, negative turns
+// counter-clockwise) in *result (free with im_free).
+IMAGEMOD_API t_im_status im_rotate(const t_im_image *image, int degrees, t_im_image **result);
+// Function im_transpose makes a copy of image mirrored along its main diagonal in *result (free with im_free).
+IMAGEMOD_API t_im_status im_transpose(const t_im_image *image, t_im_image **result);
+// Function im_warpAffine makes a width x height warp of image in *result (free with im_free). matrix maps each output
+// pixel (x, y), counted from the top-left, to the source point it samples: sx = m[0] x + m[1] y + m[2],
+// sy = m[3] x + m[4] y + m[5] (bilinear). Samples outside the source take fill (0..255 on every channel).
+IMAGEMOD_API t_im_status im_warpAffine(const t_im_image *image, const double matrix[6], int width, int height, int fill,
+                                       t_im_image **result);
+// Function im_warpPerspective is im_warpAffine with a homography: sx and sy are divided by m[6] x + m[7] y + m[8].
+IMAGEMOD_API t_im_status im_warpPerspective(const t_im_image *image, const double matrix[9], int width, int height,
+                                            int fill, t_im_image **result);
+// Function im_rotationMatrix fills the im_warpAffine matrix that turns an image counter-clockwise by degrees about
+// (centerX, centerY), as needed to deskew a scan.
+IMAGEMOD_API void im_rotationMatrix(double degrees, double centerX, double centerY, double matrix[6]);
+// Function im_pyramid builds up to maxLevels successive 2x reductions of image (rounding odd sizes up) in one pass
+// and stores them in levels[0..*count - 1] (free each with im_free). It stops early at 1x1; image is not changed.
+IMAGEMOD_API t_im_status im_pyramid(const t_im_image *image, int maxLevels, t_im_pyramid filter, t_im_image **levels,
+                                    int *count);
+// Function im_savePyramid builds the same levels and writes level i (from 1) to "<prefix>_<i>.bmp".
+IMAGEMOD_API t_im_status im_savePyramid(const t_im_image *image, const char *prefix, int maxLevels,
+                                        t_im_pyramid filter, int *count);
+// Function im_integralCreate builds the summed-area tables of image in *integral (free with im_integralFree): the
+// channel sums, and the sums of squared values if squares is non-zero (needed for variances; 8 bytes per pixel and
+// channel). The image may change or be freed afterwards.
+IMAGEMOD_API t_im_status im_integralCreate(const t_im_image *image, int squares, t_im_integral **integral);
+IMAGEMOD_API void im_integralFree(t_im_integral *integral);
+// Function im_regionStats reads the statistics of channel (0 on 8-bit images; 0 blue, 1 green, 2 red on 24-bit ones)
+// over the width x height rectangle whose top-left pixel is (x, y), in constant time.
+IMAGEMOD_API t_im_status im_regionStats(const t_im_integral *integral, int x, int y, int width, int height, int channel,
+                                        t_im_region *stats);
+// Function im_histogram counts the 256 gray levels of an 8-bit image. IM_ERR_UNSUPPORTED on 24-bit, and when a count
+// does not fit in an unsigned int (images of more than 4G pixels).
+IMAGEMOD_API t_im_status im_histogram(const t_im_image *image, unsigned int histogram[256]);
+
+// Function im_processDirectory applies op to every .bmp of inputDir (all of the given depth) and saves the results
+// under the same names in outputDir, overlapping loading, processing and saving. failed (may be NULL) receives
+// the number of files that could not be loaded or whose result could not be saved; the status is IM_ERR_IO if any
+// failed. IMAGE_MOD_QUEUE_DEPTH sets how many images may wait between two stages (default 2).
+IMAGEMOD_API t_im_status im_processDirectory(const char *inputDir, const char *outputDir, int depth,
+                                             t_im_operation op, int *failed);
+// Function im_buildIndex writes a header index of the .bmp files of directory, one tab-separated line per file
+// (path, size, width, height, depth, mtime; tabs, newlines and backslashes in the path are escaped with a backslash).
+// count (may be NULL) receives the number of indexed files.
+IMAGEMOD_API t_im_status im_buildIndex(const char *directory, const char *indexPath, int *count);
+// Function im_readIndex loads an index written by im_buildIndex into *entries (free with im_freeIndex).
+IMAGEMOD_API t_im_status im_readIndex(const char *indexPath, t_im_indexEntry **entries, int *count);
+IMAGEMOD_API void im_freeIndex(t_im_indexEntry *entries, int count);
+
+// Deferred mode. The im_graph* recording functions check their arguments like the immediate ones and only store the
+// operation. im_graphExecute then runs the whole chain on an image with fewer passes over memory: consecutive point
+// operations are merged into one table lookup, point operations run while a filter reads or writes its rows, and
+// consecutive filters run band by band while the rows are in cache. The result is identical to applying the
+// operations one by one. A graph can be executed on any number of images, but must not be changed meanwhile.
+IMAGEMOD_API t_im_status im_graphCreate(t_im_graph **graph);
+IMAGEMOD_API void im_graphFree(t_im_graph *graph);
+IMAGEMOD_API t_im_status im_graphApply(t_im_graph *graph, t_im_operation op);
+IMAGEMOD_API t_im_status im_graphBrightness(t_im_graph *graph, int value);
+// Function im_graphThreshold records a threshold; executing the graph on a 24-bit image gives IM_ERR_UNSUPPORTED.
+IMAGEMOD_API t_im_status im_graphThreshold(t_im_graph *graph, int threshold);
+IMAGEMOD_API t_im_status im_graphConvolve(t_im_graph *graph, const float *kernel, int size);
+// Function im_graphExecute runs the recorded chain on image. On IM_ERR_NO_MEMORY the image may hold a partial result.
+IMAGEMOD_API t_im_status im_graphExecute(const t_im_graph *graph, t_im_image *image);
+
+// Function im_autoTune measures the filters and point operations on this machine, applies the fastest thread count,
+// band height and chunk size, and stores them in the tuning cache under the CPU model. Processes started later on the
+// same CPU model load them on first use, without measuring again. The cache is IMAGE_MOD_TUNE_FILE, else
+// $XDG_CACHE_HOME/imagemod/tune.conf, else ~/.cache/imagemod/tune.conf; IMAGE_MOD_TUNE=off ignores it.
+// Takes a few seconds and must not run alongside other operations. tuning (may be NULL) receives the chosen values;
+// IM_ERR_IO means they are applied but could not be saved.
+IMAGEMOD_API t_im_status im_autoTune(t_im_tuning *tuning);
+IMAGEMOD_API t_im_status im_getTuning(t_im_tuning *tuning);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGEMOD_H
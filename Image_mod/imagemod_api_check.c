@@ -0,0 +1,1278 @@
+// imagemod_api_check.c
+// Checks the public interface as an outside program sees it: linked against the shared library, using only
+// imagemod.h. Covers the status codes, pixel access, a save/load round trip on the bundled samples, batch runs
+// (both batch loader backends, a deep queue) checked against the same operation on single images, a directory index
+// round trip, memory-mapped filter output checked against im_save, deferred graphs checked against the same chains
+// applied one operation at a time, and the geometric and analysis operations (resizing, pyramids, rotations and
+// flips, warps, region statistics, adaptive and automatic thresholds, the median filter, morphology, edge detection)
+// against direct computations or results known exactly. With IMAGE_MOD_TUNE_FILE set it also auto-tunes.
+// With --cached-tuning FILE it only checks that the tuning saved in FILE by an earlier run is in effect at startup.
+// Usage: imagemod_api_check [--images DIR] [--cached-tuning FILE]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "imagemod.h"
+
+static int g_failures = 0;
+
+static void expect(int condition, const char *what) {
+    if (!condition) {
+        printf("FAIL %s (last error: %s)\n", what, im_lastError());
+        ++g_failures;
+    }
+}
+
+static void check_errors(const char *imagesDir) {
+    char path[512];
+    t_im_image *image = NULL;
+
+    expect(im_load("does/not/exist.bmp", 0, &image) == IM_ERR_IO && image == NULL, "missing file gives IM_ERR_IO");
+    expect(strlen(im_lastError()) > 0, "failure leaves a message");
+    snprintf(path, sizeof(path), "%s/CMakeLists.txt", imagesDir);
+    expect(im_load(path, 0, &image) == IM_ERR_FORMAT, "non-BMP file gives IM_ERR_FORMAT");
+    snprintf(path, sizeof(path), "%s/lena_gray.bmp", imagesDir);
+    expect(im_load(path, 24, &image) == IM_ERR_FORMAT, "depth mismatch gives IM_ERR_FORMAT");
+    expect(im_load(path, 16, &image) == IM_ERR_INVALID_ARGUMENT, "bad depth gives IM_ERR_INVALID_ARGUMENT");
+    expect(im_apply(NULL, IM_OP_NEGATIVE) == IM_ERR_INVALID_ARGUMENT, "NULL image gives IM_ERR_INVALID_ARGUMENT");
+
+    expect(im_load(path, 0, &image) == IM_OK, "load 8-bit sample");
+    if (!image) return;
+    float even[4] = { 0 };
+    expect(im_convolve(image, even, 2) == IM_ERR_INVALID_ARGUMENT, "even kernel is rejected");
+    expect(im_brightness(image, 300) == IM_ERR_INVALID_ARGUMENT, "brightness out of range is rejected");
+    expect(im_apply(image, (t_im_operation)99) == IM_ERR_INVALID_ARGUMENT, "unknown operation is rejected");
+    im_free(image);
+
+    snprintf(path, sizeof(path), "%s/lena_color.bmp", imagesDir);
+    expect(im_load(path, 24, &image) == IM_OK, "load 24-bit sample");
+    if (!image) return;
+    expect(im_threshold(image, 128) == IM_ERR_UNSUPPORTED, "threshold on 24-bit gives IM_ERR_UNSUPPORTED");
+    unsigned int histogram[256];
+    expect(im_histogram(image, histogram) == IM_ERR_UNSUPPORTED, "histogram on 24-bit gives IM_ERR_UNSUPPORTED");
+    im_free(image);
+}
+
+// Writes a gradient, runs an operation, saves and reloads it, and compares the pixels.
+static void check_round_trip(int depth) {
+    const int width = 37, height = 21;
+    const int channels = depth / 8;
+    size_t stride = (size_t)width * channels + 5;
+    unsigned char *pixels = (unsigned char *)calloc((size_t)height * stride, 1);
+    unsigned char *back = (unsigned char *)calloc((size_t)height * stride, 1);
+    t_im_image *image = NULL, *loaded = NULL;
+    if (!pixels || !back) { free(pixels); free(back); expect(0, "allocate test buffers"); return; }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width * channels; ++x) pixels[(size_t)y * stride + x] = (unsigned char)(x * 7 + y * 11);
+    }
+
+    expect(im_create(width, height, depth, &image) == IM_OK, "create image");
+    expect(im_writePixels(image, pixels, stride) == IM_OK, "write pixels");
+    expect(im_apply(image, IM_OP_NEGATIVE) == IM_OK, "negative");
+    t_im_info info;
+    expect(im_getInfo(image, &info) == IM_OK && info.width == width && info.height == height && info.depth == depth,
+           "info matches the created image");
+    expect(im_save(image, "imagemod_api_check.bmp") == IM_OK, "save");
+    expect(im_load("imagemod_api_check.bmp", depth, &loaded) == IM_OK, "reload");
+    if (loaded) {
+        expect(im_readPixels(loaded, back, stride) == IM_OK, "read pixels");
+        int same = 1;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width * channels; ++x) {
+                if (back[(size_t)y * stride + x] != 255 - pixels[(size_t)y * stride + x]) same = 0;
+            }
+        }
+        expect(same, depth == 8 ? "8-bit round trip keeps the pixels (top row first)" : "24-bit round trip keeps the pixels");
+    }
+    im_free(image);
+    im_free(loaded);
+    remove("imagemod_api_check.bmp");
+    free(pixels);
+    free(back);
+}
+
+// Reads all pixels of image into a new buffer (top row first, no padding); NULL on failure.
+static unsigned char *read_all(const t_im_image *image, size_t *size) {
+    t_im_info info;
+    if (im_getInfo(image, &info) != IM_OK) return NULL;
+    size_t stride = (size_t)info.width * (info.depth / 8);
+    unsigned char *pixels = (unsigned char *)malloc(stride * info.height);
+    if (pixels && im_readPixels(image, pixels, stride) != IM_OK) {
+        free(pixels);
+        return NULL;
+    }
+    *size = stride * info.height;
+    return pixels;
+}
+
+// Runs a directory through im_processDirectory (images processed together on the pool, each filter itself
+// parallel) and compares every output with im_apply on the same input.
+static void check_batch(void) {
+    const char *inDir = "imagemod_api_check_in", *outDir = "imagemod_api_check_out";
+    const int count = 6;
+    char path[256];
+    mkdir(inDir, 0755);
+    mkdir(outDir, 0755);
+    for (int i = 0; i < count; ++i) {
+        t_im_image *image = NULL;
+        int width = 40 + 13 * i, height = 30 + 7 * i;
+        unsigned char *pixels = (unsigned char *)malloc((size_t)width * height);
+        if (!pixels || im_create(width, height, 8, &image) != IM_OK) { free(pixels); expect(0, "create batch input"); return; }
+        for (int p = 0; p < width * height; ++p) pixels[p] = (unsigned char)(p * 31 + i * 17 + (p / width) * 5);
+        im_writePixels(image, pixels, (size_t)width);
+        snprintf(path, sizeof(path), "%s/batch_%d.bmp", inDir, i);
+        expect(im_save(image, path) == IM_OK, "save batch input");
+        im_free(image);
+        free(pixels);
+    }
+
+    int failed = -1;
+    expect(im_processDirectory(inDir, "imagemod_api_check_missing/out", 8, IM_OP_NEGATIVE, &failed) == IM_ERR_IO &&
+           failed == count, "batch saves into a missing directory are counted as failed");
+    failed = -1;
+    expect(im_processDirectory(inDir, outDir, 8, IM_OP_GAUSSIAN_BLUR, &failed) == IM_OK && failed == 0,
+           "process directory");
+    int same = 1;
+    for (int i = 0; i < count; ++i) {
+        t_im_image *expected = NULL, *actual = NULL;
+        snprintf(path, sizeof(path), "%s/batch_%d.bmp", inDir, i);
+        if (im_load(path, 8, &expected) == IM_OK) im_apply(expected, IM_OP_GAUSSIAN_BLUR);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/batch_%d.bmp", outDir, i);
+        im_load(path, 8, &actual);
+        remove(path);
+        size_t expectedSize = 0, actualSize = 0;
+        unsigned char *a = expected ? read_all(expected, &expectedSize) : NULL;
+        unsigned char *b = actual ? read_all(actual, &actualSize) : NULL;
+        if (!a || !b || expectedSize != actualSize || memcmp(a, b, expectedSize) != 0) same = 0;
+        free(a);
+        free(b);
+        im_free(expected);
+        im_free(actual);
+    }
+    expect(same, "batch results match single-image results");
+    rmdir(inDir);
+    rmdir(outDir);
+}
+
+// Runs im_processDirectory, whose reader stage goes through the batch loader, on both depths with io_uring (where
+// the kernel allows it) and with IMAGE_MOD_IO_URING=0, and compares every output with im_load (bmp*_loadImage)
+// followed by the same operation. One input is not a BMP and must be counted as failed.
+static void check_batch_loading(void) {
+    const char *inDir = "imagemod_api_check_load_in", *outDir = "imagemod_api_check_load_out";
+    const int count = 5;
+    char path[256];
+    for (int backend = 0; backend < 2; ++backend) {
+        if (backend == 1) setenv("IMAGE_MOD_IO_URING", "0", 1);
+        for (int depth = 8; depth <= 24; depth += 16) {
+            int channels = depth / 8, created = 1;
+            mkdir(inDir, 0755);
+            mkdir(outDir, 0755);
+            for (int i = 0; i < count; ++i) {
+                t_im_image *image = NULL;
+                int width = 17 + 10 * i, height = 9 + 5 * i;
+                size_t rowBytes = (size_t)width * channels;
+                unsigned char *pixels = (unsigned char *)malloc(rowBytes * height);
+                if (!pixels || im_create(width, height, depth, &image) != IM_OK) { created = 0; free(pixels); continue; }
+                for (size_t p = 0; p < rowBytes * height; ++p) pixels[p] = (unsigned char)(p * 7 + i * 41 + p / rowBytes);
+                im_writePixels(image, pixels, rowBytes);
+                snprintf(path, sizeof(path), "%s/load_%d.bmp", inDir, i);
+                if (im_save(image, path) != IM_OK) created = 0;
+                im_free(image);
+                free(pixels);
+            }
+            snprintf(path, sizeof(path), "%s/broken.bmp", inDir);
+            FILE *broken = fopen(path, "wb");
+            if (broken) {
+                fputs("BM this is not a bitmap", broken);
+                fclose(broken);
+            }
+            int failed = -1;
+            t_im_status status = im_processDirectory(inDir, outDir, depth, IM_OP_NEGATIVE, &failed);
+            int same = created && status == IM_ERR_IO && failed == 1;
+            for (int i = 0; i < count; ++i) {
+                t_im_image *expected = NULL, *actual = NULL;
+                snprintf(path, sizeof(path), "%s/load_%d.bmp", inDir, i);
+                if (im_load(path, depth, &expected) == IM_OK) im_apply(expected, IM_OP_NEGATIVE);
+                remove(path);
+                snprintf(path, sizeof(path), "%s/load_%d.bmp", outDir, i);
+                im_load(path, depth, &actual);
+                remove(path);
+                size_t expectedSize = 0, actualSize = 0;
+                unsigned char *a = expected ? read_all(expected, &expectedSize) : NULL;
+                unsigned char *b = actual ? read_all(actual, &actualSize) : NULL;
+                if (!a || !b || expectedSize != actualSize || memcmp(a, b, expectedSize) != 0) same = 0;
+                free(a);
+                free(b);
+                im_free(expected);
+                im_free(actual);
+            }
+            snprintf(path, sizeof(path), "%s/broken.bmp", inDir);
+            remove(path);
+            snprintf(path, sizeof(path), "%s/broken.bmp", outDir);
+            remove(path);
+            rmdir(inDir);
+            rmdir(outDir);
+            char what[96];
+            snprintf(what, sizeof(what), "batch loading matches im_load (%d-bit, %s)", depth,
+                     backend == 0 ? "default backend" : "stdio");
+            expect(same, what);
+        }
+    }
+    unsetenv("IMAGE_MOD_IO_URING");
+}
+
+// Runs a directory of more images than the reader loads in one group with a queue depth above that group size
+// (IMAGE_MOD_QUEUE_DEPTH=100), and expects every output to be the negative of its input.
+static void check_deep_queue(void) {
+    const char *inDir = "imagemod_api_check_deep_in", *outDir = "imagemod_api_check_deep_out";
+    const int count = 70, width = 9, height = 5;
+    char path[256];
+    unsigned char pixels[9 * 5], back[9 * 5];
+    mkdir(inDir, 0755);
+    mkdir(outDir, 0755);
+    int same = 1;
+    for (int i = 0; i < count; ++i) {
+        t_im_image *image = NULL;
+        for (int p = 0; p < width * height; ++p) pixels[p] = (unsigned char)(p * 5 + i * 3);
+        snprintf(path, sizeof(path), "%s/deep_%02d.bmp", inDir, i);
+        if (im_create(width, height, 8, &image) != IM_OK || im_writePixels(image, pixels, width) != IM_OK ||
+            im_save(image, path) != IM_OK) {
+            same = 0;
+        }
+        im_free(image);
+    }
+    setenv("IMAGE_MOD_QUEUE_DEPTH", "100", 1);
+    int failed = -1;
+    if (im_processDirectory(inDir, outDir, 8, IM_OP_NEGATIVE, &failed) != IM_OK || failed != 0) same = 0;
+    unsetenv("IMAGE_MOD_QUEUE_DEPTH");
+    for (int i = 0; i < count; ++i) {
+        t_im_image *image = NULL;
+        snprintf(path, sizeof(path), "%s/deep_%02d.bmp", outDir, i);
+        if (im_load(path, 8, &image) != IM_OK || im_readPixels(image, back, width) != IM_OK) same = 0;
+        for (int p = 0; p < width * height && same; ++p) {
+            if (back[p] != (unsigned char)(255 - (unsigned char)(p * 5 + i * 3))) same = 0;
+        }
+        im_free(image);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/deep_%02d.bmp", inDir, i);
+        remove(path);
+    }
+    rmdir(inDir);
+    rmdir(outDir);
+    expect(same, "batch with a queue depth above the load group size");
+}
+
+// Indexes a directory whose file names contain a tab, a newline and a backslash, reads the index back and expects
+// every file with its exact name and size.
+static void check_index(void) {
+    const char *dir = "imagemod_api_check_index", *indexPath = "imagemod_api_check_index.txt";
+    const char *names[3] = { "plain.bmp", "tab\tand\nnewline.bmp", "back\\slash\\t.bmp" };
+    char path[256];
+    mkdir(dir, 0755);
+    int created = 1;
+    for (int i = 0; i < 3; ++i) {
+        t_im_image *image = NULL;
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        if (im_create(11 + i, 7 + i, i == 1 ? 24 : 8, &image) != IM_OK || im_save(image, path) != IM_OK) created = 0;
+        im_free(image);
+    }
+    int indexed = -1, count = -1;
+    t_im_indexEntry *entries = NULL;
+    expect(created && im_buildIndex(dir, indexPath, &indexed) == IM_OK && indexed == 3, "build index");
+    expect(im_readIndex(indexPath, &entries, &count) == IM_OK && count == 3, "read index");
+    int found = 0;
+    for (int i = 0; i < 3; ++i) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        for (int e = 0; e < count; ++e) {
+            if (strcmp(entries[e].path, path) == 0 && entries[e].width == 11 + i && entries[e].height == 7 + i &&
+                entries[e].depth == (i == 1 ? 24 : 8)) {
+                ++found;
+            }
+        }
+        remove(path);
+    }
+    expect(found == 3, "index round trip keeps tabs, newlines and backslashes in paths");
+    im_freeIndex(entries, count);
+    remove(indexPath);
+    rmdir(dir);
+}
+
+// Reads a whole file into a new buffer; NULL if it cannot be read.
+static unsigned char *read_file(const char *path, long *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    unsigned char *bytes = NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (*size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        bytes = (unsigned char *)malloc((size_t)*size);
+        if (bytes && fread(bytes, 1, (size_t)*size, file) != (size_t)*size) {
+            free(bytes);
+            bytes = NULL;
+        }
+    }
+    fclose(file);
+    return bytes;
+}
+
+// Writes a filter result through the memory-mapped writer (im_convolveToFile) and through im_convolve + im_save,
+// for the samples and for an odd-width gradient (padded 24-bit rows), and expects the same bytes. An output that
+// cannot be created must give IM_ERR_IO and leave no file behind.
+static void check_convolve_to_file(const char *imagesDir) {
+    const float kernel[9] = { 0, -1, 0, -1, 5, -1, 0, -1, 0 };
+    const char *mappedPath = "imagemod_api_check_mapped.bmp", *savedPath = "imagemod_api_check_saved.bmp";
+    char path[512];
+    for (int depth = 8; depth <= 24; depth += 16) {
+        for (int source = 0; source < 2; ++source) {
+            t_im_image *image = NULL;
+            if (source == 0) {
+                snprintf(path, sizeof(path), "%s/%s", imagesDir, depth == 8 ? "lena_gray.bmp" : "lena_color.bmp");
+                im_load(path, depth, &image);
+            } else if (im_create(37, 21, depth, &image) == IM_OK) {
+                size_t stride = (size_t)37 * (depth / 8);
+                unsigned char *pixels = (unsigned char *)malloc(stride * 21);
+                if (pixels) {
+                    for (size_t p = 0; p < stride * 21; ++p) pixels[p] = (unsigned char)(p * 13 + p / stride * 29);
+                    im_writePixels(image, pixels, stride);
+                }
+                free(pixels);
+            }
+            long mappedSize = 0, savedSize = 0;
+            int same = image && im_convolveToFile(image, kernel, 3, mappedPath) == IM_OK &&
+                       im_convolve(image, kernel, 3) == IM_OK && im_save(image, savedPath) == IM_OK;
+            unsigned char *mapped = same ? read_file(mappedPath, &mappedSize) : NULL;
+            unsigned char *saved = same ? read_file(savedPath, &savedSize) : NULL;
+            same = mapped && saved && mappedSize == savedSize && memcmp(mapped, saved, (size_t)savedSize) == 0;
+            char what[96];
+            snprintf(what, sizeof(what), "mapped filter output matches im_save (%d-bit, %s)", depth,
+                     source == 0 ? "sample" : "gradient");
+            expect(same, what);
+            free(mapped);
+            free(saved);
+            im_free(image);
+            remove(mappedPath);
+            remove(savedPath);
+        }
+    }
+
+    t_im_image *image = NULL;
+    struct stat st;
+    expect(im_create(8, 8, 8, &image) == IM_OK &&
+           im_convolveToFile(image, kernel, 3, "imagemod_api_check_missing/mapped.bmp") == IM_ERR_IO &&
+           stat("imagemod_api_check_missing/mapped.bmp", &st) != 0, "mapped output into a missing directory fails");
+    expect(im_convolveToFile(image, kernel, 2, mappedPath) == IM_ERR_INVALID_ARGUMENT && stat(mappedPath, &st) != 0,
+           "mapped output with an even kernel is rejected before the file is created");
+    im_free(image);
+}
+
+// Defines one operation of a test chain, applied either immediately or recorded in a graph.
+typedef struct {
+    int kind;                     // 0: im_apply(op), 1: brightness, 2: threshold, 3: convolve
+    t_im_operation op;
+    int value;
+    int size;
+    float kernel[25];
+} t_chain_op;
+
+static t_im_status apply_op(t_im_image *image, t_im_graph *graph, const t_chain_op *op) {
+    switch (op->kind) {
+        case 0: return graph ? im_graphApply(graph, op->op) : im_apply(image, op->op);
+        case 1: return graph ? im_graphBrightness(graph, op->value) : im_brightness(image, op->value);
+        case 2: return graph ? im_graphThreshold(graph, op->value) : im_threshold(image, op->value);
+        default: return graph ? im_graphConvolve(graph, op->kernel, op->size) : im_convolve(image, op->kernel, op->size);
+    }
+}
+
+// Runs chain on two copies of image, one operation at a time and as one graph, and compares the results.
+static int same_as_graph(const t_im_image *image, const t_chain_op *chain, int length) {
+    t_im_info info;
+    size_t size = 0;
+    unsigned char *pixels = read_all(image, &size);
+    t_im_image *direct = NULL, *deferred = NULL;
+    t_im_graph *graph = NULL;
+    if (!pixels || im_getInfo(image, &info) != IM_OK || im_graphCreate(&graph) != IM_OK) { free(pixels); return 0; }
+    size_t stride = (size_t)info.width * (info.depth / 8);
+    im_create(info.width, info.height, info.depth, &direct);
+    im_create(info.width, info.height, info.depth, &deferred);
+    int same = direct && deferred && im_writePixels(direct, pixels, stride) == IM_OK &&
+               im_writePixels(deferred, pixels, stride) == IM_OK;
+    for (int i = 0; i < length && same; ++i) {
+        if (apply_op(direct, NULL, &chain[i]) != IM_OK || apply_op(NULL, graph, &chain[i]) != IM_OK) same = 0;
+    }
+    if (same && im_graphExecute(graph, deferred) != IM_OK) same = 0;
+    size_t directSize = 0, deferredSize = 0;
+    unsigned char *a = same ? read_all(direct, &directSize) : NULL;
+    unsigned char *b = same ? read_all(deferred, &deferredSize) : NULL;
+    if (!a || !b || directSize != deferredSize || memcmp(a, b, directSize) != 0) same = 0;
+    free(a);
+    free(b);
+    free(pixels);
+    im_free(direct);
+    im_free(deferred);
+    im_graphFree(graph);
+    return same;
+}
+
+static void random_op(t_chain_op *op, int depth) {
+    static const t_im_operation ops[] = { IM_OP_NEGATIVE, IM_OP_GRAYSCALE, IM_OP_BOX_BLUR, IM_OP_GAUSSIAN_BLUR,
+                                          IM_OP_OUTLINE, IM_OP_EMBOSS, IM_OP_SHARPEN, IM_OP_EQUALIZE };
+    memset(op, 0, sizeof(*op));
+    op->kind = rand() % 4;
+    if (op->kind == 2 && depth != 8) op->kind = 0;
+    if (op->kind == 0) op->op = ops[rand() % 8];
+    if (op->kind == 1) op->value = rand() % 511 - 255;
+    if (op->kind == 2) op->value = rand() % 256;
+    if (op->kind == 3) {
+        op->size = 1 + 2 * (rand() % 3);
+        for (int i = 0; i < op->size * op->size; ++i) op->kernel[i] = (float)(rand() % 9 - 3) / (float)op->size;
+    }
+}
+
+// Compares graphs with the immediate calls: a long chain on the samples, random chains on small images (borders,
+// images narrower or lower than a kernel), and runs of filters long enough to span several passes and bands.
+static void check_graph(const char *imagesDir) {
+    static const t_chain_op sample[] = {
+        { 1, IM_OP_NEGATIVE, 20, 0, { 0 } }, { 0, IM_OP_NEGATIVE, 0, 0, { 0 } }, { 0, IM_OP_GAUSSIAN_BLUR, 0, 0, { 0 } },
+        { 0, IM_OP_SHARPEN, 0, 0, { 0 } }, { 1, IM_OP_NEGATIVE, -10, 0, { 0 } }, { 0, IM_OP_GRAYSCALE, 0, 0, { 0 } },
+        { 0, IM_OP_NEGATIVE, 0, 0, { 0 } }, { 0, IM_OP_EQUALIZE, 0, 0, { 0 } }, { 0, IM_OP_BOX_BLUR, 0, 0, { 0 } },
+        { 0, IM_OP_NEGATIVE, 0, 0, { 0 } }, { 0, IM_OP_NEGATIVE, 0, 0, { 0 } }, { 0, IM_OP_OUTLINE, 0, 0, { 0 } }
+    };
+    const int sampleLength = (int)(sizeof(sample) / sizeof(sample[0]));
+    const char *names[2] = { "lena_gray.bmp", "lena_color.bmp" };
+    char path[512];
+    for (int i = 0; i < 2; ++i) {
+        t_im_image *image = NULL;
+        snprintf(path, sizeof(path), "%s/%s", imagesDir, names[i]);
+        if (im_load(path, 0, &image) != IM_OK) { expect(0, "load graph sample"); continue; }
+        expect(same_as_graph(image, sample, sampleLength), i == 0 ? "8-bit sample graph matches the immediate calls"
+                                                                  : "24-bit sample graph matches the immediate calls");
+        im_free(image);
+    }
+
+    t_im_graph *graph = NULL;
+    t_im_image *image = NULL;
+    expect(im_graphCreate(&graph) == IM_OK && im_graphThreshold(graph, 100) == IM_OK, "record threshold");
+    expect(im_graphConvolve(graph, NULL, 3) == IM_ERR_INVALID_ARGUMENT, "graph rejects a NULL kernel");
+    expect(im_create(8, 8, 24, &image) == IM_OK && im_graphExecute(graph, image) == IM_ERR_UNSUPPORTED,
+           "graph with threshold on 24-bit gives IM_ERR_UNSUPPORTED");
+    im_free(image);
+    im_graphFree(graph);
+
+    srand(12345);
+    int same = 1;
+    t_chain_op chain[24];
+    for (int test = 0; test < 60 && same; ++test) {
+        int depth = test % 2 ? 24 : 8;
+        int large = test % 10 == 9;
+        int width = large ? 300 + rand() % 200 : 1 + rand() % 40;
+        int height = large ? 200 + rand() % 200 : 1 + rand() % 40;
+        size_t bytes = (size_t)width * height * (depth / 8);
+        unsigned char *pixels = (unsigned char *)malloc(bytes);
+        image = NULL;
+        if (!pixels || im_create(width, height, depth, &image) != IM_OK) { free(pixels); same = 0; break; }
+        for (size_t p = 0; p < bytes; ++p) pixels[p] = (unsigned char)(rand() % 256);
+        im_writePixels(image, pixels, (size_t)width * (depth / 8));
+        int length = 1 + rand() % 12;
+        for (int i = 0; i < length; ++i) random_op(&chain[i], depth);
+        if (large) {
+            // Ten filters in a row: two passes, each band carrying a halo of up to eight rows.
+            length = 12;
+            for (int i = 1; i < 11; ++i) {
+                memset(&chain[i], 0, sizeof(chain[i]));
+                chain[i].op = i % 2 ? IM_OP_GAUSSIAN_BLUR : IM_OP_SHARPEN;
+            }
+        }
+        same = same_as_graph(image, chain, length);
+        im_free(image);
+        free(pixels);
+    }
+    expect(same, "random graphs match the immediate calls");
+}
+
+static void check_resize(void) {
+    const int width = 45, height = 31;
+    t_im_image *image = NULL, *resized = NULL;
+    unsigned char pixels[45 * 31 * 3];
+    for (int i = 0; i < width * height * 3; ++i) pixels[i] = (unsigned char)(i * 7 + i / 13);
+    expect(im_create(width, height, 24, &image) == IM_OK && im_writePixels(image, pixels, (size_t)width * 3) == IM_OK,
+           "create resize input");
+    expect(im_resize(image, 0, 10, IM_RESIZE_BILINEAR, &resized) == IM_ERR_INVALID_ARGUMENT && resized == NULL,
+           "zero size is rejected");
+    expect(im_resize(image, width, height, IM_RESIZE_LANCZOS, &resized) == IM_OK, "same-size resize");
+    size_t size = 0;
+    unsigned char *copy = resized ? read_all(resized, &size) : NULL;
+    expect(copy && size == sizeof(pixels) && memcmp(copy, pixels, size) == 0, "same-size resize keeps the pixels");
+    free(copy);
+    im_free(resized);
+    im_free(image);
+
+    // Flat images stay flat in every direction and with every filter, up and down.
+    static const int sizes[][2] = { { 7, 5 }, { 90, 31 }, { 45, 100 }, { 1, 1 }, { 200, 3 } };
+    int flat = 1;
+    for (int depth = 8; depth <= 24; depth += 16) {
+        memset(pixels, 173, sizeof(pixels));
+        image = NULL;
+        if (im_create(width, height, depth, &image) != IM_OK) { flat = 0; break; }
+        im_writePixels(image, pixels, (size_t)width * (depth / 8));
+        for (int f = IM_RESIZE_BILINEAR; f <= IM_RESIZE_LANCZOS; ++f) {
+            for (int s = 0; s < 5; ++s) {
+                resized = NULL;
+                if (im_resize(image, sizes[s][0], sizes[s][1], (t_im_resize)f, &resized) != IM_OK) { flat = 0; continue; }
+                unsigned char *out = read_all(resized, &size);
+                t_im_info info;
+                if (!out || im_getInfo(resized, &info) != IM_OK || info.width != sizes[s][0] || info.height != sizes[s][1]) flat = 0;
+                for (size_t i = 0; out && i < size; ++i) {
+                    if (out[i] != 173) flat = 0;
+                }
+                free(out);
+                im_free(resized);
+            }
+        }
+        im_free(image);
+    }
+    expect(flat, "resized flat images stay flat");
+}
+
+// Straightforward 2x reduction used as the reference of check_pyramid; rows are in memory order, edges repeated.
+static void reduce_reference(const unsigned char *src, int width, int height, int channels, int binomial,
+                             unsigned char *dst) {
+    static const int weights[5] = { 1, 4, 6, 4, 1 };
+    int outWidth = (width + 1) / 2, outHeight = (height + 1) / 2;
+    for (int y = 0; y < outHeight; ++y) {
+        for (int x = 0; x < outWidth; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                int sum = 0;
+                for (int j = 0; j < (binomial ? 5 : 2); ++j) {
+                    for (int i = 0; i < (binomial ? 5 : 2); ++i) {
+                        int sy = 2 * y + j - (binomial ? 2 : 0), sx = 2 * x + i - (binomial ? 2 : 0);
+                        sy = sy < 0 ? 0 : sy >= height ? height - 1 : sy;
+                        sx = sx < 0 ? 0 : sx >= width ? width - 1 : sx;
+                        sum += (binomial ? weights[j] * weights[i] : 1) * src[((size_t)sy * width + sx) * channels + c];
+                    }
+                }
+                dst[((size_t)y * outWidth + x) * channels + c] =
+                    (unsigned char)(binomial ? (sum + 128) >> 8 : (sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+// Reverses the rows of an 8-bit buffer (up to 256 wide): 8-bit images are stored bottom-up, so the edges they repeat
+// are the other way round.
+static void flip_rows(unsigned char *pixels, int height, size_t stride) {
+    unsigned char row[256];
+    for (int y = 0; y < height / 2; ++y) {
+        memcpy(row, pixels + (size_t)y * stride, stride);
+        memcpy(pixels + (size_t)y * stride, pixels + (size_t)(height - 1 - y) * stride, stride);
+        memcpy(pixels + (size_t)(height - 1 - y) * stride, row, stride);
+    }
+}
+
+// Compares every pyramid level with the reference reduction of the level before it, for both depths and filters and
+// for sizes that exercise the vector bodies and the odd edges.
+static void check_pyramid(void) {
+    static const int sizes[][2] = { { 45, 31 }, { 256, 3 }, { 1, 77 }, { 130, 129 } };
+    int same = 1;
+    for (int depth = 8; depth <= 24; depth += 16) {
+        int channels = depth / 8;
+        for (int s = 0; s < 4; ++s) {
+            int width = sizes[s][0], height = sizes[s][1];
+            size_t bytes = (size_t)width * height * channels;
+            unsigned char *pixels = (unsigned char *)malloc(bytes);
+            t_im_image *image = NULL;
+            if (!pixels || im_create(width, height, depth, &image) != IM_OK) { same = 0; free(pixels); break; }
+            for (size_t i = 0; i < bytes; ++i) pixels[i] = (unsigned char)(i * 37 + i / 7 + (i * i >> 5));
+            im_writePixels(image, pixels, (size_t)width * channels);
+            for (int f = IM_PYRAMID_BOX; f <= IM_PYRAMID_BINOMIAL; ++f) {
+                t_im_image *levels[16];
+                int count = -1;
+                if (im_pyramid(image, 16, (t_im_pyramid)f, levels, &count) != IM_OK) { same = 0; continue; }
+                int expectedCount = 0;
+                for (int w = width, h = height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) ++expectedCount;
+                if (count != expectedCount) same = 0;
+                unsigned char *previous = (unsigned char *)malloc(bytes);
+                int w = width, h = height;
+                if (previous) memcpy(previous, pixels, bytes);
+                if (previous && depth == 8) flip_rows(previous, h, (size_t)w);
+                for (int i = 0; i < count; ++i) {
+                    int outWidth = (w + 1) / 2, outHeight = (h + 1) / 2;
+                    size_t size = 0;
+                    unsigned char *expected = (unsigned char *)malloc((size_t)outWidth * outHeight * channels);
+                    unsigned char *actual = read_all(levels[i], &size);
+                    if (previous && expected) reduce_reference(previous, w, h, channels, f == IM_PYRAMID_BINOMIAL, expected);
+                    if (actual && depth == 8) flip_rows(actual, outHeight, (size_t)outWidth);
+                    if (!previous || !expected || !actual || size != (size_t)outWidth * outHeight * channels ||
+                        memcmp(expected, actual, size) != 0) {
+                        same = 0;
+                    }
+                    free(previous);
+                    free(actual);
+                    previous = expected;
+                    w = outWidth;
+                    h = outHeight;
+                    im_free(levels[i]);
+                }
+                free(previous);
+            }
+            im_free(image);
+            free(pixels);
+        }
+    }
+    expect(same, "pyramid levels match the reference reduction");
+
+    t_im_image *image = NULL, *levels[2] = { NULL, NULL };
+    int count = -1;
+    expect(im_create(1, 1, 24, &image) == IM_OK && im_pyramid(image, 2, IM_PYRAMID_BOX, levels, &count) == IM_OK &&
+           count == 0, "1x1 image has no pyramid levels");
+    expect(im_pyramid(image, 2, (t_im_pyramid)7, levels, &count) == IM_ERR_INVALID_ARGUMENT, "unknown reduction is rejected");
+    im_free(image);
+}
+
+// Reference of check_orientation: where pixel (x, y) of a width x height image lands for each transform
+// (0-3 = quarter turns clockwise, 4 = transpose, 5/6 = horizontal/vertical flip).
+static void orient_reference(const unsigned char *src, int width, int height, int bytes, int mode, unsigned char *dst) {
+    int outWidth = mode == 1 || mode == 3 || mode == 4 ? height : width;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int ox = x, oy = y;
+            switch (mode) {
+                case 1: ox = height - 1 - y; oy = x; break;
+                case 2: ox = width - 1 - x; oy = height - 1 - y; break;
+                case 3: ox = y; oy = width - 1 - x; break;
+                case 4: ox = y; oy = x; break;
+                case 5: ox = width - 1 - x; break;
+                case 6: oy = height - 1 - y; break;
+                default: break;
+            }
+            memcpy(dst + ((size_t)oy * outWidth + ox) * bytes, src + ((size_t)y * width + x) * bytes, (size_t)bytes);
+        }
+    }
+}
+
+// Compares rotations, transposes and flips with the reference on sizes that leave partial tiles and blocks.
+static void check_orientation(void) {
+    static const int sizes[][2] = { { 45, 31 }, { 130, 97 }, { 16, 16 }, { 1, 200 }, { 67, 1 } };
+    int same = 1;
+    for (int depth = 8; depth <= 24; depth += 16) {
+        int bytes = depth / 8;
+        for (int s = 0; s < 5; ++s) {
+            int width = sizes[s][0], height = sizes[s][1];
+            size_t size = (size_t)width * height * bytes;
+            unsigned char *pixels = (unsigned char *)malloc(size), *expected = (unsigned char *)malloc(size);
+            t_im_image *image = NULL;
+            if (!pixels || !expected || im_create(width, height, depth, &image) != IM_OK) {
+                same = 0;
+                free(pixels);
+                free(expected);
+                break;
+            }
+            for (size_t i = 0; i < size; ++i) pixels[i] = (unsigned char)(i * 13 + i / 251);
+            im_writePixels(image, pixels, (size_t)width * bytes);
+            for (int mode = 0; mode <= 6; ++mode) {
+                t_im_image *result = NULL;
+                t_im_status status;
+                if (mode == 4) status = im_transpose(image, &result);
+                else if (mode < 4) status = im_rotate(image, mode == 3 ? -90 : mode * 90 + (mode == 0 ? 360 : 0), &result);
+                else status = im_flip(image, mode == 5 ? IM_FLIP_HORIZONTAL : IM_FLIP_VERTICAL);
+                size_t actualSize = 0;
+                unsigned char *actual = status == IM_OK ? read_all(mode < 5 ? result : image, &actualSize) : NULL;
+                orient_reference(pixels, width, height, bytes, mode, expected);
+                if (!actual || actualSize != size || memcmp(actual, expected, size) != 0) same = 0;
+                free(actual);
+                im_free(result);
+                // Flipping twice restores the image for the next mode.
+                if (mode >= 5) im_flip(image, mode == 5 ? IM_FLIP_HORIZONTAL : IM_FLIP_VERTICAL);
+            }
+            size_t restoredSize = 0;
+            unsigned char *restored = read_all(image, &restoredSize);
+            if (!restored || restoredSize != size || memcmp(restored, pixels, size) != 0) same = 0;
+            free(restored);
+            im_free(image);
+            free(pixels);
+            free(expected);
+        }
+    }
+    expect(same, "rotations, transposes and flips match the reference");
+    t_im_image *image = NULL, *result = NULL;
+    expect(im_create(4, 4, 8, &image) == IM_OK && im_rotate(image, 45, &result) == IM_ERR_INVALID_ARGUMENT && !result,
+           "rotation by 45 degrees is rejected");
+    im_free(image);
+}
+
+// Reads the pixels of a warp of image (affine if perspective is 0); NULL if it fails.
+static unsigned char *warp_pixels(const t_im_image *image, const double *matrix, int perspective, int width, int height,
+                                  int fill) {
+    t_im_image *warped = NULL;
+    t_im_status status = perspective ? im_warpPerspective(image, matrix, width, height, fill, &warped)
+                                     : im_warpAffine(image, matrix, width, height, fill, &warped);
+    size_t size = 0;
+    unsigned char *pixels = status == IM_OK ? read_all(warped, &size) : NULL;
+    im_free(warped);
+    return pixels;
+}
+
+// Checks warps whose result is known exactly (identity, whole-pixel shifts, a quarter turn, a homography that is
+// affine) and compares a real perspective warp with a bilinear reference computed in double.
+static void check_warp(void) {
+    const int width = 53, height = 37;
+    unsigned char pixels[53 * 37 * 3], expected[53 * 37 * 3];
+    int exact = 1, close = 1;
+    for (int depth = 8; depth <= 24; depth += 16) {
+        int bytes = depth / 8;
+        size_t size = (size_t)width * height * bytes;
+        t_im_image *image = NULL;
+        if (im_create(width, height, depth, &image) != IM_OK) { exact = 0; break; }
+        for (size_t i = 0; i < size; ++i) pixels[i] = (unsigned char)(i * 29 + i / 17);
+        im_writePixels(image, pixels, (size_t)width * bytes);
+
+        const double identity[6] = { 1, 0, 0, 0, 1, 0 };
+        unsigned char *out = warp_pixels(image, identity, 0, width, height, 0);
+        if (!out || memcmp(out, pixels, size) != 0) exact = 0;
+        free(out);
+
+        const double shift[6] = { 1, 0, 3, 0, 1, -2 };
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                int sx = x + 3, sy = y - 2, inside = sx < width && sy >= 0;
+                for (int c = 0; c < bytes; ++c) {
+                    expected[((size_t)y * width + x) * bytes + c] =
+                        inside ? pixels[((size_t)sy * width + sx) * bytes + c] : 200;
+                }
+            }
+        }
+        out = warp_pixels(image, shift, 0, width, height, 200);
+        if (!out || memcmp(out, expected, size) != 0) exact = 0;
+        free(out);
+        const double shift9[9] = { 2, 0, 6, 0, 2, -4, 0, 0, 2 };
+        out = warp_pixels(image, shift9, 1, width, height, 200);
+        if (!out || memcmp(out, expected, size) != 0) exact = 0;
+        free(out);
+
+        // Output pixel (x, y) of a clockwise quarter turn samples source (y, height - 1 - x).
+        const double quarter[6] = { 0, 1, 0, -1, 0, height - 1 };
+        t_im_image *turned = NULL;
+        size_t turnedSize = 0;
+        unsigned char *reference = im_rotate(image, 90, &turned) == IM_OK ? read_all(turned, &turnedSize) : NULL;
+        out = warp_pixels(image, quarter, 0, height, width, 0);
+        if (!out || !reference || memcmp(out, reference, size) != 0) exact = 0;
+        free(out);
+        free(reference);
+        im_free(turned);
+
+        const double keystone[9] = { 0.9, 0.04, 2.0, -0.03, 1.1, 1.0, 0.002, -0.003, 1.0 };
+        out = warp_pixels(image, keystone, 1, width, height, 0);
+        for (int y = 0; out && y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double depthDiv = keystone[6] * x + keystone[7] * y + keystone[8];
+                double sx = (keystone[0] * x + keystone[1] * y + keystone[2]) / depthDiv;
+                double sy = (keystone[3] * x + keystone[4] * y + keystone[5]) / depthDiv;
+                int ix = (int)sx - (sx < (int)sx), iy = (int)sy - (sy < (int)sy);
+                double fx = sx - ix, fy = sy - iy;
+                for (int c = 0; c < bytes; ++c) {
+                    double value = 0.0;
+                    for (int j = 0; j < 2; ++j) {
+                        for (int i = 0; i < 2; ++i) {
+                            int tx = ix + i, ty = iy + j;
+                            double tap = tx >= 0 && ty >= 0 && tx < width && ty < height
+                                       ? pixels[((size_t)ty * width + tx) * bytes + c] : 0.0;
+                            value += tap * (i ? fx : 1.0 - fx) * (j ? fy : 1.0 - fy);
+                        }
+                    }
+                    double error = out[((size_t)y * width + x) * bytes + c] - value;
+                    if (error > 2.0 || error < -2.0) close = 0;
+                }
+            }
+        }
+        if (!out) close = 0;
+        free(out);
+        im_free(image);
+    }
+    expect(exact, "identity, shifted and quarter-turn warps are exact");
+    expect(close, "perspective warp matches the double-precision reference");
+    t_im_image *image = NULL, *warped = NULL;
+    const double singular[6] = { NAN, 0, 0, 0, 1, 0 };
+    expect(im_create(4, 4, 24, &image) == IM_OK && im_warpAffine(image, singular, 4, 4, 0, &warped) == IM_ERR_INVALID_ARGUMENT,
+           "non-finite warp matrix is rejected");
+    im_free(image);
+}
+
+// Compares the region statistics of the summed-area tables with direct sums over rectangles of every shape: whole
+// image, single pixels, rows, columns and rectangles touching each border.
+static void check_integral(void) {
+    const int width = 61, height = 43;
+    unsigned char pixels[61 * 43 * 3];
+    int match = 1;
+    for (int depth = 8; depth <= 24; depth += 16) {
+        int channels = depth / 8;
+        t_im_image *image = NULL;
+        t_im_integral *integral = NULL;
+        if (im_create(width, height, depth, &image) != IM_OK) { match = 0; break; }
+        for (size_t i = 0; i < (size_t)width * height * channels; ++i) pixels[i] = (unsigned char)(i * 97 + i / 61);
+        im_writePixels(image, pixels, (size_t)width * channels);
+        if (im_integralCreate(image, 1, &integral) != IM_OK) match = 0;
+        for (int y = 0; integral && y < height; y += 6) {
+            for (int x = 0; x < width; x += 5) {
+                int sizes[4][2] = { { 1, 1 }, { width - x, 1 }, { 1, height - y }, { width - x, height - y } };
+                for (int k = 0; k < 4; ++k) {
+                    for (int c = 0; c < channels; ++c) {
+                        unsigned long long sum = 0, squares = 0;
+                        for (int j = y; j < y + sizes[k][1]; ++j) {
+                            for (int i = x; i < x + sizes[k][0]; ++i) {
+                                unsigned int v = pixels[((size_t)j * width + i) * channels + c];
+                                sum += v;
+                                squares += v * v;
+                            }
+                        }
+                        double count = (double)sizes[k][0] * sizes[k][1], mean = (double)sum / count;
+                        double variance = (double)squares / count - mean * mean, error;
+                        t_im_region stats;
+                        if (im_regionStats(integral, x, y, sizes[k][0], sizes[k][1], c, &stats) != IM_OK) {
+                            match = 0;
+                            continue;
+                        }
+                        error = stats.variance - variance;
+                        if (stats.count != (unsigned long long)count || stats.sum != sum || stats.sumSquares != squares ||
+                            stats.mean != mean || error > 1e-6 || error < -1e-6) {
+                            match = 0;
+                        }
+                    }
+                }
+            }
+        }
+        im_integralFree(integral);
+        im_free(image);
+    }
+    expect(match, "region statistics match direct sums");
+
+    t_im_image *image = NULL;
+    t_im_integral *integral = NULL;
+    t_im_region stats;
+    expect(im_create(8, 6, 24, &image) == IM_OK && im_integralCreate(image, 0, &integral) == IM_OK,
+           "summed-area table without squares");
+    expect(im_regionStats(integral, 2, 1, 6, 5, 2, &stats) == IM_OK && stats.count == 30 && stats.variance == 0.0,
+           "region statistics without squares");
+    expect(im_regionStats(integral, 3, 0, 6, 1, 0, &stats) == IM_ERR_INVALID_ARGUMENT, "region past the right edge");
+    expect(im_regionStats(integral, 0, 0, 1, 1, 3, &stats) == IM_ERR_INVALID_ARGUMENT, "invalid channel");
+    expect(im_regionStats(integral, 0, 0, 0, 1, 0, &stats) == IM_ERR_INVALID_ARGUMENT, "empty region");
+    im_integralFree(integral);
+    im_free(image);
+}
+
+// Compares the adaptive thresholds with a direct integer evaluation over clipped windows. k = -1/4 (Niblack) and
+// k = 1/2 (Sauvola, R = 128 = 2^7) make both tests exact in 64-bit integers: with count n, sum S and
+// D = n * (sum of squares) - S^2, Niblack keeps p when 4 (p n - S) >= -sqrt(D) and Sauvola when
+// 128 n (2 p n - S) >= S sqrt(D).
+static void check_adaptive_threshold(void) {
+    const int width = 37, height = 29, windows[2] = { 7, 21 };
+    unsigned char pixels[37 * 29], out[37 * 29];
+    int match = 1;
+    for (size_t i = 0; i < sizeof(pixels); ++i) pixels[i] = (unsigned char)((i * 37 + (i * i) / 11) ^ (i / 5));
+    for (int method = 0; method < 2; ++method) {
+        for (int w = 0; w < 2; ++w) {
+            int window = windows[w], radius = window / 2;
+            if (method == IM_THRESHOLD_SAUVOLA && window > 7) continue;   // keeps the squared terms below 2^63
+            t_im_image *image = NULL;
+            if (im_create(width, height, 8, &image) != IM_OK) { match = 0; continue; }
+            im_writePixels(image, pixels, width);
+            double k = method == IM_THRESHOLD_NIBLACK ? -0.25 : 0.5;
+            if (im_adaptiveThreshold(image, (t_im_threshold)method, window, k) != IM_OK ||
+                im_readPixels(image, out, width) != IM_OK) {
+                match = 0;
+            }
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    long long n = 0, sum = 0, squares = 0, p = pixels[y * width + x];
+                    for (int j = y - radius; j <= y + radius; ++j) {
+                        for (int i = x - radius; i <= x + radius; ++i) {
+                            if (i < 0 || j < 0 || i >= width || j >= height) continue;
+                            long long v = pixels[j * width + i];
+                            n += 1;
+                            sum += v;
+                            squares += v * v;
+                        }
+                    }
+                    long long spread = n * squares - sum * sum, white;
+                    if (method == IM_THRESHOLD_NIBLACK) {
+                        long long a = 4 * (p * n - sum);
+                        white = a >= 0 || a * a <= spread;
+                    } else {
+                        long long a = 128 * n * (2 * p * n - sum);
+                        white = a >= 0 && a * a >= sum * sum * spread;
+                    }
+                    if (out[y * width + x] != (white ? 255 : 0)) match = 0;
+                }
+            }
+            im_free(image);
+        }
+    }
+    expect(match, "adaptive thresholds match the direct evaluation");
+    t_im_image *image = NULL;
+    expect(im_create(8, 8, 8, &image) == IM_OK && im_adaptiveThreshold(image, IM_THRESHOLD_SAUVOLA, 4, 0.3) ==
+           IM_ERR_INVALID_ARGUMENT, "even threshold window is rejected");
+    expect(im_adaptiveThreshold(image, IM_THRESHOLD_NIBLACK, 513, -0.2) == IM_ERR_INVALID_ARGUMENT,
+           "threshold window above the limit is rejected");
+    im_free(image);
+    expect(im_create(8, 8, 24, &image) == IM_OK && im_adaptiveThreshold(image, IM_THRESHOLD_SAUVOLA, 15, 0.3) ==
+           IM_ERR_UNSUPPORTED, "adaptive threshold on 24-bit is unsupported");
+    im_free(image);
+}
+
+// Checks Otsu against the textbook search (class weights and means for every split) on a two-peak image and, for both
+// methods, that a histogram from im_histogram gives the same result as none and that the image is binarized at the
+// returned level.
+static void check_auto_threshold(void) {
+    const int width = 64, height = 48;
+    unsigned char pixels[64 * 48], out[64 * 48];
+    unsigned int histogram[256] = { 0 };
+    for (int i = 0; i < width * height; ++i) {
+        int noise = (i * 7919) % 23 - 11;
+        pixels[i] = (unsigned char)((i / width + i % width) % 5 == 0 ? 60 + noise : 190 + 2 * noise);
+        ++histogram[pixels[i]];
+    }
+    double best = -1.0;
+    int expected = 0;
+    for (int t = 1; t < 256; ++t) {
+        double n0 = 0, n1 = 0, s0 = 0, s1 = 0;
+        for (int v = 0; v < 256; ++v) {
+            if (v < t) { n0 += histogram[v]; s0 += (double)histogram[v] * v; }
+            else { n1 += histogram[v]; s1 += (double)histogram[v] * v; }
+        }
+        if (n0 == 0 || n1 == 0) continue;
+        double w0 = n0 / (n0 + n1), w1 = n1 / (n0 + n1), d = s0 / n0 - s1 / n1;
+        if (w0 * w1 * d * d > best + 1e-9) { best = w0 * w1 * d * d; expected = t; }
+    }
+    for (int method = IM_AUTO_OTSU; method <= IM_AUTO_TRIANGLE; ++method) {
+        int levels[2] = { -1, -1 }, binary = 1;
+        for (int reuse = 0; reuse < 2; ++reuse) {
+            t_im_image *image = NULL;
+            unsigned int counted[256];
+            if (im_create(width, height, 8, &image) != IM_OK) { binary = 0; continue; }
+            im_writePixels(image, pixels, width);
+            if (reuse && im_histogram(image, counted) != IM_OK) binary = 0;
+            if (im_autoThreshold(image, (t_im_auto_threshold)method, reuse ? counted : NULL, &levels[reuse]) != IM_OK ||
+                im_readPixels(image, out, width) != IM_OK) {
+                binary = 0;
+            }
+            for (int i = 0; i < width * height; ++i) {
+                if (out[i] != (pixels[i] >= levels[reuse] ? 255 : 0)) binary = 0;
+            }
+            im_free(image);
+        }
+        if (method == IM_AUTO_OTSU) expect(levels[0] == expected, "Otsu threshold matches the direct search");
+        expect(levels[0] == levels[1] && binary, "automatic threshold with and without a histogram");
+    }
+    t_im_image *image = NULL;
+    int level = -1;
+    expect(im_create(width, height, 8, &image) == IM_OK && im_autoThreshold(image, IM_AUTO_OTSU, NULL, &level) == IM_OK &&
+           level == 0, "uniform image keeps its level as threshold");
+    expect(im_autoThreshold(image, IM_AUTO_OTSU, histogram, NULL) == IM_OK, "histogram of another image with the same size");
+    histogram[0] += 1;
+    expect(im_autoThreshold(image, IM_AUTO_OTSU, histogram, NULL) == IM_ERR_INVALID_ARGUMENT,
+           "histogram with the wrong pixel count is rejected");
+    im_free(image);
+}
+
+// Compares the median filters with sorting every clamped window, for the min/max network (radius 1) and the
+// histogram path, on both depths and on images narrower than the window.
+static void check_median(void) {
+    static const int sizes[3][2] = { { 45, 31 }, { 2, 9 }, { 70, 3 } }, radii[3] = { 1, 2, 5 };
+    unsigned char pixels[70 * 31 * 3], out[70 * 31 * 3];
+    int match = 1;
+    for (size_t i = 0; i < sizeof(pixels); ++i) pixels[i] = (unsigned char)(i % 7 == 0 ? (i % 2) * 255 : (i * 13) / 17);
+    for (int depth = 8; depth <= 24; depth += 16) {
+        int channels = depth / 8;
+        for (int s = 0; s < 3; ++s) {
+            for (int k = 0; k < 3; ++k) {
+                int width = sizes[s][0], height = sizes[s][1], radius = radii[k];
+                t_im_image *image = NULL;
+                if (im_create(width, height, depth, &image) != IM_OK) { match = 0; continue; }
+                im_writePixels(image, pixels, (size_t)width * channels);
+                if (im_median(image, radius) != IM_OK || im_readPixels(image, out, (size_t)width * channels) != IM_OK) {
+                    match = 0;
+                }
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        for (int c = 0; c < channels; ++c) {
+                            unsigned int counts[256] = { 0 }, seen = 0, need = ((2 * radius + 1) * (2 * radius + 1) + 1) / 2;
+                            for (int j = y - radius; j <= y + radius; ++j) {
+                                for (int i = x - radius; i <= x + radius; ++i) {
+                                    int cy = j < 0 ? 0 : j >= height ? height - 1 : j;
+                                    int cx = i < 0 ? 0 : i >= width ? width - 1 : i;
+                                    ++counts[pixels[((size_t)cy * width + cx) * channels + c]];
+                                }
+                            }
+                            int median = 0;
+                            while (seen + counts[median] < need) seen += counts[median++];
+                            if (out[((size_t)y * width + x) * channels + c] != median) match = 0;
+                        }
+                    }
+                }
+                im_free(image);
+            }
+        }
+    }
+    expect(match, "median filters match sorted windows");
+    t_im_image *image = NULL;
+    expect(im_create(4, 4, 8, &image) == IM_OK && im_median(image, 0) == IM_ERR_INVALID_ARGUMENT &&
+           im_median(image, 128) == IM_ERR_INVALID_ARGUMENT, "median radius out of range is rejected");
+    im_free(image);
+}
+
+// Computes the minimum (or maximum) of src over the window of every pixel, skipping pixels past the borders. The
+// erosion window reaches ew / 2 left and eh / 2 up; the dilation reflects it.
+static void morph_reference(const unsigned char *src, unsigned char *dst, int width, int height, int ew, int eh,
+                            int maximum) {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int value = maximum ? 0 : 255;
+            for (int j = -(eh / 2); j <= (eh - 1) / 2; ++j) {
+                for (int i = -(ew / 2); i <= (ew - 1) / 2; ++i) {
+                    int cy = maximum ? y - j : y + j, cx = maximum ? x - i : x + i;
+                    if (cy < 0 || cy >= height || cx < 0 || cx >= width) continue;
+                    int p = src[cy * width + cx];
+                    value = maximum ? (p > value ? p : value) : (p < value ? p : value);
+                }
+            }
+            dst[y * width + x] = (unsigned char)value;
+        }
+    }
+}
+
+// Compares the morphology operations with the references, for odd and even sizes and elements larger than the image.
+static void check_morphology(void) {
+    static const int sizes[3][2] = { { 45, 31 }, { 2, 9 }, { 70, 3 } };
+    static const int elements[4][2] = { { 1, 1 }, { 3, 5 }, { 4, 2 }, { 13, 40 } };
+    static unsigned char pixels[70 * 31], eroded[70 * 31], dilated[70 * 31], opened[70 * 31], closed[70 * 31];
+    static unsigned char out[70 * 31];
+    int match = 1;
+    for (size_t i = 0; i < sizeof(pixels); ++i) pixels[i] = (unsigned char)(i % 5 == 0 ? (i % 3) * 127 : (i * 29) / 11);
+    for (int s = 0; s < 3; ++s) {
+        for (int e = 0; e < 4; ++e) {
+            int width = sizes[s][0], height = sizes[s][1], ew = elements[e][0], eh = elements[e][1];
+            morph_reference(pixels, eroded, width, height, ew, eh, 0);
+            morph_reference(pixels, dilated, width, height, ew, eh, 1);
+            morph_reference(eroded, opened, width, height, ew, eh, 1);
+            morph_reference(dilated, closed, width, height, ew, eh, 0);
+            for (int op = IM_MORPH_ERODE; op <= IM_MORPH_TOPHAT; ++op) {
+                t_im_image *image = NULL;
+                if (im_create(width, height, 8, &image) != IM_OK) { match = 0; continue; }
+                im_writePixels(image, pixels, (size_t)width);
+                if (im_morphology(image, (t_im_morph)op, ew, eh) != IM_OK ||
+                    im_readPixels(image, out, (size_t)width) != IM_OK) {
+                    match = 0;
+                }
+                for (int i = 0; i < width * height; ++i) {
+                    int expected = op == IM_MORPH_ERODE ? eroded[i] : op == IM_MORPH_DILATE ? dilated[i] :
+                                   op == IM_MORPH_OPEN ? opened[i] : op == IM_MORPH_CLOSE ? closed[i] :
+                                   pixels[i] - opened[i];
+                    if (out[i] != expected) match = 0;
+                }
+                im_free(image);
+            }
+        }
+    }
+    expect(match, "morphology matches the window minimum and maximum");
+    t_im_image *image = NULL;
+    expect(im_create(4, 4, 8, &image) == IM_OK && im_morphology(image, IM_MORPH_ERODE, 0, 3) == IM_ERR_INVALID_ARGUMENT,
+           "empty structuring element is rejected");
+    im_free(image);
+    image = NULL;
+    expect(im_create(4, 4, 24, &image) == IM_OK && im_morphology(image, IM_MORPH_DILATE, 3, 3) == IM_ERR_UNSUPPORTED,
+           "morphology on 24-bit is unsupported");
+    im_free(image);
+}
+
+// Computes the Sobel gradients of a top-down image, repeating the edge pixels; gy points up.
+static void sobel_reference(const unsigned char *pixels, int width, int height, int *gx, int *gy) {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int p[3][3];
+            for (int j = 0; j < 3; ++j) {
+                for (int i = 0; i < 3; ++i) {
+                    int cy = y + j - 1 < 0 ? 0 : y + j - 1 >= height ? height - 1 : y + j - 1;
+                    int cx = x + i - 1 < 0 ? 0 : x + i - 1 >= width ? width - 1 : x + i - 1;
+                    p[j][i] = pixels[cy * width + cx];
+                }
+            }
+            gx[y * width + x] = (p[0][2] + 2 * p[1][2] + p[2][2]) - (p[0][0] + 2 * p[1][0] + p[2][0]);
+            gy[y * width + x] = (p[0][0] + 2 * p[0][1] + p[0][2]) - (p[2][0] + 2 * p[2][1] + p[2][2]);
+        }
+    }
+}
+
+// Direction of a gradient from the angle bounds 22.5 and 67.5 degrees (tan 22.5 = sqrt(2) - 1, tan 67.5 = sqrt(2) + 1).
+static int sobel_direction(int gx, int gy) {
+    double ax = gx < 0 ? -gx : gx, ay = gy < 0 ? -gy : gy;
+    if (ay <= ax * 0.41421356237309503) return IM_GRADIENT_HORIZONTAL;
+    if (ay > ax * 2.41421356237309503) return IM_GRADIENT_VERTICAL;
+    return (gx < 0) == (gy < 0) ? IM_GRADIENT_RISING : IM_GRADIENT_FALLING;
+}
+
+// Compares im_sobel and im_canny with direct computations: the suppression looks at the two neighbours along the
+// gradient (keeping the left or lower one of two equal maxima), and the hysteresis is repeated until nothing changes.
+static void check_edges(void) {
+    static const int sizes[5][2] = { { 45, 31 }, { 2, 9 }, { 70, 3 }, { 1, 6 }, { 9, 1 } };
+    static const int thresholds[3][2] = { { 100, 300 }, { 40, 40 }, { 0, 600 } };
+    static unsigned char pixels[70 * 31], out[70 * 31], direction[71 * 31], edges[70 * 31];
+    static int gx[70 * 31], gy[70 * 31], magnitude[70 * 31];
+    int sobelMatch = 1, cannyMatch = 1;
+    for (int s = 0; s < 5; ++s) {
+        int width = sizes[s][0], height = sizes[s][1];
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                int block = (x / 7 + y / 5) % 2;
+                pixels[y * width + x] = (unsigned char)(block * 160 + (x * 13 + y * 29) % 50 + (x == y) * 40);
+            }
+        }
+        sobel_reference(pixels, width, height, gx, gy);
+        for (int i = 0; i < width * height; ++i) {
+            magnitude[i] = (gx[i] < 0 ? -gx[i] : gx[i]) + (gy[i] < 0 ? -gy[i] : gy[i]);
+        }
+        t_im_image *image = NULL;
+        if (im_create(width, height, 8, &image) != IM_OK) { sobelMatch = 0; continue; }
+        im_writePixels(image, pixels, (size_t)width);
+        if (im_sobel(image, direction, (size_t)width + 1) != IM_OK || im_readPixels(image, out, (size_t)width) != IM_OK) {
+            sobelMatch = 0;
+        }
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                int i = y * width + x;
+                if (out[i] != (magnitude[i] > 255 ? 255 : magnitude[i]) ||
+                    direction[y * (width + 1) + x] != sobel_direction(gx[i], gy[i])) {
+                    sobelMatch = 0;
+                }
+            }
+        }
+        for (int t = 0; t < 3; ++t) {
+            int low = thresholds[t][0], high = thresholds[t][1];
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    int i = y * width + x, m = magnitude[i], ax = 0, ay = 0, bx = 0, by = 0;
+                    switch (sobel_direction(gx[i], gy[i])) {
+                        case IM_GRADIENT_HORIZONTAL: ax = -1; bx = 1; break;
+                        case IM_GRADIENT_VERTICAL: ay = 1; by = -1; break;
+                        case IM_GRADIENT_RISING: ax = -1; ay = 1; bx = 1; by = -1; break;
+                        default: ax = -1; ay = -1; bx = 1; by = 1; break;
+                    }
+                    int a = 0, b = 0;
+                    if (x + ax >= 0 && x + ax < width && y + ay >= 0 && y + ay < height) a = magnitude[i + ay * width + ax];
+                    if (x + bx >= 0 && x + bx < width && y + by >= 0 && y + by < height) b = magnitude[i + by * width + bx];
+                    edges[i] = m > low && m > a && m >= b ? (m > high ? 255 : 1) : 0;
+                }
+            }
+            for (int changed = 1; changed;) {
+                changed = 0;
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        if (edges[y * width + x] != 1) continue;
+                        for (int j = -1; j <= 1; ++j) {
+                            for (int i = -1; i <= 1; ++i) {
+                                int cy = y + j, cx = x + i;
+                                if (cy < 0 || cy >= height || cx < 0 || cx >= width) continue;
+                                if (edges[cy * width + cx] != 255) continue;
+                                edges[y * width + x] = 255;
+                                changed = 1;
+                            }
+                        }
+                    }
+                }
+            }
+            im_writePixels(image, pixels, (size_t)width);
+            if (im_canny(image, low, high) != IM_OK || im_readPixels(image, out, (size_t)width) != IM_OK) cannyMatch = 0;
+            for (int i = 0; i < width * height; ++i) {
+                if (out[i] != (edges[i] == 255 ? 255 : 0)) cannyMatch = 0;
+            }
+        }
+        im_free(image);
+    }
+    expect(sobelMatch, "Sobel magnitudes and directions match the direct computation");
+    expect(cannyMatch, "Canny edges match suppression and repeated hysteresis");
+    t_im_image *image = NULL;
+    expect(im_create(4, 4, 8, &image) == IM_OK && im_canny(image, 50, 20) == IM_ERR_INVALID_ARGUMENT &&
+           im_canny(image, 0, 2041) == IM_ERR_INVALID_ARGUMENT, "Canny thresholds out of order or range are rejected");
+    expect(im_sobel(image, direction, 3) == IM_ERR_INVALID_ARGUMENT, "direction stride shorter than a row is rejected");
+    im_free(image);
+    image = NULL;
+    expect(im_create(4, 4, 24, &image) == IM_OK && im_sobel(image, NULL, 0) == IM_ERR_UNSUPPORTED &&
+           im_canny(image, 10, 20) == IM_ERR_UNSUPPORTED, "edges on 24-bit are unsupported");
+    im_free(image);
+}
+
+// Reads the values of the last entry of a tuning cache (model, cpus, threads, band rows, chunk bytes per line).
+static int read_cached_tuning(const char *path, t_im_tuning *tuning) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[512];
+    int found = -1;
+    while (fgets(line, sizeof(line), f)) {
+        const char *tab = strchr(line, '\t');
+        int cpus;
+        unsigned long chunkBytes;
+        if (line[0] == '#' || !tab) continue;
+        if (sscanf(tab + 1, "%d\t%d\t%d\t%lu", &cpus, &tuning->threads, &tuning->bandRows, &chunkBytes) == 4) {
+            tuning->chunkBytes = (size_t)chunkBytes;
+            found = 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Tunes the machine and checks that the choice is applied and saved (the cache file comes from the environment).
+static void check_tuning(void) {
+    t_im_tuning tuned, active;
+    expect(im_getTuning(NULL) == IM_ERR_INVALID_ARGUMENT, "NULL tuning is rejected");
+    expect(im_autoTune(&tuned) == IM_OK, "auto-tune");
+    expect(tuned.threads >= 1 && tuned.bandRows >= 1 && tuned.chunkBytes >= 1024, "tuned values are valid");
+    expect(im_getTuning(&active) == IM_OK && active.threads == tuned.threads && active.bandRows == tuned.bandRows &&
+           active.chunkBytes == tuned.chunkBytes, "tuned values are in effect");
+}
+
+static void check_cached_tuning(const char *path) {
+    t_im_tuning cached, active;
+    expect(read_cached_tuning(path, &cached) == 0, "tuning cache has an entry");
+    expect(im_getTuning(&active) == IM_OK && active.threads == cached.threads && active.bandRows == cached.bandRows &&
+           active.chunkBytes == cached.chunkBytes, "cached tuning is loaded at startup");
+}
+
+int main(int argc, char **argv) {
+    const char *imagesDir = ".";
+    const char *cachedTuning = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) imagesDir = argv[++i];
+        else if (strcmp(argv[i], "--cached-tuning") == 0 && i + 1 < argc) cachedTuning = argv[++i];
+        else {
+            printf("Usage: %s [--images DIR] [--cached-tuning FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("libimagemod %s\n", im_version());
+    if (cachedTuning) {
+        check_cached_tuning(cachedTuning);
+    } else {
+        check_errors(imagesDir);
+        check_round_trip(8);
+        check_round_trip(24);
+        check_batch();
+        check_batch_loading();
+        check_deep_queue();
+        check_index();
+        check_convolve_to_file(imagesDir);
+        check_graph(imagesDir);
+        check_resize();
+        check_pyramid();
+        check_orientation();
+        check_warp();
+        check_integral();
+        check_adaptive_threshold();
+        check_auto_threshold();
+        check_median();
+        check_morphology();
+        check_edges();
+        if (getenv("IMAGE_MOD_TUNE_FILE")) check_tuning();
+    }
+    if (g_failures == 0) printf("All API checks passed.\n");
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+// instrument.c
+#include "instrument.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define INSTR_HAVE_PERF 1
+#endif
+
+#define INSTR_ERROR_MAX 512
+
+static pthread_once_t g_initOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_sinkLock = PTHREAD_MUTEX_INITIALIZER;
+static t_instr_console g_console = INSTR_CONSOLE_SILENT;   // a library prints nothing unless asked (main.c asks)
+static t_instr_callback g_callback = NULL;
+static void *g_callbackData = NULL;
+static FILE *g_jsonSink = NULL;
+static int g_hardwareCounters = 0;
+static unsigned long g_nextThreadId = 0;
+
+// Per-thread state: nesting depth, scratch accounting and the perf_event group of the thread.
+static _Thread_local int t_depth = 0;
+static _Thread_local uint64_t t_scratchCurrent = 0;
+static _Thread_local uint64_t t_scratchPeak = 0;
+static _Thread_local unsigned long t_threadId = 0;
+static _Thread_local int t_perfState = 0;    // 0: not opened yet, 1: open, -1: unavailable
+static _Thread_local int t_perfFd[3] = {-1, -1, -1};
+static _Thread_local unsigned long t_errorCount = 0;
+static _Thread_local char t_lastError[INSTR_ERROR_MAX];
+static _Thread_local int t_inInit = 0;   // messages printed while reading the environment must not re-enter pthread_once
+
+static void instr_initFromEnv(void) {
+    t_inInit = 1;
+    const char *log = getenv("IMAGE_MOD_LOG");
+    if (log != NULL) {
+        if (strcmp(log, "silent") == 0) g_console = INSTR_CONSOLE_SILENT;
+        else if (strcmp(log, "errors") == 0) g_console = INSTR_CONSOLE_ERRORS;
+        else if (strcmp(log, "all") == 0) g_console = INSTR_CONSOLE_ALL;
+    }
+    const char *json = getenv("IMAGE_MOD_INSTR_JSON");
+    if (json != NULL && json[0] != '\0') {
+        g_jsonSink = fopen(json, "a");
+    }
+    const char *perf = getenv("IMAGE_MOD_PERF_COUNTERS");
+    if (perf != NULL && strcmp(perf, "1") == 0) {
+        g_hardwareCounters = 1;
+    }
+    t_inInit = 0;
+}
+
+static void instr_init(void) {
+    if (t_inInit) return;
+    pthread_once(&g_initOnce, instr_initFromEnv);
+}
+
+double instr_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void instr_setConsole(t_instr_console level) {
+    instr_init();
+    g_console = level;
+}
+
+t_instr_console instr_getConsole(void) {
+    instr_init();
+    return g_console;
+}
+
+void instr_setCallback(t_instr_callback callback, void *userData) {
+    instr_init();
+    pthread_mutex_lock(&g_sinkLock);
+    g_callback = callback;
+    g_callbackData = userData;
+    pthread_mutex_unlock(&g_sinkLock);
+}
+
+int instr_openJsonSink(const char *path) {
+    instr_init();
+    FILE *f = fopen(path, "a");
+    if (f == NULL) {
+        instr_error("Error: Cannot open instrumentation sink %s\n", path);
+        return -1;
+    }
+    pthread_mutex_lock(&g_sinkLock);
+    if (g_jsonSink != NULL) fclose(g_jsonSink);
+    g_jsonSink = f;
+    pthread_mutex_unlock(&g_sinkLock);
+    return 0;
+}
+
+void instr_closeJsonSink(void) {
+    pthread_mutex_lock(&g_sinkLock);
+    if (g_jsonSink != NULL) fclose(g_jsonSink);
+    g_jsonSink = NULL;
+    pthread_mutex_unlock(&g_sinkLock);
+}
+
+#ifdef INSTR_HAVE_PERF
+static int perf_open(uint32_t type, uint64_t config, int groupFd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = groupFd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+// Function perf_openThread opens the cycles/instructions/cache-misses group of the calling thread once.
+static int perf_openThread(void) {
+    if (t_perfState != 0) return t_perfState;
+    t_perfFd[0] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (t_perfFd[0] < 0) {
+        t_perfState = -1;
+        return t_perfState;
+    }
+    t_perfFd[1] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, t_perfFd[0]);
+    t_perfFd[2] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, t_perfFd[0]);
+    if (t_perfFd[1] < 0 || t_perfFd[2] < 0) {
+        for (int i = 0; i < 3; i++) {
+            if (t_perfFd[i] >= 0) close(t_perfFd[i]);
+            t_perfFd[i] = -1;
+        }
+        t_perfState = -1;
+        return t_perfState;
+    }
+    ioctl(t_perfFd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(t_perfFd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    t_perfState = 1;
+    return t_perfState;
+}
+
+static int perf_readThread(uint64_t counters[3]) {
+    uint64_t values[4];   // nr, then one value per event
+    if (read(t_perfFd[0], values, sizeof(values)) != (ssize_t)sizeof(values) || values[0] != 3) {
+        return -1;
+    }
+    counters[0] = values[1];
+    counters[1] = values[2];
+    counters[2] = values[3];
+    return 0;
+}
+#endif
+
+int instr_enableHardwareCounters(int enable) {
+    instr_init();
+    g_hardwareCounters = enable != 0;
+    if (!enable) return 0;
+#ifdef INSTR_HAVE_PERF
+    return perf_openThread() == 1 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+// Recording is skipped entirely when nobody consumes the records.
+static int instr_recording(void) {
+    return g_callback != NULL || g_jsonSink != NULL;
+}
+
+void instr_begin(t_instr_span *span, const char *op) {
+    instr_init();
+    span->op = op;
+    span->active = instr_recording();
+    span->hasHardwareCounters = 0;
+    span->scratchBase = t_scratchCurrent;
+    span->savedPeak = t_scratchPeak;
+    t_scratchPeak = t_scratchCurrent;
+    t_depth++;
+    span->traced = trace_active();
+    if (span->traced) trace_begin("op", op);
+    if (!span->active) return;
+#ifdef INSTR_HAVE_PERF
+    if (g_hardwareCounters && perf_openThread() == 1 && perf_readThread(span->counters) == 0) {
+        span->hasHardwareCounters = 1;
+    }
+#endif
+    span->start = instr_now();
+}
+
+static void instr_writeJson(FILE *f, const t_instr_record *r) {
+    fprintf(f, "{\"op\":\"%s\",\"depth\":%d,\"thread\":%lu,\"seconds\":%.9f,\"pixels\":%llu,\"bytes\":%llu,"
+               "\"peak_scratch\":%llu",
+            r->op, r->depth, r->thread, r->seconds, (unsigned long long)r->pixels,
+            (unsigned long long)r->bytes, (unsigned long long)r->peakScratch);
+    if (r->hasHardwareCounters) {
+        fprintf(f, ",\"cycles\":%llu,\"instructions\":%llu,\"cache_misses\":%llu",
+                (unsigned long long)r->cycles, (unsigned long long)r->instructions,
+                (unsigned long long)r->cacheMisses);
+    }
+    fputs("}\n", f);
+}
+
+void instr_end(t_instr_span *span, uint64_t pixels, uint64_t bytes) {
+    double end = span->active ? instr_now() : 0.0;
+    uint64_t peak = t_scratchPeak - span->scratchBase;
+    t_scratchPeak = t_scratchPeak > span->savedPeak ? t_scratchPeak : span->savedPeak;
+    t_depth--;
+    if (span->traced) trace_end("op", span->op);
+    if (!span->active) return;
+
+    t_instr_record record;
+    memset(&record, 0, sizeof(record));
+    record.op = span->op;
+    record.depth = t_depth;
+    record.seconds = end - span->start;
+    record.pixels = pixels;
+    record.bytes = bytes;
+    record.peakScratch = peak;
+#ifdef INSTR_HAVE_PERF
+    uint64_t counters[3];
+    if (span->hasHardwareCounters && perf_readThread(counters) == 0) {
+        record.hasHardwareCounters = 1;
+        record.cycles = counters[0] - span->counters[0];
+        record.instructions = counters[1] - span->counters[1];
+        record.cacheMisses = counters[2] - span->counters[2];
+    }
+#endif
+
+    pthread_mutex_lock(&g_sinkLock);
+    if (t_threadId == 0) t_threadId = ++g_nextThreadId;
+    record.thread = t_threadId;
+    if (g_callback != NULL) g_callback(&record, g_callbackData);
+    if (g_jsonSink != NULL) instr_writeJson(g_jsonSink, &record);
+    pthread_mutex_unlock(&g_sinkLock);
+}
+
+void instr_scratchAlloc(size_t bytes) {
+    t_scratchCurrent += bytes;
+    if (t_scratchCurrent > t_scratchPeak) t_scratchPeak = t_scratchCurrent;
+}
+
+void instr_scratchFree(size_t bytes) {
+    t_scratchCurrent = bytes < t_scratchCurrent ? t_scratchCurrent - bytes : 0;
+}
+
+void instr_info(const char *format, ...) {
+    instr_init();
+    if (g_console != INSTR_CONSOLE_ALL) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void instr_warning(const char *format, ...) {
+    instr_init();
+    if (g_console == INSTR_CONSOLE_SILENT) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void instr_error(const char *format, ...) {
+    instr_init();
+    va_list args;
+    va_start(args, format);
+    vsnprintf(t_lastError, sizeof(t_lastError), format, args);
+    va_end(args);
+    size_t len = strlen(t_lastError);
+    while (len > 0 && (t_lastError[len - 1] == '\n' || t_lastError[len - 1] == ' ')) t_lastError[--len] = '\0';
+    ++t_errorCount;
+
+    if (g_console == INSTR_CONSOLE_SILENT) return;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+unsigned long instr_errorCount(void) {
+    return t_errorCount;
+}
+
+const char *instr_lastError(void) {
+    return t_lastError;
+}
@@ -0,0 +1,75 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Console verbosity of library messages. INSTR_CONSOLE_ALL keeps the interactive progress messages,
+// the other levels are meant for production runs and benchmarks. The default is INSTR_CONSOLE_SILENT.
+typedef enum {
+    INSTR_CONSOLE_ALL = 0,
+    INSTR_CONSOLE_ERRORS,
+    INSTR_CONSOLE_SILENT
+} t_instr_console;
+
+// Defines the measurements of one completed operation.
+typedef struct {
+    const char *op;
+    int depth;                  // nesting level: 0 for an op called by the user, 1 for an op it called, ...
+    unsigned long thread;
+    double seconds;
+    uint64_t pixels;            // pixels processed
+    uint64_t bytes;             // bytes read + written
+    uint64_t peakScratch;       // peak temporary memory held during the op
+    int hasHardwareCounters;    // the three fields below are valid only when this is 1
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cacheMisses;
+} t_instr_record;
+
+typedef void (*t_instr_callback)(const t_instr_record *record, void *userData);
+
+// Defines an operation in progress; lives on the stack of the instrumented function.
+typedef struct {
+    const char *op;
+    double start;
+    uint64_t scratchBase;
+    uint64_t savedPeak;
+    int active;
+    int traced;
+    int hasHardwareCounters;
+    uint64_t counters[3];
+} t_instr_span;
+
+// Configuration. The environment provides defaults read on first use:
+// IMAGE_MOD_LOG=all|errors|silent, IMAGE_MOD_INSTR_JSON=<path>, IMAGE_MOD_PERF_COUNTERS=1, IMAGE_MOD_TRACE=<path>.
+void instr_setConsole(t_instr_console level);
+t_instr_console instr_getConsole(void);
+void instr_setCallback(t_instr_callback callback, void *userData);
+int instr_openJsonSink(const char *path);
+void instr_closeJsonSink(void);
+// Function instr_enableHardwareCounters turns on cycles/instructions/cache-miss counting via perf_event_open (Linux only).
+// Returns 0 if the counters are available.
+int instr_enableHardwareCounters(int enable);
+
+// Used by the instrumented functions.
+void instr_begin(t_instr_span *span, const char *op);
+void instr_end(t_instr_span *span, uint64_t pixels, uint64_t bytes);
+void instr_scratchAlloc(size_t bytes);
+void instr_scratchFree(size_t bytes);
+
+// Progress messages (shown only with INSTR_CONSOLE_ALL) and errors/warnings (hidden only with INSTR_CONSOLE_SILENT).
+// Errors are also recorded per thread, whatever the console level, so callers can report them as status codes.
+void instr_info(const char *format, ...);
+void instr_warning(const char *format, ...);
+void instr_error(const char *format, ...);
+
+// Function instr_errorCount returns how many errors the calling thread has reported; a change across a call means it failed.
+unsigned long instr_errorCount(void);
+// Function instr_lastError returns the last error message of the calling thread ("" if none), without the trailing newline.
+const char *instr_lastError(void);
+
+// Function instr_now returns a monotonic time in seconds.
+double instr_now(void);
+
+#endif // INSTRUMENT_H
@@ -0,0 +1,273 @@
+// integral.c
+// Summed-area tables. The scan is split into one band of rows per pool thread: the first pass builds each band's
+// table as if the band were the top of the image (rows are prefix-summed and added to the row above), the last rows
+// of the bands are then carried down serially (one row per band), and the second pass adds the final row above each
+// band to the rest of its rows. With a single thread the first pass already gives the final table.
+#include "integral.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Defines one table build; rows are the image rows in display order.
+typedef struct {
+    t_integral *table;
+    const unsigned char *const *rows;
+    size_t bandRows;
+} t_integral_job;
+
+static size_t integral_stride(const t_integral *table) {
+    return ((size_t)table->width + 1) * (size_t)table->channels;
+}
+
+// Writes table row out (column 0 and the prefix sums of pixels added to above), one kernel per entry type.
+static void integral_rowSums32(const unsigned char *pixels, size_t width, int channels, const uint32_t *above,
+                               uint32_t *out) {
+    uint32_t run[3] = { 0, 0, 0 };
+    for (int c = 0; c < channels; ++c) out[c] = 0;
+    if (channels == 1) {
+        for (size_t x = 0; x < width; ++x) {
+            run[0] += pixels[x];
+            out[x + 1] = above[x + 1] + run[0];
+        }
+        return;
+    }
+    for (size_t x = 0; x < width; ++x) {
+        for (int c = 0; c < 3; ++c) {
+            run[c] += pixels[3 * x + c];
+            out[3 * x + 3 + c] = above[3 * x + 3 + c] + run[c];
+        }
+    }
+}
+
+static void integral_rowSums64(const unsigned char *pixels, size_t width, int channels, const uint64_t *above,
+                               uint64_t *out) {
+    uint64_t run[3] = { 0, 0, 0 };
+    for (int c = 0; c < channels; ++c) out[c] = 0;
+    if (channels == 1) {
+        for (size_t x = 0; x < width; ++x) {
+            run[0] += pixels[x];
+            out[x + 1] = above[x + 1] + run[0];
+        }
+        return;
+    }
+    for (size_t x = 0; x < width; ++x) {
+        for (int c = 0; c < 3; ++c) {
+            run[c] += pixels[3 * x + c];
+            out[3 * x + 3 + c] = above[3 * x + 3 + c] + run[c];
+        }
+    }
+}
+
+static void integral_rowSquares(const unsigned char *pixels, size_t width, int channels, const uint64_t *above,
+                                uint64_t *out) {
+    uint64_t run[3] = { 0, 0, 0 };
+    for (int c = 0; c < channels; ++c) out[c] = 0;
+    if (channels == 1) {
+        for (size_t x = 0; x < width; ++x) {
+            run[0] += (uint32_t)pixels[x] * pixels[x];
+            out[x + 1] = above[x + 1] + run[0];
+        }
+        return;
+    }
+    for (size_t x = 0; x < width; ++x) {
+        for (int c = 0; c < 3; ++c) {
+            run[c] += (uint32_t)pixels[3 * x + c] * pixels[3 * x + c];
+            out[3 * x + 3 + c] = above[3 * x + 3 + c] + run[c];
+        }
+    }
+}
+
+// Adds the carry row to count entries of row (the second pass).
+static void integral_carry32(const uint32_t *carry, uint32_t *row, size_t count) {
+    for (size_t i = 0; i < count; ++i) row[i] += carry[i];
+}
+
+static void integral_carry64(const uint64_t *carry, uint64_t *row, size_t count) {
+    for (size_t i = 0; i < count; ++i) row[i] += carry[i];
+}
+
+// Range of image rows of band: [*first, *last).
+static void integral_band(const t_integral_job *job, size_t band, size_t *first, size_t *last) {
+    *first = band * job->bandRows;
+    *last = *first + job->bandRows < job->table->height ? *first + job->bandRows : job->table->height;
+}
+
+static void integral_scanBands(size_t begin, size_t end, void *userData) {
+    const t_integral_job *job = (const t_integral_job *)userData;
+    t_integral *table = job->table;
+    size_t stride = integral_stride(table);
+    for (size_t band = begin; band < end; ++band) {
+        size_t first, last;
+        integral_band(job, band, &first, &last);
+        for (size_t y = first; y < last; ++y) {
+            // The first row of a band starts from table row 0, which is all zeros.
+            size_t above = y == first ? 0 : y * stride, out = (y + 1) * stride;
+            if (table->wide) {
+                uint64_t *sums = (uint64_t *)table->sums;
+                integral_rowSums64(job->rows[y], table->width, table->channels, sums + above, sums + out);
+            } else {
+                uint32_t *sums = (uint32_t *)table->sums;
+                integral_rowSums32(job->rows[y], table->width, table->channels, sums + above, sums + out);
+            }
+            if (table->squares) {
+                integral_rowSquares(job->rows[y], table->width, table->channels, table->squares + above,
+                                    table->squares + out);
+            }
+        }
+    }
+}
+
+// Adds table row first (the final last row of the band above) to the rows of band except its last one.
+static void integral_carryBands(size_t begin, size_t end, void *userData) {
+    const t_integral_job *job = (const t_integral_job *)userData;
+    t_integral *table = job->table;
+    size_t stride = integral_stride(table);
+    for (size_t band = begin; band < end; ++band) {
+        size_t first, last;
+        integral_band(job, band, &first, &last);
+        if (band == 0) continue;
+        for (size_t y = first + 1; y < last; ++y) {
+            if (table->wide) {
+                uint64_t *sums = (uint64_t *)table->sums;
+                integral_carry64(sums + first * stride, sums + y * stride, stride);
+            } else {
+                uint32_t *sums = (uint32_t *)table->sums;
+                integral_carry32(sums + first * stride, sums + y * stride, stride);
+            }
+            if (table->squares) integral_carry64(table->squares + first * stride, table->squares + y * stride, stride);
+        }
+    }
+}
+
+static void integral_scan(t_integral_job *job) {
+    t_integral *table = job->table;
+    size_t stride = integral_stride(table);
+    size_t bands = (size_t)pool_threadCount();
+    if (bands > table->height) bands = table->height;
+    job->bandRows = (table->height + bands - 1) / bands;
+    bands = (table->height + job->bandRows - 1) / job->bandRows;
+    pool_parallelFor(bands, 1, integral_scanBands, job);
+    if (bands == 1) return;
+    // Carry the last rows down: each becomes final once the band above is.
+    for (size_t band = 1; band < bands; ++band) {
+        size_t first, last;
+        integral_band(job, band, &first, &last);
+        if (table->wide) {
+            uint64_t *sums = (uint64_t *)table->sums;
+            integral_carry64(sums + first * stride, sums + last * stride, stride);
+        } else {
+            uint32_t *sums = (uint32_t *)table->sums;
+            integral_carry32(sums + first * stride, sums + last * stride, stride);
+        }
+        if (table->squares) integral_carry64(table->squares + first * stride, table->squares + last * stride, stride);
+    }
+    pool_parallelFor(bands, 1, integral_carryBands, job);
+}
+
+// Allocates a table for a width x height image of channels channels, with row 0 cleared.
+static t_integral *integral_allocate(unsigned int width, unsigned int height, int channels, int squares) {
+    size_t stride = ((size_t)width + 1) * (size_t)channels, rows = (size_t)height + 1;
+    if (stride > SIZE_MAX / sizeof(uint64_t) / rows) {
+        instr_error("Error: Image too large for a summed-area table (%ux%u).\n", width, height);
+        return NULL;
+    }
+    t_integral *table = (t_integral *)calloc(1, sizeof(t_integral));
+    if (!table) {
+        instr_error("Error: Failed to allocate memory for the summed-area table.\n");
+        return NULL;
+    }
+    table->width = width;
+    table->height = height;
+    table->channels = channels;
+    table->wide = (uint64_t)width * height * 255 > UINT32_MAX;
+    size_t entryBytes = table->wide ? sizeof(uint64_t) : sizeof(uint32_t);
+    table->sums = malloc(stride * rows * entryBytes);
+    if (squares) table->squares = (uint64_t *)malloc(stride * rows * sizeof(uint64_t));
+    if (!table->sums || (squares && !table->squares)) {
+        instr_error("Error: Failed to allocate memory for the summed-area table.\n");
+        integral_free(table);
+        return NULL;
+    }
+    memset(table->sums, 0, stride * entryBytes);
+    if (squares) memset(table->squares, 0, stride * sizeof(uint64_t));
+    return table;
+}
+
+static uint64_t integral_bytes(const t_integral *table) {
+    uint64_t entries = ((uint64_t)table->width + 1) * ((uint64_t)table->height + 1) * (uint64_t)table->channels;
+    uint64_t pixels = (uint64_t)table->width * table->height * (uint64_t)table->channels;
+    return pixels + entries * (table->wide ? 8 : 4) + (table->squares ? entries * 8 : 0);
+}
+
+t_integral *bmp8_integral(const t_bmp8 *img, int squares) {
+    if (!img || !img->data || img->width == 0 || img->height == 0) {
+        instr_error("Error: Invalid image for the summed-area table (8-bit).\n");
+        return NULL;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_integral");
+    t_integral *table = integral_allocate(img->width, img->height, 1, squares);
+    const unsigned char **rows = (const unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    if (!table || !rows) {
+        if (table) instr_error("Error: Failed to allocate summed-area rows (8-bit).\n");
+        integral_free(table);
+        free(rows);
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    for (unsigned int y = 0; y < img->height; ++y) rows[y] = img->data + (size_t)(img->height - 1 - y) * img->width;
+    t_integral_job job = { table, rows, 0 };
+    integral_scan(&job);
+    free(rows);
+    instr_info("Summed-area table built for %ux%u (8-bit).\n", img->width, img->height);
+    instr_end(&span, (uint64_t)img->width * img->height, integral_bytes(table));
+    return table;
+}
+
+t_integral *bmp24_integral(const t_bmp24 *img, int squares) {
+    if (!img || !img->data || img->width <= 0 || img->height <= 0) {
+        instr_error("Error: Invalid image for the summed-area table (24-bit).\n");
+        return NULL;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp24_integral");
+    t_integral *table = integral_allocate((unsigned int)img->width, (unsigned int)img->height, 3, squares);
+    if (!table) {
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    t_integral_job job = { table, (const unsigned char *const *)img->data, 0 };
+    integral_scan(&job);
+    instr_info("Summed-area table built for %dx%d (24-bit).\n", img->width, img->height);
+    instr_end(&span, (uint64_t)img->width * img->height, integral_bytes(table));
+    return table;
+}
+
+void integral_free(t_integral *table) {
+    if (!table) return;
+    free(table->sums);
+    free(table->squares);
+    free(table);
+}
+
+int integral_region(const t_integral *table, unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+                    int channel, t_integral_stats *stats) {
+    if (!table || !stats || channel < 0 || channel >= table->channels || width == 0 || height == 0 ||
+        x >= table->width || y >= table->height || width > table->width - x || height > table->height - y) {
+        instr_error("Error: Invalid region for the summed-area table.\n");
+        return -1;
+    }
+    stats->count = (uint64_t)width * height;
+    stats->sum = integral_sum(table, x, y, x + width, y + height, channel);
+    stats->sumSquares = table->squares ? integral_sumSquares(table, x, y, x + width, y + height, channel) : 0;
+    stats->mean = (double)stats->sum / (double)stats->count;
+    stats->variance = 0.0;
+    if (table->squares) {
+        // (count * sumSquares - sum^2) / count^2, in long double to limit the cancellation of the two large terms.
+        long double count = (long double)stats->count;
+        long double spread = count * (long double)stats->sumSquares - (long double)stats->sum * (long double)stats->sum;
+        stats->variance = spread > 0.0L ? (double)(spread / (count * count)) : 0.0;
+    }
+    return 0;
+}
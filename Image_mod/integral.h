@@ -0,0 +1,68 @@
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+#include <stdint.h>
+
+// Defines the summed-area tables of an image. Entry (x, y) of a table, at [(y * (width + 1) + x) * channels + c], is
+// the sum of channel c over the display rows above y and the columns left of x, so row 0 and column 0 are zero and
+// the sum of any rectangle takes four reads.
+typedef struct {
+    unsigned int width;            // of the image
+    unsigned int height;
+    int channels;                  // 1 for 8-bit images, 3 (blue, green, red) for 24-bit ones
+    int wide;                      // 1 when the sums need 64 bits (width * height * 255 > UINT32_MAX)
+    void *sums;                    // uint32_t or uint64_t entries, by wide
+    uint64_t *squares;             // sums of squared values, or NULL when not requested
+} t_integral;
+
+// Defines the statistics of one channel over a rectangle.
+typedef struct {
+    uint64_t count;                // pixels in the rectangle
+    uint64_t sum;
+    uint64_t sumSquares;           // 0 when the table has no squares
+    double mean;
+    double variance;               // population variance; 0 when the table has no squares
+} t_integral_stats;
+
+// Function bmp8_integral is needed to build the summed-area table of img, and of its squared values if squares is
+// non-zero. Rows are scanned in parallel bands whose partial sums are then carried down in a second pass.
+// Returns a new table (free with integral_free), or NULL on invalid arguments or when memory runs out.
+t_integral *bmp8_integral(const t_bmp8 *img, int squares);
+
+// Function bmp24_integral is needed to build the tables of the three channels of img, interleaved like its pixels.
+t_integral *bmp24_integral(const t_bmp24 *img, int squares);
+
+void integral_free(t_integral *table);
+
+// Function integral_region is needed to read the statistics of channel over the width x height rectangle at (x, y)
+// (display coordinates) in O(1). Returns -1 if the rectangle is empty or leaves the image, or channel is invalid.
+int integral_region(const t_integral *table, unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+                    int channel, t_integral_stats *stats);
+
+// Function integral_sum returns the sum of channel over the columns [x0, x1) of the rows [y0, y1), without checks
+// (for per-pixel loops such as local thresholds).
+static inline uint64_t integral_sum(const t_integral *table, unsigned int x0, unsigned int y0, unsigned int x1,
+                                    unsigned int y1, int channel) {
+    size_t stride = ((size_t)table->width + 1) * (size_t)table->channels;
+    size_t a = y0 * stride + (size_t)x0 * table->channels + channel, b = a + (size_t)(x1 - x0) * table->channels;
+    size_t c = a + (y1 - y0) * stride, d = c + (size_t)(x1 - x0) * table->channels;
+    if (table->wide) {
+        const uint64_t *sums = (const uint64_t *)table->sums;
+        return sums[d] - sums[b] - sums[c] + sums[a];
+    }
+    const uint32_t *sums = (const uint32_t *)table->sums;
+    return (uint32_t)(sums[d] - sums[b] - sums[c] + sums[a]);
+}
+
+// Function integral_sumSquares is integral_sum over the squared values (the table must have them).
+static inline uint64_t integral_sumSquares(const t_integral *table, unsigned int x0, unsigned int y0, unsigned int x1,
+                                           unsigned int y1, int channel) {
+    size_t stride = ((size_t)table->width + 1) * (size_t)table->channels;
+    size_t a = y0 * stride + (size_t)x0 * table->channels + channel, b = a + (size_t)(x1 - x0) * table->channels;
+    size_t c = a + (y1 - y0) * stride, d = c + (size_t)(x1 - x0) * table->channels;
+    return table->squares[d] - table->squares[b] - table->squares[c] + table->squares[a];
+}
+
+#endif // INTEGRAL_H
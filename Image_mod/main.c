@@ -1,10 +1,9 @@
 // main.c
+// Interactive menu over the public libimagemod interface (imagemod.h).
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "bmp8.h"
-#include "bmp24.h"
-#include "utils.h"
+#include "imagemod.h"
 
 void clear_input_buffer() {
     int c;
@@ -21,18 +20,185 @@ void get_filename(char *buffer, int size) {
     }
 }
 
+// Batch operations offered by menu option 8, in menu order; the same operations work for both depths.
+static const t_im_operation g_batchOps[] = { IM_OP_NEGATIVE, IM_OP_GAUSSIAN_BLUR, IM_OP_SHARPEN, IM_OP_EQUALIZE };
+
+// Processes every .bmp of a directory into another directory through the load/compute/save pipeline.
+static void run_batch(void) {
+    char input_dir[256], output_dir[256];
+    int depth = 0, op = 0;
+
+    printf("Color depth of the batch (8 or 24): ");
+    if (scanf("%d", &depth) != 1 || (depth != 8 && depth != 24)) { clear_input_buffer(); printf("Invalid depth.\n"); return; }
+    clear_input_buffer();
+    printf("\n-- Batch Operations --\n 1. Negative\n 2. Gaussian Blur\n 3. Sharpen\n 4. Histogram Equalization\n Choice: ");
+    if (scanf("%d", &op) != 1 || op < 1 || op > 4) { clear_input_buffer(); printf("Invalid operation.\n"); return; }
+    clear_input_buffer();
+    printf("Input directory. ");
+    get_filename(input_dir, sizeof(input_dir));
+    printf("Output directory. ");
+    get_filename(output_dir, sizeof(output_dir));
+    if (strlen(input_dir) == 0 || strlen(output_dir) == 0) return;
+
+    im_processDirectory(input_dir, output_dir, depth, g_batchOps[op - 1], NULL);
+}
+
+static void print_info(const t_im_image *image) {
+    t_im_info info;
+    if (im_getInfo(image, &info) != IM_OK) {
+        printf("No image loaded.\n");
+        return;
+    }
+    printf("--- %d-bit Image Info ---\n", info.depth);
+    printf("  Width:       %d\n", info.width);
+    printf("  Height:      %d\n", info.height);
+    printf("  Color Depth: %d\n", info.depth);
+    printf("  Data Size:   %zu bytes\n", info.dataSize);
+    printf("  File Size (Header): %u bytes\n", info.fileSize);
+    printf("  Data Offset (Header): %u\n", info.dataOffset);
+}
+
+// Reads an integer answer; returns 0 if the input was not a number.
+static int read_int(int *value) {
+    int ok = scanf("%d", value) == 1;
+    clear_input_buffer();
+    return ok;
+}
+
+// Replaces the current image with a resized copy.
+static void run_resize(t_im_image **image) {
+    int width = 0, height = 0, filter = 0;
+    printf("New width and height: ");
+    if (scanf("%d %d", &width, &height) != 2) { clear_input_buffer(); printf("Invalid size.\n"); return; }
+    clear_input_buffer();
+    printf("\n-- Resampling Filters --\n 1. Bilinear\n 2. Bicubic\n 3. Lanczos\n Choice: ");
+    if (!read_int(&filter) || filter < 1 || filter > 3) { printf("Invalid filter choice.\n"); return; }
+
+    t_im_image *resized = NULL;
+    if (im_resize(*image, width, height, (t_im_resize)(filter - 1), &resized) == IM_OK) {
+        im_free(*image);
+        *image = resized;
+    }
+}
+
+// Replaces the current image with a rotated or transposed copy, or flips it in place.
+static void run_orientation(t_im_image **image) {
+    int choice = 0;
+    printf("\n-- Orientation --\n 1. Rotate 90 clockwise\n 2. Rotate 180\n 3. Rotate 90 counter-clockwise\n"
+           " 4. Transpose\n 5. Flip horizontally\n 6. Flip vertically\n Choice: ");
+    if (!read_int(&choice) || choice < 1 || choice > 6) { printf("Invalid orientation choice.\n"); return; }
+    if (choice >= 5) {
+        im_flip(*image, choice == 5 ? IM_FLIP_HORIZONTAL : IM_FLIP_VERTICAL);
+        return;
+    }
+    t_im_image *turned = NULL;
+    t_im_status status = choice == 4 ? im_transpose(*image, &turned) : im_rotate(*image, choice * 90, &turned);
+    if (status == IM_OK) {
+        im_free(*image);
+        *image = turned;
+    }
+}
+
+// Replaces the current image with a copy turned counter-clockwise by any angle about its centre (deskew).
+static void run_deskew(t_im_image **image) {
+    double degrees = 0.0;
+    t_im_info info;
+    printf("Angle in degrees (counter-clockwise): ");
+    if (scanf("%lf", &degrees) != 1) { clear_input_buffer(); printf("Invalid angle.\n"); return; }
+    clear_input_buffer();
+    if (im_getInfo(*image, &info) != IM_OK) return;
+    double matrix[6];
+    im_rotationMatrix(degrees, (info.width - 1) / 2.0, (info.height - 1) / 2.0, matrix);
+    t_im_image *warped = NULL;
+    if (im_warpAffine(*image, matrix, info.width, info.height, 255, &warped) == IM_OK) {
+        im_free(*image);
+        *image = warped;
+    }
+}
+
+// Binarizes the current 8-bit image at a threshold picked from its histogram, or against local thresholds
+// (uneven lighting of scans).
+static void run_auto_threshold(t_im_image *image) {
+    int method = 0, window = 0;
+    printf("\n-- Automatic Threshold --\n 1. Otsu\n 2. Triangle\n 3. Niblack (local, k = -0.2)\n"
+           " 4. Sauvola (local, k = 0.34)\n Choice: ");
+    if (!read_int(&method) || method < 1 || method > 4) { printf("Invalid threshold choice.\n"); return; }
+    if (method <= 2) {
+        im_autoThreshold(image, method == 1 ? IM_AUTO_OTSU : IM_AUTO_TRIANGLE, NULL, NULL);
+        return;
+    }
+    printf("Window size (odd, 3 to 511): ");
+    if (!read_int(&window)) { printf("Invalid window size.\n"); return; }
+    if (method == 3) im_adaptiveThreshold(image, IM_THRESHOLD_NIBLACK, window, -0.2);
+    else im_adaptiveThreshold(image, IM_THRESHOLD_SAUVOLA, window, 0.34);
+}
+
+// Removes salt-and-pepper noise with a median filter.
+static void run_median(t_im_image *image) {
+    int radius = 0;
+    printf("Radius (1 for 3x3, 2 for 5x5, ... up to 127): ");
+    if (!read_int(&radius)) { printf("Invalid radius.\n"); return; }
+    im_median(image, radius);
+}
+
+// Cleans up binarized images (specks, holes, broken strokes) with a rectangular structuring element.
+static void run_morphology(t_im_image *image) {
+    static const t_im_morph ops[] = { IM_MORPH_ERODE, IM_MORPH_DILATE, IM_MORPH_OPEN, IM_MORPH_CLOSE, IM_MORPH_TOPHAT };
+    int op = 0, width = 0, height = 0;
+    printf("\n-- Morphology --\n 1. Erode\n 2. Dilate\n 3. Open\n 4. Close\n 5. Top-hat\n Choice: ");
+    if (!read_int(&op) || op < 1 || op > 5) { printf("Invalid morphology choice.\n"); return; }
+    printf("Element width and height: ");
+    if (scanf("%d %d", &width, &height) != 2) { clear_input_buffer(); printf("Invalid element size.\n"); return; }
+    clear_input_buffer();
+    im_morphology(image, ops[op - 1], width, height);
+}
+
+// Replaces the image with its Sobel gradient magnitude or its Canny edges.
+static void run_edges(t_im_image *image) {
+    int method = 0, low = 0, high = 0;
+    printf("\n-- Edge Detection --\n 1. Sobel magnitude\n 2. Canny edges\n Choice: ");
+    if (!read_int(&method) || method < 1 || method > 2) { printf("Invalid edge detection choice.\n"); return; }
+    if (method == 1) {
+        im_sobel(image, NULL, 0);
+        return;
+    }
+    printf("Low and high thresholds (0 to 2040, e.g. 100 300): ");
+    if (scanf("%d %d", &low, &high) != 2) { clear_input_buffer(); printf("Invalid thresholds.\n"); return; }
+    clear_input_buffer();
+    im_canny(image, low, high);
+}
+
+// Saves the 2x reductions of the current image as <prefix>_1.bmp, <prefix>_2.bmp, ...
+static void run_pyramid(const t_im_image *image) {
+    char prefix[256];
+    int levels = 0, filter = 0, count = 0;
+    printf("Number of levels: ");
+    if (!read_int(&levels) || levels < 1) { printf("Invalid number of levels.\n"); return; }
+    printf("\n-- Reduction --\n 1. 2x2 box\n 2. 5x5 binomial\n Choice: ");
+    if (!read_int(&filter) || filter < 1 || filter > 2) { printf("Invalid reduction choice.\n"); return; }
+    printf("Prefix of the level files. ");
+    get_filename(prefix, sizeof(prefix));
+    if (strlen(prefix) == 0) return;
+    if (im_savePyramid(image, prefix, levels, (t_im_pyramid)(filter - 1), &count) == IM_OK) {
+        printf("%d level(s) saved.\n", count);
+    }
+}
+
 
 int main() {
-    t_bmp8 *img8 = NULL;
-    t_bmp24 *img24 = NULL;
+    t_im_image *image = NULL;
+    int depth = 0;
     char filename[256];
     int choice = 0;
 
+    // The menu shows the library's progress messages unless IMAGE_MOD_LOG says otherwise.
+    if (!getenv("IMAGE_MOD_LOG")) im_setLogLevel(IM_LOG_ALL);
+
     while (choice != 99) { // Use 99 for Quit
         printf("\n--- Image Processor ---\n");
         printf("Current Image: ");
-        if (img8) printf("8-bit Grayscale Loaded ('%s')\n", filename);
-        else if (img24) printf("24-bit Color Loaded ('%s')\n", filename);
+        if (depth == 8) printf("8-bit Grayscale Loaded ('%s')\n", filename);
+        else if (depth == 24) printf("24-bit Color Loaded ('%s')\n", filename);
         else printf("None Loaded\n");
 
         printf("Please choose an option:\n");
@@ -43,6 +209,16 @@ int main() {
         printf(" 5. Apply Filter (Basic: Neg/Bright/Thresh/Gray)\n");
         printf(" 6. Apply Filter (Convolution: Blur/Outline/Emboss/Sharpen)\n");
         printf(" 7. Apply Histogram Equalization\n");
+        printf(" 8. Batch Process a Directory\n");
+        printf(" 9. Build Header Index of a Directory\n");
+        printf("10. Resize Image\n");
+        printf("11. Save Image Pyramid\n");
+        printf("12. Rotate / Flip Image\n");
+        printf("13. Deskew (Rotate by Angle)\n");
+        printf("14. Automatic / Adaptive Threshold (8-bit)\n");
+        printf("15. Median Filter (Denoise)\n");
+        printf("16. Morphology (Erode/Dilate/Open/Close/Top-hat, 8-bit)\n");
+        printf("17. Edge Detection (Sobel/Canny, 8-bit)\n");
         printf("99. Quit\n");
         printf(">>> Your choice: ");
 
@@ -56,36 +232,24 @@ int main() {
 
         switch (choice) {
             case 1: // Open 8-bit
-                bmp8_free(img8); img8 = NULL;
-                bmp24_free(img24); img24 = NULL;
-                get_filename(filename, sizeof(filename));
-                if (strlen(filename) > 0) {
-                    img8 = bmp8_loadImage(filename);
-                    if (!img8) filename[0] = '\0';
-                }
-                break;
-
             case 2: // Open 24-bit
-                bmp8_free(img8); img8 = NULL;
-                bmp24_free(img24); img24 = NULL;
+                im_free(image); image = NULL;
+                depth = 0;
                 get_filename(filename, sizeof(filename));
-                 if (strlen(filename) > 0) {
-                    img24 = bmp24_loadImage(filename);
-                    if (!img24) filename[0] = '\0';
+                if (strlen(filename) > 0 && im_load(filename, choice == 1 ? 8 : 24, &image) == IM_OK) {
+                    depth = choice == 1 ? 8 : 24;
+                } else {
+                    filename[0] = '\0';
                 }
                 break;
 
             case 3: // Save
                 {
                     char save_filename[256];
-                    if (img8) {
-                        printf("Save 8-bit image as: ");
+                    if (image) {
+                        printf("Save %d-bit image as: ", depth);
                         get_filename(save_filename, sizeof(save_filename));
-                         if (strlen(save_filename) > 0) bmp8_saveImage(save_filename, img8);
-                    } else if (img24) {
-                        printf("Save 24-bit image as: ");
-                        get_filename(save_filename, sizeof(save_filename));
-                        if (strlen(save_filename) > 0) bmp24_saveImage(save_filename, img24);
+                        if (strlen(save_filename) > 0) im_save(image, save_filename);
                     } else {
                         printf("No image loaded to save.\n");
                     }
@@ -93,31 +257,21 @@ int main() {
                 break;
 
             case 4: // Info
-                 if (img8) bmp8_printInfo(img8);
-                 else if (img24) bmp24_printInfo(img24);
-                 else printf("No image loaded.\n");
+                 print_info(image);
                  break;
 
             case 5: // Basic Filters
-                 if (img8) {
-                     int filter_choice = 0;
-                     int value = 0;
-                     printf("\n-- 8-bit Basic Filters --\n 1. Negative\n 2. Brightness\n 3. Threshold\n 0. Cancel\n Choice: ");
-                     if (scanf("%d", &filter_choice) != 1) { filter_choice = -1; } clear_input_buffer();
-
-                     if (filter_choice == 1) bmp8_negative(img8);
-                     else if (filter_choice == 2) { printf("Enter brightness value (-255 to 255): "); if(scanf("%d", &value)==1) { clear_input_buffer(); bmp8_brightness(img8, value); } else {clear_input_buffer();} }
-                     else if (filter_choice == 3) { printf("Enter threshold value (0 to 255): "); if(scanf("%d", &value)==1) { clear_input_buffer(); bmp8_threshold(img8, value); } else {clear_input_buffer();} }
-                     else if (filter_choice != 0) printf("Invalid filter choice.\n");
-                 } else if (img24) {
+                 if (image) {
                      int filter_choice = 0;
                      int value = 0;
-                     printf("\n-- 24-bit Basic Filters --\n 1. Negative\n 2. Brightness\n 3. Grayscale\n 0. Cancel\n Choice: ");
-                      if (scanf("%d", &filter_choice) != 1) { filter_choice = -1; } clear_input_buffer();
+                     if (depth == 8) printf("\n-- 8-bit Basic Filters --\n 1. Negative\n 2. Brightness\n 3. Threshold\n 0. Cancel\n Choice: ");
+                     else printf("\n-- 24-bit Basic Filters --\n 1. Negative\n 2. Brightness\n 3. Grayscale\n 0. Cancel\n Choice: ");
+                     if (!read_int(&filter_choice)) filter_choice = -1;
 
-                     if (filter_choice == 1) bmp24_negative(img24);
-                     else if (filter_choice == 2) { printf("Enter brightness value (-255 to 255): "); if(scanf("%d", &value)==1) { clear_input_buffer(); bmp24_brightness(img24, value); } else {clear_input_buffer();} }
-                     else if (filter_choice == 3) bmp24_grayscale(img24);
+                     if (filter_choice == 1) im_apply(image, IM_OP_NEGATIVE);
+                     else if (filter_choice == 2) { printf("Enter brightness value (-255 to 255): "); if (read_int(&value)) im_brightness(image, value); }
+                     else if (filter_choice == 3 && depth == 8) { printf("Enter threshold value (0 to 255): "); if (read_int(&value)) im_threshold(image, value); }
+                     else if (filter_choice == 3) im_apply(image, IM_OP_GRAYSCALE);
                      else if (filter_choice != 0) printf("Invalid filter choice.\n");
                  } else {
                     printf("No image loaded.\n");
@@ -125,44 +279,81 @@ int main() {
                  break;
 
             case 6: // Convolution Filters
-                 if (img8) {
+                 if (image) {
+                      static const t_im_operation filters[] = { IM_OP_BOX_BLUR, IM_OP_GAUSSIAN_BLUR, IM_OP_OUTLINE, IM_OP_EMBOSS, IM_OP_SHARPEN };
                       int filter_choice = 0;
-                      printf("\n-- 8-bit Convolution Filters --\n 1. Box Blur\n 2. Gaussian Blur\n 3. Outline\n 4. Emboss\n 5. Sharpen\n 0. Cancel\n Choice: ");
-                      if (scanf("%d", &filter_choice) != 1) { filter_choice = -1; } clear_input_buffer();
-
-                      if(filter_choice == 1) bmp8_boxBlur(img8);
-                      else if(filter_choice == 2) bmp8_gaussianBlur(img8);
-                      else if(filter_choice == 3) bmp8_outline(img8);
-                      else if(filter_choice == 4) bmp8_emboss(img8);
-                      else if(filter_choice == 5) bmp8_sharpen(img8);
-                      else if (filter_choice != 0) printf("Invalid filter choice.\n");
+                      printf("\n-- %d-bit Convolution Filters --\n 1. Box Blur\n 2. Gaussian Blur\n 3. Outline\n 4. Emboss\n 5. Sharpen\n 0. Cancel\n Choice: ", depth);
+                      if (!read_int(&filter_choice)) filter_choice = -1;
 
-                 } else if (img24) {
-                      int filter_choice = 0;
-                       printf("\n-- 24-bit Convolution Filters --\n 1. Box Blur\n 2. Gaussian Blur\n 3. Outline\n 4. Emboss\n 5. Sharpen\n 0. Cancel\n Choice: ");
-                       if (scanf("%d", &filter_choice) != 1) { filter_choice = -1; } clear_input_buffer();
-
-                       if(filter_choice == 1) bmp24_boxBlur(img24);
-                       else if(filter_choice == 2) bmp24_gaussianBlur(img24);
-                       else if(filter_choice == 3) bmp24_outline(img24);
-                       else if(filter_choice == 4) bmp24_emboss(img24);
-                       else if(filter_choice == 5) bmp24_sharpen(img24);
-                       else if (filter_choice != 0) printf("Invalid filter choice.\n");
+                      if (filter_choice >= 1 && filter_choice <= 5) im_apply(image, filters[filter_choice - 1]);
+                      else if (filter_choice != 0) printf("Invalid filter choice.\n");
                  } else {
                     printf("No image loaded.\n");
                  }
                  break;
 
              case 7: // Histogram Equalization
-                 if (img8) {
-                     bmp8_equalize(img8);
-                 } else if (img24) {
-                     bmp24_equalize(img24);
+                 if (image) {
+                     im_apply(image, IM_OP_EQUALIZE);
                  } else {
                      printf("No image loaded.\n");
                  }
                  break;
 
+            case 8: // Batch
+                 run_batch();
+                 break;
+
+            case 9: // Header index
+                {
+                    char index_dir[256], index_path[256];
+                    printf("Directory to index. ");
+                    get_filename(index_dir, sizeof(index_dir));
+                    printf("Index file to write. ");
+                    get_filename(index_path, sizeof(index_path));
+                    if (strlen(index_dir) > 0 && strlen(index_path) > 0) im_buildIndex(index_dir, index_path, NULL);
+                }
+                break;
+
+            case 10: // Resize
+                if (image) run_resize(&image);
+                else printf("No image loaded.\n");
+                break;
+
+            case 11: // Pyramid
+                if (image) run_pyramid(image);
+                else printf("No image loaded.\n");
+                break;
+
+            case 12: // Orientation
+                if (image) run_orientation(&image);
+                else printf("No image loaded.\n");
+                break;
+
+            case 13: // Deskew
+                if (image) run_deskew(&image);
+                else printf("No image loaded.\n");
+                break;
+
+            case 14: // Automatic threshold
+                if (image) run_auto_threshold(image);
+                else printf("No image loaded.\n");
+                break;
+
+            case 15: // Median
+                if (image) run_median(image);
+                else printf("No image loaded.\n");
+                break;
+
+            case 16: // Morphology
+                if (image) run_morphology(image);
+                else printf("No image loaded.\n");
+                break;
+
+            case 17: // Edges
+                if (image) run_edges(image);
+                else printf("No image loaded.\n");
+                break;
 
             case 99: // Quit
                 printf("Exiting...\n");
@@ -174,7 +365,6 @@ int main() {
         }
     }
 
-    bmp8_free(img8);
-    bmp24_free(img24);
+    im_free(image);
     return 0;
-}
\ No newline at end of file
+}
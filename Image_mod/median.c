@@ -0,0 +1,300 @@
+// median.c
+// Median filters. Radius 1 runs the median3 dispatch kernel, a network of byte min/max operations: the three pixels
+// of each column are sorted, and the median of the nine is the median of the largest low, the median middle and the
+// smallest high of the three columns.
+// Larger radii follow Perreault and Hebert: every pool task takes a band of rows and keeps a 256-bin histogram of the
+// window rows for every column (and channel), updated with one pixel in and one out when it moves down a row. Along a
+// row the window histogram gains the column entering on the right and loses the one leaving on the left. Histograms
+// have two levels: the 16 coarse bins (high nibble) are kept up to date at every pixel and locate the median's
+// segment, whose 16 fine bins are only brought up to date when the median falls in it, by replaying the columns moved
+// since (or by summing the window columns again when that is cheaper). The cost per pixel is therefore constant.
+// Counts are 16-bit and packed four to a 64-bit word, so a 16-bin update is four integer additions: no count exceeds
+// 255 x 255 and a window never goes below zero, so no carry crosses into the next count.
+#include "median.h"
+#include "cpu_dispatch.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEDIAN_BINS 256
+#define MEDIAN_COARSE 16
+#define MEDIAN_WORDS (MEDIAN_COARSE / 4)     // words holding 16 counts
+#define MEDIAN_BAND_WINDOWS 4
+#define MEDIAN_STALE SIZE_MAX
+#define MEDIAN_STRIP_BYTES (256 * 1024)
+
+// Defines one median filter; rows are in memory order (the window is symmetric), src holds a copy of the image.
+typedef struct {
+    const unsigned char *const *src;
+    unsigned char *const *dst;
+    size_t width;
+    size_t height;
+    int channels;
+    size_t radius;
+    atomic_int failed;
+} t_median_job;
+
+// Defines the window histogram of one channel along a row (packed counts).
+typedef struct {
+    uint64_t coarse[MEDIAN_WORDS];
+    uint64_t fine[MEDIAN_BINS / 4];
+    size_t updated[MEDIAN_COARSE];     // x at which each fine segment was last brought up to date, or MEDIAN_STALE
+} t_median_window;
+
+// Column histograms: per column, the fine words then the coarse ones.
+#define MEDIAN_COLUMN_WORDS ((MEDIAN_BINS + MEDIAN_COARSE) / 4)
+
+static size_t median_clamp(long i, size_t n) {
+    return i < 0 ? 0 : i >= (long)n ? n - 1 : (size_t)i;
+}
+
+// Median of n values (n odd, at most 9), for the pixels of the radius 1 filter next to the left and right borders.
+static unsigned char median_small(unsigned char *values, int n) {
+    for (int i = 1; i < n; ++i) {
+        unsigned char v = values[i];
+        int j = i;
+        for (; j > 0 && values[j - 1] > v; --j) values[j] = values[j - 1];
+        values[j] = v;
+    }
+    return values[n / 2];
+}
+
+static void median_edge3(const t_median_job *job, const unsigned char *const *rows, size_t x, unsigned char *dst) {
+    for (int c = 0; c < job->channels; ++c) {
+        unsigned char values[9];
+        int n = 0;
+        for (int k = 0; k < 3; ++k) {
+            for (long dx = -1; dx <= 1; ++dx) {
+                values[n++] = rows[k][median_clamp((long)x + dx, job->width) * job->channels + c];
+            }
+        }
+        dst[x * job->channels + c] = median_small(values, 9);
+    }
+}
+
+static void median_band3(size_t begin, size_t end, void *userData) {
+    const t_median_job *job = (const t_median_job *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t step = (size_t)job->channels;
+    for (size_t y = begin; y < end; ++y) {
+        const unsigned char *rows[3] = { job->src[median_clamp((long)y - 1, job->height)], job->src[y],
+                                         job->src[median_clamp((long)y + 1, job->height)] };
+        if (job->width >= 3) {
+            const unsigned char *inner[3] = { rows[0] + step, rows[1] + step, rows[2] + step };
+            kernels->median3(inner, step, (job->width - 2) * step, job->dst[y] + step);
+            median_edge3(job, rows, 0, job->dst[y]);
+            median_edge3(job, rows, job->width - 1, job->dst[y]);
+        } else {
+            for (size_t x = 0; x < job->width; ++x) median_edge3(job, rows, x, job->dst[y]);
+        }
+    }
+}
+
+// Adds (add != 0) or removes the pixels of row in the histograms of count columns.
+static void median_columns(const unsigned char *row, size_t count, int add, uint64_t *columns) {
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t *column = columns + i * MEDIAN_COLUMN_WORDS;
+        unsigned int v = row[i];
+        uint64_t fine = (uint64_t)1 << (16 * (v & 3)), coarse = (uint64_t)1 << (16 * ((v >> 4) & 3));
+        if (add) {
+            column[v >> 2] += fine;
+            column[MEDIAN_BINS / 4 + (v >> 6)] += coarse;
+        } else {
+            column[v >> 2] -= fine;
+            column[MEDIAN_BINS / 4 + (v >> 6)] -= coarse;
+        }
+    }
+}
+
+// Returns the first of the 16 bins of words at which *below plus the running count reaches need, and sets *below to
+// the count before that bin. One multiplication forms the running counts of the four bins of a word (none reaches
+// 2^16, so nothing carries between them); the bins under need are then counted rather than searched, as the median
+// moves between bins too irregularly for a searching loop to be predicted.
+static int median_rank(const uint64_t *words, unsigned int need, unsigned int *below) {
+    const uint64_t spread = 0x0001000100010001ULL;
+    unsigned int running[MEDIAN_COARSE + 1];
+    uint64_t word = (uint64_t)*below << 48;
+    running[0] = *below;
+    for (int i = 0; i < MEDIAN_WORDS; ++i) {
+        word = words[i] * spread + (word >> 48) * spread;
+        for (int k = 0; k < 4; ++k) running[4 * i + k + 1] = (unsigned int)(word >> (16 * k)) & 0xFFFFu;
+    }
+    int bin = 0;
+    for (int k = 1; k <= MEDIAN_COARSE; ++k) bin += running[k] < need;
+    *below = running[bin];
+    return bin;
+}
+
+// Moves 16 bins of the window from column leave to column enter (adding first, so no count goes below zero).
+static void median_slide(uint64_t *bins, const uint64_t *enter, const uint64_t *leave) {
+    for (int i = 0; i < MEDIAN_WORDS; ++i) bins[i] = bins[i] + enter[i] - leave[i];
+}
+
+// Filters channel c of the pixels [x0, x1) of one row from the column histograms of its window rows, which cover the
+// image columns from first on.
+static void median_row(const t_median_job *job, const uint64_t *columns, size_t first, int c, size_t x0, size_t x1,
+                       t_median_window *window, unsigned char *dst) {
+    size_t width = job->width, radius = job->radius, channels = (size_t)job->channels;
+    long r = (long)radius;
+    size_t side = 2 * radius + 1;
+    unsigned int need = (unsigned int)((side * side + 1) / 2);   // rank of the median, from 1
+    // Words of channel c of image column x: columns + ((x - first) * channels + c) * MEDIAN_COLUMN_WORDS.
+#define MEDIAN_COLUMN(x) (columns + (((x) - first) * channels + (size_t)c) * MEDIAN_COLUMN_WORDS)
+    memset(window->coarse, 0, sizeof(window->coarse));
+    for (long dx = -r; dx <= r; ++dx) {
+        const uint64_t *coarse = MEDIAN_COLUMN(median_clamp((long)x0 + dx, width)) + MEDIAN_BINS / 4;
+        for (int i = 0; i < MEDIAN_WORDS; ++i) window->coarse[i] += coarse[i];
+    }
+    for (int s = 0; s < MEDIAN_COARSE; ++s) window->updated[s] = MEDIAN_STALE;
+    for (size_t x = x0; x < x1; ++x) {
+        if (x > x0) {
+            const uint64_t *enter = MEDIAN_COLUMN(median_clamp((long)x + r, width));
+            const uint64_t *leave = MEDIAN_COLUMN(median_clamp((long)x - r - 1, width));
+            median_slide(window->coarse, enter + MEDIAN_BINS / 4, leave + MEDIAN_BINS / 4);
+        }
+        unsigned int below = 0;
+        int s = median_rank(window->coarse, need, &below);
+        uint64_t *segment = window->fine + s * MEDIAN_WORDS;
+        if (window->updated[s] == MEDIAN_STALE || 2 * (x - window->updated[s]) > side) {
+            memset(segment, 0, MEDIAN_WORDS * sizeof(uint64_t));
+            for (long dx = -r; dx <= r; ++dx) {
+                const uint64_t *fine = MEDIAN_COLUMN(median_clamp((long)x + dx, width)) + s * MEDIAN_WORDS;
+                for (int i = 0; i < MEDIAN_WORDS; ++i) segment[i] += fine[i];
+            }
+        } else {
+            for (size_t p = window->updated[s] + 1; p <= x; ++p) {
+                const uint64_t *enter = MEDIAN_COLUMN(median_clamp((long)p + r, width));
+                const uint64_t *leave = MEDIAN_COLUMN(median_clamp((long)p - r - 1, width));
+                median_slide(segment, enter + s * MEDIAN_WORDS, leave + s * MEDIAN_WORDS);
+            }
+        }
+#undef MEDIAN_COLUMN
+        window->updated[s] = x;
+        int v = median_rank(segment, need, &below);
+        dst[x * channels + c] = (unsigned char)(s * MEDIAN_COARSE + v);
+    }
+}
+
+// Filters the rows [begin, end) strip by strip: the column histograms of a strip and its radius on both sides stay
+// within MEDIAN_STRIP_BYTES, so the scattered updates of a new row hit the cache.
+static void median_band(size_t begin, size_t end, void *userData) {
+    t_median_job *job = (t_median_job *)userData;
+    size_t width = job->width, channels = (size_t)job->channels, radius = job->radius;
+    long r = (long)radius;
+    size_t columnBytes = channels * MEDIAN_COLUMN_WORDS * sizeof(uint64_t), fit = MEDIAN_STRIP_BYTES / columnBytes;
+    size_t strip = fit > 4 * radius ? fit - 2 * radius : 2 * radius;
+    if (strip > width) strip = width;
+    size_t span = strip + 2 * radius < width ? strip + 2 * radius : width;
+    uint64_t *columns = (uint64_t *)malloc(span * channels * MEDIAN_COLUMN_WORDS * sizeof(uint64_t));
+    t_median_window *window = (t_median_window *)malloc(sizeof(t_median_window));
+    if (!columns || !window) {
+        atomic_store(&job->failed, 1);
+        free(columns);
+        free(window);
+        return;
+    }
+    for (size_t x0 = 0; x0 < width; x0 += strip) {
+        size_t x1 = x0 + strip < width ? x0 + strip : width;
+        size_t first = x0 > radius ? x0 - radius : 0, last = x1 + radius < width ? x1 + radius : width;
+        size_t count = (last - first) * channels;
+        memset(columns, 0, count * MEDIAN_COLUMN_WORDS * sizeof(uint64_t));
+        for (long dy = -r; dy <= r; ++dy) {
+            const unsigned char *row = job->src[median_clamp((long)begin + dy, job->height)];
+            median_columns(row + first * channels, count, 1, columns);
+        }
+        for (size_t y = begin; y < end; ++y) {
+            if (y > begin) {
+                const unsigned char *leave = job->src[median_clamp((long)y - r - 1, job->height)];
+                const unsigned char *enter = job->src[median_clamp((long)y + r, job->height)];
+                median_columns(leave + first * channels, count, 0, columns);
+                median_columns(enter + first * channels, count, 1, columns);
+            }
+            for (int c = 0; c < job->channels; ++c) median_row(job, columns, first, c, x0, x1, window, job->dst[y]);
+        }
+    }
+    free(columns);
+    free(window);
+}
+
+static int median_run(t_median_job *job) {
+    if (job->radius == 1) {
+        pool_parallelFor(job->height, (size_t)tune_params()->bandRows, median_band3, job);
+        return 0;
+    }
+    size_t bandRows = (size_t)tune_params()->bandRows, minimum = MEDIAN_BAND_WINDOWS * (2 * job->radius + 1);
+    pool_parallelFor(job->height, bandRows > minimum ? bandRows : minimum, median_band, job);
+    return atomic_load(&job->failed) ? -1 : 0;
+}
+
+int bmp8_median(t_bmp8 *img, int radius) {
+    if (!img || !img->data || img->width == 0 || img->height == 0 || radius < 1 || radius > MEDIAN_MAX_RADIUS) {
+        instr_error("Error: Invalid arguments for median filter (radius must be 1 to %d).\n", MEDIAN_MAX_RADIUS);
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_median");
+    size_t dataSize = img->dataSize, height = img->height;
+    unsigned char *copy = (unsigned char *)malloc(dataSize);
+    unsigned char **rows = (unsigned char **)malloc(2 * height * sizeof(unsigned char *));
+    if (!copy || !rows) {
+        instr_error("Error: Failed to allocate memory for median filter (8-bit).\n");
+        free(copy);
+        free(rows);
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_scratchAlloc(dataSize);
+    memcpy(copy, img->data, dataSize);
+    for (size_t y = 0; y < height; ++y) {
+        rows[y] = copy + y * img->width;
+        rows[height + y] = img->data + y * img->width;
+    }
+    t_median_job job = { (const unsigned char *const *)rows, rows + height, img->width, height, 1, (size_t)radius, 0 };
+    int status = median_run(&job);
+    if (status != 0) {
+        memcpy(img->data, copy, dataSize);
+        instr_error("Error: Failed to allocate median histograms (8-bit).\n");
+    }
+    free(copy);
+    free(rows);
+    instr_scratchFree(dataSize);
+    instr_end(&span, status == 0 ? dataSize : 0, status == 0 ? 2 * (uint64_t)dataSize : 0);
+    if (status == 0) instr_info("Median filter applied with a %dx%d window (8-bit).\n", 2 * radius + 1, 2 * radius + 1);
+    return status;
+}
+
+int bmp24_median(t_bmp24 *img, int radius) {
+    if (!img || !img->data || img->width <= 0 || img->height <= 0 || radius < 1 || radius > MEDIAN_MAX_RADIUS) {
+        instr_error("Error: Invalid arguments for median filter (radius must be 1 to %d).\n", MEDIAN_MAX_RADIUS);
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp24_median");
+    size_t rowBytes = (size_t)img->width * sizeof(t_pixel), pixels = (size_t)img->width * (size_t)img->height;
+    t_pixel **copy = bmp24_allocateDataPixels(img->width, img->height);
+    if (!copy) {
+        instr_error("Error: Failed to allocate memory for median filter (24-bit).\n");
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_scratchAlloc(pixels * sizeof(t_pixel));
+    for (int y = 0; y < img->height; ++y) memcpy(copy[y], img->data[y], rowBytes);
+    t_median_job job = { (const unsigned char *const *)copy, (unsigned char *const *)img->data, (size_t)img->width,
+                         (size_t)img->height, 3, (size_t)radius, 0 };
+    int status = median_run(&job);
+    if (status != 0) {
+        for (int y = 0; y < img->height; ++y) memcpy(img->data[y], copy[y], rowBytes);
+        instr_error("Error: Failed to allocate median histograms (24-bit).\n");
+    }
+    bmp24_freeDataPixels(copy, img->height);
+    instr_scratchFree(pixels * sizeof(t_pixel));
+    instr_end(&span, status == 0 ? pixels : 0, status == 0 ? 6 * (uint64_t)pixels : 0);
+    if (status == 0) {
+        instr_info("Median filter applied with a %dx%d window (24-bit).\n", 2 * radius + 1, 2 * radius + 1);
+    }
+    return status;
+}
@@ -0,0 +1,21 @@
+#ifndef MEDIAN_H
+#define MEDIAN_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Largest radius of bmp8_median/bmp24_median: a window then holds 255 x 255 pixels, the most a 16-bit histogram
+// bin can count.
+#define MEDIAN_MAX_RADIUS 127
+
+// Function bmp8_median is needed to replace every pixel with the median of the (2 radius + 1)^2 pixels around it, as
+// salt-and-pepper noise on scans needs; pixels past the borders repeat the edge ones. Radius 1 uses a min/max network,
+// larger radii per-column histograms whose cost per pixel does not grow with the radius.
+// Returns 0, or -1 on invalid arguments (radius 1 to MEDIAN_MAX_RADIUS) or when memory runs out (the image is then
+// unchanged).
+int bmp8_median(t_bmp8 *img, int radius);
+
+// Function bmp24_median is needed to apply the median to each channel of a 24-bit image.
+int bmp24_median(t_bmp24 *img, int radius);
+
+#endif // MEDIAN_H
@@ -0,0 +1,186 @@
+// morph.c
+// Grayscale morphology with rectangular elements, as a vertical then a horizontal pass of the van Herk / Gil-Werman
+// running extremum. A line of n values is padded with the identity (255 for a minimum, 0 for a maximum) so that the
+// window of output x starts at padded index x, and cut into blocks of k (the window length): within each block, g
+// holds the extremum from the start of the block and h the extremum to its end. A window covers the end of one block
+// and the start of the next, so its extremum is op(h[x], g[x + k - 1]): one comparison each for g, h and the result.
+// The vertical pass works on whole rows with the rowExtremum dispatch kernel (vectorized across the columns); each
+// pool task takes a band of output rows and rebuilds the blocks it needs, so bands are at least a few windows tall.
+// The horizontal pass prefix-scans each row and combines g and h with the same kernel.
+#include "morph.h"
+#include "cpu_dispatch.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MORPH_BAND_WINDOWS 4
+
+// Defines one pass: the window of memory position x along the pass is [x - before, x + after].
+typedef struct {
+    const unsigned char *src;
+    unsigned char *dst;
+    size_t width;
+    size_t height;
+    size_t before;
+    size_t after;
+    int maximum;
+    const unsigned char *identity;     // a row of the identity value
+    atomic_int failed;
+} t_morph_pass;
+
+// Row j of the padded column of pass: source row start - before + j, or the identity row outside the image.
+static const unsigned char *morph_paddedRow(const t_morph_pass *pass, size_t start, size_t j) {
+    size_t y = start + j;
+    if (y < pass->before || y - pass->before >= pass->height) return pass->identity;
+    return pass->src + (y - pass->before) * pass->width;
+}
+
+// Produces the output rows [begin, end) block by block: output i of a block is h[i] op g'[i - 1], where h belongs to
+// the block and g' to the next one (only its first k - 1 rows are needed, and none past the last output).
+static void morph_verticalBand(size_t begin, size_t end, void *userData) {
+    t_morph_pass *pass = (t_morph_pass *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t width = pass->width, k = pass->before + pass->after + 1;
+    unsigned char *h = (unsigned char *)malloc((2 * k - 1) * width);
+    if (!h) {
+        atomic_store(&pass->failed, 1);
+        return;
+    }
+    unsigned char *g = h + k * width;
+    for (size_t x = 0; begin + x < end; x += k) {
+        size_t outputs = end - begin - x < k ? end - begin - x : k;
+        memcpy(h + (k - 1) * width, morph_paddedRow(pass, begin, x + k - 1), width);
+        for (size_t j = k - 1; j-- > 0;) {
+            kernels->rowExtremum(h + (j + 1) * width, morph_paddedRow(pass, begin, x + j), width, pass->maximum,
+                                 h + j * width);
+        }
+        if (outputs > 1) memcpy(g, morph_paddedRow(pass, begin, x + k), width);
+        for (size_t j = 1; j + 1 < outputs; ++j) {
+            kernels->rowExtremum(g + (j - 1) * width, morph_paddedRow(pass, begin, x + k + j), width, pass->maximum,
+                                 g + j * width);
+        }
+        unsigned char *out = pass->dst + (begin + x) * width;
+        memcpy(out, h, width);
+        for (size_t i = 1; i < outputs; ++i) {
+            kernels->rowExtremum(h + i * width, g + (i - 1) * width, width, pass->maximum, out + i * width);
+        }
+    }
+    free(h);
+}
+
+static unsigned char morph_pick(unsigned char a, unsigned char b, int maximum) {
+    return maximum ? (a > b ? a : b) : (a < b ? a : b);
+}
+
+static void morph_horizontalRows(size_t begin, size_t end, void *userData) {
+    t_morph_pass *pass = (t_morph_pass *)userData;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t width = pass->width, k = pass->before + pass->after + 1, length = width + k - 1;
+    unsigned char *line = (unsigned char *)malloc(3 * length);
+    if (!line) {
+        atomic_store(&pass->failed, 1);
+        return;
+    }
+    unsigned char *g = line + length, *h = g + length;
+    unsigned char fill = pass->identity[0];
+    for (size_t y = begin; y < end; ++y) {
+        memset(line, fill, pass->before);
+        memcpy(line + pass->before, pass->src + y * width, width);
+        memset(line + pass->before + width, fill, pass->after);
+        for (size_t start = 0; start < length; start += k) {
+            size_t stop = start + k < length ? start + k : length;
+            g[start] = line[start];
+            for (size_t j = start + 1; j < stop; ++j) g[j] = morph_pick(g[j - 1], line[j], pass->maximum);
+            h[stop - 1] = line[stop - 1];
+            for (size_t j = stop - 1; j-- > start;) h[j] = morph_pick(h[j + 1], line[j], pass->maximum);
+        }
+        kernels->rowExtremum(h, g + k - 1, width, pass->maximum, pass->dst + y * width);
+    }
+    free(line);
+}
+
+// Applies the erosion (maximum = 0) or dilation of a width x height element from src to dst through tmp (all
+// unpadded bottom-up images of columns x rows). Even sizes reflect for the dilation, so that it is the adjoint of the
+// erosion. Returns -1 if a pass ran out of memory.
+static int morph_filter(const unsigned char *src, unsigned char *dst, unsigned char *tmp, size_t columns, size_t rows,
+                        size_t width, size_t height, int maximum, const unsigned char *identity) {
+    // Display rows above are higher in memory: the element's extra row above is after the pixel in memory.
+    size_t up = height / 2, down = (height - 1) / 2, left = width / 2, right = (width - 1) / 2;
+    t_morph_pass pass = { src, tmp, columns, rows, maximum ? up : down, maximum ? down : up, maximum, identity, 0 };
+    // Windows reaching further than the image only add identity values.
+    if (pass.before >= rows) pass.before = rows - 1;
+    if (pass.after >= rows) pass.after = rows - 1;
+    size_t bandRows = (size_t)tune_params()->bandRows, minimum = MORPH_BAND_WINDOWS * (pass.before + pass.after + 1);
+    pool_parallelFor(rows, bandRows > minimum ? bandRows : minimum, morph_verticalBand, &pass);
+    if (atomic_load(&pass.failed)) return -1;
+    pass.src = tmp;
+    pass.dst = dst;
+    pass.width = columns;
+    pass.before = maximum ? right : left;
+    pass.after = maximum ? left : right;
+    if (pass.before >= columns) pass.before = columns - 1;
+    if (pass.after >= columns) pass.after = columns - 1;
+    pool_parallelFor(rows, (size_t)tune_params()->bandRows, morph_horizontalRows, &pass);
+    return atomic_load(&pass.failed) ? -1 : 0;
+}
+
+static const char *const g_morphNames[MORPH_OP_COUNT] = { "erosion", "dilation", "opening", "closing", "top-hat" };
+
+int bmp8_morphology(t_bmp8 *img, t_morph_op op, int width, int height) {
+    if (!img || !img->data || img->width == 0 || img->height == 0 || op < 0 || op >= MORPH_OP_COUNT || width < 1 ||
+        height < 1) {
+        instr_error("Error: Invalid arguments for morphology (8-bit).\n");
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_morphology");
+    size_t dataSize = img->dataSize, columns = img->width, rows = img->height;
+    size_t scratch = 2 * dataSize + 2 * columns;
+    unsigned char *copy = (unsigned char *)malloc(scratch);
+    if (!copy) {
+        instr_error("Error: Failed to allocate memory for morphology (8-bit).\n");
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_scratchAlloc(scratch);
+    unsigned char *tmp = copy + dataSize, *white = tmp + dataSize, *black = white + columns;
+    memcpy(copy, img->data, dataSize);
+    memset(white, 255, columns);
+    memset(black, 0, columns);
+    size_t w = (size_t)width, h = (size_t)height;
+    int status;
+    switch (op) {
+        case MORPH_ERODE:
+            status = morph_filter(copy, img->data, tmp, columns, rows, w, h, 0, white);
+            break;
+        case MORPH_DILATE:
+            status = morph_filter(copy, img->data, tmp, columns, rows, w, h, 1, black);
+            break;
+        case MORPH_CLOSE:
+            status = morph_filter(copy, img->data, tmp, columns, rows, w, h, 1, black);
+            if (status == 0) status = morph_filter(img->data, img->data, tmp, columns, rows, w, h, 0, white);
+            break;
+        default:   // opening, and the top-hat from it
+            status = morph_filter(copy, img->data, tmp, columns, rows, w, h, 0, white);
+            if (status == 0) status = morph_filter(img->data, img->data, tmp, columns, rows, w, h, 1, black);
+            if (status == 0 && op == MORPH_TOPHAT) {
+                // The opening is never above the image.
+                for (size_t i = 0; i < dataSize; ++i) img->data[i] = (unsigned char)(copy[i] - img->data[i]);
+            }
+            break;
+    }
+    if (status != 0) {
+        memcpy(img->data, copy, dataSize);
+        instr_error("Error: Failed to allocate morphology rows (8-bit).\n");
+    }
+    free(copy);
+    instr_scratchFree(scratch);
+    int passes = op == MORPH_ERODE || op == MORPH_DILATE ? 2 : 4;
+    instr_end(&span, status == 0 ? dataSize : 0, status == 0 ? (uint64_t)(2 * passes + 1) * dataSize : 0);
+    if (status == 0) instr_info("Applied %dx%d %s (8-bit).\n", width, height, g_morphNames[op]);
+    return status;
+}
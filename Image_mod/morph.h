@@ -0,0 +1,23 @@
+#ifndef MORPH_H
+#define MORPH_H
+
+#include "bmp8.h"
+
+// Defines the operations of bmp8_morphology with a rectangular structuring element.
+typedef enum {
+    MORPH_ERODE = 0,       // minimum over the element: thins white shapes, removes white specks
+    MORPH_DILATE,          // maximum over the element: thickens white shapes, fills black holes
+    MORPH_OPEN,            // erode then dilate: removes white details smaller than the element
+    MORPH_CLOSE,           // dilate then erode: fills black details smaller than the element
+    MORPH_TOPHAT,          // image minus its opening: the small bright details alone
+    MORPH_OP_COUNT
+} t_morph_op;
+
+// Function bmp8_morphology is needed to clean up binarized (or any 8-bit) images with op and a width x height
+// rectangle centred on each pixel (the extra row or column of an even size is above or left of it for erosion and
+// below or right for dilation, so openings and closings are exact). Pixels past the borders are ignored. Both passes
+// take three comparisons per pixel whatever the size (van Herk / Gil-Werman).
+// Returns 0, or -1 on invalid arguments (sizes of at least 1) or when memory runs out (the image is then unchanged).
+int bmp8_morphology(t_bmp8 *img, t_morph_op op, int width, int height);
+
+#endif // MORPH_H
@@ -0,0 +1,276 @@
+// pipeline.c
+#include "pipeline.h"
+#include "batch_loader.h"
+#include "instrument.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// Most images the compute stage processes at once.
+#define PIPELINE_MAX_BATCH 64
+
+// One image travelling through the pipeline. A failed load travels with both pointers NULL
+// so that the writer still sees every job in order.
+typedef struct {
+    int jobIndex;
+    t_bmp8 *img8;
+    t_bmp24 *img24;
+} t_pipeline_item;
+
+// Bounded FIFO between two stages. The producer blocks while it is full, the consumer while it is empty.
+typedef struct {
+    t_pipeline_item *items;
+    int capacity;
+    int head;
+    int count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} t_pipeline_queue;
+
+typedef struct {
+    const t_pipeline_job *jobs;
+    int jobCount;
+    int colorDepth;
+    t_pipeline_queue loaded;
+    t_pipeline_queue processed;
+    int loadGroup;                 // images read by one batch loader call (<= PIPELINE_MAX_BATCH and the loaded queue)
+    int failed;                    // jobs whose image could not be loaded or saved (writer thread only)
+} t_pipeline;
+
+
+static int queue_init(t_pipeline_queue *q, int capacity) {
+    q->items = (t_pipeline_item *)malloc(capacity * sizeof(t_pipeline_item));
+    if (!q->items) return -1;
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    q->closed = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->notEmpty, NULL);
+    pthread_cond_init(&q->notFull, NULL);
+    return 0;
+}
+
+static void queue_destroy(t_pipeline_queue *q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->notEmpty);
+    pthread_cond_destroy(&q->notFull);
+    free(q->items);
+    q->items = NULL;
+}
+
+static void queue_push(t_pipeline_queue *q, t_pipeline_item item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->capacity) {
+        pthread_cond_wait(&q->notFull, &q->lock);
+    }
+    q->items[(q->head + q->count) % q->capacity] = item;
+    q->count++;
+    pthread_cond_signal(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Blocks until n items fit without blocking. With a single producer the room stays free for its next n pushes.
+static void queue_waitRoom(t_pipeline_queue *q, int n) {
+    pthread_mutex_lock(&q->lock);
+    while (q->capacity - q->count < n) {
+        pthread_cond_wait(&q->notFull, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Marks the end of the stream; consumers drain what is left and then stop.
+static void queue_close(t_pipeline_queue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->notEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Returns 0 and fills item, or -1 once the queue is closed and empty.
+static int queue_pop(t_pipeline_queue *q, t_pipeline_item *item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) {
+        pthread_cond_wait(&q->notEmpty, &q->lock);
+    }
+    if (q->count == 0) {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    *item = q->items[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    pthread_cond_signal(&q->notFull);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+// Returns 0 and fills item if one is waiting, -1 otherwise; never blocks.
+static int queue_tryPop(t_pipeline_queue *q, t_pipeline_item *item) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == 0) {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    *item = q->items[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    pthread_cond_signal(&q->notFull);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+
+// Reader stage: loads the jobs in order, a group at a time through the batch loader (io_uring reads where the kernel
+// has them), and hands them one by one to the compute stage. A group is only loaded once it fits in the loaded
+// queue, so the images held by the reader and the queue together never exceed the queue's capacity.
+static void *pipeline_reader(void *arg) {
+    t_pipeline *p = (t_pipeline *)arg;
+    const char *paths[PIPELINE_MAX_BATCH];
+    t_bmp8 *images8[PIPELINE_MAX_BATCH];
+    t_bmp24 *images24[PIPELINE_MAX_BATCH];
+    trace_setThreadName("pipeline reader");
+    for (int start = 0; start < p->jobCount; start += p->loadGroup) {
+        int n = p->jobCount - start < p->loadGroup ? p->jobCount - start : p->loadGroup;
+        for (int i = 0; i < n; ++i) paths[i] = p->jobs[start + i].inputPath;
+        queue_waitRoom(&p->loaded, n);
+        trace_beginIndexed("job", "load", start);
+        if (p->colorDepth == 8) bmp8_loadBatch(paths, n, images8);
+        else bmp24_loadBatch(paths, n, images24);
+        trace_end("job", "load");
+        for (int i = 0; i < n; ++i) {
+            t_pipeline_item item = { start + i, p->colorDepth == 8 ? images8[i] : NULL,
+                                     p->colorDepth == 8 ? NULL : images24[i] };
+            queue_push(&p->loaded, item);
+        }
+    }
+    queue_close(&p->loaded);
+    return NULL;
+}
+
+// Writer stage: saves and releases every processed image. The savers report failures through instr_error only, so a
+// save failed when this thread's error count moved.
+static void *pipeline_writer(void *arg) {
+    t_pipeline *p = (t_pipeline *)arg;
+    t_pipeline_item item;
+    trace_setThreadName("pipeline writer");
+    while (queue_pop(&p->processed, &item) == 0) {
+        const char *outputPath = p->jobs[item.jobIndex].outputPath;
+        unsigned long errorsBefore = instr_errorCount();
+        trace_beginIndexed("job", "save", item.jobIndex);
+        if (item.img8) {
+            bmp8_saveImage(outputPath, item.img8);
+            bmp8_free(item.img8);
+        } else if (item.img24) {
+            bmp24_saveImage(outputPath, item.img24);
+            bmp24_free(item.img24);
+        } else {
+            instr_error("Error: Skipping %s, input could not be loaded.\n", p->jobs[item.jobIndex].inputPath);
+        }
+        if (instr_errorCount() != errorsBefore) p->failed++;
+        trace_end("job", "save");
+    }
+    return NULL;
+}
+
+
+// Defines the images the compute stage processes together, one pool task each.
+typedef struct {
+    t_pipeline_item *items;
+    t_pipeline_op op;
+    void *userData;
+} t_pipeline_batch;
+
+static void pipeline_computeItems(size_t begin, size_t end, void *userData) {
+    const t_pipeline_batch *batch = (const t_pipeline_batch *)userData;
+    for (size_t i = begin; i < end; ++i) {
+        t_pipeline_item *item = &batch->items[i];
+        if (!item->img8 && !item->img24) continue;
+        trace_beginIndexed("job", "process", item->jobIndex);
+        batch->op(item->img8, item->img24, batch->userData);
+        trace_end("job", "process");
+    }
+}
+
+
+int pipeline_run(const t_pipeline_job *jobs, int jobCount, int colorDepth,
+                 t_pipeline_op op, void *userData, int queueDepth) {
+    if (!jobs || jobCount < 0 || (colorDepth != 8 && colorDepth != 24)) {
+        instr_error("Error: Invalid arguments for pipeline_run.\n");
+        return -1;
+    }
+    if (queueDepth <= 0) {
+        const char *env = getenv("IMAGE_MOD_QUEUE_DEPTH");
+        queueDepth = env && atoi(env) > 0 ? atoi(env) : PIPELINE_DEFAULT_QUEUE_DEPTH;
+    }
+    // The loaded queue holds a full batch so that every pool thread can get an image.
+    int loadedDepth = pool_threadCount();
+    if (loadedDepth > PIPELINE_MAX_BATCH) loadedDepth = PIPELINE_MAX_BATCH;
+    if (loadedDepth < queueDepth) loadedDepth = queueDepth;
+
+    t_pipeline p;
+    p.jobs = jobs;
+    p.jobCount = jobCount;
+    p.colorDepth = colorDepth;
+    p.loadGroup = loadedDepth < PIPELINE_MAX_BATCH ? loadedDepth : PIPELINE_MAX_BATCH;
+    p.failed = 0;
+
+    if (queue_init(&p.loaded, loadedDepth) != 0) {
+        instr_error("Error: Failed to allocate pipeline queue.\n");
+        return -1;
+    }
+    if (queue_init(&p.processed, queueDepth) != 0) {
+        instr_error("Error: Failed to allocate pipeline queue.\n");
+        queue_destroy(&p.loaded);
+        return -1;
+    }
+
+    pthread_t reader, writer;
+    if (pthread_create(&reader, NULL, pipeline_reader, &p) != 0) {
+        instr_error("Error: Failed to start pipeline reader thread.\n");
+        queue_destroy(&p.loaded);
+        queue_destroy(&p.processed);
+        return -1;
+    }
+    if (pthread_create(&writer, NULL, pipeline_writer, &p) != 0) {
+        instr_error("Error: Failed to start pipeline writer thread.\n");
+        // Drain the reader so it can finish, then release what it produced.
+        t_pipeline_item item;
+        while (queue_pop(&p.loaded, &item) == 0) {
+            bmp8_free(item.img8);
+            bmp24_free(item.img24);
+        }
+        pthread_join(reader, NULL);
+        queue_destroy(&p.loaded);
+        queue_destroy(&p.processed);
+        return -1;
+    }
+
+    // Compute stage runs on the calling thread. It takes every loaded image that is waiting (up to one per pool
+    // thread) and runs op on them as pool tasks; an op that is itself parallel nests inside those tasks.
+    trace_setThreadName("pipeline compute");
+    t_pipeline_item batch[PIPELINE_MAX_BATCH];
+    int batchLimit = pool_threadCount();
+    if (batchLimit > PIPELINE_MAX_BATCH) batchLimit = PIPELINE_MAX_BATCH;
+    t_pipeline_batch work = { batch, op, userData };
+    while (queue_pop(&p.loaded, &batch[0]) == 0) {
+        int count = 1;
+        while (count < batchLimit && queue_tryPop(&p.loaded, &batch[count]) == 0) count++;
+        if (op) pool_parallelFor((size_t)count, 1, pipeline_computeItems, &work);
+        for (int i = 0; i < count; ++i) queue_push(&p.processed, batch[i]);
+    }
+    queue_close(&p.processed);
+
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    queue_destroy(&p.loaded);
+    queue_destroy(&p.processed);
+
+    instr_info("Batch finished: %d of %d images processed.\n", jobCount - p.failed, jobCount);
+    return p.failed;
+}
@@ -0,0 +1,32 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Default number of images allowed to wait between two pipeline stages.
+#define PIPELINE_DEFAULT_QUEUE_DEPTH 2
+
+// Defines one unit of batch work: the image to load and where to save the result.
+typedef struct {
+    const char *inputPath;
+    const char *outputPath;
+} t_pipeline_job;
+
+// Defines the processing callback run by the compute stage. Exactly one of img8/img24 is non-NULL.
+typedef void (*t_pipeline_op)(t_bmp8 *img8, t_bmp24 *img24, void *userData);
+
+// Function pipeline_run is needed to process a batch of images with overlapped load, compute and save.
+// A reader thread loads the next images while the calling thread runs op on image N+1 and a writer thread saves
+// image N. The reader loads up to a loaded-queue's worth of images (at most 64) per bmp8_loadBatch/bmp24_loadBatch
+// call, and only once they fit in the queue, so a group counts against the queue depth.
+// Images that are loaded while op runs are processed together on the shared pool, so op may run on several
+// images at once and must be safe to call from several threads.
+// colorDepth selects the loader/saver (8 or 24). queueDepth bounds the images queued between stages (<= 0 uses
+// IMAGE_MOD_QUEUE_DEPTH, else the default); the loaded queue is raised to the pool thread count so that every
+// thread can get an image.
+// Returns the number of jobs whose image failed to load or to save, or -1 if the pipeline could not be started.
+int pipeline_run(const t_pipeline_job *jobs, int jobCount, int colorDepth,
+                 t_pipeline_op op, void *userData, int queueDepth);
+
+#endif // PIPELINE_H
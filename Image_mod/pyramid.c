@@ -0,0 +1,217 @@
+// pyramid.c
+// Pyramid of successive 2x reductions built in one pass. The source is read row by row; as soon as a level has the
+// rows an output row needs, that row is reduced (pyramidV sums the rows into 16 bits, pyramidH8/24 sum and round the
+// columns) and handed on to the next level, so every row is reduced again while it is still in cache and no level
+// is read back from memory. The pass follows the rows in order and runs on the calling thread.
+#include "pyramid.h"
+#include "instrument.h"
+#include "cpu_dispatch.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Defines the reduction of one level into the next; rows are given as pointer arrays so that 8-bit and 24-bit
+// images share the code.
+typedef struct {
+    unsigned char *const *in;
+    unsigned char **out;
+    size_t width;              // pixels of in
+    size_t height;
+    size_t outHeight;
+    size_t next;               // next row of out to produce
+} t_pyramid_stage;
+
+typedef struct {
+    t_pyramid_stage stages[PYRAMID_MAX_LEVELS];
+    int count;
+    int channels;
+    int binomial;
+    uint16_t *sums;            // one row of vertical sums, shared by all levels
+} t_pyramid_job;
+
+int pyramid_levelCount(unsigned int width, unsigned int height) {
+    int count = 0;
+    while (width > 1 || height > 1) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        ++count;
+    }
+    return count;
+}
+
+// Called when row of level is complete: produces every row of the next level that no longer waits for input.
+static void pyramid_push(t_pyramid_job *job, int level, size_t row) {
+    const t_cpu_kernels *kernels = cpu_kernels();
+    t_pyramid_stage *stage = &job->stages[level];
+    int taps = job->binomial ? 5 : 2;
+    while (stage->next < stage->outHeight) {
+        size_t y = stage->next;
+        size_t last = 2 * y + (size_t)(job->binomial ? 2 : 1);
+        if (last >= stage->height) last = stage->height - 1;
+        if (row < last) return;
+        const unsigned char *rows[5];
+        for (int k = 0; k < taps; ++k) {
+            long i = (long)(2 * y) + k - (job->binomial ? 2 : 0);
+            i = i < 0 ? 0 : i >= (long)stage->height ? (long)stage->height - 1 : i;
+            rows[k] = stage->in[i];
+        }
+        kernels->pyramidV(rows, job->binomial, stage->width * job->channels, job->sums);
+        if (job->channels == 1) kernels->pyramidH8(job->sums, stage->width, job->binomial, stage->out[y]);
+        else kernels->pyramidH24(job->sums, stage->width, job->binomial, stage->out[y]);
+        ++stage->next;
+        if (level + 1 < job->count) pyramid_push(job, level + 1, y);
+    }
+}
+
+// Builds count levels from src; out[i] holds the row pointers of level i (filled in by the caller).
+static int pyramid_run(unsigned char *const *src, size_t width, size_t height, unsigned char ***out, int count,
+                       int channels, t_pyramid_filter filter) {
+    t_pyramid_job job;
+    job.count = count;
+    job.channels = channels;
+    job.binomial = filter == PYRAMID_BINOMIAL;
+    job.sums = (uint16_t *)malloc(width * channels * sizeof(uint16_t));
+    if (!job.sums) {
+        instr_error("Error: Failed to allocate pyramid row buffer.\n");
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        t_pyramid_stage *stage = &job.stages[i];
+        stage->in = i == 0 ? src : out[i - 1];
+        stage->out = out[i];
+        stage->width = width;
+        stage->height = height;
+        stage->outHeight = (height + 1) / 2;
+        stage->next = 0;
+        width = (width + 1) / 2;
+        height = stage->outHeight;
+    }
+    for (size_t y = 0; y < job.stages[0].height; ++y) pyramid_push(&job, 0, y);
+    free(job.sums);
+    return 0;
+}
+
+// Allocates the row pointer arrays of the count levels below an image of height rows; NULL on failure.
+static unsigned char ***pyramid_allocRows(size_t height, int count) {
+    unsigned char ***rows = (unsigned char ***)calloc((size_t)count, sizeof(unsigned char **));
+    if (!rows) return NULL;
+    for (int i = 0; i < count; ++i) {
+        height = (height + 1) / 2;
+        rows[i] = (unsigned char **)malloc(height * sizeof(unsigned char *));
+        if (!rows[i]) {
+            for (int j = 0; j < i; ++j) free(rows[j]);
+            free(rows);
+            return NULL;
+        }
+    }
+    return rows;
+}
+
+static void pyramid_freeRows(unsigned char ***rows, int count) {
+    if (!rows) return;
+    for (int i = 0; i < count; ++i) free(rows[i]);
+    free(rows);
+}
+
+static int pyramid_checkArgs(int maxLevels, t_pyramid_filter filter, const void *levels) {
+    return maxLevels >= 0 && (int)filter >= 0 && filter < PYRAMID_FILTER_COUNT && (levels || maxLevels == 0);
+}
+
+int bmp8_pyramid(const t_bmp8 *img, int maxLevels, t_pyramid_filter filter, t_bmp8 **levels) {
+    if (!img || !img->data || !pyramid_checkArgs(maxLevels, filter, levels)) {
+        instr_error("Error: Invalid arguments for pyramid (8-bit).\n");
+        return -1;
+    }
+    int count = pyramid_levelCount(img->width, img->height);
+    if (count > maxLevels) count = maxLevels;
+    if (count > PYRAMID_MAX_LEVELS) count = PYRAMID_MAX_LEVELS;
+    if (count == 0) return 0;
+    t_instr_span span;
+    instr_begin(&span, "bmp8_pyramid");
+    unsigned char **src = (unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    unsigned char ***rows = pyramid_allocRows(img->height, count);
+    int result = src && rows ? 0 : -1;
+    if (result != 0) instr_error("Error: Failed to allocate pyramid rows (8-bit).\n");
+    unsigned int width = img->width, height = img->height;
+    uint64_t pixels = 0, bytes = img->dataSize;
+    for (int i = 0; i < count; ++i) levels[i] = NULL;
+    for (int i = 0; i < count && result == 0; ++i) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        levels[i] = bmp8_allocate(width, height);
+        if (!levels[i]) {
+            result = -1;
+            break;
+        }
+        memcpy(levels[i]->colorTable, img->colorTable, sizeof(levels[i]->colorTable));
+        for (unsigned int y = 0; y < height; ++y) rows[i][y] = levels[i]->data + (size_t)y * width;
+        pixels += (uint64_t)width * height;
+        bytes += levels[i]->dataSize;
+    }
+    if (result == 0) {
+        for (unsigned int y = 0; y < img->height; ++y) src[y] = img->data + (size_t)y * img->width;
+        result = pyramid_run(src, img->width, img->height, rows, count, 1, filter);
+    }
+    free(src);
+    pyramid_freeRows(rows, count);
+    if (result != 0) {
+        for (int i = 0; i < count; ++i) {
+            bmp8_free(levels[i]);
+            levels[i] = NULL;
+        }
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_info("Pyramid of %d levels built from %ux%u (8-bit).\n", count, img->width, img->height);
+    instr_end(&span, pixels, bytes);
+    return count;
+}
+
+int bmp24_pyramid(const t_bmp24 *img, int maxLevels, t_pyramid_filter filter, t_bmp24 **levels) {
+    if (!img || !img->data || img->width <= 0 || img->height <= 0 || !pyramid_checkArgs(maxLevels, filter, levels)) {
+        instr_error("Error: Invalid arguments for pyramid (24-bit).\n");
+        return -1;
+    }
+    int count = pyramid_levelCount((unsigned int)img->width, (unsigned int)img->height);
+    if (count > maxLevels) count = maxLevels;
+    if (count > PYRAMID_MAX_LEVELS) count = PYRAMID_MAX_LEVELS;
+    if (count == 0) return 0;
+    t_instr_span span;
+    instr_begin(&span, "bmp24_pyramid");
+    unsigned char **src = (unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    unsigned char ***rows = pyramid_allocRows((size_t)img->height, count);
+    int result = src && rows ? 0 : -1;
+    if (result != 0) instr_error("Error: Failed to allocate pyramid rows (24-bit).\n");
+    int width = img->width, height = img->height;
+    uint64_t pixels = 0, bytes = (uint64_t)img->width * img->height * sizeof(t_pixel);
+    for (int i = 0; i < count; ++i) levels[i] = NULL;
+    for (int i = 0; i < count && result == 0; ++i) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        levels[i] = bmp24_allocate(width, height, 24);
+        if (!levels[i]) {
+            result = -1;
+            break;
+        }
+        for (int y = 0; y < height; ++y) rows[i][y] = (unsigned char *)levels[i]->data[y];
+        pixels += (uint64_t)width * height;
+        bytes += (uint64_t)width * height * sizeof(t_pixel);
+    }
+    if (result == 0) {
+        for (int y = 0; y < img->height; ++y) src[y] = (unsigned char *)img->data[y];
+        result = pyramid_run(src, (size_t)img->width, (size_t)img->height, rows, count, (int)sizeof(t_pixel), filter);
+    }
+    free(src);
+    pyramid_freeRows(rows, count);
+    if (result != 0) {
+        for (int i = 0; i < count; ++i) {
+            bmp24_free(levels[i]);
+            levels[i] = NULL;
+        }
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_info("Pyramid of %d levels built from %dx%d (24-bit).\n", count, img->width, img->height);
+    instr_end(&span, pixels, bytes);
+    return count;
+}
@@ -0,0 +1,28 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Defines the 2x reduction between two levels of a pyramid.
+typedef enum {
+    PYRAMID_BOX = 0,       // mean of each 2x2 block
+    PYRAMID_BINOMIAL,      // 5x5 binomial (1 4 6 4 1) centred on the even pixels, smoother previews
+    PYRAMID_FILTER_COUNT
+} t_pyramid_filter;
+
+#define PYRAMID_MAX_LEVELS 32
+
+// Function pyramid_levelCount returns how many 2x reductions a width x height image has down to 1x1.
+int pyramid_levelCount(unsigned int width, unsigned int height);
+
+// Function bmp8_pyramid is needed to build up to maxLevels successive 2x reductions of img into levels[0..]. Level i
+// is (w + 1) / 2 x (h + 1) / 2 of the level before it (of img for i = 0); odd edges repeat their last row or column.
+// All levels come from one pass over img: each new row of a level is reduced into the next level right away.
+// Returns the number of levels (free each with bmp8_free), or -1 on invalid arguments or when memory runs out.
+int bmp8_pyramid(const t_bmp8 *img, int maxLevels, t_pyramid_filter filter, t_bmp8 **levels);
+
+// Function bmp24_pyramid is needed to build the levels of a 24-bit image (free each with bmp24_free).
+int bmp24_pyramid(const t_bmp24 *img, int maxLevels, t_pyramid_filter filter, t_bmp24 **levels);
+
+#endif // PYRAMID_H
@@ -0,0 +1,301 @@
+// resize.c
+// Separable resampling: a horizontal pass into an intermediate image of the new width, then a vertical pass to the
+// new height. The weights of every output column and row are computed once per call in fixed point
+// (CPU_RESIZE_BITS), and both passes run the dispatched resizeH/resizeV kernels on the shared pool, one task per
+// band of rows.
+#include "resize.h"
+#include "instrument.h"
+#include "cpu_dispatch.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESIZE_PI 3.14159265358979323846
+#define RESIZE_ONE (1 << CPU_RESIZE_BITS)
+#define RESIZE_STACK_TAPS 64       // vertical windows up to this size keep their row pointers on the stack
+#define RESIZE_STRIP_BYTES 4096    // bytes per strip of the vertical pass (see resize_rowsV)
+#define RESIZE_H_COST 4            // cost of a horizontal tap relative to a vertical one (see resize_run)
+
+// Defines the weights of one direction: output pixel i sums taps source pixels from start[i].
+typedef struct {
+    int taps;
+    int32_t *start;
+    int16_t *weights;              // taps per output pixel, summing to RESIZE_ONE
+} t_resize_coeffs;
+
+// Defines one pass; rows are given as pointer arrays so that 8-bit and 24-bit images share the code.
+typedef struct {
+    unsigned char *const *src;
+    unsigned char *const *dst;
+    size_t srcWidth;               // pixels
+    size_t dstWidth;
+    int channels;
+    const t_resize_coeffs *coeffs;
+    atomic_int failed;
+} t_resize_job;
+
+static double resize_radius(t_resize_filter filter) {
+    return filter == RESIZE_BILINEAR ? 1.0 : filter == RESIZE_BICUBIC ? 2.0 : 3.0;
+}
+
+static double resize_sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= RESIZE_PI;
+    return sin(x) / x;
+}
+
+static double resize_kernel(t_resize_filter filter, double x) {
+    const double a = -0.5;
+    if (x < 0.0) x = -x;
+    switch (filter) {
+        case RESIZE_BILINEAR:
+            return x < 1.0 ? 1.0 - x : 0.0;
+        case RESIZE_BICUBIC:
+            if (x < 1.0) return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+            if (x < 2.0) return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+            return 0.0;
+        default:
+            return x < 3.0 ? resize_sinc(x) * resize_sinc(x / 3.0) : 0.0;
+    }
+}
+
+// Safe to call twice: the pointers are cleared, so a failed resize_coeffs can be cleaned up again by its caller.
+static void resize_freeCoeffs(t_resize_coeffs *coeffs) {
+    free(coeffs->start);
+    free(coeffs->weights);
+    coeffs->start = NULL;
+    coeffs->weights = NULL;
+}
+
+// Computes the weights for inSize -> outSize. The window of each output pixel is cut at the image edges and its
+// weights renormalised; the rounding error of the fixed-point weights goes to the largest one, so a flat image stays
+// flat. Windows are moved left where needed so that all taps lie inside the row (the extra taps get weight 0).
+static int resize_coeffs(unsigned int inSize, unsigned int outSize, t_resize_filter filter, t_resize_coeffs *coeffs) {
+    double scale = (double)inSize / outSize;
+    double filterScale = scale > 1.0 ? scale : 1.0;
+    double support = resize_radius(filter) * filterScale;
+    int taps = (int)ceil(support) * 2 + 1;
+    if ((unsigned int)taps > inSize) taps = (int)inSize;
+
+    coeffs->taps = taps;
+    coeffs->start = (int32_t *)malloc((size_t)outSize * sizeof(int32_t));
+    coeffs->weights = (int16_t *)calloc((size_t)outSize * taps, sizeof(int16_t));
+    double *window = (double *)malloc((size_t)taps * sizeof(double));
+    if (!coeffs->start || !coeffs->weights || !window) {
+        instr_error("Error: Failed to allocate resize coefficients.\n");
+        resize_freeCoeffs(coeffs);
+        free(window);
+        return -1;
+    }
+    for (unsigned int i = 0; i < outSize; ++i) {
+        double center = (i + 0.5) * scale;
+        int lo = (int)floor(center - support + 0.5);
+        int hi = (int)floor(center + support + 0.5);
+        if (lo < 0) lo = 0;
+        if (hi > (int)inSize) hi = (int)inSize;
+        if (hi - lo > taps) hi = lo + taps;
+        if (hi <= lo) hi = lo + 1;
+
+        double sum = 0.0;
+        for (int j = lo; j < hi; ++j) {
+            window[j - lo] = resize_kernel(filter, (j + 0.5 - center) / filterScale);
+            sum += window[j - lo];
+        }
+        int first = lo + taps > (int)inSize ? (int)inSize - taps : lo;
+        int16_t *w = coeffs->weights + (size_t)i * taps;
+        int total = 0, peak = lo - first;
+        for (int j = lo; j < hi; ++j) {
+            int value = sum != 0.0 ? (int)lround(window[j - lo] / sum * RESIZE_ONE) : (j == lo ? RESIZE_ONE : 0);
+            w[j - first] = (int16_t)value;
+            total += value;
+            if (value > w[peak]) peak = j - first;
+        }
+        w[peak] = (int16_t)(w[peak] + RESIZE_ONE - total);
+        coeffs->start[i] = first;
+    }
+    free(window);
+    return 0;
+}
+
+static void resize_rowsH(size_t begin, size_t end, void *userData) {
+    t_resize_job *job = (t_resize_job *)userData;
+    const t_resize_coeffs *c = job->coeffs;
+    const t_cpu_kernels *kernels = cpu_kernels();
+    for (size_t y = begin; y < end; ++y) {
+        kernels->resizeH(job->src[y], job->srcWidth, job->channels, c->start, c->weights, c->taps,
+                         job->dstWidth, job->dst[y]);
+    }
+}
+
+// Output rows are computed in vertical strips of RESIZE_STRIP_BYTES: the windows of consecutive output rows overlap
+// (by most of their rows when shrinking), and within a strip the overlapping source rows are still in cache.
+static void resize_rowsV(size_t begin, size_t end, void *userData) {
+    t_resize_job *job = (t_resize_job *)userData;
+    const t_resize_coeffs *c = job->coeffs;
+    const unsigned char *stackRows[RESIZE_STACK_TAPS];
+    const unsigned char **rows = stackRows;
+    if (c->taps > RESIZE_STACK_TAPS) {
+        rows = (const unsigned char **)malloc((size_t)c->taps * sizeof(unsigned char *));
+        if (!rows) {
+            atomic_store(&job->failed, 1);
+            return;
+        }
+    }
+    const t_cpu_kernels *kernels = cpu_kernels();
+    size_t rowBytes = job->dstWidth * job->channels;
+    for (size_t x = 0; x < rowBytes; x += RESIZE_STRIP_BYTES) {
+        size_t n = rowBytes - x < RESIZE_STRIP_BYTES ? rowBytes - x : RESIZE_STRIP_BYTES;
+        for (size_t y = begin; y < end; ++y) {
+            for (int k = 0; k < c->taps; ++k) rows[k] = job->src[c->start[y] + k] + x;
+            kernels->resizeV(rows, c->weights + y * c->taps, c->taps, n, job->dst[y] + x);
+        }
+    }
+    if (rows != stackRows) free(rows);
+}
+
+static void resize_pass(t_resize_job *job, size_t rowCount, void (*body)(size_t, size_t, void *)) {
+    size_t rowBytes = job->dstWidth * job->channels;
+    pool_parallelFor(rowCount, pool_grain(rowBytes, tune_params()->chunkBytes), body, job);
+}
+
+// Resamples srcHeight rows of srcWidth pixels into dstHeight rows of dstWidth pixels. A direction whose size does not
+// change is skipped (its weights would be the identity). When both change, the pass order with the fewer weighted
+// taps runs: the vertical kernel works on whole vectors of bytes, the horizontal one on one output pixel at a time,
+// so a horizontal tap counts RESIZE_H_COST times. Returns 0, or -1 if memory runs out.
+static int resize_run(unsigned char *const *src, size_t srcWidth, size_t srcHeight,
+                      unsigned char *const *dst, size_t dstWidth, size_t dstHeight, int channels, t_resize_filter filter) {
+    int horizontal = srcWidth != dstWidth, vertical = srcHeight != dstHeight;
+    if (!horizontal && !vertical) {
+        for (size_t y = 0; y < dstHeight; ++y) memcpy(dst[y], src[y], dstWidth * channels);
+        return 0;
+    }
+    t_resize_coeffs h = { 0, NULL, NULL }, v = { 0, NULL, NULL };
+    if ((horizontal && resize_coeffs((unsigned int)srcWidth, (unsigned int)dstWidth, filter, &h) != 0) ||
+        (vertical && resize_coeffs((unsigned int)srcHeight, (unsigned int)dstHeight, filter, &v) != 0)) {
+        resize_freeCoeffs(&h);
+        resize_freeCoeffs(&v);
+        return -1;
+    }
+
+    // Intermediate image between the two passes: srcHeight x dstWidth (horizontal first) or dstHeight x srcWidth.
+    int verticalFirst = 0;
+    unsigned char *buffer = NULL;
+    unsigned char **bufferRows = NULL;
+    size_t bufferBytes = 0, bufferHeight = 0, bufferWidth = 0;
+    if (horizontal && vertical) {
+        double hFirst = (double)srcHeight * dstWidth * h.taps * RESIZE_H_COST + (double)dstHeight * dstWidth * v.taps;
+        double vFirst = (double)dstHeight * srcWidth * v.taps + (double)dstHeight * dstWidth * h.taps * RESIZE_H_COST;
+        verticalFirst = vFirst < hFirst;
+        bufferHeight = verticalFirst ? dstHeight : srcHeight;
+        bufferWidth = verticalFirst ? srcWidth : dstWidth;
+        bufferBytes = bufferHeight * bufferWidth * channels;
+        buffer = (unsigned char *)malloc(bufferBytes);
+        bufferRows = (unsigned char **)malloc(bufferHeight * sizeof(unsigned char *));
+        if (!buffer || !bufferRows) {
+            instr_error("Error: Failed to allocate resize buffer (%zu bytes).\n", bufferBytes);
+            free(buffer);
+            free(bufferRows);
+            resize_freeCoeffs(&h);
+            resize_freeCoeffs(&v);
+            return -1;
+        }
+        instr_scratchAlloc(bufferBytes);
+        for (size_t y = 0; y < bufferHeight; ++y) bufferRows[y] = buffer + y * bufferWidth * channels;
+    }
+
+    int result = 0;
+    unsigned char *const *in = src;
+    size_t inWidth = srcWidth;
+    for (int pass = 0; pass < 2; ++pass) {
+        int isVertical = pass == 0 ? verticalFirst || !horizontal : !verticalFirst;
+        if (pass == 1 && !(horizontal && vertical)) break;
+        unsigned char *const *out = pass == 0 && horizontal && vertical ? bufferRows : dst;
+        if (isVertical) {
+            t_resize_job job = { in, out, inWidth, inWidth, channels, &v, 0 };
+            resize_pass(&job, dstHeight, resize_rowsV);
+            if (atomic_load(&job.failed)) {
+                instr_error("Error: Failed to allocate resize rows.\n");
+                result = -1;
+                break;
+            }
+        } else {
+            t_resize_job job = { in, out, inWidth, dstWidth, channels, &h, 0 };
+            resize_pass(&job, pass == 0 ? srcHeight : dstHeight, resize_rowsH);
+            inWidth = dstWidth;
+        }
+        in = out;
+    }
+    if (buffer) instr_scratchFree(bufferBytes);
+    free(buffer);
+    free(bufferRows);
+    resize_freeCoeffs(&h);
+    resize_freeCoeffs(&v);
+    return result;
+}
+
+t_bmp8 *bmp8_resize(const t_bmp8 *img, unsigned int width, unsigned int height, t_resize_filter filter) {
+    if (!img || !img->data || width == 0 || height == 0 || (int)filter < 0 || filter >= RESIZE_FILTER_COUNT) {
+        instr_error("Error: Invalid arguments for resize (8-bit).\n");
+        return NULL;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp8_resize");
+    t_bmp8 *out = bmp8_allocate(width, height);
+    unsigned char **src = (unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    unsigned char **dst = (unsigned char **)malloc((size_t)height * sizeof(unsigned char *));
+    int result = out && src && dst ? 0 : -1;
+    if (result == 0) {
+        memcpy(out->colorTable, img->colorTable, sizeof(out->colorTable));
+        for (unsigned int y = 0; y < img->height; ++y) src[y] = img->data + (size_t)y * img->width;
+        for (unsigned int y = 0; y < height; ++y) dst[y] = out->data + (size_t)y * width;
+        result = resize_run(src, img->width, img->height, dst, width, height, 1, filter);
+    } else if (out) {
+        instr_error("Error: Failed to allocate resize rows (8-bit).\n");
+    }
+    free(src);
+    free(dst);
+    if (result != 0) {
+        bmp8_free(out);
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    instr_info("Image resized from %ux%u to %ux%u (8-bit).\n", img->width, img->height, width, height);
+    instr_end(&span, (uint64_t)width * height, (uint64_t)img->dataSize + out->dataSize);
+    return out;
+}
+
+t_bmp24 *bmp24_resize(const t_bmp24 *img, int width, int height, t_resize_filter filter) {
+    if (!img || !img->data || width <= 0 || height <= 0 || (int)filter < 0 || filter >= RESIZE_FILTER_COUNT) {
+        instr_error("Error: Invalid arguments for resize (24-bit).\n");
+        return NULL;
+    }
+    t_instr_span span;
+    instr_begin(&span, "bmp24_resize");
+    t_bmp24 *out = bmp24_allocate(width, height, 24);
+    unsigned char **src = (unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    unsigned char **dst = (unsigned char **)malloc((size_t)height * sizeof(unsigned char *));
+    int result = out && src && dst ? 0 : -1;
+    if (result == 0) {
+        for (int y = 0; y < img->height; ++y) src[y] = (unsigned char *)img->data[y];
+        for (int y = 0; y < height; ++y) dst[y] = (unsigned char *)out->data[y];
+        result = resize_run(src, (size_t)img->width, (size_t)img->height, dst, (size_t)width, (size_t)height,
+                            (int)sizeof(t_pixel), filter);
+    } else if (out) {
+        instr_error("Error: Failed to allocate resize rows (24-bit).\n");
+    }
+    free(src);
+    free(dst);
+    if (result != 0) {
+        bmp24_free(out);
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    instr_info("Image resized from %dx%d to %dx%d (24-bit).\n", img->width, img->height, width, height);
+    instr_end(&span, (uint64_t)width * height,
+              ((uint64_t)img->width * img->height + (uint64_t)width * height) * sizeof(t_pixel));
+    return out;
+}
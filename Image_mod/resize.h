@@ -0,0 +1,23 @@
+#ifndef RESIZE_H
+#define RESIZE_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Defines the resampling filters, from fastest to sharpest. When shrinking, each filter is widened by the scale
+// factor so that every source pixel contributes (no aliasing on thumbnails).
+typedef enum {
+    RESIZE_BILINEAR = 0,   // triangle, radius 1
+    RESIZE_BICUBIC,        // Keys cubic (a = -0.5), radius 2
+    RESIZE_LANCZOS,        // Lanczos-3, radius 3
+    RESIZE_FILTER_COUNT
+} t_resize_filter;
+
+// Function bmp8_resize is needed to resample an 8-bit image to width x height. The source is not changed.
+// Returns a new image (free with bmp8_free), or NULL for a zero size or when memory runs out.
+t_bmp8 *bmp8_resize(const t_bmp8 *img, unsigned int width, unsigned int height, t_resize_filter filter);
+
+// Function bmp24_resize is needed to resample a 24-bit image to width x height (free with bmp24_free).
+t_bmp24 *bmp24_resize(const t_bmp24 *img, int width, int height, t_resize_filter filter);
+
+#endif // RESIZE_H
@@ -0,0 +1,332 @@
+// simd_avx2.c
+// AVX2 kernels: the SSE2 algorithms on 256-bit vectors (32 bytes, 8 floats or 4 doubles per step).
+#include "simd_kernels.h"
+#include <immintrin.h>
+#include <string.h>
+
+static void avx2_negate(unsigned char *data, size_t n) {
+    const __m256i ones = _mm256_set1_epi8((char)0xFF);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_xor_si256(v, ones));
+    }
+    if (i < n) scalar_negate(data + i, n - i);
+}
+
+static void avx2_addSaturate(unsigned char *data, size_t n, int value) {
+    int magnitude = value < 0 ? (value < -255 ? 255 : -value) : (value > 255 ? 255 : value);
+    const __m256i delta = _mm256_set1_epi8((char)magnitude);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        v = value < 0 ? _mm256_subs_epu8(v, delta) : _mm256_adds_epu8(v, delta);
+        _mm256_storeu_si256((__m256i *)(data + i), v);
+    }
+    if (i < n) scalar_addSaturate(data + i, n - i, value);
+}
+
+static void avx2_threshold(unsigned char *data, size_t n, int threshold) {
+    const __m256i t = _mm256_set1_epi8((char)threshold);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_cmpeq_epi8(_mm256_max_epu8(v, t), v));
+    }
+    if (i < n) scalar_threshold(data + i, n - i, threshold);
+}
+
+static __m256 avx2_load8(const unsigned char *p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p)));
+}
+
+// Round half away from zero for non-negative values (see simd_sse2.c).
+static __m256i avx2_roundPs(__m256 x) {
+    __m256i t = _mm256_cvttps_epi32(x);
+    __m256 frac = _mm256_sub_ps(x, _mm256_cvtepi32_ps(t));
+    return _mm256_sub_epi32(t, _mm256_castps_si256(_mm256_cmp_ps(frac, _mm256_set1_ps(0.5f), _CMP_GE_OQ)));
+}
+
+static __m128i avx2_roundPd(__m256d x) {
+    __m128i t = _mm256_cvttpd_epi32(x);
+    __m256d frac = _mm256_sub_pd(x, _mm256_cvtepi32_pd(t));
+    __m256d up = _mm256_and_pd(_mm256_cmp_pd(frac, _mm256_set1_pd(0.5), _CMP_GE_OQ), _mm256_set1_pd(1.0));
+    return _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_cvtepi32_pd(t), up));
+}
+
+static __m256d avx2_clampPd(__m256d x) {
+    return _mm256_min_pd(_mm256_max_pd(x, _mm256_setzero_pd()), _mm256_set1_pd(255.0));
+}
+
+// Packs 8 int32 values in [0, 255] to 8 bytes.
+static void avx2_store8(unsigned char *dst, __m256i values) {
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+    _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(words, words));
+}
+
+static void avx2_convolve8(const unsigned char *const *rows, const float *weights, int kernelSize,
+                           size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    size_t x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            const unsigned char *row = rows[ky] + x - n;
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                __m256 w = _mm256_set1_ps(weights[ky * kernelSize + kx]);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(avx2_load8(row + kx), w));
+            }
+        }
+        sum = _mm256_min_ps(_mm256_max_ps(sum, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+        avx2_store8(dst + x, avx2_roundPs(sum));
+    }
+    if (x < x1) scalar_convolve8(rows, weights, kernelSize, x, x1, dst);
+}
+
+static void avx2_convolve24(const unsigned char *const *rows, const float *weights, int kernelSize,
+                            size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    size_t x = x0;
+    for (; x + 8 <= x1; x += 8) {
+        __m256d sumLo = _mm256_setzero_pd(), sumHi = _mm256_setzero_pd();
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            const unsigned char *row = rows[ky] + x - (size_t)n * 3;
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                __m256 product = _mm256_mul_ps(avx2_load8(row + (size_t)kx * 3),
+                                               _mm256_set1_ps(weights[ky * kernelSize + kx]));
+                sumLo = _mm256_add_pd(sumLo, _mm256_cvtps_pd(_mm256_castps256_ps128(product)));
+                sumHi = _mm256_add_pd(sumHi, _mm256_cvtps_pd(_mm256_extractf128_ps(product, 1)));
+            }
+        }
+        __m128i lo = avx2_roundPd(avx2_clampPd(sumLo));
+        __m128i hi = avx2_roundPd(avx2_clampPd(sumHi));
+        avx2_store8(dst + x, _mm256_set_m128i(hi, lo));
+    }
+    if (x < x1) scalar_convolve24(rows, weights, kernelSize, x, x1, dst);
+}
+
+// Widens one channel (byte offset 0 = blue, 1 = green, 2 = red) of 4 pixels to doubles.
+static __m256d avx2_channel(const t_pixel *p, int offset) {
+    const unsigned char *b = (const unsigned char *)p;
+    return _mm256_set_pd((double)b[9 + offset], (double)b[6 + offset], (double)b[3 + offset], (double)b[offset]);
+}
+
+static void avx2_rgbToYuv(const t_pixel *src, size_t n, uint8_t *y, double *u, double *v) {
+    size_t x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m256d r = avx2_channel(src + x, 2), g = avx2_channel(src + x, 1), b = avx2_channel(src + x, 0);
+        __m256d yy = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(0.299), r),
+                                                 _mm256_mul_pd(_mm256_set1_pd(0.587), g)),
+                                   _mm256_mul_pd(_mm256_set1_pd(0.114), b));
+        __m256d uu = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(-0.14713), r),
+                                                 _mm256_mul_pd(_mm256_set1_pd(0.28886), g)),
+                                   _mm256_mul_pd(_mm256_set1_pd(0.436), b));
+        __m256d vv = _mm256_sub_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(0.615), r),
+                                                 _mm256_mul_pd(_mm256_set1_pd(0.51499), g)),
+                                   _mm256_mul_pd(_mm256_set1_pd(0.10001), b));
+        __m128i yi = avx2_roundPd(avx2_clampPd(yy));
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(yi, yi), yi);
+        int word = _mm_cvtsi128_si32(packed);
+        memcpy(y + x, &word, 4);
+        _mm256_storeu_pd(u + x, uu);
+        _mm256_storeu_pd(v + x, vv);
+    }
+    if (x < n) scalar_rgbToYuv(src + x, n - x, y + x, u + x, v + x);
+}
+
+static void avx2_yuvToRgb(const uint8_t *y, const unsigned int *yMap, const double *u, const double *v,
+                          size_t n, t_pixel *dst) {
+    size_t x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m256d yy = _mm256_set_pd((double)yMap[y[x + 3]], (double)yMap[y[x + 2]],
+                                   (double)yMap[y[x + 1]], (double)yMap[y[x]]);
+        __m256d uu = _mm256_loadu_pd(u + x), vv = _mm256_loadu_pd(v + x);
+        __m256d r = _mm256_add_pd(yy, _mm256_mul_pd(_mm256_set1_pd(1.13983), vv));
+        __m256d g = _mm256_sub_pd(_mm256_sub_pd(yy, _mm256_mul_pd(_mm256_set1_pd(0.39465), uu)),
+                                  _mm256_mul_pd(_mm256_set1_pd(0.58060), vv));
+        __m256d b = _mm256_add_pd(yy, _mm256_mul_pd(_mm256_set1_pd(2.03211), uu));
+        int ri[4], gi[4], bi[4];
+        _mm_storeu_si128((__m128i *)ri, avx2_roundPd(avx2_clampPd(r)));
+        _mm_storeu_si128((__m128i *)gi, avx2_roundPd(avx2_clampPd(g)));
+        _mm_storeu_si128((__m128i *)bi, avx2_roundPd(avx2_clampPd(b)));
+        for (int lane = 0; lane < 4; ++lane) {
+            dst[x + lane].red = (uint8_t)ri[lane];
+            dst[x + lane].green = (uint8_t)gi[lane];
+            dst[x + lane].blue = (uint8_t)bi[lane];
+        }
+    }
+    if (x < n) scalar_yuvToRgb(y + x, yMap, u + x, v + x, n - x, dst + x);
+}
+
+// As sse2_resizeV on 32 bytes; unpack and pack both work within 128-bit lanes, so the bytes come back in order.
+static void avx2_resizeV(const unsigned char *const *rows, const int16_t *weights, int taps, size_t n, unsigned char *dst) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i half = _mm256_set1_epi32(1 << (CPU_RESIZE_BITS - 1));
+    size_t x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256i acc0 = half, acc1 = half, acc2 = half, acc3 = half;
+        for (int k = 0; k < taps; k += 2) {
+            int w1 = k + 1 < taps ? weights[k + 1] : 0;
+            __m256i w = _mm256_set1_epi32((int)((uint32_t)(uint16_t)w1 << 16 | (uint16_t)weights[k]));
+            __m256i a = _mm256_loadu_si256((const __m256i *)(rows[k] + x));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(rows[k + 1 < taps ? k + 1 : k] + x));
+            __m256i lo = _mm256_unpacklo_epi8(a, b), hi = _mm256_unpackhi_epi8(a, b);
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+        }
+        __m256i s0 = _mm256_packs_epi32(_mm256_srai_epi32(acc0, CPU_RESIZE_BITS), _mm256_srai_epi32(acc1, CPU_RESIZE_BITS));
+        __m256i s1 = _mm256_packs_epi32(_mm256_srai_epi32(acc2, CPU_RESIZE_BITS), _mm256_srai_epi32(acc3, CPU_RESIZE_BITS));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_packus_epi16(s0, s1));
+    }
+    for (; x < n; ++x) {
+        int32_t sum = 0;
+        for (int k = 0; k < taps; ++k) sum += (int32_t)rows[k][x] * weights[k];
+        dst[x] = resize_round(sum);
+    }
+}
+
+static inline __m256i avx2_widen(const unsigned char *p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+// As sse2_pyramidV on 16 bytes, widened with one zero extension instead of unpacking.
+static void avx2_pyramidV(const unsigned char *const *rows, int binomial, size_t n, uint16_t *dst) {
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i sum;
+        if (binomial) {
+            __m256i outer = _mm256_add_epi16(avx2_widen(rows[0] + x), avx2_widen(rows[4] + x));
+            __m256i inner = _mm256_add_epi16(avx2_widen(rows[1] + x), avx2_widen(rows[3] + x));
+            __m256i center = avx2_widen(rows[2] + x);
+            sum = _mm256_add_epi16(outer, _mm256_slli_epi16(inner, 2));
+            sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_slli_epi16(center, 2), _mm256_slli_epi16(center, 1)));
+        } else {
+            sum = _mm256_add_epi16(avx2_widen(rows[0] + x), avx2_widen(rows[1] + x));
+        }
+        _mm256_storeu_si256((__m256i *)(dst + x), sum);
+    }
+    if (x < n) {
+        const unsigned char *rest[5];
+        for (int k = 0; k < (binomial ? 5 : 2); ++k) rest[k] = rows[k] + x;
+        scalar_pyramidV(rest, binomial, n - x, dst + x);
+    }
+}
+
+// As sse2_localThreshold on 4 pixels.
+static void avx2_localThreshold(const unsigned char *src, size_t n, const uint32_t *sums, const uint64_t *squares,
+                                size_t window, const t_cpu_threshold *params, unsigned char *dst) {
+    const __m256d count = _mm256_set1_pd(params->count), scale = _mm256_set1_pd(params->scale);
+    const __m256d meanWeight = _mm256_set1_pd(params->meanWeight), offset = _mm256_set1_pd(params->offset);
+    const __m256d slope = _mm256_set1_pd(params->slope), zero = _mm256_setzero_pd();
+    const __m256d magic = _mm256_set1_pd(THRESHOLD_MAGIC), signBias = _mm256_set1_pd(2147483648.0);
+    const __m256i magicBits = _mm256_set1_epi64x((long long)THRESHOLD_MAGIC_BITS);
+    const __m128i sign = _mm_set1_epi32(INT32_MIN);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i windowSum = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(sums + i + window)),
+                                          _mm_loadu_si128((const __m128i *)(sums + i)));
+        __m256d sum = _mm256_add_pd(_mm256_cvtepi32_pd(_mm_xor_si128(windowSum, sign)), signBias);
+        __m256i windowSquares = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(squares + i + window)),
+                                                 _mm256_loadu_si256((const __m256i *)(squares + i)));
+        __m256d squareSum = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(windowSquares, magicBits)), magic);
+        __m256d spread = _mm256_sub_pd(_mm256_mul_pd(count, squareSum), _mm256_mul_pd(sum, sum));
+        int32_t four;
+        memcpy(&four, src + i, 4);
+        __m256d pixel = _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(four)));
+        __m256d a = _mm256_mul_pd(scale, _mm256_sub_pd(_mm256_mul_pd(pixel, count), _mm256_mul_pd(sum, meanWeight)));
+        __m256d b = _mm256_add_pd(offset, _mm256_mul_pd(slope, sum));
+        __m256d bound = _mm256_mul_pd(_mm256_mul_pd(b, b), spread), square = _mm256_mul_pd(a, a);
+        __m256d white = params->positive
+                      ? _mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_GE_OQ), _mm256_cmp_pd(square, bound, _CMP_GE_OQ))
+                      : _mm256_or_pd(_mm256_cmp_pd(a, zero, _CMP_GE_OQ), _mm256_cmp_pd(square, bound, _CMP_LE_OQ));
+        uint32_t bytes = threshold_maskBytes((unsigned int)_mm256_movemask_pd(white));
+        memcpy(dst + i, &bytes, 4);
+    }
+    if (i < n) scalar_localThreshold(src + i, n - i, sums + i, squares + i, window, params, dst + i);
+}
+
+// As sse2_median3 on 32 bytes.
+static void avx2_median3(const unsigned char *const *rows, size_t step, size_t n, unsigned char *dst) {
+    const unsigned char *left[3] = { rows[0] - step, rows[1] - step, rows[2] - step };
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i low[3], mid[3], high[3];
+        for (int d = 0; d < 3; ++d) {
+            size_t at = i + (size_t)d * step;
+            __m256i a = _mm256_loadu_si256((const __m256i *)(left[0] + at));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(left[1] + at));
+            __m256i c = _mm256_loadu_si256((const __m256i *)(left[2] + at));
+            __m256i t = _mm256_min_epu8(a, b), u = _mm256_max_epu8(a, b);
+            low[d] = _mm256_min_epu8(t, c);
+            t = _mm256_max_epu8(t, c);
+            mid[d] = _mm256_min_epu8(u, t);
+            high[d] = _mm256_max_epu8(u, t);
+        }
+        __m256i lo = _mm256_max_epu8(_mm256_max_epu8(low[0], low[1]), low[2]);
+        __m256i hi = _mm256_min_epu8(_mm256_min_epu8(high[0], high[1]), high[2]);
+        __m256i me = _mm256_min_epu8(_mm256_max_epu8(mid[0], mid[1]), mid[2]);
+        me = _mm256_max_epu8(_mm256_min_epu8(mid[0], mid[1]), me);
+        __m256i median = _mm256_max_epu8(_mm256_min_epu8(lo, me), _mm256_min_epu8(_mm256_max_epu8(lo, me), hi));
+        _mm256_storeu_si256((__m256i *)(dst + i), median);
+    }
+    const unsigned char *rest[3] = { rows[0] + i, rows[1] + i, rows[2] + i };
+    scalar_median3(rest, step, n - i, dst + i);
+}
+
+// As sse2_rowExtremum on 32 bytes.
+static void avx2_rowExtremum(const unsigned char *a, const unsigned char *b, size_t n, int maximum, unsigned char *dst) {
+    size_t i = 0;
+    if (maximum) {
+        for (; i + 32 <= n; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(a + i)), y = _mm256_loadu_si256((const __m256i *)(b + i));
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_max_epu8(x, y));
+        }
+    } else {
+        for (; i + 32 <= n; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(a + i)), y = _mm256_loadu_si256((const __m256i *)(b + i));
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_min_epu8(x, y));
+        }
+    }
+    scalar_rowExtremum(a + i, b + i, n - i, maximum, dst + i);
+}
+
+// As sse2_sobel on 16 pixels, with a zero extension per load and abs.
+static void avx2_sobel(const unsigned char *const *rows, size_t n, int16_t *gx, int16_t *gy, int16_t *magnitude) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i left[3], right[3];
+        for (int k = 0; k < 3; ++k) {
+            left[k] = avx2_widen(rows[k] + i - 1);
+            right[k] = avx2_widen(rows[k] + i + 1);
+        }
+        __m256i below = avx2_widen(rows[0] + i), above = avx2_widen(rows[2] + i);
+        __m256i dx = _mm256_add_epi16(_mm256_sub_epi16(right[0], left[0]), _mm256_sub_epi16(right[2], left[2]));
+        dx = _mm256_add_epi16(dx, _mm256_slli_epi16(_mm256_sub_epi16(right[1], left[1]), 1));
+        __m256i up = _mm256_add_epi16(_mm256_add_epi16(left[2], right[2]), _mm256_slli_epi16(above, 1));
+        __m256i down = _mm256_add_epi16(_mm256_add_epi16(left[0], right[0]), _mm256_slli_epi16(below, 1));
+        __m256i dy = _mm256_sub_epi16(up, down);
+        _mm256_storeu_si256((__m256i *)(gx + i), dx);
+        _mm256_storeu_si256((__m256i *)(gy + i), dy);
+        _mm256_storeu_si256((__m256i *)(magnitude + i), _mm256_add_epi16(_mm256_abs_epi16(dx), _mm256_abs_epi16(dy)));
+    }
+    const unsigned char *rest[3] = { rows[0] + i, rows[1] + i, rows[2] + i };
+    scalar_sobel(rest, n - i, gx + i, gy + i, magnitude + i);
+}
+
+void cpu_fillAvx2(t_cpu_kernels *k) {
+    k->negate = avx2_negate;
+    k->addSaturate = avx2_addSaturate;
+    k->threshold = avx2_threshold;
+    k->convolve8 = avx2_convolve8;
+    k->convolve24 = avx2_convolve24;
+    k->rgbToYuv = avx2_rgbToYuv;
+    k->yuvToRgb = avx2_yuvToRgb;
+    k->resizeV = avx2_resizeV;
+    k->pyramidV = avx2_pyramidV;
+    k->localThreshold = avx2_localThreshold;
+    k->median3 = avx2_median3;
+    k->rowExtremum = avx2_rowExtremum;
+    k->sobel = avx2_sobel;
+}
@@ -0,0 +1,313 @@
+// simd_avx512.c
+// AVX-512 (F + BW) kernels: 64 bytes, 16 floats or 8 doubles per step, with mask registers for compares.
+#include "simd_kernels.h"
+#include <immintrin.h>
+#include <string.h>
+
+static void avx512_negate(unsigned char *data, size_t n) {
+    const __m512i ones = _mm512_set1_epi8((char)0xFF);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        _mm512_storeu_si512((void *)(data + i), _mm512_xor_si512(v, ones));
+    }
+    if (i < n) scalar_negate(data + i, n - i);
+}
+
+static void avx512_addSaturate(unsigned char *data, size_t n, int value) {
+    int magnitude = value < 0 ? (value < -255 ? 255 : -value) : (value > 255 ? 255 : value);
+    const __m512i delta = _mm512_set1_epi8((char)magnitude);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        v = value < 0 ? _mm512_subs_epu8(v, delta) : _mm512_adds_epu8(v, delta);
+        _mm512_storeu_si512((void *)(data + i), v);
+    }
+    if (i < n) scalar_addSaturate(data + i, n - i, value);
+}
+
+static void avx512_threshold(unsigned char *data, size_t n, int threshold) {
+    const __m512i t = _mm512_set1_epi8((char)threshold);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        __mmask64 above = _mm512_cmpge_epu8_mask(v, t);
+        _mm512_storeu_si512((void *)(data + i), _mm512_maskz_set1_epi8(above, (char)0xFF));
+    }
+    if (i < n) scalar_threshold(data + i, n - i, threshold);
+}
+
+static __m512 avx512_load16(const unsigned char *p) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)p)));
+}
+
+// Round half away from zero for non-negative values (see simd_sse2.c).
+static __m512i avx512_roundPs(__m512 x) {
+    __m512i t = _mm512_cvttps_epi32(x);
+    __m512 frac = _mm512_sub_ps(x, _mm512_cvtepi32_ps(t));
+    __mmask16 up = _mm512_cmp_ps_mask(frac, _mm512_set1_ps(0.5f), _CMP_GE_OQ);
+    return _mm512_mask_add_epi32(t, up, t, _mm512_set1_epi32(1));
+}
+
+static __m256i avx512_roundPd(__m512d x) {
+    __m512d t = _mm512_cvtepi32_pd(_mm512_cvttpd_epi32(x));
+    __mmask8 up = _mm512_cmp_pd_mask(_mm512_sub_pd(x, t), _mm512_set1_pd(0.5), _CMP_GE_OQ);
+    return _mm512_cvttpd_epi32(_mm512_mask_add_pd(t, up, t, _mm512_set1_pd(1.0)));
+}
+
+static void avx512_convolve8(const unsigned char *const *rows, const float *weights, int kernelSize,
+                             size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    size_t x = x0;
+    for (; x + 16 <= x1; x += 16) {
+        __m512 sum = _mm512_setzero_ps();
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            const unsigned char *row = rows[ky] + x - n;
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                __m512 w = _mm512_set1_ps(weights[ky * kernelSize + kx]);
+                sum = _mm512_add_ps(sum, _mm512_mul_ps(avx512_load16(row + kx), w));
+            }
+        }
+        sum = _mm512_min_ps(_mm512_max_ps(sum, _mm512_setzero_ps()), _mm512_set1_ps(255.0f));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm512_cvtepi32_epi8(avx512_roundPs(sum)));
+    }
+    if (x < x1) scalar_convolve8(rows, weights, kernelSize, x, x1, dst);
+}
+
+static void avx512_convolve24(const unsigned char *const *rows, const float *weights, int kernelSize,
+                              size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    size_t x = x0;
+    const __m512d zero = _mm512_setzero_pd(), max = _mm512_set1_pd(255.0);
+    for (; x + 16 <= x1; x += 16) {
+        __m512d sumLo = _mm512_setzero_pd(), sumHi = _mm512_setzero_pd();
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            const unsigned char *row = rows[ky] + x - (size_t)n * 3;
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                __m512 product = _mm512_mul_ps(avx512_load16(row + (size_t)kx * 3),
+                                               _mm512_set1_ps(weights[ky * kernelSize + kx]));
+                sumLo = _mm512_add_pd(sumLo, _mm512_cvtps_pd(_mm512_castps512_ps256(product)));
+                sumHi = _mm512_add_pd(sumHi, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(product), 1))));
+            }
+        }
+        __m256i lo = avx512_roundPd(_mm512_min_pd(_mm512_max_pd(sumLo, zero), max));
+        __m256i hi = avx512_roundPd(_mm512_min_pd(_mm512_max_pd(sumHi, zero), max));
+        __m512i all = _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm512_cvtepi32_epi8(all));
+    }
+    if (x < x1) scalar_convolve24(rows, weights, kernelSize, x, x1, dst);
+}
+
+// Same slices as ssse3_lut; the compare gives a mask register, so each slice is a single masked shuffle.
+static void avx512_lut(unsigned char *data, size_t n, const unsigned char *table) {
+    __m512i slices[16];
+    for (int h = 0; h < 16; ++h) {
+        slices[h] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(table + 16 * h)));
+    }
+    const __m512i nibble = _mm512_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        __m512i lo = _mm512_and_si512(v, nibble);
+        __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), nibble);
+        __m512i result = _mm512_setzero_si512();
+        for (int h = 0; h < 16; ++h) {
+            __mmask64 select = _mm512_cmpeq_epi8_mask(hi, _mm512_set1_epi8((char)h));
+            result = _mm512_mask_shuffle_epi8(result, select, slices[h], lo);
+        }
+        _mm512_storeu_si512((void *)(data + i), result);
+    }
+    if (i < n) scalar_lut(data + i, n - i, table);
+}
+
+// With AVX512-VBMI two vpermi2b cover the whole table (low and high half by bit 7): about 7x the masked shuffles.
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+#endif
+static void avx512vbmi_lut(unsigned char *data, size_t n, const unsigned char *table) {
+    const __m512i t0 = _mm512_loadu_si512((const void *)table);
+    const __m512i t1 = _mm512_loadu_si512((const void *)(table + 64));
+    const __m512i t2 = _mm512_loadu_si512((const void *)(table + 128));
+    const __m512i t3 = _mm512_loadu_si512((const void *)(table + 192));
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        __m512i low = _mm512_permutex2var_epi8(t0, v, t1);
+        __m512i high = _mm512_permutex2var_epi8(t2, v, t3);
+        _mm512_storeu_si512((void *)(data + i), _mm512_mask_blend_epi8(_mm512_movepi8_mask(v), low, high));
+    }
+    if (i < n) scalar_lut(data + i, n - i, table);
+}
+
+// As sse2_resizeV on 64 bytes (unpack and pack work within 128-bit lanes).
+static void avx512_resizeV(const unsigned char *const *rows, const int16_t *weights, int taps, size_t n, unsigned char *dst) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i half = _mm512_set1_epi32(1 << (CPU_RESIZE_BITS - 1));
+    size_t x = 0;
+    for (; x + 64 <= n; x += 64) {
+        __m512i acc0 = half, acc1 = half, acc2 = half, acc3 = half;
+        for (int k = 0; k < taps; k += 2) {
+            int w1 = k + 1 < taps ? weights[k + 1] : 0;
+            __m512i w = _mm512_set1_epi32((int)((uint32_t)(uint16_t)w1 << 16 | (uint16_t)weights[k]));
+            __m512i a = _mm512_loadu_si512((const void *)(rows[k] + x));
+            __m512i b = _mm512_loadu_si512((const void *)(rows[k + 1 < taps ? k + 1 : k] + x));
+            __m512i lo = _mm512_unpacklo_epi8(a, b), hi = _mm512_unpackhi_epi8(a, b);
+            acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(_mm512_unpacklo_epi8(lo, zero), w));
+            acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(_mm512_unpackhi_epi8(lo, zero), w));
+            acc2 = _mm512_add_epi32(acc2, _mm512_madd_epi16(_mm512_unpacklo_epi8(hi, zero), w));
+            acc3 = _mm512_add_epi32(acc3, _mm512_madd_epi16(_mm512_unpackhi_epi8(hi, zero), w));
+        }
+        __m512i s0 = _mm512_packs_epi32(_mm512_srai_epi32(acc0, CPU_RESIZE_BITS), _mm512_srai_epi32(acc1, CPU_RESIZE_BITS));
+        __m512i s1 = _mm512_packs_epi32(_mm512_srai_epi32(acc2, CPU_RESIZE_BITS), _mm512_srai_epi32(acc3, CPU_RESIZE_BITS));
+        _mm512_storeu_si512((void *)(dst + x), _mm512_packus_epi16(s0, s1));
+    }
+    for (; x < n; ++x) {
+        int32_t sum = 0;
+        for (int k = 0; k < taps; ++k) sum += (int32_t)rows[k][x] * weights[k];
+        dst[x] = resize_round(sum);
+    }
+}
+
+static inline __m512i avx512_widen(const unsigned char *p) {
+    return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)p));
+}
+
+// As sse2_pyramidV on 32 bytes, widened with one zero extension instead of unpacking.
+static void avx512_pyramidV(const unsigned char *const *rows, int binomial, size_t n, uint16_t *dst) {
+    size_t x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m512i sum;
+        if (binomial) {
+            __m512i outer = _mm512_add_epi16(avx512_widen(rows[0] + x), avx512_widen(rows[4] + x));
+            __m512i inner = _mm512_add_epi16(avx512_widen(rows[1] + x), avx512_widen(rows[3] + x));
+            __m512i center = avx512_widen(rows[2] + x);
+            sum = _mm512_add_epi16(outer, _mm512_slli_epi16(inner, 2));
+            sum = _mm512_add_epi16(sum, _mm512_add_epi16(_mm512_slli_epi16(center, 2), _mm512_slli_epi16(center, 1)));
+        } else {
+            sum = _mm512_add_epi16(avx512_widen(rows[0] + x), avx512_widen(rows[1] + x));
+        }
+        _mm512_storeu_si512((void *)(dst + x), sum);
+    }
+    if (x < n) {
+        const unsigned char *rest[5];
+        for (int k = 0; k < (binomial ? 5 : 2); ++k) rest[k] = rows[k] + x;
+        scalar_pyramidV(rest, binomial, n - x, dst + x);
+    }
+}
+
+// As sse2_localThreshold on 8 pixels.
+static void avx512_localThreshold(const unsigned char *src, size_t n, const uint32_t *sums, const uint64_t *squares,
+                                  size_t window, const t_cpu_threshold *params, unsigned char *dst) {
+    const __m512d count = _mm512_set1_pd(params->count), scale = _mm512_set1_pd(params->scale);
+    const __m512d meanWeight = _mm512_set1_pd(params->meanWeight), offset = _mm512_set1_pd(params->offset);
+    const __m512d slope = _mm512_set1_pd(params->slope), zero = _mm512_setzero_pd();
+    const __m512d magic = _mm512_set1_pd(THRESHOLD_MAGIC);
+    const __m512i magicBits = _mm512_set1_epi64((long long)THRESHOLD_MAGIC_BITS);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i windowSum = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(sums + i + window)),
+                                             _mm256_loadu_si256((const __m256i *)(sums + i)));
+        __m512d sum = _mm512_cvtepu32_pd(windowSum);
+        __m512i windowSquares = _mm512_sub_epi64(_mm512_loadu_si512((const void *)(squares + i + window)),
+                                                 _mm512_loadu_si512((const void *)(squares + i)));
+        __m512d squareSum = _mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(windowSquares, magicBits)), magic);
+        __m512d spread = _mm512_sub_pd(_mm512_mul_pd(count, squareSum), _mm512_mul_pd(sum, sum));
+        __m512d pixel = _mm512_cvtepi32_pd(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i))));
+        __m512d a = _mm512_mul_pd(scale, _mm512_sub_pd(_mm512_mul_pd(pixel, count), _mm512_mul_pd(sum, meanWeight)));
+        __m512d b = _mm512_add_pd(offset, _mm512_mul_pd(slope, sum));
+        __m512d bound = _mm512_mul_pd(_mm512_mul_pd(b, b), spread), square = _mm512_mul_pd(a, a);
+        __mmask8 nonNegative = _mm512_cmp_pd_mask(a, zero, _CMP_GE_OQ);
+        __mmask8 white = params->positive ? nonNegative & _mm512_cmp_pd_mask(square, bound, _CMP_GE_OQ)
+                                          : nonNegative | _mm512_cmp_pd_mask(square, bound, _CMP_LE_OQ);
+        uint32_t bytes[2] = { threshold_maskBytes(white), threshold_maskBytes((unsigned int)white >> 4) };
+        memcpy(dst + i, bytes, 8);
+    }
+    if (i < n) scalar_localThreshold(src + i, n - i, sums + i, squares + i, window, params, dst + i);
+}
+
+// As sse2_median3 on 64 bytes.
+static void avx512_median3(const unsigned char *const *rows, size_t step, size_t n, unsigned char *dst) {
+    const unsigned char *left[3] = { rows[0] - step, rows[1] - step, rows[2] - step };
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i low[3], mid[3], high[3];
+        for (int d = 0; d < 3; ++d) {
+            size_t at = i + (size_t)d * step;
+            __m512i a = _mm512_loadu_si512((const void *)(left[0] + at));
+            __m512i b = _mm512_loadu_si512((const void *)(left[1] + at));
+            __m512i c = _mm512_loadu_si512((const void *)(left[2] + at));
+            __m512i t = _mm512_min_epu8(a, b), u = _mm512_max_epu8(a, b);
+            low[d] = _mm512_min_epu8(t, c);
+            t = _mm512_max_epu8(t, c);
+            mid[d] = _mm512_min_epu8(u, t);
+            high[d] = _mm512_max_epu8(u, t);
+        }
+        __m512i lo = _mm512_max_epu8(_mm512_max_epu8(low[0], low[1]), low[2]);
+        __m512i hi = _mm512_min_epu8(_mm512_min_epu8(high[0], high[1]), high[2]);
+        __m512i me = _mm512_min_epu8(_mm512_max_epu8(mid[0], mid[1]), mid[2]);
+        me = _mm512_max_epu8(_mm512_min_epu8(mid[0], mid[1]), me);
+        __m512i median = _mm512_max_epu8(_mm512_min_epu8(lo, me), _mm512_min_epu8(_mm512_max_epu8(lo, me), hi));
+        _mm512_storeu_si512((void *)(dst + i), median);
+    }
+    const unsigned char *rest[3] = { rows[0] + i, rows[1] + i, rows[2] + i };
+    scalar_median3(rest, step, n - i, dst + i);
+}
+
+// As sse2_rowExtremum on 64 bytes.
+static void avx512_rowExtremum(const unsigned char *a, const unsigned char *b, size_t n, int maximum, unsigned char *dst) {
+    size_t i = 0;
+    if (maximum) {
+        for (; i + 64 <= n; i += 64) {
+            __m512i x = _mm512_loadu_si512((const void *)(a + i)), y = _mm512_loadu_si512((const void *)(b + i));
+            _mm512_storeu_si512((void *)(dst + i), _mm512_max_epu8(x, y));
+        }
+    } else {
+        for (; i + 64 <= n; i += 64) {
+            __m512i x = _mm512_loadu_si512((const void *)(a + i)), y = _mm512_loadu_si512((const void *)(b + i));
+            _mm512_storeu_si512((void *)(dst + i), _mm512_min_epu8(x, y));
+        }
+    }
+    scalar_rowExtremum(a + i, b + i, n - i, maximum, dst + i);
+}
+
+// As sse2_sobel on 32 pixels, with a zero extension per load and abs.
+static void avx512_sobel(const unsigned char *const *rows, size_t n, int16_t *gx, int16_t *gy, int16_t *magnitude) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i left[3], right[3];
+        for (int k = 0; k < 3; ++k) {
+            left[k] = avx512_widen(rows[k] + i - 1);
+            right[k] = avx512_widen(rows[k] + i + 1);
+        }
+        __m512i below = avx512_widen(rows[0] + i), above = avx512_widen(rows[2] + i);
+        __m512i dx = _mm512_add_epi16(_mm512_sub_epi16(right[0], left[0]), _mm512_sub_epi16(right[2], left[2]));
+        dx = _mm512_add_epi16(dx, _mm512_slli_epi16(_mm512_sub_epi16(right[1], left[1]), 1));
+        __m512i up = _mm512_add_epi16(_mm512_add_epi16(left[2], right[2]), _mm512_slli_epi16(above, 1));
+        __m512i down = _mm512_add_epi16(_mm512_add_epi16(left[0], right[0]), _mm512_slli_epi16(below, 1));
+        __m512i dy = _mm512_sub_epi16(up, down);
+        _mm512_storeu_si512((void *)(gx + i), dx);
+        _mm512_storeu_si512((void *)(gy + i), dy);
+        _mm512_storeu_si512((void *)(magnitude + i), _mm512_add_epi16(_mm512_abs_epi16(dx), _mm512_abs_epi16(dy)));
+    }
+    const unsigned char *rest[3] = { rows[0] + i, rows[1] + i, rows[2] + i };
+    scalar_sobel(rest, n - i, gx + i, gy + i, magnitude + i);
+}
+
+void cpu_fillAvx512(t_cpu_kernels *k) {
+    k->negate = avx512_negate;
+    k->addSaturate = avx512_addSaturate;
+    k->threshold = avx512_threshold;
+    k->lut = avx512_lut;
+    k->convolve8 = avx512_convolve8;
+    k->convolve24 = avx512_convolve24;
+    k->resizeV = avx512_resizeV;
+    k->pyramidV = avx512_pyramidV;
+    k->localThreshold = avx512_localThreshold;
+    k->median3 = avx512_median3;
+    k->rowExtremum = avx512_rowExtremum;
+    k->sobel = avx512_sobel;
+}
+
+void cpu_fillAvx512Vbmi(t_cpu_kernels *k) {
+    k->lut = avx512vbmi_lut;
+}
@@ -0,0 +1,88 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+// Internal to the dispatch layer: each level's translation unit overwrites the table entries it specialises.
+// The SIMD units are compiled with their own instruction-set flags and are only called after cpuid allows it.
+#include "cpu_dispatch.h"
+
+void cpu_fillScalar(t_cpu_kernels *k);
+
+// Scalar kernels, also used by the SIMD versions for the pixels left over after the last full vector.
+void scalar_negate(unsigned char *data, size_t n);
+void scalar_addSaturate(unsigned char *data, size_t n, int value);
+void scalar_threshold(unsigned char *data, size_t n, int threshold);
+void scalar_lut(unsigned char *data, size_t n, const unsigned char *table);
+void scalar_histogram(const unsigned char *data, size_t n, unsigned int *hist);
+void scalar_convolve8(const unsigned char *const *rows, const float *weights, int kernelSize,
+                      size_t x0, size_t x1, unsigned char *dst);
+void scalar_convolve24(const unsigned char *const *rows, const float *weights, int kernelSize,
+                       size_t x0, size_t x1, unsigned char *dst);
+void scalar_grayscale24(t_pixel *row, size_t n);
+void scalar_rgbToYuv(const t_pixel *src, size_t n, uint8_t *y, double *u, double *v);
+void scalar_yuvToRgb(const uint8_t *y, const unsigned int *yMap, const double *u, const double *v,
+                     size_t n, t_pixel *dst);
+void scalar_resizeH(const unsigned char *src, size_t srcWidth, int channels, const int32_t *start,
+                    const int16_t *weights, int taps, size_t n, unsigned char *dst);
+void scalar_resizeV(const unsigned char *const *rows, const int16_t *weights, int taps, size_t n, unsigned char *dst);
+void scalar_pyramidV(const unsigned char *const *rows, int binomial, size_t n, uint16_t *dst);
+void scalar_pyramidH8(const uint16_t *src, size_t width, int binomial, unsigned char *dst);
+void scalar_pyramidH24(const uint16_t *src, size_t width, int binomial, unsigned char *dst);
+void scalar_transposeTile8(const unsigned char *const *src, size_t srcX, unsigned char *const *dst, size_t dstX);
+void scalar_transposeTile24(const unsigned char *const *src, size_t srcX, unsigned char *const *dst, size_t dstX);
+void scalar_reverse8(unsigned char *row, size_t n);
+void scalar_reverse24(unsigned char *row, size_t n);
+void scalar_localThreshold(const unsigned char *src, size_t n, const uint32_t *sums, const uint64_t *squares,
+                           size_t window, const t_cpu_threshold *params, unsigned char *dst);
+void scalar_median3(const unsigned char *const *rows, size_t step, size_t n, unsigned char *dst);
+void scalar_rowExtremum(const unsigned char *a, const unsigned char *b, size_t n, int maximum, unsigned char *dst);
+void scalar_sobel(const unsigned char *const *rows, size_t n, int16_t *gx, int16_t *gy, int16_t *magnitude);
+// Function pyramid_reduceH is needed to compute the output pixels first..last-1 of pyramidH8/24; the vector kernels use it for
+// the outputs whose window crosses the ends of the row.
+static inline void pyramid_reduceH(const uint16_t *src, size_t width, int channels, int binomial, size_t first,
+                                   size_t last, unsigned char *dst) {
+    static const unsigned int weights[5] = { 1, 4, 6, 4, 1 };
+    for (size_t x = first; x < last; ++x) {
+        for (int c = 0; c < channels; ++c) {
+            unsigned int sum = 0;
+            if (binomial) {
+                for (int k = 0; k < 5; ++k) {
+                    long i = (long)(2 * x) + k - 2;
+                    i = i < 0 ? 0 : i >= (long)width ? (long)width - 1 : i;
+                    sum += weights[k] * src[(size_t)i * channels + c];
+                }
+                dst[x * channels + c] = (unsigned char)((sum + 128) >> 8);
+            } else {
+                size_t right = 2 * x + 1 < width ? 2 * x + 1 : width - 1;
+                sum = src[2 * x * channels + c] + src[right * channels + c];
+                dst[x * channels + c] = (unsigned char)((sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+// Function resize_round is needed to turn a weighted sum into a byte the same way at every level.
+static inline unsigned char resize_round(int32_t sum) {
+    sum = (sum + (1 << (CPU_RESIZE_BITS - 1))) >> CPU_RESIZE_BITS;
+    return (unsigned char)(sum < 0 ? 0 : sum > 255 ? 255 : sum);
+}
+
+// Function threshold_maskBytes is needed to expand the low 4 bits of a comparison mask into 4 bytes of 0 or 255
+// (byte i from bit i, in memory order). Each bit is moved to the low bit of its byte by one multiplication.
+static inline uint32_t threshold_maskBytes(unsigned int bits) {
+    return (((bits & 15u) * 0x204081u) & 0x01010101u) * 255u;
+}
+
+// Bits of 2^52 as a double: OR-ing an integer below 2^52 into its mantissa and subtracting 2^52 converts it exactly
+// (the vector levels below AVX-512DQ have no 64-bit integer conversion).
+#define THRESHOLD_MAGIC_BITS 0x4330000000000000ULL
+#define THRESHOLD_MAGIC 4503599627370496.0
+#ifdef IMAGE_MOD_SIMD_X86
+void cpu_fillSse2(t_cpu_kernels *k);
+void cpu_fillSsse3(t_cpu_kernels *k);
+void cpu_fillAvx2(t_cpu_kernels *k);
+void cpu_fillAvx512(t_cpu_kernels *k);
+// Function cpu_fillAvx512Vbmi is needed on top of cpu_fillAvx512 when the CPU also has AVX512-VBMI (byte permutes).
+void cpu_fillAvx512Vbmi(t_cpu_kernels *k);
+#endif
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,472 @@
+// simd_sse2.c
+// SSE2 kernels. Arithmetic is done lane by lane in the same order and precision as the scalar kernels
+// (float sums for 8-bit, float products summed in double for 24-bit), so results are bit-identical.
+#include "simd_kernels.h"
+#include <emmintrin.h>
+#include <string.h>
+
+static void sse2_negate(unsigned char *data, size_t n) {
+    const __m128i ones = _mm_set1_epi8((char)0xFF);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(v, ones));
+    }
+    if (i < n) scalar_negate(data + i, n - i);
+}
+
+static void sse2_addSaturate(unsigned char *data, size_t n, int value) {
+    int magnitude = value < 0 ? (value < -255 ? 255 : -value) : (value > 255 ? 255 : value);
+    const __m128i delta = _mm_set1_epi8((char)magnitude);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        v = value < 0 ? _mm_subs_epu8(v, delta) : _mm_adds_epu8(v, delta);
+        _mm_storeu_si128((__m128i *)(data + i), v);
+    }
+    if (i < n) scalar_addSaturate(data + i, n - i, value);
+}
+
+static void sse2_threshold(unsigned char *data, size_t n, int threshold) {
+    const __m128i t = _mm_set1_epi8((char)threshold);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        // v >= t exactly when max(v, t) == v.
+        _mm_storeu_si128((__m128i *)(data + i), _mm_cmpeq_epi8(_mm_max_epu8(v, t), v));
+    }
+    if (i < n) scalar_threshold(data + i, n - i, threshold);
+}
+
+// Histograms do not vectorise; four interleaved tables break the store-to-load dependency on repeated values.
+static void sse2_histogram(const unsigned char *data, size_t n, unsigned int *hist) {
+    unsigned int tables[4][256];
+    memset(tables, 0, sizeof(tables));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        tables[0][data[i]]++;
+        tables[1][data[i + 1]]++;
+        tables[2][data[i + 2]]++;
+        tables[3][data[i + 3]]++;
+    }
+    for (; i < n; ++i) tables[0][data[i]]++;
+    for (int v = 0; v < 256; ++v) hist[v] += tables[0][v] + tables[1][v] + tables[2][v] + tables[3][v];
+}
+
+static __m128 sse2_load4(const unsigned char *p) {
+    int word;
+    memcpy(&word, p, 4);
+    __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(word), _mm_setzero_si128());
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+
+// Rounds non-negative values half away from zero, as round() does: truncate, then add 1 if the dropped fraction
+// is at least 0.5 (the subtraction is exact in this range).
+static __m128i sse2_roundPs(__m128 x) {
+    __m128i t = _mm_cvttps_epi32(x);
+    __m128 frac = _mm_sub_ps(x, _mm_cvtepi32_ps(t));
+    return _mm_sub_epi32(t, _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f))));
+}
+
+static __m128i sse2_roundPd(__m128d x) {
+    __m128i t = _mm_cvttpd_epi32(x);
+    __m128d frac = _mm_sub_pd(x, _mm_cvtepi32_pd(t));
+    __m128i up = _mm_castpd_si128(_mm_cmpge_pd(frac, _mm_set1_pd(0.5)));
+    // The compare gives 64-bit masks; keep one 32-bit half of each so it lines up with the two ints in t.
+    return _mm_sub_epi32(t, _mm_shuffle_epi32(up, _MM_SHUFFLE(3, 3, 2, 0)));
+}
+
+static __m128d sse2_clampPd(__m128d x) {
+    return _mm_min_pd(_mm_max_pd(x, _mm_setzero_pd()), _mm_set1_pd(255.0));
+}
+
+static void sse2_store4(unsigned char *dst, __m128i values) {
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(values, values), _mm_setzero_si128());
+    int word = _mm_cvtsi128_si32(packed);
+    memcpy(dst, &word, 4);
+}
+
+static void sse2_convolve8(const unsigned char *const *rows, const float *weights, int kernelSize,
+                           size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    size_t x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            const unsigned char *row = rows[ky] + x - n;
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                __m128 w = _mm_set1_ps(weights[ky * kernelSize + kx]);
+                sum = _mm_add_ps(sum, _mm_mul_ps(sse2_load4(row + kx), w));
+            }
+        }
+        sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+        sse2_store4(dst + x, sse2_roundPs(sum));
+    }
+    if (x < x1) scalar_convolve8(rows, weights, kernelSize, x, x1, dst);
+}
+
+static void sse2_convolve24(const unsigned char *const *rows, const float *weights, int kernelSize,
+                            size_t x0, size_t x1, unsigned char *dst) {
+    int n = kernelSize / 2;
+    size_t x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        __m128d sumLo = _mm_setzero_pd(), sumHi = _mm_setzero_pd();
+        for (int ky = 0; ky < kernelSize; ++ky) {
+            const unsigned char *row = rows[ky] + x - (size_t)n * 3;
+            for (int kx = 0; kx < kernelSize; ++kx) {
+                __m128 product = _mm_mul_ps(sse2_load4(row + (size_t)kx * 3), _mm_set1_ps(weights[ky * kernelSize + kx]));
+                sumLo = _mm_add_pd(sumLo, _mm_cvtps_pd(product));
+                sumHi = _mm_add_pd(sumHi, _mm_cvtps_pd(_mm_movehl_ps(product, product)));
+            }
+        }
+        __m128i lo = sse2_roundPd(sse2_clampPd(sumLo));
+        __m128i hi = sse2_roundPd(sse2_clampPd(sumHi));
+        sse2_store4(dst + x, _mm_unpacklo_epi64(lo, hi));
+    }
+    if (x < x1) scalar_convolve24(rows, weights, kernelSize, x, x1, dst);
+}
+
+static __m128d sse2_channel(const t_pixel *p, size_t offset) {
+    const unsigned char *b = (const unsigned char *)p;
+    return _mm_set_pd((double)b[3 + offset], (double)b[offset]);
+}
+
+static void sse2_rgbToYuv(const t_pixel *src, size_t n, uint8_t *y, double *u, double *v) {
+    size_t x = 0;
+    for (; x + 2 <= n; x += 2) {
+        __m128d r = sse2_channel(src + x, 2), g = sse2_channel(src + x, 1), b = sse2_channel(src + x, 0);
+        __m128d yy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(0.299), r), _mm_mul_pd(_mm_set1_pd(0.587), g)),
+                                _mm_mul_pd(_mm_set1_pd(0.114), b));
+        __m128d uu = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(_mm_set1_pd(-0.14713), r), _mm_mul_pd(_mm_set1_pd(0.28886), g)),
+                                _mm_mul_pd(_mm_set1_pd(0.436), b));
+        __m128d vv = _mm_sub_pd(_mm_sub_pd(_mm_mul_pd(_mm_set1_pd(0.615), r), _mm_mul_pd(_mm_set1_pd(0.51499), g)),
+                                _mm_mul_pd(_mm_set1_pd(0.10001), b));
+        __m128i yi = sse2_roundPd(sse2_clampPd(yy));
+        y[x] = (uint8_t)_mm_cvtsi128_si32(yi);
+        y[x + 1] = (uint8_t)_mm_cvtsi128_si32(_mm_srli_si128(yi, 4));
+        _mm_storeu_pd(u + x, uu);
+        _mm_storeu_pd(v + x, vv);
+    }
+    if (x < n) scalar_rgbToYuv(src + x, n - x, y + x, u + x, v + x);
+}
+
+static void sse2_yuvToRgb(const uint8_t *y, const unsigned int *yMap, const double *u, const double *v,
+                          size_t n, t_pixel *dst) {
+    size_t x = 0;
+    for (; x + 2 <= n; x += 2) {
+        __m128d yy = _mm_set_pd((double)yMap[y[x + 1]], (double)yMap[y[x]]);
+        __m128d uu = _mm_loadu_pd(u + x), vv = _mm_loadu_pd(v + x);
+        __m128d r = _mm_add_pd(yy, _mm_mul_pd(_mm_set1_pd(1.13983), vv));
+        __m128d g = _mm_sub_pd(_mm_sub_pd(yy, _mm_mul_pd(_mm_set1_pd(0.39465), uu)), _mm_mul_pd(_mm_set1_pd(0.58060), vv));
+        __m128d b = _mm_add_pd(yy, _mm_mul_pd(_mm_set1_pd(2.03211), uu));
+        __m128i ri = sse2_roundPd(sse2_clampPd(r)), gi = sse2_roundPd(sse2_clampPd(g)), bi = sse2_roundPd(sse2_clampPd(b));
+        for (int lane = 0; lane < 2; ++lane) {
+            dst[x + lane].red = (uint8_t)_mm_cvtsi128_si32(ri);
+            dst[x + lane].green = (uint8_t)_mm_cvtsi128_si32(gi);
+            dst[x + lane].blue = (uint8_t)_mm_cvtsi128_si32(bi);
+            ri = _mm_srli_si128(ri, 4);
+            gi = _mm_srli_si128(gi, 4);
+            bi = _mm_srli_si128(bi, 4);
+        }
+    }
+    if (x < n) scalar_yuvToRgb(y + x, yMap, u + x, v + x, n - x, dst + x);
+}
+
+// Two weights in each int32 lane, so that madd on interleaved rows k and k + 1 gives both products summed.
+static __m128i sse2_weightPair(const int16_t *weights, int k, int taps) {
+    int w1 = k + 1 < taps ? weights[k + 1] : 0;
+    return _mm_set1_epi32((int)((uint32_t)(uint16_t)w1 << 16 | (uint16_t)weights[k]));
+}
+
+// Integer sums, so the order of the additions does not matter and the result equals scalar_resizeH.
+static void sse2_resizeH(const unsigned char *src, size_t srcWidth, int channels, const int32_t *start,
+                         const int16_t *weights, int taps, size_t n, unsigned char *dst) {
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < n; ++i) {
+        const int16_t *w = weights + i * (size_t)taps;
+        const unsigned char *p = src + (size_t)start[i] * channels;
+        int k = 0;
+        if (channels == 1) {
+            __m128i acc = zero;
+            for (; k + 8 <= taps; k += 8) {
+                __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + k)), zero);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(v, _mm_loadu_si128((const __m128i *)(w + k))));
+            }
+            acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+            acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+            int32_t sum = _mm_cvtsi128_si32(acc);
+            for (; k < taps; ++k) sum += (int32_t)p[k] * w[k];
+            dst[i] = resize_round(sum);
+        } else {
+            // Two pixels per step: the 8 loaded bytes are B0 G0 R0 B1 G1 R1 and two bytes that get weight 0. Each
+            // byte goes to its own int32 lane with a zero high half, so madd with the weight in the low half of the
+            // lane multiplies them.
+            size_t bytes = (srcWidth - (size_t)start[i]) * 3;
+            __m128i acc0 = zero, acc1 = zero;
+            for (; k + 2 <= taps && (size_t)k * 3 + 8 <= bytes; k += 2) {
+                __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + k * 3)), zero);
+                int w0 = (uint16_t)w[k], w1 = (uint16_t)w[k + 1];
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(v, zero), _mm_set_epi32(w1, w0, w0, w0)));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(v, zero), _mm_set_epi32(0, 0, w1, w1)));
+            }
+            int32_t a[4], b[4];
+            _mm_storeu_si128((__m128i *)a, acc0);
+            _mm_storeu_si128((__m128i *)b, acc1);
+            int32_t sum[3] = { a[0] + a[3], a[1] + b[0], a[2] + b[1] };
+            for (; k < taps; ++k) {
+                for (int c = 0; c < 3; ++c) sum[c] += (int32_t)p[k * 3 + c] * w[k];
+            }
+            for (int c = 0; c < 3; ++c) dst[i * 3 + c] = resize_round(sum[c]);
+        }
+    }
+}
+
+static void sse2_resizeV(const unsigned char *const *rows, const int16_t *weights, int taps, size_t n, unsigned char *dst) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(1 << (CPU_RESIZE_BITS - 1));
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i acc0 = half, acc1 = half, acc2 = half, acc3 = half;
+        for (int k = 0; k < taps; k += 2) {
+            __m128i w = sse2_weightPair(weights, k, taps);
+            __m128i a = _mm_loadu_si128((const __m128i *)(rows[k] + x));
+            __m128i b = _mm_loadu_si128((const __m128i *)(rows[k + 1 < taps ? k + 1 : k] + x));
+            __m128i lo = _mm_unpacklo_epi8(a, b), hi = _mm_unpackhi_epi8(a, b);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+        }
+        __m128i s0 = _mm_packs_epi32(_mm_srai_epi32(acc0, CPU_RESIZE_BITS), _mm_srai_epi32(acc1, CPU_RESIZE_BITS));
+        __m128i s1 = _mm_packs_epi32(_mm_srai_epi32(acc2, CPU_RESIZE_BITS), _mm_srai_epi32(acc3, CPU_RESIZE_BITS));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(s0, s1));
+    }
+    for (; x < n; ++x) {
+        int32_t sum = 0;
+        for (int k = 0; k < taps; ++k) sum += (int32_t)rows[k][x] * weights[k];
+        dst[x] = resize_round(sum);
+    }
+}
+
+static void sse2_pyramidV(const unsigned char *const *rows, int binomial, size_t n, uint16_t *dst) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i sum[2];
+        for (int half = 0; half < 2; ++half) {
+            __m128i r[5];
+            for (int k = 0; k < (binomial ? 5 : 2); ++k) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(rows[k] + x));
+                r[k] = half ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero);
+            }
+            if (binomial) {
+                __m128i outer = _mm_add_epi16(r[0], r[4]);
+                __m128i inner = _mm_slli_epi16(_mm_add_epi16(r[1], r[3]), 2);
+                __m128i center = _mm_add_epi16(_mm_slli_epi16(r[2], 2), _mm_slli_epi16(r[2], 1));
+                sum[half] = _mm_add_epi16(_mm_add_epi16(outer, inner), center);
+            } else {
+                sum[half] = _mm_add_epi16(r[0], r[1]);
+            }
+        }
+        _mm_storeu_si128((__m128i *)(dst + x), sum[0]);
+        _mm_storeu_si128((__m128i *)(dst + x + 8), sum[1]);
+    }
+    if (x < n) {
+        const unsigned char *rest[5];
+        for (int k = 0; k < (binomial ? 5 : 2); ++k) rest[k] = rows[k] + x;
+        scalar_pyramidV(rest, binomial, n - x, dst + x);
+    }
+}
+
+// The outputs whose window crosses the ends of the row are left to pyramid_reduceH.
+static void sse2_pyramidH8(const uint16_t *src, size_t width, int binomial, unsigned char *dst) {
+    size_t outWidth = (width + 1) / 2;
+    size_t x = 0;
+    if (binomial) {
+        // Each 32-bit lane holds an even sample in its low half and the odd one after it in the high half.
+        const __m128i low = _mm_set1_epi32(0xFFFF), round = _mm_set1_epi32(128);
+        pyramid_reduceH(src, width, 1, 1, 0, 1, dst);
+        for (x = 1; 2 * x + 18 <= width; x += 8) {
+            __m128i out[2];
+            for (int half = 0; half < 2; ++half) {
+                const uint16_t *p = src + 2 * x + 8 * half;
+                __m128i a = _mm_loadu_si128((const __m128i *)(p - 2));
+                __m128i b = _mm_loadu_si128((const __m128i *)p);
+                __m128i c = _mm_loadu_si128((const __m128i *)(p + 2));
+                __m128i even = _mm_and_si128(b, low);
+                __m128i odd = _mm_add_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+                __m128i sum = _mm_add_epi32(_mm_and_si128(a, low), _mm_and_si128(c, low));
+                sum = _mm_add_epi32(sum, _mm_slli_epi32(odd, 2));
+                sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_slli_epi32(even, 2), _mm_slli_epi32(even, 1)));
+                out[half] = _mm_srli_epi32(_mm_add_epi32(sum, round), 8);
+            }
+            __m128i packed = _mm_packs_epi32(out[0], out[1]);
+            _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(packed, packed));
+        }
+    } else {
+        const __m128i ones = _mm_set1_epi16(1), two = _mm_set1_epi16(2);
+        for (; 2 * x + 16 <= width; x += 8) {
+            __m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * x)), ones);
+            __m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * x + 8)), ones);
+            __m128i out = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(a, b), two), 2);
+            _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(out, out));
+        }
+    }
+    pyramid_reduceH(src, width, 1, binomial, x, outWidth, dst);
+}
+
+// 16x16 bytes in registers: four rounds of unpacking interleave rows 2, 4, 8 and then 16 at a time, after which
+// each register holds one column.
+static void sse2_transposeTile8(const unsigned char *const *src, size_t srcX, unsigned char *const *dst, size_t dstX) {
+    __m128i r[16], t[16];
+    for (int j = 0; j < 16; ++j) r[j] = _mm_loadu_si128((const __m128i *)(src[j] + srcX));
+    // t[i] / t[i + 8]: columns 0-7 / 8-15 of rows 2i and 2i + 1, a byte of each in turn.
+    for (int i = 0; i < 8; ++i) {
+        t[i] = _mm_unpacklo_epi8(r[2 * i], r[2 * i + 1]);
+        t[i + 8] = _mm_unpackhi_epi8(r[2 * i], r[2 * i + 1]);
+    }
+    // r[h + j] / r[h + j + 4]: 4 columns of rows 4j..4j + 3.
+    for (int h = 0; h < 16; h += 8) {
+        for (int j = 0; j < 4; ++j) {
+            r[h + j] = _mm_unpacklo_epi16(t[h + 2 * j], t[h + 2 * j + 1]);
+            r[h + j + 4] = _mm_unpackhi_epi16(t[h + 2 * j], t[h + 2 * j + 1]);
+        }
+    }
+    // t[b + m] / t[b + m + 2]: 2 columns of rows 8m..8m + 7.
+    for (int b = 0; b < 16; b += 4) {
+        for (int m = 0; m < 2; ++m) {
+            t[b + m] = _mm_unpacklo_epi32(r[b + 2 * m], r[b + 2 * m + 1]);
+            t[b + m + 2] = _mm_unpackhi_epi32(r[b + 2 * m], r[b + 2 * m + 1]);
+        }
+    }
+    // Block b holds columns 0-3 of its half (b = 0, 8) or columns 4-7 (b = 4, 12).
+    for (int b = 0; b < 16; b += 4) {
+        int column = (b & 8) + (b & 4);
+        _mm_storeu_si128((__m128i *)(dst[column] + dstX), _mm_unpacklo_epi64(t[b], t[b + 1]));
+        _mm_storeu_si128((__m128i *)(dst[column + 1] + dstX), _mm_unpackhi_epi64(t[b], t[b + 1]));
+        _mm_storeu_si128((__m128i *)(dst[column + 2] + dstX), _mm_unpacklo_epi64(t[b + 2], t[b + 3]));
+        _mm_storeu_si128((__m128i *)(dst[column + 3] + dstX), _mm_unpackhi_epi64(t[b + 2], t[b + 3]));
+    }
+}
+
+// Two pixels per step with the same double operations as scalar_localThreshold, so the results are identical.
+static void sse2_localThreshold(const unsigned char *src, size_t n, const uint32_t *sums, const uint64_t *squares,
+                                size_t window, const t_cpu_threshold *params, unsigned char *dst) {
+    const __m128d count = _mm_set1_pd(params->count), scale = _mm_set1_pd(params->scale);
+    const __m128d meanWeight = _mm_set1_pd(params->meanWeight), offset = _mm_set1_pd(params->offset);
+    const __m128d slope = _mm_set1_pd(params->slope), zero = _mm_setzero_pd();
+    const __m128d magic = _mm_set1_pd(THRESHOLD_MAGIC), signBias = _mm_set1_pd(2147483648.0);
+    const __m128i magicBits = _mm_set1_epi64x((long long)THRESHOLD_MAGIC_BITS), sign = _mm_set1_epi32(INT32_MIN);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        // Window sums are below 2^32: flipping the sign bit makes them signed, the bias restores them.
+        __m128i windowSum = _mm_sub_epi32(_mm_loadl_epi64((const __m128i *)(sums + i + window)),
+                                          _mm_loadl_epi64((const __m128i *)(sums + i)));
+        __m128d sum = _mm_add_pd(_mm_cvtepi32_pd(_mm_xor_si128(windowSum, sign)), signBias);
+        __m128i windowSquares = _mm_sub_epi64(_mm_loadu_si128((const __m128i *)(squares + i + window)),
+                                              _mm_loadu_si128((const __m128i *)(squares + i)));
+        __m128d squareSum = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(windowSquares, magicBits)), magic);
+        __m128d spread = _mm_sub_pd(_mm_mul_pd(count, squareSum), _mm_mul_pd(sum, sum));
+        __m128d pixel = _mm_cvtepi32_pd(_mm_setr_epi32(src[i], src[i + 1], 0, 0));
+        __m128d a = _mm_mul_pd(scale, _mm_sub_pd(_mm_mul_pd(pixel, count), _mm_mul_pd(sum, meanWeight)));
+        __m128d b = _mm_add_pd(offset, _mm_mul_pd(slope, sum));
+        __m128d bound = _mm_mul_pd(_mm_mul_pd(b, b), spread), square = _mm_mul_pd(a, a);
+        __m128d white = params->positive
+                      ? _mm_and_pd(_mm_cmpge_pd(a, zero), _mm_cmpge_pd(square, bound))
+                      : _mm_or_pd(_mm_cmpge_pd(a, zero), _mm_cmple_pd(square, bound));
+        uint16_t bytes = (uint16_t)threshold_maskBytes((unsigned int)_mm_movemask_pd(white));
+        memcpy(dst + i, &bytes, 2);
+    }
+    if (i < n) scalar_localThreshold(src + i, n - i, sums + i, squares + i, window, params, dst + i);
+}
+
+// 3x3 median of 16 bytes per step with the min/max network of scalar_median3.
+static void sse2_median3(const unsigned char *const *rows, size_t step, size_t n, unsigned char *dst) {
+    const unsigned char *left[3] = { rows[0] - step, rows[1] - step, rows[2] - step };
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i low[3], mid[3], high[3];
+        for (int d = 0; d < 3; ++d) {
+            size_t at = i + (size_t)d * step;
+            __m128i a = _mm_loadu_si128((const __m128i *)(left[0] + at));
+            __m128i b = _mm_loadu_si128((const __m128i *)(left[1] + at));
+            __m128i c = _mm_loadu_si128((const __m128i *)(left[2] + at));
+            __m128i t = _mm_min_epu8(a, b), u = _mm_max_epu8(a, b);
+            low[d] = _mm_min_epu8(t, c);
+            t = _mm_max_epu8(t, c);
+            mid[d] = _mm_min_epu8(u, t);
+            high[d] = _mm_max_epu8(u, t);
+        }
+        __m128i lo = _mm_max_epu8(_mm_max_epu8(low[0], low[1]), low[2]);
+        __m128i hi = _mm_min_epu8(_mm_min_epu8(high[0], high[1]), high[2]);
+        __m128i me = _mm_min_epu8(_mm_max_epu8(mid[0], mid[1]), mid[2]);
+        me = _mm_max_epu8(_mm_min_epu8(mid[0], mid[1]), me);
+        __m128i median = _mm_max_epu8(_mm_min_epu8(lo, me), _mm_min_epu8(_mm_max_epu8(lo, me), hi));
+        _mm_storeu_si128((__m128i *)(dst + i), median);
+    }
+    const unsigned char *rest[3] = { rows[0] + i, rows[1] + i, rows[2] + i };
+    scalar_median3(rest, step, n - i, dst + i);
+}
+
+// Row minimum or maximum of 16 bytes per step.
+static void sse2_rowExtremum(const unsigned char *a, const unsigned char *b, size_t n, int maximum, unsigned char *dst) {
+    size_t i = 0;
+    if (maximum) {
+        for (; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(a + i)), y = _mm_loadu_si128((const __m128i *)(b + i));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_max_epu8(x, y));
+        }
+    } else {
+        for (; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(a + i)), y = _mm_loadu_si128((const __m128i *)(b + i));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_min_epu8(x, y));
+        }
+    }
+    scalar_rowExtremum(a + i, b + i, n - i, maximum, dst + i);
+}
+
+// Sobel gradients of 8 pixels per step in 16-bit lanes (|v| as max(v, -v), SSE2 has no abs).
+static void sse2_sobel(const unsigned char *const *rows, size_t n, int16_t *gx, int16_t *gy, int16_t *magnitude) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i left[3], right[3];
+        for (int k = 0; k < 3; ++k) {
+            left[k] = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[k] + i - 1)), zero);
+            right[k] = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[k] + i + 1)), zero);
+        }
+        __m128i below = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[0] + i)), zero);
+        __m128i above = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[2] + i)), zero);
+        __m128i dx = _mm_add_epi16(_mm_sub_epi16(right[0], left[0]), _mm_sub_epi16(right[2], left[2]));
+        dx = _mm_add_epi16(dx, _mm_slli_epi16(_mm_sub_epi16(right[1], left[1]), 1));
+        __m128i up = _mm_add_epi16(_mm_add_epi16(left[2], right[2]), _mm_slli_epi16(above, 1));
+        __m128i down = _mm_add_epi16(_mm_add_epi16(left[0], right[0]), _mm_slli_epi16(below, 1));
+        __m128i dy = _mm_sub_epi16(up, down);
+        __m128i ax = _mm_max_epi16(dx, _mm_sub_epi16(zero, dx)), ay = _mm_max_epi16(dy, _mm_sub_epi16(zero, dy));
+        _mm_storeu_si128((__m128i *)(gx + i), dx);
+        _mm_storeu_si128((__m128i *)(gy + i), dy);
+        _mm_storeu_si128((__m128i *)(magnitude + i), _mm_add_epi16(ax, ay));
+    }
+    const unsigned char *rest[3] = { rows[0] + i, rows[1] + i, rows[2] + i };
+    scalar_sobel(rest, n - i, gx + i, gy + i, magnitude + i);
+}
+
+void cpu_fillSse2(t_cpu_kernels *k) {
+    k->negate = sse2_negate;
+    k->addSaturate = sse2_addSaturate;
+    k->threshold = sse2_threshold;
+    k->histogram = sse2_histogram;
+    k->convolve8 = sse2_convolve8;
+    k->convolve24 = sse2_convolve24;
+    k->rgbToYuv = sse2_rgbToYuv;
+    k->yuvToRgb = sse2_yuvToRgb;
+    k->resizeH = sse2_resizeH;
+    k->resizeV = sse2_resizeV;
+    k->pyramidV = sse2_pyramidV;
+    k->pyramidH8 = sse2_pyramidH8;
+    k->transposeTile8 = sse2_transposeTile8;
+    k->localThreshold = sse2_localThreshold;
+    k->median3 = sse2_median3;
+    k->rowExtremum = sse2_rowExtremum;
+    k->sobel = sse2_sobel;
+}
@@ -0,0 +1,188 @@
+// simd_ssse3.c
+// SSSE3 kernels: byte shuffles de-interleave and re-interleave BGR pixels 16 at a time.
+#include "simd_kernels.h"
+#include <tmmintrin.h>
+#include <string.h>
+
+// Gathers one channel (0 = blue, 1 = green, 2 = red) of 16 pixels spread over three 16-byte blocks.
+static __m128i ssse3_gather(__m128i a, __m128i b, __m128i c, int channel) {
+    static const signed char masks[3][3][16] = {
+        { {0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+          {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+          {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13} },
+        { {1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+          {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+          {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14} },
+        { {2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+          {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+          {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15} },
+    };
+    __m128i va = _mm_shuffle_epi8(a, _mm_loadu_si128((const __m128i *)masks[channel][0]));
+    __m128i vb = _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *)masks[channel][1]));
+    __m128i vc = _mm_shuffle_epi8(c, _mm_loadu_si128((const __m128i *)masks[channel][2]));
+    return _mm_or_si128(_mm_or_si128(va, vb), vc);
+}
+
+// sum / 3 for sum <= 765 as (sum * 43691) >> 17, which is exact in that range.
+static __m128i ssse3_divide3(__m128i sum16) {
+    return _mm_srli_epi16(_mm_mulhi_epu16(sum16, _mm_set1_epi16((short)43691)), 1);
+}
+
+static void ssse3_grayscale24(t_pixel *row, size_t n) {
+    static const signed char spread[3][16] = {
+        {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5},
+        {5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10},
+        {10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15},
+    };
+    const __m128i zero = _mm_setzero_si128();
+    unsigned char *bytes = (unsigned char *)row;
+    size_t x = 0;
+    for (; x + 16 <= n; x += 16) {
+        unsigned char *p = bytes + x * 3;
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + 32));
+        __m128i blue = ssse3_gather(a, b, c, 0), green = ssse3_gather(a, b, c, 1), red = ssse3_gather(a, b, c, 2);
+
+        __m128i sumLo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(red, zero), _mm_unpacklo_epi8(green, zero)),
+                                      _mm_unpacklo_epi8(blue, zero));
+        __m128i sumHi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(red, zero), _mm_unpackhi_epi8(green, zero)),
+                                      _mm_unpackhi_epi8(blue, zero));
+        __m128i gray = _mm_packus_epi16(ssse3_divide3(sumLo), ssse3_divide3(sumHi));
+
+        _mm_storeu_si128((__m128i *)p, _mm_shuffle_epi8(gray, _mm_loadu_si128((const __m128i *)spread[0])));
+        _mm_storeu_si128((__m128i *)(p + 16), _mm_shuffle_epi8(gray, _mm_loadu_si128((const __m128i *)spread[1])));
+        _mm_storeu_si128((__m128i *)(p + 32), _mm_shuffle_epi8(gray, _mm_loadu_si128((const __m128i *)spread[2])));
+    }
+    if (x < n) scalar_grayscale24(row + x, n - x);
+}
+
+// Works on the interleaved sums: the taps of channel c of output pixel x sit 3 elements apart around element 6x + c,
+// so one stencil over 16 consecutive elements gives 3 output pixels (elements 0-2, 6-8, 12-14), which a shuffle
+// packs together. The sums stay below 2^16 (16 * 4080 + 128), so 16-bit lanes suffice.
+static void ssse3_pyramidH24(const uint16_t *src, size_t width, int binomial, unsigned char *dst) {
+    static const signed char keep[16] = { 0, 1, 2, 6, 7, 8, 12, 13, 14, -1, -1, -1, -1, -1, -1, -1 };
+    const __m128i select = _mm_loadu_si128((const __m128i *)keep);
+    size_t outWidth = (width + 1) / 2;
+    size_t x = binomial ? 1 : 0;
+    if (binomial) pyramid_reduceH(src, width, 3, 1, 0, 1, dst);
+    for (; 6 * x + 22 <= 3 * width; x += 3) {
+        __m128i out[2];
+        for (int half = 0; half < 2; ++half) {
+            const uint16_t *p = src + 6 * x + 8 * half;
+            __m128i center = _mm_loadu_si128((const __m128i *)p);
+            __m128i next = _mm_loadu_si128((const __m128i *)(p + 3));
+            if (binomial) {
+                __m128i outer = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(p - 6)),
+                                              _mm_loadu_si128((const __m128i *)(p + 6)));
+                __m128i inner = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(p - 3)), next);
+                __m128i sum = _mm_add_epi16(_mm_add_epi16(outer, _mm_slli_epi16(inner, 2)), _mm_set1_epi16(128));
+                sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(center, 2), _mm_slli_epi16(center, 1)));
+                out[half] = _mm_srli_epi16(sum, 8);
+            } else {
+                out[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(center, next), _mm_set1_epi16(2)), 2);
+            }
+        }
+        __m128i pixels = _mm_shuffle_epi8(_mm_packus_epi16(out[0], out[1]), select);
+        _mm_storel_epi64((__m128i *)(dst + 3 * x), pixels);
+        dst[3 * x + 8] = (unsigned char)_mm_extract_epi16(pixels, 4);
+    }
+    pyramid_reduceH(src, width, 3, binomial, x, outWidth, dst);
+}
+
+// 8x8 pixels: each row of 24 bytes is spread to 8 lanes of 32 bits, transposed as four 4x4 blocks of 32-bit
+// values and packed back, so every row is read and written with one 16-byte and one 8-byte access.
+static void ssse3_transposeTile24(const unsigned char *const *src, size_t srcX, unsigned char *const *dst,
+                                  size_t dstX) {
+    static const signed char spread[16] = { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
+    static const signed char pack[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 };
+    const __m128i spreadMask = _mm_loadu_si128((const __m128i *)spread);
+    const __m128i packMask = _mm_loadu_si128((const __m128i *)pack);
+    __m128i lanes[8][2];           // row j, pixels 0-3 and 4-7
+    for (int j = 0; j < 8; ++j) {
+        const unsigned char *p = src[j] + srcX * 3;
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadl_epi64((const __m128i *)(p + 16));
+        lanes[j][0] = _mm_shuffle_epi8(a, spreadMask);
+        lanes[j][1] = _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), spreadMask);
+    }
+    __m128i columns[8][2];         // column i, rows 0-3 and 4-7
+    for (int bj = 0; bj < 2; ++bj) {
+        for (int bi = 0; bi < 2; ++bi) {
+            __m128i t0 = _mm_unpacklo_epi32(lanes[4 * bj][bi], lanes[4 * bj + 1][bi]);
+            __m128i t1 = _mm_unpackhi_epi32(lanes[4 * bj][bi], lanes[4 * bj + 1][bi]);
+            __m128i t2 = _mm_unpacklo_epi32(lanes[4 * bj + 2][bi], lanes[4 * bj + 3][bi]);
+            __m128i t3 = _mm_unpackhi_epi32(lanes[4 * bj + 2][bi], lanes[4 * bj + 3][bi]);
+            columns[4 * bi][bj] = _mm_unpacklo_epi64(t0, t2);
+            columns[4 * bi + 1][bj] = _mm_unpackhi_epi64(t0, t2);
+            columns[4 * bi + 2][bj] = _mm_unpacklo_epi64(t1, t3);
+            columns[4 * bi + 3][bj] = _mm_unpackhi_epi64(t1, t3);
+        }
+    }
+    for (int i = 0; i < 8; ++i) {
+        __m128i first = _mm_shuffle_epi8(columns[i][0], packMask);
+        __m128i second = _mm_shuffle_epi8(columns[i][1], packMask);
+        unsigned char *p = dst[i] + dstX * 3;
+        _mm_storeu_si128((__m128i *)p, _mm_or_si128(first, _mm_slli_si128(second, 12)));
+        _mm_storel_epi64((__m128i *)(p + 16), _mm_srli_si128(second, 4));
+    }
+}
+
+// Swaps 16-byte blocks from both ends of the row, each reversed by a shuffle, until they meet.
+static void ssse3_reverse8(unsigned char *row, size_t n) {
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t left = 0, right = n;
+    for (; left + 32 <= right; left += 16, right -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(row + left));
+        __m128i b = _mm_loadu_si128((const __m128i *)(row + right - 16));
+        _mm_storeu_si128((__m128i *)(row + left), _mm_shuffle_epi8(b, reverse));
+        _mm_storeu_si128((__m128i *)(row + right - 16), _mm_shuffle_epi8(a, reverse));
+    }
+    scalar_reverse8(row + left, right - left);
+}
+
+// Reverses 16 pixels held in three registers (48 bytes); each output register draws on two or three inputs.
+static void ssse3_reverse16Pixels(const __m128i in[3], __m128i out[3]) {
+    static const signed char masks[5][16] = {
+        { 13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -1 },          // out[0] from in[2]
+        { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14 },  // out[0] from in[1]
+        { 15, -1, 11, 12, 13, 8, 9, 10, 5, 6, 7, 2, 3, 4, -1, 0 },          // out[1] from in[1]
+        { -1, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2 },           // out[2] from in[0]
+        { 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  // out[2] from in[1]
+    };
+    out[0] = _mm_or_si128(_mm_shuffle_epi8(in[2], _mm_loadu_si128((const __m128i *)masks[0])),
+                          _mm_shuffle_epi8(in[1], _mm_loadu_si128((const __m128i *)masks[1])));
+    // out[1] also takes the last byte of in[0] (as byte 14) and the first byte of in[2] (as byte 1).
+    out[1] = _mm_shuffle_epi8(in[1], _mm_loadu_si128((const __m128i *)masks[2]));
+    out[1] = _mm_or_si128(out[1], _mm_slli_si128(_mm_srli_si128(in[0], 15), 14));
+    out[1] = _mm_or_si128(out[1], _mm_slli_si128(_mm_and_si128(in[2], _mm_cvtsi32_si128(0xFF)), 1));
+    out[2] = _mm_or_si128(_mm_shuffle_epi8(in[0], _mm_loadu_si128((const __m128i *)masks[3])),
+                          _mm_shuffle_epi8(in[1], _mm_loadu_si128((const __m128i *)masks[4])));
+}
+
+// As ssse3_reverse8 on blocks of 16 pixels.
+static void ssse3_reverse24(unsigned char *row, size_t n) {
+    size_t left = 0, right = n * 3;
+    for (; left + 96 <= right; left += 48, right -= 48) {
+        __m128i a[3], b[3], ra[3], rb[3];
+        for (int i = 0; i < 3; ++i) {
+            a[i] = _mm_loadu_si128((const __m128i *)(row + left + 16 * i));
+            b[i] = _mm_loadu_si128((const __m128i *)(row + right - 48 + 16 * i));
+        }
+        ssse3_reverse16Pixels(a, ra);
+        ssse3_reverse16Pixels(b, rb);
+        for (int i = 0; i < 3; ++i) {
+            _mm_storeu_si128((__m128i *)(row + left + 16 * i), rb[i]);
+            _mm_storeu_si128((__m128i *)(row + right - 48 + 16 * i), ra[i]);
+        }
+    }
+    scalar_reverse24(row + left, (right - left) / 3);
+}
+
+void cpu_fillSsse3(t_cpu_kernels *k) {
+    k->grayscale24 = ssse3_grayscale24;
+    k->pyramidH24 = ssse3_pyramidH24;
+    k->transposeTile24 = ssse3_transposeTile24;
+    k->reverse8 = ssse3_reverse8;
+    k->reverse24 = ssse3_reverse24;
+}
@@ -0,0 +1,315 @@
+// thread_pool.c
+// Work-stealing pool shared by every parallel operation.
+// Deques are small mutex-protected rings: tasks are coarse (bands of rows, chunks of hundreds of KB), so the lock is
+// not contended enough to justify a lock-free deque.
+#include "thread_pool.h"
+#include "instrument.h"
+#include "trace.h"
+#include "tune.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define POOL_MAX_THREADS 256
+#define POOL_INITIAL_TASKS 64
+
+// Defines the chunks of one pool_parallelFor call still to finish.
+typedef struct {
+    atomic_size_t pending;
+} t_pool_group;
+
+typedef struct {
+    t_pool_body body;
+    size_t begin;
+    size_t end;
+    void *userData;
+    t_pool_group *group;
+} t_pool_task;
+
+// Ring of tasks. The owner pushes and pops at the bottom (newest), thieves take from the top (oldest).
+typedef struct {
+    pthread_mutex_t lock;
+    t_pool_task *tasks;
+    size_t capacity;
+    size_t top;
+    size_t count;
+} t_pool_deque;
+
+typedef struct {
+    pthread_mutex_t lock;      // start/stop, and the sleeping of workers and waiters
+    pthread_cond_t wake;       // idle workers wait here for new tasks
+    pthread_cond_t done;       // callers wait here for their stolen chunks to finish
+    int workerCount;
+    pthread_t *threads;
+    t_pool_deque *deques;      // one per worker, plus one shared by callers outside the pool (index workerCount)
+    atomic_size_t queued;      // tasks in all deques
+    int stop;
+    int started;
+} t_pool;
+
+static t_pool g_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                         0, NULL, NULL, 0, 0, 0 };
+static int g_requestedThreads = 0;          // 0: from IMAGE_MOD_THREADS, the tuning cache or the CPU count
+static _Thread_local int t_workerIndex = -1;
+
+
+// ---- Deques ----
+
+static int deque_push(t_pool_deque *d, const t_pool_task *task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->capacity) {
+        size_t capacity = d->capacity ? d->capacity * 2 : POOL_INITIAL_TASKS;
+        t_pool_task *tasks = (t_pool_task *)malloc(capacity * sizeof(t_pool_task));
+        if (!tasks) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < d->count; ++i) tasks[i] = d->tasks[(d->top + i) % d->capacity];
+        free(d->tasks);
+        d->tasks = tasks;
+        d->capacity = capacity;
+        d->top = 0;
+    }
+    d->tasks[(d->top + d->count) % d->capacity] = *task;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+// Takes the newest task, if it belongs to group (any group when group is NULL).
+static int deque_popBottom(t_pool_deque *d, const t_pool_group *group, t_pool_task *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        size_t bottom = (d->top + d->count - 1) % d->capacity;
+        if (!group || d->tasks[bottom].group == group) {
+            *task = d->tasks[bottom];
+            d->count--;
+            found = 1;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+// Takes the oldest task, if it belongs to group (any group when group is NULL).
+static int deque_popTop(t_pool_deque *d, const t_pool_group *group, t_pool_task *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0 && (!group || d->tasks[d->top].group == group)) {
+        *task = d->tasks[d->top];
+        d->top = (d->top + 1) % d->capacity;
+        d->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+
+// ---- Workers ----
+
+// Runs one range of a parallel loop, as a "band" span of the thread that runs it so the trace shows how the work
+// was spread over the workers.
+static void pool_runBody(t_pool_body body, size_t begin, size_t end, void *userData) {
+    if (!trace_active()) {
+        body(begin, end, userData);
+        return;
+    }
+    trace_beginIndexed("band", "task", (long long)begin);
+    body(begin, end, userData);
+    trace_end("band", "task");
+}
+
+static void pool_runTask(const t_pool_task *task) {
+    atomic_fetch_sub(&g_pool.queued, 1);
+    pool_runBody(task->body, task->begin, task->end, task->userData);
+    if (atomic_fetch_sub(&task->group->pending, 1) == 1) {
+        pthread_mutex_lock(&g_pool.lock);
+        pthread_cond_broadcast(&g_pool.done);
+        pthread_mutex_unlock(&g_pool.lock);
+    }
+}
+
+// Own deque first (newest first, keeps the caches warm), then the callers' deque, then the other workers.
+static int pool_findTask(int self, t_pool_task *task) {
+    int count = g_pool.workerCount;
+    if (self >= 0 && deque_popBottom(&g_pool.deques[self], NULL, task)) return 1;
+    if (deque_popTop(&g_pool.deques[count], NULL, task)) return 1;
+    for (int i = 1; i <= count; ++i) {
+        int victim = (self + i) % count;
+        if (victim != self && deque_popTop(&g_pool.deques[victim], NULL, task)) return 1;
+    }
+    return 0;
+}
+
+static void *pool_worker(void *arg) {
+    int self = (int)(size_t)arg;
+    t_workerIndex = self;
+    char name[32];
+    snprintf(name, sizeof(name), "pool worker %d", self);
+    trace_setThreadName(name);
+
+    for (;;) {
+        t_pool_task task;
+        if (pool_findTask(self, &task)) {
+            pool_runTask(&task);
+            continue;
+        }
+        pthread_mutex_lock(&g_pool.lock);
+        while (atomic_load(&g_pool.queued) == 0 && !g_pool.stop) {
+            pthread_cond_wait(&g_pool.wake, &g_pool.lock);
+        }
+        int stop = g_pool.stop;
+        pthread_mutex_unlock(&g_pool.lock);
+        if (stop) break;
+    }
+    t_workerIndex = -1;
+    return NULL;
+}
+
+static int pool_defaultThreads(void) {
+    const char *env = getenv("IMAGE_MOD_THREADS");
+    if (env && atoi(env) > 0) return atoi(env);
+    if (tune_params()->threads > 0) return tune_params()->threads;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// Starts threads - 1 workers. Called with g_pool.lock held.
+static void pool_startLocked(int threads) {
+    if (threads > POOL_MAX_THREADS) threads = POOL_MAX_THREADS;
+    int workers = threads - 1;
+    g_pool.stop = 0;
+    g_pool.workerCount = 0;
+    g_pool.deques = (t_pool_deque *)calloc((size_t)workers + 1, sizeof(t_pool_deque));
+    g_pool.threads = workers > 0 ? (pthread_t *)calloc((size_t)workers, sizeof(pthread_t)) : NULL;
+    if (!g_pool.deques || (workers > 0 && !g_pool.threads)) {
+        instr_error("Error: Failed to allocate the thread pool; running single-threaded.\n");
+        free(g_pool.threads);
+        g_pool.threads = NULL;
+        workers = 0;
+        if (!g_pool.deques) g_pool.deques = (t_pool_deque *)calloc(1, sizeof(t_pool_deque));
+    }
+    for (int i = 0; i <= workers && g_pool.deques; ++i) pthread_mutex_init(&g_pool.deques[i].lock, NULL);
+    // Workers index the deques with workerCount, so it is set before they start and reduced if a start fails.
+    g_pool.workerCount = workers;
+    for (int i = 0; i < workers; ++i) {
+        if (pthread_create(&g_pool.threads[i], NULL, pool_worker, (void *)(size_t)i) != 0) {
+            instr_error("Error: Failed to start pool worker %d; using %d workers.\n", i, i);
+            g_pool.workerCount = i;
+            break;
+        }
+    }
+    g_pool.started = 1;
+}
+
+static void pool_stopLocked(void) {
+    if (!g_pool.started) return;
+    g_pool.stop = 1;
+    pthread_cond_broadcast(&g_pool.wake);
+    int workers = g_pool.workerCount;
+    pthread_mutex_unlock(&g_pool.lock);
+    for (int i = 0; i < workers; ++i) pthread_join(g_pool.threads[i], NULL);
+    pthread_mutex_lock(&g_pool.lock);
+    for (int i = 0; g_pool.deques && i <= workers; ++i) {
+        pthread_mutex_destroy(&g_pool.deques[i].lock);
+        free(g_pool.deques[i].tasks);
+    }
+    free(g_pool.deques);
+    free(g_pool.threads);
+    g_pool.deques = NULL;
+    g_pool.threads = NULL;
+    g_pool.workerCount = 0;
+    g_pool.started = 0;
+}
+
+static void pool_ensureStarted(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    if (!g_pool.started) {
+        pool_startLocked(g_requestedThreads > 0 ? g_requestedThreads : pool_defaultThreads());
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+}
+
+
+// ---- Public interface ----
+
+int pool_threadCount(void) {
+    pool_ensureStarted();
+    return g_pool.workerCount + 1;
+}
+
+int pool_setThreadCount(int threads) {
+    if (threads <= 0) return -1;
+    pthread_mutex_lock(&g_pool.lock);
+    g_requestedThreads = threads;
+    pool_stopLocked();
+    pool_startLocked(threads);
+    int ok = g_pool.workerCount + 1 == (threads > POOL_MAX_THREADS ? POOL_MAX_THREADS : threads);
+    pthread_mutex_unlock(&g_pool.lock);
+    return ok ? 0 : -1;
+}
+
+size_t pool_grain(size_t itemBytes, size_t targetBytes) {
+    if (itemBytes == 0 || itemBytes >= targetBytes) return 1;
+    return targetBytes / itemBytes;
+}
+
+void pool_parallelFor(size_t count, size_t grain, t_pool_body body, void *userData) {
+    if (count == 0 || !body) return;
+    if (grain == 0) grain = 1;
+    pool_ensureStarted();
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks <= 1 || g_pool.workerCount == 0) {
+        pool_runBody(body, 0, count, userData);
+        return;
+    }
+
+    int self = t_workerIndex;
+    t_pool_deque *deque = &g_pool.deques[self >= 0 ? self : g_pool.workerCount];
+    t_pool_group group;
+    atomic_init(&group.pending, chunks);
+
+    // The first chunk is kept for the calling thread; the others are offered to the pool.
+    size_t pushed = 0;
+    for (size_t c = 1; c < chunks; ++c) {
+        t_pool_task task = { body, c * grain, c + 1 == chunks ? count : (c + 1) * grain, userData, &group };
+        atomic_fetch_add(&g_pool.queued, 1);
+        if (deque_push(deque, &task) != 0) {
+            // No memory for the deque: run the chunk here instead.
+            atomic_fetch_sub(&g_pool.queued, 1);
+            pool_runBody(body, task.begin, task.end, userData);
+            atomic_fetch_sub(&group.pending, 1);
+            continue;
+        }
+        pushed++;
+    }
+    if (pushed > 0) {
+        pthread_mutex_lock(&g_pool.lock);
+        pthread_cond_broadcast(&g_pool.wake);
+        pthread_mutex_unlock(&g_pool.lock);
+    }
+
+    pool_runBody(body, 0, grain, userData);
+    atomic_fetch_sub(&group.pending, 1);
+
+    // Help with this call's own chunks until none is left to take, then wait for the stolen ones.
+    // Only tasks of this group are taken, so a waiting thread never starts unrelated long work.
+    t_pool_task task;
+    while (atomic_load(&group.pending) > 0) {
+        int found = self >= 0 ? deque_popBottom(deque, &group, &task) : deque_popTop(deque, &group, &task);
+        if (found) {
+            pool_runTask(&task);
+            continue;
+        }
+        pthread_mutex_lock(&g_pool.lock);
+        while (atomic_load(&group.pending) > 0) {
+            pthread_cond_wait(&g_pool.done, &g_pool.lock);
+        }
+        pthread_mutex_unlock(&g_pool.lock);
+    }
+}
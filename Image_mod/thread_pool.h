@@ -0,0 +1,31 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+// Rows per task of the convolution filters and bytes per task of the point ops, unless tuned otherwise (tune.h).
+#define POOL_DEFAULT_BAND_ROWS 16
+#define POOL_DEFAULT_CHUNK_BYTES (256 * 1024)
+
+// Defines the work of one task: the items [begin, end) of a pool_parallelFor range.
+typedef void (*t_pool_body)(size_t begin, size_t end, void *userData);
+
+// Function pool_parallelFor is needed to run body over [0, count) in chunks of about grain items on the process-wide
+// pool. The calling thread takes part and the call returns when every chunk has run.
+// Each worker owns a deque: it pushes and pops its own tasks at one end while idle workers steal from the other.
+// A task may call pool_parallelFor again (a batch job running a parallel filter): the nested chunks go to the
+// worker's own deque and the worker runs them itself while it waits, so nesting never adds threads.
+void pool_parallelFor(size_t count, size_t grain, t_pool_body body, void *userData);
+
+// Function pool_threadCount returns the number of threads that run tasks (the workers plus the caller).
+// The default is IMAGE_MOD_THREADS, else the tuned count of this machine (tune.h), else the number of online CPUs.
+int pool_threadCount(void);
+
+// Function pool_setThreadCount is needed to resize the pool; it must not be called while a parallel op is running.
+// Returns -1 if threads is not positive or the workers cannot be started (the pool then runs everything inline).
+int pool_setThreadCount(int threads);
+
+// Function pool_grain returns how many items of size itemBytes make one task of about targetBytes (at least 1).
+size_t pool_grain(size_t itemBytes, size_t targetBytes);
+
+#endif // THREAD_POOL_H
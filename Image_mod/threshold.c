@@ -0,0 +1,256 @@
+// threshold.c
+// Local (adaptive) thresholds. Each pool task takes a band of rows and keeps, for every column, the sum and the sum of
+// squares of the window rows around the current row; moving down one row adds the entering row and subtracts the
+// leaving one. Prefix sums of those column sums form the current row of a summed-area table, from which every window
+// sum is two reads. The window size only changes the start of a band (the first window rows are summed once), so
+// bands are made at least THRESHOLD_BAND_WINDOWS windows tall.
+// The global thresholds of bmp8_autoThreshold only need the 256 histogram bins, so their selection costs the same
+// for any image size.
+// The running column sums are 32-bit, as are the prefix sums of values (a window sum always fits, so the wrap cancels
+// in the difference); the prefix sums of squares are 64-bit. For windows up to THRESHOLD_MAX_WINDOW every window
+// statistic, and count times the sum of squares, is an integer below 2^53, so the double arithmetic of the per-pixel
+// test starts from exact values.
+#include "threshold.h"
+#include "cpu_dispatch.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include "tune.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define THRESHOLD_BAND_WINDOWS 4
+#define THRESHOLD_SAUVOLA_RANGE 128.0   // dynamic range R of the standard deviation in Sauvola's formula
+
+// Defines one adaptive threshold; src is a copy of the image, dst the image data (both bottom-up, which does not
+// matter for a symmetric window).
+typedef struct {
+    const unsigned char *src;
+    unsigned char *dst;
+    size_t width;
+    size_t height;
+    size_t radius;
+    t_threshold_method method;
+    double k;
+    atomic_int failed;
+} t_threshold_job;
+
+// Adds the entering row to the running column sums and subtracts the leaving one (either may be NULL).
+static void threshold_columns(const unsigned char *enter, const unsigned char *leave, size_t width, uint32_t *sums,
+                              uint32_t *squares) {
+    if (enter && leave) {
+        for (size_t x = 0; x < width; ++x) {
+            sums[x] += (uint32_t)enter[x] - leave[x];
+            squares[x] += (uint32_t)enter[x] * enter[x] - (uint32_t)leave[x] * leave[x];
+        }
+    } else if (enter) {
+        for (size_t x = 0; x < width; ++x) {
+            sums[x] += enter[x];
+            squares[x] += (uint32_t)enter[x] * enter[x];
+        }
+    } else if (leave) {
+        for (size_t x = 0; x < width; ++x) {
+            sums[x] -= leave[x];
+            squares[x] -= (uint32_t)leave[x] * leave[x];
+        }
+    }
+}
+
+// Binarizes n pixels whose windows all hold count pixels, from the prefix sums of their first window column on. With
+// sum S and D = count^2 * variance (both exact), p >= m + k s becomes p count - S >= k sqrt(D) (Niblack) and
+// p >= m (1 + k (s / R - 1)) becomes count (p count - S (1 - k)) >= (k / R) S sqrt(D) (Sauvola): both are the
+// a >= b sqrt(D) of the localThreshold kernel, which needs no division or root per pixel.
+static void threshold_span(const t_threshold_job *job, const unsigned char *src, size_t n, size_t count,
+                           const uint32_t *sums, const uint64_t *squares, size_t window, unsigned char *dst) {
+    int sauvola = job->method == THRESHOLD_SAUVOLA;
+    double k = job->k;
+    t_cpu_threshold params = {
+        (double)count, sauvola ? (double)count : 1.0, sauvola ? 1.0 - k : 1.0, sauvola ? 0.0 : k,
+        sauvola ? k / THRESHOLD_SAUVOLA_RANGE : 0.0, k >= 0.0
+    };
+    cpu_kernels()->localThreshold(src, n, sums, squares, window, &params, dst);
+}
+
+// Binarizes one row from the prefix sums of its window rows (rows of them, clipped at the image borders). The
+// columns within radius of a border have narrower windows and are done one by one.
+static void threshold_row(const t_threshold_job *job, const unsigned char *src, size_t rows, const uint32_t *sums,
+                          const uint64_t *squares, unsigned char *dst) {
+    size_t width = job->width, radius = job->radius, window = 2 * radius + 1;
+    size_t inner0 = radius < width ? radius : width, inner1 = width > radius ? width - radius : 0;
+    if (inner1 < inner0) inner1 = inner0;
+    for (size_t x = 0; x < width; ++x) {
+        if (x == inner0 && inner1 > inner0) {
+            threshold_span(job, src + x, inner1 - x, window * rows, sums, squares, window, dst + x);
+            x = inner1 - 1;
+            continue;
+        }
+        size_t left = x > radius ? x - radius : 0, right = x + radius + 1 < width ? x + radius + 1 : width;
+        threshold_span(job, src + x, 1, (right - left) * rows, sums + left, squares + left, right - left, dst + x);
+    }
+}
+
+static void threshold_band(size_t begin, size_t end, void *userData) {
+    t_threshold_job *job = (t_threshold_job *)userData;
+    size_t width = job->width, height = job->height, radius = job->radius;
+    uint32_t *columns = (uint32_t *)calloc(3 * width + 1, sizeof(uint32_t));
+    uint64_t *squares = (uint64_t *)malloc((width + 1) * sizeof(uint64_t));
+    if (!columns || !squares) {
+        atomic_store(&job->failed, 1);
+        free(columns);
+        free(squares);
+        return;
+    }
+    uint32_t *columnSums = columns, *columnSquares = columns + width, *sums = columns + 2 * width;
+    size_t top = begin > radius ? begin - radius : 0;
+    size_t bottom = begin + radius + 1 < height ? begin + radius + 1 : height;   // window rows are [top, bottom)
+    for (size_t y = top; y < bottom; ++y) {
+        threshold_columns(job->src + y * width, NULL, width, columnSums, columnSquares);
+    }
+    for (size_t y = begin; y < end; ++y) {
+        if (y > begin) {
+            const unsigned char *enter = y + radius < height ? job->src + (y + radius) * width : NULL;
+            const unsigned char *leave = y > radius ? job->src + (y - radius - 1) * width : NULL;
+            threshold_columns(enter, leave, width, columnSums, columnSquares);
+            bottom += enter != NULL;
+            top += leave != NULL;
+        }
+        sums[0] = 0;
+        squares[0] = 0;
+        for (size_t x = 0; x < width; ++x) {
+            sums[x + 1] = sums[x] + columnSums[x];
+            squares[x + 1] = squares[x] + columnSquares[x];
+        }
+        threshold_row(job, job->src + y * width, bottom - top, sums, squares, job->dst + y * width);
+    }
+    free(columns);
+    free(squares);
+}
+
+int bmp8_adaptiveThreshold(t_bmp8 *img, t_threshold_method method, int window, double k) {
+    if (!img || !img->data || method < 0 || method >= THRESHOLD_METHOD_COUNT || window < 3 || window % 2 == 0 ||
+        window > THRESHOLD_MAX_WINDOW || !isfinite(k)) {
+        instr_error("Error: Invalid arguments for adaptive threshold (window must be odd, 3 to %d).\n",
+                    THRESHOLD_MAX_WINDOW);
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, method == THRESHOLD_NIBLACK ? "bmp8_niblack" : "bmp8_sauvola");
+    size_t dataSize = img->dataSize;
+    unsigned char *copy = (unsigned char *)malloc(dataSize);
+    if (!copy) {
+        instr_error("Error: Failed to allocate memory for adaptive threshold.\n");
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_scratchAlloc(dataSize);
+    memcpy(copy, img->data, dataSize);
+    t_threshold_job job = { copy, img->data, img->width, img->height, (size_t)window / 2, method, k, 0 };
+    size_t bandRows = (size_t)tune_params()->bandRows;
+    if (bandRows < THRESHOLD_BAND_WINDOWS * (size_t)window) bandRows = THRESHOLD_BAND_WINDOWS * (size_t)window;
+    pool_parallelFor(img->height, bandRows, threshold_band, &job);
+    int failed = atomic_load(&job.failed);
+    if (failed) {
+        memcpy(img->data, copy, dataSize);
+        instr_error("Error: Failed to allocate memory for adaptive threshold rows.\n");
+    }
+    free(copy);
+    instr_scratchFree(dataSize);
+    instr_end(&span, failed ? 0 : dataSize, failed ? 0 : 3 * (uint64_t)dataSize);
+    if (failed) return -1;
+    instr_info("%s threshold applied with a %dx%d window, k = %g (8-bit).\n",
+               method == THRESHOLD_NIBLACK ? "Niblack" : "Sauvola", window, window, k);
+    return 0;
+}
+
+// Otsu: the split after level k maximizes the between-class variance n0 n1 (m0 - m1)^2 / N^2, which with the counts
+// n0, n1 and the sum s0 of the dark class (total N and S) is (N s0 - S n0)^2 / (N^2 n0 n1). The constant N^2 is
+// dropped; doubles hold the terms (N s0 reaches 2^72) and the first of equal maxima wins.
+static int threshold_otsu(const uint64_t hist[256], uint64_t total, uint64_t totalSum) {
+    double best = 0.0;
+    int threshold = -1;
+    uint64_t count = 0, sum = 0;
+    for (int level = 0; level < 255; ++level) {
+        count += hist[level];
+        sum += hist[level] * (uint64_t)level;
+        if (count == 0) continue;
+        if (count == total) break;
+        double spread = (double)total * (double)sum - (double)totalSum * (double)count;
+        double variance = spread * spread / ((double)count * (double)(total - count));
+        if (variance > best) {
+            best = variance;
+            threshold = level + 1;
+        }
+    }
+    return threshold;
+}
+
+// Triangle (Zack et al.): the line joins the peak bin to the outer end of the longer tail; the bin of the tail
+// farthest below it ends the class of the peak if the tail is bright (the tail starts after it) and the class of
+// the tail if the tail is dark. The distance is compared unnormalized: height(peak) |level - end| -
+// |peak - end| height(level), exact in 64 bits.
+static int threshold_triangle(const uint64_t hist[256]) {
+    int first = 0, last = 255, peak = 0;
+    while (first < 255 && hist[first] == 0) ++first;
+    while (last > 0 && hist[last] == 0) --last;
+    for (int level = first; level <= last; ++level) {
+        if (hist[level] > hist[peak]) peak = level;
+    }
+    if (first == last) return first;
+    int end = peak - first > last - peak ? first : last;
+    int step = end > peak ? 1 : -1, span = end > peak ? end - peak : peak - end, best = peak;
+    int64_t bestDistance = -1;
+    for (int level = peak + step; level != end + step; level += step) {
+        int64_t distance = (int64_t)hist[peak] * (end > level ? end - level : level - end) -
+                           (int64_t)span * (int64_t)hist[level];
+        if (distance > bestDistance) {
+            bestDistance = distance;
+            best = level;
+        }
+    }
+    return best + 1 > 255 ? 255 : best + 1;
+}
+
+int threshold_select(const uint64_t hist[256], t_threshold_auto method) {
+    if (!hist || method < 0 || method >= THRESHOLD_AUTO_COUNT) return -1;
+    uint64_t total = 0, totalSum = 0;
+    int level = -1;
+    for (int i = 0; i < 256; ++i) {
+        total += hist[i];
+        totalSum += hist[i] * (uint64_t)i;
+        if (hist[i]) level = i;
+    }
+    if (total == 0) return -1;
+    if (method == THRESHOLD_TRIANGLE) return threshold_triangle(hist);
+    int threshold = threshold_otsu(hist, total, totalSum);
+    return threshold < 0 ? level : threshold;   // a single gray level has no split
+}
+
+int bmp8_autoThreshold(t_bmp8 *img, t_threshold_auto method, const uint64_t *hist) {
+    if (!img || !img->data || img->dataSize == 0 || method < 0 || method >= THRESHOLD_AUTO_COUNT) {
+        instr_error("Error: Invalid arguments for automatic threshold.\n");
+        return -1;
+    }
+    t_instr_span span;
+    instr_begin(&span, method == THRESHOLD_OTSU ? "bmp8_otsu" : "bmp8_triangle");
+    uint64_t *computed = NULL;
+    uint64_t reads = hist ? 1 : 2;
+    if (!hist) {
+        computed = bmp8_computeHistogram(img);
+        if (!computed) {
+            instr_end(&span, 0, 0);
+            return -1;
+        }
+        hist = computed;
+    }
+    int threshold = threshold_select(hist, method);
+    free(computed);
+    if (threshold < 0) {
+        instr_error("Error: Empty histogram for automatic threshold.\n");
+        instr_end(&span, 0, 0);
+        return -1;
+    }
+    instr_info("%s threshold selected: %d (8-bit).\n", method == THRESHOLD_OTSU ? "Otsu" : "Triangle", threshold);
+    bmp8_threshold(img, threshold);
+    instr_end(&span, img->dataSize, (reads + 1) * (uint64_t)img->dataSize);
+    return threshold;
+}
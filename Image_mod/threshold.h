@@ -0,0 +1,41 @@
+#ifndef THRESHOLD_H
+#define THRESHOLD_H
+
+#include "bmp8.h"
+
+// Defines the local threshold of bmp8_adaptiveThreshold, from the mean m and standard deviation s of the window
+// around each pixel.
+typedef enum {
+    THRESHOLD_NIBLACK = 0,         // m + k * s (k around -0.2: dark text needs to be below the local mean)
+    THRESHOLD_SAUVOLA,             // m * (1 + k * (s / 128 - 1)) (k around 0.2 to 0.5, robust on flat paper)
+    THRESHOLD_METHOD_COUNT
+} t_threshold_method;
+
+#define THRESHOLD_MAX_WINDOW 511
+
+// Defines how bmp8_autoThreshold picks one global threshold from the histogram.
+typedef enum {
+    THRESHOLD_OTSU = 0,            // maximal between-class variance (two clear peaks)
+    THRESHOLD_TRIANGLE,            // farthest bin below the line from the peak to the end of the longer tail (one peak)
+    THRESHOLD_AUTO_COUNT
+} t_threshold_auto;
+
+// Function bmp8_adaptiveThreshold is needed to binarize an 8-bit image against a threshold computed for every pixel
+// from the window x window pixels around it (clipped at the borders), as unevenly lit scans need: pixels at or above
+// their threshold become 255, the others 0. window must be odd, from 3 to THRESHOLD_MAX_WINDOW. The window sums come
+// from running summed-area rows, so the cost does not depend on the window size.
+// Returns 0, or -1 on invalid arguments or when memory runs out (the image is then unchanged).
+int bmp8_adaptiveThreshold(t_bmp8 *img, t_threshold_method method, int window, double k);
+
+// Function threshold_select is needed to pick the threshold of method from the 256 bins of hist in O(256): levels
+// below it are the dark class. An image of a single gray level gets that level (it becomes all white).
+// Returns the threshold (0 to 255), or -1 if method is invalid or the histogram is empty.
+int threshold_select(const uint64_t hist[256], t_threshold_auto method);
+
+// Function bmp8_autoThreshold is needed to binarize an 8-bit image at the threshold picked by method, as
+// bmp8_threshold would. hist is the histogram of img when the caller already has it (from bmp8_computeHistogram),
+// so the image is read only once more; NULL computes it.
+// Returns the threshold applied, or -1 on invalid arguments or when memory runs out (the image is then unchanged).
+int bmp8_autoThreshold(t_bmp8 *img, t_threshold_auto method, const uint64_t *hist);
+
+#endif // THRESHOLD_H
@@ -0,0 +1,103 @@
+// trace.c
+#include "trace.h"
+#include "instrument.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static pthread_once_t g_traceOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_traceLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *g_traceFile = NULL;
+static volatile int g_traceOn = 0;
+static double g_traceStart = 0.0;
+static int g_traceEvents = 0;
+static int g_nextTid = 0;
+static _Thread_local int t_tid = 0;
+
+static void trace_initFromEnv(void) {
+    const char *path = getenv("IMAGE_MOD_TRACE");
+    if (path != NULL && path[0] != '\0' && trace_start(path) == 0) {
+        atexit(trace_stop);
+    }
+}
+
+int trace_start(const char *path) {
+    if (!path) return -1;
+    // Checked before opening: fopen(path, "w") would truncate the trace being recorded if path is the same file.
+    pthread_mutex_lock(&g_traceLock);
+    if (g_traceFile) {
+        pthread_mutex_unlock(&g_traceLock);
+        instr_error("Error: A trace is already being recorded.\n");
+        return -1;
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        pthread_mutex_unlock(&g_traceLock);
+        instr_error("Error: Cannot open trace file %s for writing.\n", path);
+        return -1;
+    }
+    g_traceFile = f;
+    g_traceStart = instr_now();
+    g_traceEvents = 0;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    g_traceOn = 1;
+    pthread_mutex_unlock(&g_traceLock);
+    return 0;
+}
+
+void trace_stop(void) {
+    pthread_mutex_lock(&g_traceLock);
+    g_traceOn = 0;
+    if (g_traceFile) {
+        fputs("\n]}\n", g_traceFile);
+        fclose(g_traceFile);
+        g_traceFile = NULL;
+    }
+    pthread_mutex_unlock(&g_traceLock);
+}
+
+int trace_active(void) {
+    pthread_once(&g_traceOnce, trace_initFromEnv);
+    return g_traceOn;
+}
+
+// Called with g_traceLock held: writes the separator and the fields every event shares.
+static void trace_writePrefix(char phase, const char *category, const char *name) {
+    if (t_tid == 0) t_tid = ++g_nextTid;
+    double ts = (instr_now() - g_traceStart) * 1e6;
+    fprintf(g_traceFile, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+            g_traceEvents++ ? ",\n" : "", name, category, phase, ts, t_tid);
+}
+
+static void trace_event(char phase, const char *category, const char *name, const long long *index) {
+    if (!trace_active()) return;
+    pthread_mutex_lock(&g_traceLock);
+    if (g_traceFile) {
+        trace_writePrefix(phase, category, name);
+        if (index) fprintf(g_traceFile, ",\"args\":{\"index\":%lld}", *index);
+        fputc('}', g_traceFile);
+    }
+    pthread_mutex_unlock(&g_traceLock);
+}
+
+void trace_begin(const char *category, const char *name) {
+    trace_event('B', category, name, NULL);
+}
+
+void trace_beginIndexed(const char *category, const char *name, long long index) {
+    trace_event('B', category, name, &index);
+}
+
+void trace_end(const char *category, const char *name) {
+    trace_event('E', category, name, NULL);
+}
+
+void trace_setThreadName(const char *name) {
+    if (!trace_active()) return;
+    pthread_mutex_lock(&g_traceLock);
+    if (g_traceFile) {
+        trace_writePrefix('M', "__metadata", "thread_name");
+        fprintf(g_traceFile, ",\"args\":{\"name\":\"%s\"}}", name);
+    }
+    pthread_mutex_unlock(&g_traceLock);
+}
@@ -0,0 +1,25 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Timeline recorder in the Chrome trace_event JSON format (open the file in chrome://tracing or Perfetto).
+// Every instrumented op is recorded automatically (category "op"), and so is every range of a parallel loop run by a
+// pool thread ("band", named "task"); other bands/tiles and I/O calls ("io") are recorded by the code that issues them. Recording can also be started with IMAGE_MOD_TRACE=<path>.
+
+// Function trace_start is needed to open the trace file and start recording. Returns 0 on success.
+int trace_start(const char *path);
+
+// Function trace_stop finishes the JSON document and closes the file.
+void trace_stop(void);
+
+// Function trace_active returns 1 while a trace is being recorded.
+int trace_active(void);
+
+// Spans: each trace_begin must be matched by a trace_end with the same name on the same thread.
+void trace_begin(const char *category, const char *name);
+void trace_beginIndexed(const char *category, const char *name, long long index);
+void trace_end(const char *category, const char *name);
+
+// Function trace_setThreadName labels the calling thread's lane in the viewer.
+void trace_setThreadName(const char *name);
+
+#endif // TRACE_H
@@ -0,0 +1,297 @@
+// tune.c
+// Parameters of the parallel ops, the auto-tuner that measures them, and the per-CPU-model cache that keeps them.
+// Cache format: one line per CPU model, tab-separated: model, online CPUs, threads, band rows, chunk bytes.
+#include "tune.h"
+#include "thread_pool.h"
+#include "cpu_dispatch.h"
+#include "instrument.h"
+#include "bmp8.h"
+#include "bmp24.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TUNE_REPS 5
+#define TUNE_MARGIN 0.97            // a candidate must be 3% faster to replace the current choice
+#define TUNE_GRAY_WIDTH 2048        // test images larger than a typical L2 cache
+#define TUNE_GRAY_HEIGHT 1024
+#define TUNE_COLOR_WIDTH 1024
+#define TUNE_COLOR_HEIGHT 768
+#define TUNE_MODEL_MAX 128
+#define TUNE_LINE_MAX 512
+
+static const int g_bandCandidates[] = { 4, 8, 16, 32, 64, 128 };
+static const size_t g_chunkCandidates[] = { 32 * 1024, 64 * 1024, 128 * 1024, 256 * 1024, 512 * 1024,
+                                            1024 * 1024, 4096 * 1024 };
+
+static pthread_once_t g_loadOnce = PTHREAD_ONCE_INIT;
+static t_tune_params g_params = { 0, POOL_DEFAULT_BAND_ROWS, POOL_DEFAULT_CHUNK_BYTES };
+static _Thread_local char t_cachePath[1024];
+
+
+// ---- Cache ----
+
+static int tune_onlineCpus(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+const char *tune_cachePath(void) {
+    const char *file = getenv("IMAGE_MOD_TUNE_FILE");
+    if (file && file[0] != '\0') return file;
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && xdg[0] != '\0') {
+        snprintf(t_cachePath, sizeof(t_cachePath), "%s/imagemod/tune.conf", xdg);
+    } else if (home && home[0] != '\0') {
+        snprintf(t_cachePath, sizeof(t_cachePath), "%s/.cache/imagemod/tune.conf", home);
+    } else {
+        return NULL;
+    }
+    return t_cachePath;
+}
+
+// Splits a cache line into its model and values. Returns -1 for comments and malformed lines.
+static int tune_parseLine(char *line, const char **model, int *cpus, t_tune_params *params) {
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\0') return -1;
+    char *tab = strchr(line, '\t');
+    if (!tab) return -1;
+    *tab = '\0';
+    *model = line;
+    unsigned long chunkBytes = 0;
+    if (sscanf(tab + 1, "%d\t%d\t%d\t%lu", cpus, &params->threads, &params->bandRows, &chunkBytes) != 4) return -1;
+    params->chunkBytes = (size_t)chunkBytes;
+    if (*cpus <= 0 || params->threads < 0 || params->bandRows < 1 || params->chunkBytes < 1024) return -1;
+    return 0;
+}
+
+int tune_load(const char *path, t_tune_params *params) {
+    if (!path || !params) return -1;
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char model[TUNE_MODEL_MAX];
+    cpu_modelName(model, sizeof(model));
+
+    char line[TUNE_LINE_MAX];
+    int found = -1;
+    while (fgets(line, sizeof(line), f)) {
+        const char *lineModel;
+        int cpus;
+        t_tune_params entry;
+        if (tune_parseLine(line, &lineModel, &cpus, &entry) != 0 || strcmp(lineModel, model) != 0) continue;
+        // The same model with another CPU count (a smaller VM, cores taken offline) keeps its own default.
+        if (cpus != tune_onlineCpus()) entry.threads = 0;
+        *params = entry;
+        found = 0;
+    }
+    fclose(f);
+    return found;
+}
+
+// Creates the missing directories of path, like mkdir -p on its dirname.
+static void tune_makeParents(const char *path) {
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *p = dir + 1; *p; ++p) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(dir, 0755);
+        *p = '/';
+    }
+}
+
+int tune_save(const char *path, const t_tune_params *params) {
+    if (!path || !params) return -1;
+    char model[TUNE_MODEL_MAX];
+    cpu_modelName(model, sizeof(model));
+    tune_makeParents(path);
+
+    // The new file is written next to the old one and renamed over it, so readers never see half a file.
+    char tmpPath[1100];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp.%ld", path, (long)getpid());
+    FILE *out = fopen(tmpPath, "w");
+    if (!out) {
+        instr_error("Error: Cannot write tuning cache %s (%s).\n", tmpPath, strerror(errno));
+        return -1;
+    }
+    fprintf(out, "# libimagemod tuning cache: cpu model, online cpus, threads, band rows, chunk bytes\n");
+    FILE *in = fopen(path, "r");
+    if (in) {
+        char line[TUNE_LINE_MAX], copy[TUNE_LINE_MAX];
+        while (fgets(line, sizeof(line), in)) {
+            const char *lineModel;
+            int cpus;
+            t_tune_params entry;
+            memcpy(copy, line, sizeof(line));
+            if (tune_parseLine(copy, &lineModel, &cpus, &entry) != 0 || strcmp(lineModel, model) == 0) continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s\t%d\t%d\t%d\t%lu\n", model, tune_onlineCpus(), params->threads, params->bandRows,
+            (unsigned long)params->chunkBytes);
+    if (fclose(out) != 0 || rename(tmpPath, path) != 0) {
+        instr_error("Error: Cannot write tuning cache %s (%s).\n", path, strerror(errno));
+        remove(tmpPath);
+        return -1;
+    }
+    return 0;
+}
+
+static void tune_loadCache(void) {
+    const char *mode = getenv("IMAGE_MOD_TUNE");
+    if (mode && strcmp(mode, "off") == 0) return;
+    t_tune_params cached;
+    if (tune_load(tune_cachePath(), &cached) == 0) g_params = cached;
+}
+
+const t_tune_params *tune_params(void) {
+    pthread_once(&g_loadOnce, tune_loadCache);
+    return &g_params;
+}
+
+void tune_setParams(const t_tune_params *params) {
+    if (!params) return;
+    pthread_once(&g_loadOnce, tune_loadCache);
+    g_params = *params;
+    if (g_params.bandRows < 1) g_params.bandRows = POOL_DEFAULT_BAND_ROWS;
+    if (g_params.chunkBytes < 1024) g_params.chunkBytes = POOL_DEFAULT_CHUNK_BYTES;
+    if (g_params.threads > 0) pool_setThreadCount(g_params.threads);
+}
+
+
+// ---- Measurement ----
+
+typedef struct {
+    t_bmp8 *gray;
+    t_bmp24 *color;
+} t_tune_images;
+
+typedef enum { TUNE_FILTERS, TUNE_POINT_OPS, TUNE_ALL } t_tune_workload;
+
+static void tune_runWorkload(const t_tune_images *images, t_tune_workload workload) {
+    if (workload != TUNE_POINT_OPS) {
+        bmp8_gaussianBlur(images->gray);
+        bmp24_gaussianBlur(images->color);
+    }
+    if (workload != TUNE_FILTERS) {
+        bmp8_negative(images->gray);
+        bmp24_negative(images->color);
+        free(bmp8_computeHistogram(images->gray));
+    }
+}
+
+// Median seconds of TUNE_REPS runs after one warm-up run. The progress messages of the ops are muted meanwhile.
+static double tune_measure(const t_tune_images *images, t_tune_workload workload) {
+    double times[TUNE_REPS];
+    t_instr_console console = instr_getConsole();
+    if (console == INSTR_CONSOLE_ALL) instr_setConsole(INSTR_CONSOLE_ERRORS);
+    tune_runWorkload(images, workload);
+    for (int r = 0; r < TUNE_REPS; ++r) {
+        double start = instr_now();
+        tune_runWorkload(images, workload);
+        double t = instr_now() - start;
+        int i = r;
+        while (i > 0 && times[i - 1] > t) { times[i] = times[i - 1]; --i; }
+        times[i] = t;
+    }
+    instr_setConsole(console);
+    return times[TUNE_REPS / 2];
+}
+
+static int tune_makeImages(t_tune_images *images) {
+    images->gray = bmp8_allocate(TUNE_GRAY_WIDTH, TUNE_GRAY_HEIGHT);
+    images->color = bmp24_allocate(TUNE_COLOR_WIDTH, TUNE_COLOR_HEIGHT, 24);
+    if (!images->gray || !images->color) {
+        bmp8_free(images->gray);
+        bmp24_free(images->color);
+        return -1;
+    }
+    for (size_t i = 0; i < images->gray->dataSize; ++i) images->gray->data[i] = (unsigned char)(i * 7 + i / 4093);
+    for (int y = 0; y < TUNE_COLOR_HEIGHT; ++y) {
+        for (int x = 0; x < TUNE_COLOR_WIDTH; ++x) {
+            t_pixel *p = &images->color->data[y][x];
+            p->red = (uint8_t)(x + y);
+            p->green = (uint8_t)(x * 3);
+            p->blue = (uint8_t)(y * 5 + x);
+        }
+    }
+    return 0;
+}
+
+// Picks the band height of the filters, then the chunk size of the point ops, starting from the defaults so that
+// noise does not move them.
+static void tune_taskSizes(const t_tune_images *images, t_tune_params *best) {
+    t_tune_params trial = *best;
+    tune_setParams(&trial);
+    double bestTime = tune_measure(images, TUNE_FILTERS);
+    for (size_t i = 0; i < sizeof(g_bandCandidates) / sizeof(g_bandCandidates[0]); ++i) {
+        if (g_bandCandidates[i] == POOL_DEFAULT_BAND_ROWS) continue;
+        trial = *best;
+        trial.bandRows = g_bandCandidates[i];
+        tune_setParams(&trial);
+        double t = tune_measure(images, TUNE_FILTERS);
+        instr_info("Auto-tune: %d rows per band: %.2f ms\n", trial.bandRows, t * 1e3);
+        if (t < bestTime * TUNE_MARGIN) {
+            best->bandRows = trial.bandRows;
+            bestTime = t;
+        }
+    }
+
+    trial = *best;
+    tune_setParams(&trial);
+    bestTime = tune_measure(images, TUNE_POINT_OPS);
+    for (size_t i = 0; i < sizeof(g_chunkCandidates) / sizeof(g_chunkCandidates[0]); ++i) {
+        if (g_chunkCandidates[i] == POOL_DEFAULT_CHUNK_BYTES) continue;
+        trial = *best;
+        trial.chunkBytes = g_chunkCandidates[i];
+        tune_setParams(&trial);
+        double t = tune_measure(images, TUNE_POINT_OPS);
+        instr_info("Auto-tune: %zu KB per chunk: %.2f ms\n", trial.chunkBytes / 1024, t * 1e3);
+        if (t < bestTime * TUNE_MARGIN) {
+            best->chunkBytes = trial.chunkBytes;
+            bestTime = t;
+        }
+    }
+}
+
+int tune_run(t_tune_params *result) {
+    t_tune_images images;
+    if (tune_makeImages(&images) != 0) {
+        instr_error("Error: Failed to allocate the auto-tune test images.\n");
+        return -1;
+    }
+    t_tune_params best = { 0, POOL_DEFAULT_BAND_ROWS, POOL_DEFAULT_CHUNK_BYTES };
+    t_tune_params trial;
+
+    // Thread counts: powers of two up to the CPU count, and the CPU count itself.
+    int cpus = tune_onlineCpus();
+    double bestTime = 0.0;
+    for (int threads = 1; ; threads = threads * 2 < cpus ? threads * 2 : cpus) {
+        trial = best;
+        trial.threads = threads;
+        tune_setParams(&trial);
+        double t = tune_measure(&images, TUNE_ALL);
+        instr_info("Auto-tune: %d threads: %.2f ms\n", threads, t * 1e3);
+        if (threads == 1 || t < bestTime * TUNE_MARGIN) {
+            best.threads = threads;
+            bestTime = t;
+        }
+        if (threads == cpus) break;
+    }
+
+    // With a single thread every op runs inline and the task sizes have no effect.
+    if (best.threads > 1) tune_taskSizes(&images, &best);
+
+    tune_setParams(&best);
+    bmp8_free(images.gray);
+    bmp24_free(images.color);
+    if (result) *result = best;
+    instr_info("Auto-tune: %d threads, %d rows per band, %zu KB per chunk.\n", best.threads, best.bandRows,
+               best.chunkBytes / 1024);
+    return 0;
+}
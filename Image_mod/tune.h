@@ -0,0 +1,39 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stddef.h>
+
+// Defines how the parallel ops split their work. The defaults suit most machines; tune_run measures better ones.
+typedef struct {
+    int threads;          // pool threads; 0 keeps the pool default (IMAGE_MOD_THREADS or the CPU count)
+    int bandRows;         // rows per task of the convolution filters
+    size_t chunkBytes;    // bytes per task of the point ops, histograms and equalize passes
+} t_tune_params;
+
+// Function tune_params returns the active parameters. The first call loads the entry of this CPU model from the
+// tuning cache (tune_cachePath), so a tuned machine starts with its measured values without re-tuning.
+// IMAGE_MOD_TUNE=off skips the cache and keeps the defaults.
+const t_tune_params *tune_params(void);
+
+// Function tune_setParams is needed to switch parameters (and resize the pool if threads > 0). Like
+// pool_setThreadCount it must not be called while a parallel op is running.
+void tune_setParams(const t_tune_params *params);
+
+// Function tune_run is needed to microbenchmark the convolution and point-op kernels on synthetic images and pick
+// the fastest thread count, band height and chunk size, in that order. The chosen parameters are applied and
+// stored in result. Takes a few seconds. Returns -1 if the test images cannot be allocated.
+int tune_run(t_tune_params *result);
+
+// Function tune_cachePath returns the tuning cache: IMAGE_MOD_TUNE_FILE, else $XDG_CACHE_HOME/imagemod/tune.conf,
+// else $HOME/.cache/imagemod/tune.conf (NULL if none of these is set).
+const char *tune_cachePath(void);
+
+// Function tune_load is needed to read the entry of this CPU model from path. The thread count is only taken if the
+// entry was measured with the same number of online CPUs. Returns -1 if the file has no entry for this CPU.
+int tune_load(const char *path, t_tune_params *params);
+
+// Function tune_save is needed to write params as the entry of this CPU model, keeping the entries of other
+// models (a cache in a shared home directory serves several machines). Returns -1 on I/O errors.
+int tune_save(const char *path, const t_tune_params *params);
+
+#endif // TUNE_H
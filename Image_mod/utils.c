@@ -1,41 +1,62 @@
 // utils.c
 #include "utils.h"
+#include "instrument.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h> // For memcpy if used, or other string functions. It was present in original.
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
 
 // [Part 2.4.1 Implementation] Reads raw data using fseek and fread. Basic error check.
-void file_rawRead(uint32_t position, void *buffer, uint32_t size, size_t n, FILE *file) {
+void file_rawRead(uint64_t position, void *buffer, size_t size, size_t n, FILE *file) {
     if (!file || !buffer) return;
-    if (fseek(file, position, SEEK_SET) != 0) {
-        printf("Error: fseek failed to position %u.\n", position);
+    if (file_seek64(file, position) != 0) {
+        instr_error("Error: fseek failed to position %" PRIu64 ".\n", position);
         return;
     }
-    if (fread(buffer, size, n, file) != n) {
-        printf("Error: fread failed to read %zu elements of size %u at position %u.\n", n, size, position);
+    t_instr_span span;
+    instr_begin(&span, "file_rawRead");
+    size_t got = fread(buffer, size, n, file);
+    instr_end(&span, 0, (uint64_t)got * size);
+    if (got != n) {
+        instr_error("Error: fread failed to read %zu elements of size %zu at position %" PRIu64 ".\n", n, size, position);
         if (ferror(file)) {
-            perror("fread error");
+            instr_error("fread error: %s\n", strerror(errno));
         } else if (feof(file)) {
-            printf("fread error: unexpected end of file.\n");
+            instr_error("fread error: unexpected end of file.\n");
         }
     }
 }
 
 // [Part 2.4.1 Implementation] Writes raw data using fseek and fwrite.
-void file_rawWrite(uint32_t position, void *buffer, uint32_t size, size_t n, FILE *file) {
+void file_rawWrite(uint64_t position, void *buffer, size_t size, size_t n, FILE *file) {
     if (!file || !buffer) return;
-    if (fseek(file, position, SEEK_SET) != 0) {
-        printf("Error: fseek failed to position %u for writing.\n", position);
+    if (file_seek64(file, position) != 0) {
+        instr_error("Error: fseek failed to position %" PRIu64 " for writing.\n", position);
         return;
     }
-    if (fwrite(buffer, size, n, file) != n) {
-        printf("Error: fwrite failed to write %zu elements of size %u at position %u.\n", n, size, position);
+    t_instr_span span;
+    instr_begin(&span, "file_rawWrite");
+    size_t put = fwrite(buffer, size, n, file);
+    instr_end(&span, 0, (uint64_t)put * size);
+    if (put != n) {
+        instr_error("Error: fwrite failed to write %zu elements of size %zu at position %" PRIu64 ".\n", n, size, position);
         if (ferror(file)) {
-            perror("fwrite error");
+            instr_error("fwrite error: %s\n", strerror(errno));
         }
     }
 }
 
+int file_seek64(FILE *file, uint64_t position) {
+    if (!file || position > (uint64_t)INT64_MAX) return -1;
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)position, SEEK_SET);
+#else
+    return fseeko(file, (off_t)position, SEEK_SET);
+#endif
+}
+
 float** allocate_kernel(int size) {
     if (size <= 0) return NULL;
     float **kernel = (float **)malloc(size * sizeof(float *));
@@ -48,6 +69,7 @@ float** allocate_kernel(int size) {
     for (int i = 1; i < size; ++i) {
         kernel[i] = kernel[0] + i * size;
     }
+    instr_scratchAlloc((size_t)size * (sizeof(float *) + size * sizeof(float)));
     return kernel;
 }
 
@@ -55,8 +77,8 @@ void free_kernel(float **kernel, int size) {
     if (kernel) {
         if (kernel[0]) free(kernel[0]);
         free(kernel);
+        instr_scratchFree((size_t)size * (sizeof(float *) + size * sizeof(float)));
     }
-    (void)size;
 }
 
 // [Part 3.4.1 Implementation] Converts RGB to YUV using formula 3.3.
@@ -98,7 +120,88 @@ t_pixel yuv_to_rgb(t_yuv yuv) {
     return rgb;
 }
 
-int calculate_row_stride(int width) {
-    int bytes_per_row = width * 3; // For 24-bit BMP
-    return (bytes_per_row + 3) & ~3;
+size_t calculate_row_stride(int width) {
+    if (width <= 0) return 0;
+    size_t bytes_per_row = (size_t)width * 3; // For 24-bit BMP
+    return (bytes_per_row + 3) & ~(size_t)3;
+}
+
+int checked_mul_size(size_t a, size_t b, size_t *result) {
+    if (a != 0 && b > SIZE_MAX / a) return -1;
+    *result = a * b;
+    return 0;
+}
+static int has_bmp_extension(const char *name) {
+    size_t len = strlen(name);
+    if (len < 4) return 0;
+    const char *ext = name + len - 4;
+    return ext[0] == '.' && (ext[1] == 'b' || ext[1] == 'B') && (ext[2] == 'm' || ext[2] == 'M') && (ext[3] == 'p' || ext[3] == 'P');
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+char **list_bmp_files(const char *directory, int *count) {
+    if (!directory || !count) return NULL;
+    *count = 0;
+
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        instr_error("Error: Cannot open directory %s\n", directory);
+        return NULL;
+    }
+
+    t_instr_span span;
+    instr_begin(&span, "list_bmp_files");
+    int capacity = 16;
+    char **files = (char **)malloc(capacity * sizeof(char *));
+    if (!files) {
+        instr_error("Error: Failed to allocate memory for file list.\n");
+        closedir(dir);
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+
+    struct dirent *entry;
+    int outOfMemory = 0;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!has_bmp_extension(entry->d_name)) continue;
+        if (*count == capacity) {
+            char **grown = (char **)realloc(files, 2 * capacity * sizeof(char *));
+            if (!grown) {
+                outOfMemory = 1;
+                break;
+            }
+            files = grown;
+            capacity *= 2;
+        }
+        size_t len = strlen(directory) + strlen(entry->d_name) + 2;
+        char *path = (char *)malloc(len);
+        if (!path) {
+            outOfMemory = 1;
+            break;
+        }
+        snprintf(path, len, "%s/%s", directory, entry->d_name);
+        files[(*count)++] = path;
+    }
+    closedir(dir);
+    // A partial list would make a batch skip files without an error.
+    if (outOfMemory) {
+        instr_error("Error: Failed to allocate memory for file list.\n");
+        free_file_list(files, *count);
+        *count = 0;
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+
+    qsort(files, *count, sizeof(char *), compare_paths);
+    instr_end(&span, 0, 0);
+    return files;
+}
+
+void free_file_list(char **files, int count) {
+    if (!files) return;
+    for (int i = 0; i < count; ++i) free(files[i]);
+    free(files);
 }
\ No newline at end of file
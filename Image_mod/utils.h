@@ -3,12 +3,15 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "bmp24.h"
 
 // [Part 2.4.1 step 1] Function file_rawRead Reads raw bytes from a specific file position.
-void file_rawRead(uint32_t position, void *buffer, uint32_t size, size_t n, FILE *file);
+void file_rawRead(uint64_t position, void *buffer, size_t size, size_t n, FILE *file);
 // [Part 2.4.1 step 2] Function file_rawWrite Writes raw bytes to a specific file position.
-void file_rawWrite(uint32_t position, void *buffer, uint32_t size, size_t n, FILE *file);
+void file_rawWrite(uint64_t position, void *buffer, size_t size, size_t n, FILE *file);
+// Function file_seek64 moves to an absolute 64-bit file position (files larger than 2 GB). Returns 0 on success.
+int file_seek64(FILE *file, uint64_t position);
 
 float** allocate_kernel(int size);
 void free_kernel(float **kernel, int size);
@@ -26,7 +29,14 @@ t_yuv rgb_to_yuv(t_pixel rgb);
 t_pixel yuv_to_rgb(t_yuv yuv);
 
 uint8_t clamp_u8(double value);
-int calculate_row_stride(int width);
+size_t calculate_row_stride(int width);
+
+// Function checked_mul_size multiplies two sizes into *result. Returns -1 instead of wrapping around on overflow.
+int checked_mul_size(size_t a, size_t b, size_t *result);
+
+// Function list_bmp_files returns the sorted paths of the .bmp files in a directory (count receives how many).
+char **list_bmp_files(const char *directory, int *count);
+void free_file_list(char **files, int count);
 
 
 #endif // UTILS_H
\ No newline at end of file
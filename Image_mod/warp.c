@@ -0,0 +1,312 @@
+// warp.c
+// Affine and perspective warps. Source coordinates are computed exactly (in double) only at a few points of each span
+// of WARP_SPAN output pixels and then stepped in fixed point: for an affine matrix the step is the matrix column
+// itself, for a perspective one it is the parabola through the exact coordinates at the start, middle and end of the
+// span, stepped by forward differences (three divisions per span instead of one per pixel, and well under a 1/256
+// pixel weight step away from the true curve for any keystone a document scan needs). Bilinear weights are the top 8
+// fraction bits. Tasks of the shared pool take WARP_TILE x WARP_TILE output tiles, whose source footprint stays in
+// cache for any rotation.
+#include "warp.h"
+#include "instrument.h"
+#include "thread_pool.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WARP_BITS 16               // fraction bits of a sample position
+#define WARP_ONE ((int64_t)1 << WARP_BITS)
+#define WARP_STEP_BITS 32          // fraction bits of the stepped positions, so that the tiny curvature term survives
+#define WARP_SPAN 16               // output pixels between exactly computed coordinates
+#define WARP_TILE 64               // output pixels per side of a task (a multiple of WARP_SPAN)
+#define WARP_RANGE 1e7             // coordinates and steps are clamped to +-this many pixels before fixed point
+#define WARP_MIN_DEPTH 1e-9        // perspective divisors below this are points behind the camera (filled)
+
+// Defines one warp; rows are given as pointer arrays in display order so that 8-bit and 24-bit images share the code.
+typedef struct {
+    unsigned char *const *src;
+    unsigned char *const *dst;
+    int64_t srcWidth;
+    int64_t srcHeight;
+    size_t dstWidth;
+    size_t dstHeight;
+    int channels;
+    int perspective;
+    double m[9];
+    unsigned char fill[3];
+} t_warp_job;
+
+static int64_t warp_fixed(double value, int bits) {
+    if (value > WARP_RANGE) value = WARP_RANGE;
+    if (value < -WARP_RANGE) value = -WARP_RANGE;
+    value *= (double)((int64_t)1 << bits);
+    // Rounds half away from zero without a libm call; this runs six times per span.
+    return (int64_t)(value < 0.0 ? value - 0.5 : value + 0.5);
+}
+
+// Blends the four taps around (fx, fy) (non-negative fixed point, all taps inside the source) into out. Callers pass
+// channels as a constant so that the inner loops unroll.
+static inline void warp_blend(const t_warp_job *job, int64_t fx, int64_t fy, unsigned char *out, int channels) {
+    int64_t ix = fx >> WARP_BITS, iy = fy >> WARP_BITS;
+    int32_t wx = (int32_t)((fx >> (WARP_BITS - 8)) & 0xFF), wy = (int32_t)((fy >> (WARP_BITS - 8)) & 0xFF);
+    const unsigned char *top = job->src[iy] + ix * channels, *bottom = job->src[iy + 1] + ix * channels;
+    for (int c = 0; c < channels; ++c) {
+        int32_t upper = top[c] * (256 - wx) + top[c + channels] * wx;
+        int32_t lower = bottom[c] * (256 - wx) + bottom[c + channels] * wx;
+        out[c] = (unsigned char)((upper * (256 - wy) + lower * wy + 32768) >> 16);
+    }
+}
+
+// Samples the source at (fx, fy) (fixed point) into out. Taps outside the source count as the fill value.
+static inline void warp_sample(const t_warp_job *job, int64_t fx, int64_t fy, unsigned char *out, int channels) {
+    if (fx <= -WARP_ONE || fy <= -WARP_ONE || fx >= job->srcWidth * WARP_ONE || fy >= job->srcHeight * WARP_ONE) {
+        memcpy(out, job->fill, (size_t)channels);
+        return;
+    }
+    // Shifted by one pixel so that the shifts work on non-negative values.
+    int64_t ix = ((fx + WARP_ONE) >> WARP_BITS) - 1, iy = ((fy + WARP_ONE) >> WARP_BITS) - 1;
+    int32_t wx = (int32_t)(((fx + WARP_ONE) >> (WARP_BITS - 8)) & 0xFF);
+    int32_t wy = (int32_t)(((fy + WARP_ONE) >> (WARP_BITS - 8)) & 0xFF);
+    if (ix >= 0 && iy >= 0 && ix + 1 < job->srcWidth && iy + 1 < job->srcHeight) {
+        warp_blend(job, fx, fy, out, channels);
+        return;
+    }
+    const unsigned char *taps[2][2];
+    for (int j = 0; j < 2; ++j) {
+        for (int i = 0; i < 2; ++i) {
+            int64_t x = ix + i, y = iy + j;
+            int inside = x >= 0 && y >= 0 && x < job->srcWidth && y < job->srcHeight;
+            taps[j][i] = inside ? job->src[y] + x * channels : job->fill;
+        }
+    }
+    for (int c = 0; c < channels; ++c) {
+        int32_t upper = taps[0][0][c] * (256 - wx) + taps[0][1][c] * wx;
+        int32_t lower = taps[1][0][c] * (256 - wx) + taps[1][1][c] * wx;
+        out[c] = (unsigned char)((upper * (256 - wy) + lower * wy + 32768) >> 16);
+    }
+}
+
+// Returns 1 when the n stepped positions starting at (fx, fy) all have their four taps inside the source. The steps
+// change by a constant, so a coordinate is monotonic whenever its first and last step share a sign; it is then
+// enough to check the first and last positions.
+static int warp_inside(const t_warp_job *job, int64_t fx, int64_t fy, int64_t dx, int64_t dy, int64_t ddx,
+                       int64_t ddy, int64_t n) {
+    int64_t lastDx = dx + (n - 1) * ddx, lastDy = dy + (n - 1) * ddy;
+    if ((dx < 0 && lastDx > 0) || (dx > 0 && lastDx < 0) || (dy < 0 && lastDy > 0) || (dy > 0 && lastDy < 0)) {
+        return 0;
+    }
+    int64_t lastX = fx + (n - 1) * dx + (n - 1) * (n - 2) / 2 * ddx;
+    int64_t lastY = fy + (n - 1) * dy + (n - 1) * (n - 2) / 2 * ddy;
+    int64_t limitX = (job->srcWidth - 1) << WARP_STEP_BITS, limitY = (job->srcHeight - 1) << WARP_STEP_BITS;
+    return fx >= 0 && fy >= 0 && lastX >= 0 && lastY >= 0 && fx < limitX && fy < limitY && lastX < limitX &&
+           lastY < limitY;
+}
+
+// Exact source coordinates of output pixel (x, y); returns 0 for a perspective point behind the camera.
+static int warp_map(const t_warp_job *job, double x, double y, double *sx, double *sy) {
+    const double *m = job->m;
+    *sx = m[0] * x + m[1] * y + m[2];
+    *sy = m[3] * x + m[4] * y + m[5];
+    if (!job->perspective) return 1;
+    double depth = m[6] * x + m[7] * y + m[8];
+    if (depth < WARP_MIN_DEPTH) return 0;
+    *sx /= depth;
+    *sy /= depth;
+    return 1;
+}
+
+// Warps the output pixels [x0, x1) of row y, span by span.
+static void warp_row(const t_warp_job *job, size_t y, size_t x0, size_t x1) {
+    unsigned char *row = job->dst[y];
+    int channels = job->channels;
+    for (size_t x = x0; x < x1;) {
+        size_t end = (x / WARP_SPAN + 1) * WARP_SPAN;
+        if (end > x1) end = x1;
+        double sx, sy, mx = 0.0, my = 0.0, ex = 0.0, ey = 0.0;
+        double half = (double)(end - x) / 2.0;
+        int visible = warp_map(job, (double)x, (double)y, &sx, &sy);
+        // Per-pixel step and its change from pixel to pixel (zero for an affine matrix).
+        double stepX = job->m[0], stepY = job->m[3], bendX = 0.0, bendY = 0.0;
+        if (job->perspective && visible) {
+            visible = warp_map(job, (double)x + half, (double)y, &mx, &my) &&
+                      warp_map(job, (double)end, (double)y, &ex, &ey);
+            bendX = (ex - 2.0 * mx + sx) / (2.0 * half * half);
+            bendY = (ey - 2.0 * my + sy) / (2.0 * half * half);
+            stepX = (mx - sx) / half - bendX * half + bendX;
+            stepY = (my - sy) / half - bendY * half + bendY;
+            bendX *= 2.0;
+            bendY *= 2.0;
+        }
+        if (!visible) {
+            // Part of the span is behind the camera: map every pixel on its own.
+            for (; x < end; ++x) {
+                if (warp_map(job, (double)x, (double)y, &sx, &sy)) {
+                    warp_sample(job, warp_fixed(sx, WARP_BITS), warp_fixed(sy, WARP_BITS), row + x * channels, channels);
+                } else {
+                    memcpy(row + x * channels, job->fill, (size_t)channels);
+                }
+            }
+            continue;
+        }
+        int64_t fx = warp_fixed(sx, WARP_STEP_BITS), fy = warp_fixed(sy, WARP_STEP_BITS);
+        int64_t dx = warp_fixed(stepX, WARP_STEP_BITS), dy = warp_fixed(stepY, WARP_STEP_BITS);
+        int64_t ddx = warp_fixed(bendX, WARP_STEP_BITS), ddy = warp_fixed(bendY, WARP_STEP_BITS);
+        // Arithmetic shifts: positions left of the source floor towards -1 and sample as fill.
+        int shift = WARP_STEP_BITS - WARP_BITS;
+        if (warp_inside(job, fx, fy, dx, dy, ddx, ddy, (int64_t)(end - x))) {
+            // The whole span reads inside the source: no per-pixel bounds checks.
+            if (channels == 1) {
+                for (; x < end; ++x, fx += dx, fy += dy, dx += ddx, dy += ddy) {
+                    warp_blend(job, fx >> shift, fy >> shift, row + x, 1);
+                }
+            } else {
+                for (; x < end; ++x, fx += dx, fy += dy, dx += ddx, dy += ddy) {
+                    warp_blend(job, fx >> shift, fy >> shift, row + x * 3, 3);
+                }
+            }
+        } else if (channels == 1) {
+            for (; x < end; ++x, fx += dx, fy += dy, dx += ddx, dy += ddy) {
+                warp_sample(job, fx >> shift, fy >> shift, row + x, 1);
+            }
+        } else {
+            for (; x < end; ++x, fx += dx, fy += dy, dx += ddx, dy += ddy) {
+                warp_sample(job, fx >> shift, fy >> shift, row + x * 3, 3);
+            }
+        }
+    }
+}
+
+static void warp_tiles(size_t begin, size_t end, void *userData) {
+    const t_warp_job *job = (const t_warp_job *)userData;
+    size_t tilesX = (job->dstWidth + WARP_TILE - 1) / WARP_TILE;
+    for (size_t tile = begin; tile < end; ++tile) {
+        size_t x0 = (tile % tilesX) * WARP_TILE, y0 = (tile / tilesX) * WARP_TILE;
+        size_t x1 = x0 + WARP_TILE < job->dstWidth ? x0 + WARP_TILE : job->dstWidth;
+        size_t y1 = y0 + WARP_TILE < job->dstHeight ? y0 + WARP_TILE : job->dstHeight;
+        for (size_t y = y0; y < y1; ++y) warp_row(job, y, x0, x1);
+    }
+}
+
+static void warp_run(t_warp_job *job) {
+    size_t tiles = ((job->dstWidth + WARP_TILE - 1) / WARP_TILE) * ((job->dstHeight + WARP_TILE - 1) / WARP_TILE);
+    pool_parallelFor(tiles, 1, warp_tiles, job);
+}
+
+static int warp_finite(const double *matrix, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (!isfinite(matrix[i])) return 0;
+    }
+    return 1;
+}
+
+int warp_invertAffine(const double matrix[6], double inverse[6]) {
+    double det = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+    if (det == 0.0 || !isfinite(det)) return -1;
+    double a = matrix[4] / det, b = -matrix[1] / det, d = -matrix[3] / det, e = matrix[0] / det;
+    double c = matrix[2], f = matrix[5];
+    inverse[0] = a;
+    inverse[1] = b;
+    inverse[2] = -(a * c + b * f);
+    inverse[3] = d;
+    inverse[4] = e;
+    inverse[5] = -(d * c + e * f);
+    return 0;
+}
+
+int warp_invertPerspective(const double matrix[9], double inverse[9]) {
+    const double *m = matrix;
+    double cofactor[9] = {
+        m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+        m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+        m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3],
+    };
+    double det = m[0] * cofactor[0] + m[1] * cofactor[3] + m[2] * cofactor[6];
+    if (det == 0.0 || !isfinite(det)) return -1;
+    for (int i = 0; i < 9; ++i) inverse[i] = cofactor[i] / det;
+    return 0;
+}
+
+void warp_rotationMatrix(double degrees, double centerX, double centerY, double matrix[6]) {
+    double angle = degrees * 3.14159265358979323846 / 180.0;
+    double c = cos(angle), s = sin(angle);
+    matrix[0] = c;
+    matrix[1] = -s;
+    matrix[2] = centerX - c * centerX + s * centerY;
+    matrix[3] = s;
+    matrix[4] = c;
+    matrix[5] = centerY - s * centerX - c * centerY;
+}
+
+// Warps an 8-bit image with a 6- or 9-value matrix.
+static t_bmp8 *warp_image8(const t_bmp8 *img, const double *matrix, int perspective, unsigned int width,
+                           unsigned int height, unsigned char fill) {
+    if (!img || !img->data || !matrix || width == 0 || height == 0 || !warp_finite(matrix, perspective ? 9 : 6)) {
+        instr_error("Error: Invalid arguments for warp (8-bit).\n");
+        return NULL;
+    }
+    t_instr_span span;
+    instr_begin(&span, perspective ? "bmp8_warpPerspective" : "bmp8_warpAffine");
+    t_bmp8 *out = bmp8_allocate(width, height);
+    unsigned char **src = (unsigned char **)malloc((size_t)img->height * sizeof(unsigned char *));
+    unsigned char **dst = (unsigned char **)malloc((size_t)height * sizeof(unsigned char *));
+    if (!out || !src || !dst) {
+        if (out) instr_error("Error: Failed to allocate warp rows (8-bit).\n");
+        bmp8_free(out);
+        free(src);
+        free(dst);
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    memcpy(out->colorTable, img->colorTable, sizeof(out->colorTable));
+    for (unsigned int y = 0; y < img->height; ++y) src[y] = img->data + (size_t)(img->height - 1 - y) * img->width;
+    for (unsigned int y = 0; y < height; ++y) dst[y] = out->data + (size_t)(height - 1 - y) * width;
+    t_warp_job job = { src, dst, img->width, img->height, width, height, 1, perspective, { 0 }, { fill, fill, fill } };
+    memcpy(job.m, matrix, (perspective ? 9 : 6) * sizeof(double));
+    warp_run(&job);
+    free(src);
+    free(dst);
+    instr_info("Image warped to %ux%u (8-bit).\n", width, height);
+    instr_end(&span, (uint64_t)width * height, (uint64_t)out->dataSize * 5);
+    return out;
+}
+
+static t_bmp24 *warp_image24(const t_bmp24 *img, const double *matrix, int perspective, int width, int height,
+                             t_pixel fill) {
+    if (!img || !img->data || !matrix || width <= 0 || height <= 0 || !warp_finite(matrix, perspective ? 9 : 6)) {
+        instr_error("Error: Invalid arguments for warp (24-bit).\n");
+        return NULL;
+    }
+    t_instr_span span;
+    instr_begin(&span, perspective ? "bmp24_warpPerspective" : "bmp24_warpAffine");
+    t_bmp24 *out = bmp24_allocate(width, height, 24);
+    if (!out) {
+        instr_end(&span, 0, 0);
+        return NULL;
+    }
+    t_warp_job job = { (unsigned char *const *)img->data, (unsigned char *const *)out->data, img->width, img->height,
+                       (size_t)width, (size_t)height, (int)sizeof(t_pixel), perspective, { 0 },
+                       { fill.blue, fill.green, fill.red } };
+    memcpy(job.m, matrix, (perspective ? 9 : 6) * sizeof(double));
+    warp_run(&job);
+    instr_info("Image warped to %dx%d (24-bit).\n", width, height);
+    instr_end(&span, (uint64_t)width * height, (uint64_t)width * height * sizeof(t_pixel) * 5);
+    return out;
+}
+
+t_bmp8 *bmp8_warpAffine(const t_bmp8 *img, const double matrix[6], unsigned int width, unsigned int height,
+                        unsigned char fill) {
+    return warp_image8(img, matrix, 0, width, height, fill);
+}
+
+t_bmp8 *bmp8_warpPerspective(const t_bmp8 *img, const double matrix[9], unsigned int width, unsigned int height,
+                             unsigned char fill) {
+    return warp_image8(img, matrix, 1, width, height, fill);
+}
+
+t_bmp24 *bmp24_warpAffine(const t_bmp24 *img, const double matrix[6], int width, int height, t_pixel fill) {
+    return warp_image24(img, matrix, 0, width, height, fill);
+}
+
+t_bmp24 *bmp24_warpPerspective(const t_bmp24 *img, const double matrix[9], int width, int height, t_pixel fill) {
+    return warp_image24(img, matrix, 1, width, height, fill);
+}
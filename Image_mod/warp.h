@@ -0,0 +1,33 @@
+#ifndef WARP_H
+#define WARP_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Geometric warps with bilinear sampling. A matrix maps each pixel (x, y) of the output to the point of the source
+// it samples, in display coordinates (x to the right, y down from the top row, pixel centres at whole numbers):
+//   affine (6 values):      sx = m[0] x + m[1] y + m[2],  sy = m[3] x + m[4] y + m[5]
+//   perspective (9 values): the same with both divided by m[6] x + m[7] y + m[8]
+// Output pixels whose sample falls outside the source take the fill value; pixels near the edge blend with it.
+
+// Function warp_invertAffine is needed to turn a source-to-output matrix into the output-to-source one the warps take.
+// Returns -1 if the matrix cannot be inverted.
+int warp_invertAffine(const double matrix[6], double inverse[6]);
+int warp_invertPerspective(const double matrix[9], double inverse[9]);
+
+// Function warp_rotationMatrix is needed to build the affine matrix that turns an image counter-clockwise by degrees
+// (as a scan is deskewed) about (centerX, centerY) of the source, which lands at the same place in the output.
+void warp_rotationMatrix(double degrees, double centerX, double centerY, double matrix[6]);
+
+// Function bmp8_warpAffine is needed to make a width x height warp of an 8-bit image. The source is not changed.
+// Returns a new image (free with bmp8_free), or NULL for a zero size or when memory runs out.
+t_bmp8 *bmp8_warpAffine(const t_bmp8 *img, const double matrix[6], unsigned int width, unsigned int height,
+                        unsigned char fill);
+t_bmp8 *bmp8_warpPerspective(const t_bmp8 *img, const double matrix[9], unsigned int width, unsigned int height,
+                             unsigned char fill);
+
+// Function bmp24_warpAffine is needed to make a width x height warp of a 24-bit image (free with bmp24_free).
+t_bmp24 *bmp24_warpAffine(const t_bmp24 *img, const double matrix[6], int width, int height, t_pixel fill);
+t_bmp24 *bmp24_warpPerspective(const t_bmp24 *img, const double matrix[9], int width, int height, t_pixel fill);
+
+#endif // WARP_H